@@ -50,6 +50,7 @@ struct service_settings anvil_service_settings = {
 	.service_count = 0,
 	.idle_kill = UINT_MAX,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &anvil_unix_listeners_buf,
 			      sizeof(anvil_unix_listeners[0]) } },
@@ -92,6 +92,7 @@ struct service_settings auth_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &auth_unix_listeners_buf,
 			      sizeof(auth_unix_listeners[0]) } },
@@ -137,6 +138,7 @@ struct service_settings auth_worker_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &auth_worker_unix_listeners_buf,
 			      sizeof(auth_worker_unix_listeners[0]) } },
@@ -57,6 +57,7 @@ struct service_settings dict_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &dict_unix_listeners_buf,
 			      sizeof(dict_unix_listeners[0]) } },
@@ -83,6 +84,7 @@ struct service_settings dict_async_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &dict_async_unix_listeners_buf,
 			      sizeof(dict_async_unix_listeners[0]) } },
@@ -109,6 +111,7 @@ struct service_settings dict_expire_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = ARRAY_INIT,
 	.fifo_listeners = ARRAY_INIT,
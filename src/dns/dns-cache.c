@@ -0,0 +1,132 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "hash.h"
+#include "priorityq.h"
+#include "ioloop.h"
+#include "net.h"
+#include "dns-cache.h"
+
+struct dns_cache_entry {
+	struct priorityq_item item;
+	time_t expires;
+
+	/* <command> TAB <name> */
+	char *key;
+	/* reply line without LF */
+	char *reply;
+};
+
+struct dns_cache {
+	unsigned int ttl_secs, negative_ttl_secs;
+	unsigned int max_entries;
+
+	HASH_TABLE(char *, struct dns_cache_entry *) entries;
+	struct priorityq *queue;
+};
+
+static int dns_cache_entry_cmp(const void *p1, const void *p2)
+{
+	const struct dns_cache_entry *entry1 = p1, *entry2 = p2;
+
+	if (entry1->expires < entry2->expires)
+		return -1;
+	return entry1->expires > entry2->expires ? 1 : 0;
+}
+
+struct dns_cache *
+dns_cache_init(unsigned int ttl_secs, unsigned int negative_ttl_secs,
+	       unsigned int max_entries)
+{
+	struct dns_cache *cache;
+
+	i_assert(max_entries > 0);
+
+	cache = i_new(struct dns_cache, 1);
+	cache->ttl_secs = ttl_secs;
+	cache->negative_ttl_secs = negative_ttl_secs;
+	cache->max_entries = max_entries;
+	hash_table_create(&cache->entries, default_pool, 0, str_hash, strcmp);
+	cache->queue = priorityq_init(dns_cache_entry_cmp, 16);
+	return cache;
+}
+
+static void
+dns_cache_entry_free(struct dns_cache *cache, struct dns_cache_entry *entry)
+{
+	hash_table_remove(cache->entries, entry->key);
+	i_free(entry->key);
+	i_free(entry->reply);
+	i_free(entry);
+}
+
+void dns_cache_deinit(struct dns_cache **_cache)
+{
+	struct dns_cache *cache = *_cache;
+	struct dns_cache_entry *entry;
+
+	*_cache = NULL;
+	while (priorityq_count(cache->queue) > 0) {
+		entry = (struct dns_cache_entry *)priorityq_pop(cache->queue);
+		dns_cache_entry_free(cache, entry);
+	}
+	priorityq_deinit(&cache->queue);
+	hash_table_destroy(&cache->entries);
+	i_free(cache);
+}
+
+static void dns_cache_expire(struct dns_cache *cache, unsigned int max_count)
+{
+	struct dns_cache_entry *entry;
+
+	while (priorityq_count(cache->queue) > 0) {
+		entry = (struct dns_cache_entry *)priorityq_peek(cache->queue);
+		if (entry->expires > ioloop_time &&
+		    priorityq_count(cache->queue) <= max_count)
+			break;
+		(void)priorityq_pop(cache->queue);
+		dns_cache_entry_free(cache, entry);
+	}
+}
+
+const char *dns_cache_lookup(struct dns_cache *cache, const char *key)
+{
+	struct dns_cache_entry *entry;
+
+	dns_cache_expire(cache, cache->max_entries);
+	entry = hash_table_lookup(cache->entries, key);
+	return entry == NULL ? NULL : entry->reply;
+}
+
+void dns_cache_add(struct dns_cache *cache, const char *key,
+		   const char *reply, int ret)
+{
+	struct dns_cache_entry *entry;
+	unsigned int ttl_secs;
+
+	switch (ret) {
+	case EAI_AGAIN:
+	case EAI_MEMORY:
+	case EAI_SYSTEM:
+		/* temporary failure - don't cache */
+		return;
+	}
+	ttl_secs = ret == 0 ? cache->ttl_secs : cache->negative_ttl_secs;
+	if (ttl_secs == 0)
+		return;
+
+	/* make room for the new entry, evicting the soonest-expiring ones */
+	dns_cache_expire(cache, cache->max_entries - 1);
+	entry = hash_table_lookup(cache->entries, key);
+	if (entry != NULL) {
+		priorityq_remove(cache->queue, &entry->item);
+		dns_cache_entry_free(cache, entry);
+	}
+
+	entry = i_new(struct dns_cache_entry, 1);
+	entry->expires = ioloop_time + ttl_secs;
+	entry->key = i_strdup(key);
+	entry->reply = i_strdup(reply);
+	hash_table_insert(cache->entries, entry->key, entry);
+	priorityq_add(cache->queue, &entry->item);
+}
@@ -0,0 +1,18 @@
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+/* Cache of the reply lines sent by dns-client. getaddrinfo() doesn't return
+   the records' TTLs, so the replies are cached for the configured times. */
+struct dns_cache *
+dns_cache_init(unsigned int ttl_secs, unsigned int negative_ttl_secs,
+	       unsigned int max_entries);
+void dns_cache_deinit(struct dns_cache **cache);
+
+/* Returns the cached reply for the key, or NULL if there is none. */
+const char *dns_cache_lookup(struct dns_cache *cache, const char *key);
+/* Add the reply for the key. ret is the lookup's getaddrinfo() error code,
+   or 0 on success. Temporary failures aren't cached. */
+void dns_cache_add(struct dns_cache *cache, const char *key,
+		   const char *reply, int ret);
+
+#endif
@@ -4,6 +4,7 @@
 #include "buffer.h"
 #include "settings-parser.h"
 #include "service-settings.h"
+#include "dns-client-settings.h"
 
 #include <stddef.h>
 
@@ -50,9 +51,37 @@ struct service_settings dns_client_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &dns_client_unix_listeners_buf,
 			      sizeof(dns_client_unix_listeners[0]) } },
 	.fifo_listeners = ARRAY_INIT,
 	.inet_listeners = ARRAY_INIT
 };
+
+#undef DEF
+#define DEF(type, name) \
+	SETTING_DEFINE_STRUCT_##type(#name, name, struct dns_client_settings)
+
+static const struct setting_define dns_client_setting_defines[] = {
+	DEF(TIME, dns_client_cache_ttl),
+	DEF(TIME, dns_client_cache_negative_ttl),
+
+	SETTING_DEFINE_LIST_END
+};
+
+static const struct dns_client_settings dns_client_default_settings = {
+	.dns_client_cache_ttl = 0,
+	.dns_client_cache_negative_ttl = 0
+};
+
+const struct setting_parser_info dns_client_setting_parser_info = {
+	.module_name = "dns-client",
+	.defines = dns_client_setting_defines,
+	.defaults = &dns_client_default_settings,
+
+	.type_offset = SIZE_MAX,
+	.struct_size = sizeof(struct dns_client_settings),
+
+	.parent_offset = SIZE_MAX
+};
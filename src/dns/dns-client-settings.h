@@ -0,0 +1,11 @@
+#ifndef DNS_CLIENT_SETTINGS_H
+#define DNS_CLIENT_SETTINGS_H
+
+struct dns_client_settings {
+	unsigned int dns_client_cache_ttl;
+	unsigned int dns_client_cache_negative_ttl;
+};
+
+extern const struct setting_parser_info dns_client_setting_parser_info;
+
+#endif
@@ -5,24 +5,95 @@
 #include "ostream.h"
 #include "array.h"
 #include "strfuncs.h"
+#include "ioloop.h"
 #include "connection.h"
 #include "restrict-access.h"
 #include "master-service.h"
+#include "master-service-settings.h"
+#include "dns-client-settings.h"
+#include "dns-cache.h"
 
 #include <unistd.h>
 
+#define DNS_CACHE_MAX_ENTRIES 1024
+
 static struct event_category event_category_dns = {
 	.name = "dns-worker"
 };
 
 static struct connection_list *dns_clients = NULL;
+static struct dns_cache *dns_cache = NULL;
 
-static int dns_client_input_args(struct connection *client, const char *const *args)
+static const char *
+dns_client_lookup_ip(const char *name, struct event_passthrough *e, int *ret_r)
+{
+	struct ip_addr *ips;
+	unsigned int i, ips_count;
+	int ret;
+
+	ret = net_gethostbyname(name, &ips, &ips_count);
+	if (ret == 0 && ips_count == 0) {
+		/* shouldn't happen, but fix it anyway.. */
+		ret = EAI_NONAME;
+	}
+	/* update timestamp after hostname lookup so the event duration
+	   field gets set correctly */
+	io_loop_time_refresh();
+	*ret_r = ret;
+	if (ret != 0) {
+		const char *err = net_gethosterror(ret);
+		e->add_int("error_code", ret);
+		e->add_str("error", err);
+		e_debug(e->event(), "Resolve failed: %s", err);
+		return t_strdup_printf("%d\t%s", ret, err);
+	}
+
+	ARRAY_TYPE(const_string) tmp;
+	t_array_init(&tmp, ips_count);
+	for (i = 0; i < ips_count; i++) {
+		const char *ip = net_ip2addr(&ips[i]);
+		array_push_back(&tmp, &ip);
+	}
+	array_append_zero(&tmp);
+	e_debug(e->event(), "Resolve success: %s",
+		t_strarray_join(array_front(&tmp), ", "));
+	return t_strconcat("0\t", t_strarray_join(array_front(&tmp), "\t"),
+			   NULL);
+}
+
+static const char *
+dns_client_lookup_name(const char *ip_str, struct event_passthrough *e,
+		       int *ret_r)
 {
-	struct ip_addr *ips, ip;
+	struct ip_addr ip;
 	const char *name;
+	int ret;
+
+	if (net_addr2ip(ip_str, &ip) < 0) {
+		*ret_r = EAI_FAIL;
+		e->add_int("error_code", EAI_FAIL);
+		e->add_str("error", "Not an IP");
+		e_debug(e->event(), "Resolve failed: Not an IP");
+		return "-1\tNot an IP";
+	}
+	ret = net_gethostbyaddr(&ip, &name);
+	io_loop_time_refresh();
+	*ret_r = ret;
+	if (ret != 0) {
+		const char *err = net_gethosterror(ret);
+		e->add_int("error_code", ret);
+		e->add_str("error", err);
+		e_debug(e->event(), "Resolve failed: %s", err);
+		return t_strdup_printf("%d\t%s", ret, err);
+	}
+	e_debug(e->event(), "Resolve success: %s", name);
+	return t_strconcat("0\t", name, NULL);
+}
+
+static int dns_client_input_args(struct connection *client, const char *const *args)
+{
+	const char *key, *reply;
 	struct event *event;
-	unsigned int i, ips_count;
 	int ret;
 	struct event_passthrough *e;
 
@@ -45,60 +116,25 @@ static int dns_client_input_args(struct connection *client, const char *const *a
 		set_name("dns_worker_request_finished")->
 		add_str("name", args[1]);
 
-	if (strcmp(args[0], "IP") == 0) {
-		ret = net_gethostbyname(args[1], &ips, &ips_count);
-		if (ret == 0 && ips_count == 0) {
-			/* shouldn't happen, but fix it anyway.. */
-			ret = EAI_NONAME;
-		}
-		/* update timestamp after hostname lookup so the event duration
-		   field gets set correctly */
-		io_loop_time_refresh();
-		if (ret != 0) {
-			const char *err = net_gethosterror(ret);
-			e->add_int("error_code", ret);
-			e->add_str("error", err);
-			e_debug(e->event(), "Resolve failed: %s", err);
-			o_stream_nsend_str(client->output,
-				t_strdup_printf("%d\t%s\n", ret, err));
-		} else {
-			ARRAY_TYPE(const_string) tmp;
-			t_array_init(&tmp, ips_count);
-			o_stream_nsend_str(client->output, "0\t");
-			for (i = 0; i < ips_count; i++) {
-				const char *ip = net_ip2addr(&ips[i]);
-				array_push_back(&tmp, &ip);
-			}
-			array_append_zero(&tmp);
-			e_debug(e->event(), "Resolve success: %s",
-				t_strarray_join(array_front(&tmp), ", "));
-			o_stream_nsend_str(client->output,
-					   t_strarray_join(array_front(&tmp), "\t"));
-			o_stream_nsend_str(client->output, "\n");
-		}
+	key = t_strconcat(args[0], "\t", args[1], NULL);
+	if (dns_cache != NULL &&
+	    (reply = dns_cache_lookup(dns_cache, key)) != NULL) {
+		e->add_str("cached", "yes");
+		e_debug(e->event(), "Cached reply: %s", reply);
+	} else if (strcmp(args[0], "IP") == 0) {
+		reply = dns_client_lookup_ip(args[1], e, &ret);
+		if (dns_cache != NULL)
+			dns_cache_add(dns_cache, key, reply, ret);
 	} else if (strcmp(args[0], "NAME") == 0) {
-		if (net_addr2ip(args[1], &ip) < 0) {
-			e->add_int("error_code", EAI_FAIL);
-			e->add_str("error", "Not an IP");
-			e_debug(e->event(), "Resolve failed: Not an IP");
-			o_stream_nsend_str(client->output, "-1\tNot an IP\n");
-		} else if ((ret = net_gethostbyaddr(&ip, &name)) != 0) {
-			const char *err = net_gethosterror(ret);
-			e->add_int("error_code", ret);
-			e->add_str("error", err);
-			e_debug(e->event(), "Resolve failed: %s", err);
-			o_stream_nsend_str(client->output,
-				t_strdup_printf("%d\t%s\n", ret, err));
-		} else {
-			e_debug(e->event(), "Resolve success: %s", name);
-			o_stream_nsend_str(client->output,
-				t_strdup_printf("0\t%s\n", name));
-		}
+		reply = dns_client_lookup_name(args[1], e, &ret);
+		if (dns_cache != NULL)
+			dns_cache_add(dns_cache, key, reply, ret);
 	} else {
 		e->add_str("error", "Unknown command");
 		e_error(e->event(), "Unknown command '%s'", args[0]);
-		o_stream_nsend_str(client->output, "-1\tUnknown command\n");
+		reply = "-1\tUnknown command";
 	}
+	o_stream_nsend_str(client->output, t_strconcat(reply, "\n", NULL));
 
 	event_unref(&event);
 
@@ -138,23 +174,43 @@ static void client_connected(struct master_service_connection *master_conn)
 
 int main(int argc, char *argv[])
 {
+	const struct setting_parser_info *set_roots[] = {
+		&dns_client_setting_parser_info,
+		NULL
+	};
+	const struct dns_client_settings *set;
+	const char *error;
+
 	master_service = master_service_init("dns-client", 0,
 					     &argc, &argv, "");
 	if (master_getopt(master_service) > 0)
 		return FATAL_DEFAULT;
 
+	if (master_service_settings_read_simple(master_service, set_roots,
+						&error) < 0)
+		i_fatal("Error reading configuration: %s", error);
 	master_service_init_log(master_service);
 	restrict_access_by_env(RESTRICT_ACCESS_FLAG_ALLOW_ROOT, NULL);
 	restrict_access_allow_coredumps(TRUE);
 
 	/* setup connection list */
 	dns_clients = connection_list_init(&dns_client_set, &dns_client_vfuncs);
+	set = master_service_settings_get_root_set(master_service,
+						   &dns_client_setting_parser_info);
+	if (set->dns_client_cache_ttl > 0 ||
+	    set->dns_client_cache_negative_ttl > 0) {
+		dns_cache = dns_cache_init(set->dns_client_cache_ttl,
+					   set->dns_client_cache_negative_ttl,
+					   DNS_CACHE_MAX_ENTRIES);
+	}
 
 	master_service_init_finish(master_service);
 	master_service_run(master_service, client_connected);
 
 	/* disconnect all clients */
 	connection_list_deinit(&dns_clients);
+	if (dns_cache != NULL)
+		dns_cache_deinit(&dns_cache);
 
 	master_service_deinit(&master_service);
         return 0;
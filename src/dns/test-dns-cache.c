@@ -0,0 +1,106 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "net.h"
+#include "dns-cache.h"
+#include "test-common.h"
+
+static void test_dns_cache_ttl(void)
+{
+	struct dns_cache *cache;
+
+	test_begin("dns cache ttl");
+	cache = dns_cache_init(30, 5, 100);
+	ioloop_time = 1000000;
+
+	dns_cache_add(cache, "IP\tfound", "0\t192.168.0.1", 0);
+	dns_cache_add(cache, "IP\tmissing", "-2\tUnknown host", EAI_NONAME);
+	test_assert_strcmp(dns_cache_lookup(cache, "IP\tfound"),
+			   "0\t192.168.0.1");
+	test_assert_strcmp(dns_cache_lookup(cache, "IP\tmissing"),
+			   "-2\tUnknown host");
+	test_assert(dns_cache_lookup(cache, "NAME\tfound") == NULL);
+
+	/* negative replies expire first */
+	ioloop_time += 5;
+	test_assert(dns_cache_lookup(cache, "IP\tmissing") == NULL);
+	test_assert(dns_cache_lookup(cache, "IP\tfound") != NULL);
+	ioloop_time += 25;
+	test_assert(dns_cache_lookup(cache, "IP\tfound") == NULL);
+
+	/* a new reply replaces the old one */
+	dns_cache_add(cache, "IP\tfound", "0\t192.168.0.1", 0);
+	ioloop_time += 10;
+	dns_cache_add(cache, "IP\tfound", "0\t192.168.0.2", 0);
+	ioloop_time += 25;
+	test_assert_strcmp(dns_cache_lookup(cache, "IP\tfound"),
+			   "0\t192.168.0.2");
+
+	dns_cache_deinit(&cache);
+	test_end();
+}
+
+static void test_dns_cache_not_cached(void)
+{
+	struct dns_cache *cache;
+
+	test_begin("dns cache not cached");
+	ioloop_time = 1000000;
+
+	/* temporary failures are never cached */
+	cache = dns_cache_init(30, 5, 100);
+	dns_cache_add(cache, "IP\tagain", "-3\tTemporary failure", EAI_AGAIN);
+	dns_cache_add(cache, "IP\tsystem", "-11\tSystem error", EAI_SYSTEM);
+	test_assert(dns_cache_lookup(cache, "IP\tagain") == NULL);
+	test_assert(dns_cache_lookup(cache, "IP\tsystem") == NULL);
+	dns_cache_deinit(&cache);
+
+	/* zero TTL disables caching the replies */
+	cache = dns_cache_init(30, 0, 100);
+	dns_cache_add(cache, "IP\tfound", "0\t192.168.0.1", 0);
+	dns_cache_add(cache, "IP\tmissing", "-2\tUnknown host", EAI_NONAME);
+	test_assert(dns_cache_lookup(cache, "IP\tfound") != NULL);
+	test_assert(dns_cache_lookup(cache, "IP\tmissing") == NULL);
+	dns_cache_deinit(&cache);
+
+	test_end();
+}
+
+static void test_dns_cache_max_entries(void)
+{
+	struct dns_cache *cache;
+	unsigned int i;
+
+	test_begin("dns cache max entries");
+	cache = dns_cache_init(30, 5, 10);
+	ioloop_time = 1000000;
+
+	for (i = 0; i < 20; i++) {
+		dns_cache_add(cache, t_strdup_printf("IP\thost%u", i),
+			      t_strdup_printf("0\t192.168.0.%u", i), 0);
+		ioloop_time++;
+	}
+	/* the soonest-expiring entries were evicted */
+	for (i = 0; i < 10; i++) {
+		test_assert_idx(dns_cache_lookup(cache,
+			t_strdup_printf("IP\thost%u", i)) == NULL, i);
+	}
+	for (; i < 20; i++) {
+		test_assert_idx(dns_cache_lookup(cache,
+			t_strdup_printf("IP\thost%u", i)) != NULL, i);
+	}
+	dns_cache_deinit(&cache);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_dns_cache_ttl,
+		test_dns_cache_not_cached,
+		test_dns_cache_max_entries,
+		NULL
+	};
+	return test_run(test_functions);
+}
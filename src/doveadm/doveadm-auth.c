@@ -87,39 +87,27 @@ doveadm_get_auth_master_conn(const char *auth_socket_path)
 }
 
 static int
-cmd_user_input(struct auth_master_connection *conn,
-	       const struct authtest_input *input,
-	       const char *show_field, bool userdb,
-	       struct event *event)
+cmd_user_input_print(const char *username, int ret,
+		     const char *updated_username, const char *const *fields,
+		     const char *show_field, bool userdb, struct event *event)
 {
 	const char *lookup_name = userdb ? "userdb lookup" : "passdb lookup";
-	pool_t pool;
-	const char *updated_username = NULL, *const *fields, *p;
-	int ret;
-
-	pool = pool_alloconly_create("auth master lookup", 1024);
+	const char *p;
 
-	if (userdb) {
-		ret = auth_master_user_lookup(conn, input->username, &input->info,
-					      pool, &updated_username, &fields);
-	} else {
-		ret = auth_master_pass_lookup(conn, input->username, &input->info,
-					      pool, &fields);
-	}
 	if (ret < 0) {
 		if (fields[0] == NULL)
 			e_error(event,
-				"%s failed for %s", lookup_name, input->username);
+				"%s failed for %s", lookup_name, username);
 		else {
 			e_error(event,
 				"%s failed for %s: %s", lookup_name,
-				input->username, fields[0]);
+				username, fields[0]);
 		}
 		ret = -1;
 	} else if (ret == 0) {
 		fprintf(show_field == NULL ? stdout : stderr,
 			"%s: user %s doesn't exist\n", lookup_name,
-			input->username);
+			username);
 	} else if (show_field != NULL) {
 		size_t show_field_len = strlen(show_field);
 
@@ -129,7 +117,7 @@ cmd_user_input(struct auth_master_connection *conn,
 				printf("%s\n", *fields + show_field_len + 1);
 		}
 	} else {
-		printf("%s: %s\n", userdb ? "userdb" : "passdb", input->username);
+		printf("%s: %s\n", userdb ? "userdb" : "passdb", username);
 
 		if (updated_username != NULL)
 			printf("  %-10s: %s\n", "user", updated_username);
@@ -143,6 +131,30 @@ cmd_user_input(struct auth_master_connection *conn,
 			}
 		}
 	}
+	return ret;
+}
+
+static int
+cmd_user_input(struct auth_master_connection *conn,
+	       const struct authtest_input *input,
+	       const char *show_field, bool userdb,
+	       struct event *event)
+{
+	pool_t pool;
+	const char *updated_username = NULL, *const *fields;
+	int ret;
+
+	pool = pool_alloconly_create("auth master lookup", 1024);
+
+	if (userdb) {
+		ret = auth_master_user_lookup(conn, input->username, &input->info,
+					      pool, &updated_username, &fields);
+	} else {
+		ret = auth_master_pass_lookup(conn, input->username, &input->info,
+					      pool, &fields);
+	}
+	ret = cmd_user_input_print(input->username, ret, updated_username,
+				   fields, show_field, userdb, event);
 	pool_unref(&pool);
 	return ret;
 }
@@ -698,6 +710,37 @@ cmd_user_mail_input(struct mail_storage_service_ctx *storage_service,
 	return 1;
 }
 
+static void
+cmd_user_multi(struct auth_master_connection *conn,
+	       const struct authtest_input *input,
+	       const char *const *users, const char *show_field,
+	       struct event *event)
+{
+	struct auth_master_user_lookup_result *results;
+	unsigned int i;
+	pool_t pool;
+
+	pool = pool_alloconly_create("auth master lookup", 1024);
+	auth_master_user_lookup_multi(conn, users, &input->info,
+				      pool, &results);
+	for (i = 0; users[i] != NULL; i++) {
+		if (i > 0)
+			putchar('\n');
+		switch (cmd_user_input_print(results[i].user, results[i].ret,
+					     results[i].username,
+					     results[i].fields, show_field,
+					     TRUE, event)) {
+		case -1:
+			doveadm_exit_code = EX_TEMPFAIL;
+			break;
+		case 0:
+			doveadm_exit_code = EX_NOUSER;
+			break;
+		}
+	}
+	pool_unref(&pool);
+}
+
 static void cmd_user(struct doveadm_cmd_context *cctx)
 {
 	const char *auth_socket_path;
@@ -749,6 +792,14 @@ static void cmd_user(struct doveadm_cmd_context *cctx)
 		return;
 	}
 
+	if (userdb_only && user_masks[0] != NULL && user_masks[1] != NULL) {
+		/* pipeline the lookups instead of waiting for each reply */
+		cmd_user_multi(conn, &input, user_masks, show_field,
+			       cctx->event);
+		auth_master_deinit(&conn);
+		return;
+	}
+
 	if (!userdb_only) {
 		storage_service = mail_storage_service_init(master_service, NULL,
 			MAIL_STORAGE_SERVICE_FLAG_USERDB_LOOKUP |
@@ -0,0 +1,72 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "md5.h"
+#include "hex-binary.h"
+#include "strnum.h"
+#include "mail-search.h"
+#include "doveadm-deduplicate-state.h"
+
+static bool
+doveadm_deduplicate_args_are_full(const struct mail_search_arg *arg)
+{
+	for (; arg != NULL; arg = arg->next) {
+		switch (arg->type) {
+		case SEARCH_OR:
+		case SEARCH_SUB:
+			if (!doveadm_deduplicate_args_are_full(arg->value.subargs))
+				return FALSE;
+			break;
+		case SEARCH_ALL:
+			if (arg->match_not)
+				return FALSE;
+			break;
+		case SEARCH_MAILBOX:
+		case SEARCH_MAILBOX_GUID:
+		case SEARCH_MAILBOX_GLOB:
+			break;
+		default:
+			return FALSE;
+		}
+	}
+	return TRUE;
+}
+
+bool doveadm_deduplicate_query_is_full(const struct mail_search_args *args)
+{
+	return doveadm_deduplicate_args_are_full(args->args);
+}
+
+const char *doveadm_deduplicate_query_hash(const char *const *query)
+{
+	const char *query_str = t_strarray_join(query, " ");
+	unsigned char digest[MD5_RESULTLEN];
+
+	md5_get_digest(query_str, strlen(query_str), digest);
+	return binary_to_hex(digest, sizeof(digest));
+}
+
+const char *
+doveadm_deduplicate_state_export(const struct doveadm_deduplicate_state *state)
+{
+	return t_strdup_printf("%u %u %s %s", state->uidvalidity,
+			       state->uidnext, state->mode, state->query_hash);
+}
+
+uint32_t
+doveadm_deduplicate_state_get_uidnext(const char *value,
+	const struct doveadm_deduplicate_state *cur_state)
+{
+	const char *const *args = t_strsplit_spaces(value, " ");
+	uint32_t uidvalidity, uidnext;
+
+	if (str_array_length(args) < 4 ||
+	    str_to_uint32(args[0], &uidvalidity) < 0 ||
+	    str_to_uint32(args[1], &uidnext) < 0)
+		return 0;
+	if (uidvalidity != cur_state->uidvalidity ||
+	    strcmp(args[2], cur_state->mode) != 0 ||
+	    strcmp(args[3], cur_state->query_hash) != 0)
+		return 0;
+	return uidnext;
+}
@@ -0,0 +1,36 @@
+#ifndef DOVEADM_DEDUPLICATE_STATE_H
+#define DOVEADM_DEDUPLICATE_STATE_H
+
+struct mail_search_args;
+
+/* State of the previous incremental deduplicate run of a mailbox, saved in
+   a private mailbox attribute. */
+struct doveadm_deduplicate_state {
+	uint32_t uidvalidity;
+	/* Mails with UIDs below this were handled by the previous run */
+	uint32_t uidnext;
+	/* Key type and cross-mailbox mode of the run */
+	const char *mode;
+	/* Hash of the search query */
+	const char *query_hash;
+};
+
+/* Returns TRUE if the search query only selects mailboxes, i.e. it matches
+   all the mails in each of the mailboxes it matches. Only such runs can
+   save the state, because otherwise the previous run may have skipped
+   some of the old mails. */
+bool doveadm_deduplicate_query_is_full(const struct mail_search_args *args);
+/* Returns the hash of the search query as a hex string. */
+const char *doveadm_deduplicate_query_hash(const char *const *query);
+
+/* Returns the state as a string. */
+const char *
+doveadm_deduplicate_state_export(const struct doveadm_deduplicate_state *state);
+/* Returns the uidnext of the saved state if it was written by a run with
+   the same UIDVALIDITY, mode and query as in cur_state. Otherwise none of
+   the mails can be trusted to be unique and 0 is returned. */
+uint32_t
+doveadm_deduplicate_state_get_uidnext(const char *value,
+	const struct doveadm_deduplicate_state *cur_state);
+
+#endif
@@ -2,41 +2,195 @@
 
 #include "lib.h"
 #include "hash.h"
+#include "guid.h"
 #include "mail-storage.h"
+#include "mailbox-attribute.h"
 #include "mail-search-build.h"
 #include "doveadm-mailbox-list-iter.h"
 #include "doveadm-mail-iter.h"
 #include "doveadm-mail.h"
+#include "doveadm-deduplicate-state.h"
+
+/* Private mailbox attribute remembering how far the previous incremental
+   run got: "<uidvalidity> <uidnext> <mode> <query hash>" */
+#define DEDUPLICATE_STATE_ATTR_KEY \
+	MAILBOX_ATTRIBUTE_PREFIX_DOVECOT_PVT"doveadm-deduplicate"
+
+enum deduplicate_phase {
+	/* Look up keys of all messages and expunge the new duplicates */
+	DEDUPLICATE_PHASE_ALL,
+	/* Only look up keys of the messages handled by the previous
+	   incremental run. */
+	DEDUPLICATE_PHASE_LOAD_OLD,
+	/* Only look up keys of the new messages and expunge duplicates */
+	DEDUPLICATE_PHASE_EXPUNGE_NEW,
+};
 
 struct deduplicate_cmd_context {
 	struct doveadm_mail_cmd_context ctx;
 	bool by_msgid;
+	bool cross_mailbox;
+	bool incremental;
+	const char *query_hash;
+
+	/* 128bit hashes of the seen GUIDs or Message-IDs. With cross_mailbox
+	   they are kept across all of the user's mailboxes. */
+	pool_t pool;
+	HASH_TABLE(uint8_t *, void *) hash;
 };
 
+static void cmd_deduplicate_hash_init(struct deduplicate_cmd_context *ctx)
+{
+	ctx->pool = pool_alloconly_create("deduplicate", 10240);
+	hash_table_create(&ctx->hash, ctx->pool, 0,
+			  guid_128_hash, guid_128_cmp);
+}
+
+static void cmd_deduplicate_hash_deinit(struct deduplicate_cmd_context *ctx)
+{
+	hash_table_destroy(&ctx->hash);
+	pool_unref(&ctx->pool);
+}
+
+static const char *
+cmd_deduplicate_get_mode(struct deduplicate_cmd_context *ctx)
+{
+	const char *mode = ctx->by_msgid ? "msgid" : "guid";
+
+	return ctx->cross_mailbox ? t_strconcat(mode, ",cross", NULL) : mode;
+}
+
+static void
+cmd_deduplicate_get_state(struct deduplicate_cmd_context *ctx,
+			  const struct mailbox_status *status,
+			  struct doveadm_deduplicate_state *state_r)
+{
+	i_zero(state_r);
+	state_r->uidvalidity = status->uidvalidity;
+	state_r->uidnext = status->uidnext;
+	state_r->mode = cmd_deduplicate_get_mode(ctx);
+	state_r->query_hash = ctx->query_hash;
+}
+
+static int
+cmd_deduplicate_get_old_uidnext(struct deduplicate_cmd_context *ctx,
+				struct mailbox *box,
+				const struct mailbox_status *status,
+				uint32_t *uidnext_r)
+{
+	struct doveadm_deduplicate_state state;
+	struct mail_attribute_value value;
+	int ret;
+
+	*uidnext_r = 0;
+	if (!ctx->incremental)
+		return 0;
+
+	ret = mailbox_attribute_get(box, MAIL_ATTRIBUTE_TYPE_PRIVATE,
+				    DEDUPLICATE_STATE_ATTR_KEY, &value);
+	if (ret < 0) {
+		e_error(ctx->ctx.cctx->event,
+			"Mailbox %s: Failed to lookup deduplication state: %s",
+			mailbox_get_vname(box),
+			mailbox_get_last_internal_error(box, NULL));
+		doveadm_mail_failed_mailbox(&ctx->ctx, box);
+		return -1;
+	}
+	if (ret == 0)
+		return 0;
+
+	/* A different UIDVALIDITY, mode or query means that the previously
+	   processed messages can't be trusted to be unique anymore. */
+	cmd_deduplicate_get_state(ctx, status, &state);
+	*uidnext_r = doveadm_deduplicate_state_get_uidnext(value.value,
+							   &state);
+	return 0;
+}
+
+static int
+cmd_deduplicate_update_state(struct deduplicate_cmd_context *ctx,
+			     struct doveadm_mail_iter *iter,
+			     const struct mailbox_status *status)
+{
+	struct mailbox_transaction_context *t =
+		doveadm_mail_iter_get_transaction(iter);
+	struct doveadm_deduplicate_state state;
+	struct mail_attribute_value value;
+
+	cmd_deduplicate_get_state(ctx, status, &state);
+	i_zero(&value);
+	value.value = doveadm_deduplicate_state_export(&state);
+	if (mailbox_attribute_set(t, MAIL_ATTRIBUTE_TYPE_PRIVATE,
+				  DEDUPLICATE_STATE_ATTR_KEY, &value) < 0) {
+		struct mailbox *box = doveadm_mail_iter_get_mailbox(iter);
+
+		e_error(ctx->ctx.cctx->event,
+			"Mailbox %s: Failed to update deduplication state: %s",
+			mailbox_get_vname(box),
+			mailbox_get_last_internal_error(box, NULL));
+		doveadm_mail_failed_mailbox(&ctx->ctx, box);
+		return -1;
+	}
+	return 0;
+}
+
 static int
 cmd_deduplicate_box(struct doveadm_mail_cmd_context *_ctx,
 		    const struct mailbox_info *info,
-		    struct mail_search_args *search_args)
+		    struct mail_search_args *search_args,
+		    enum deduplicate_phase phase)
 {
 	struct deduplicate_cmd_context *ctx =
 		container_of(_ctx, struct deduplicate_cmd_context, ctx);
+	static const char *const msgid_header[] = { "Message-ID", NULL };
 
 	struct doveadm_mail_iter *iter;
+	struct mailbox_status status;
 	struct mail *mail;
 	enum mail_error error;
-	pool_t pool;
-	HASH_TABLE(const char *, void *) hash;
+	guid_128_t key_hash;
+	const uint8_t *key_hash_p = key_hash;
+	uint8_t *key_p;
+	uint32_t old_uidnext;
 	const char *key, *errstr;
 
-	int ret = doveadm_mail_iter_init(_ctx, info, search_args, 0, NULL, 0,
+	/* Ask for the keys as wanted fields, so they get added to the
+	   mailbox cache and are available without opening the mails on
+	   the following runs. */
+	int ret = doveadm_mail_iter_init(_ctx, info, search_args,
+					 ctx->by_msgid ? 0 : MAIL_FETCH_GUID,
+					 ctx->by_msgid ? msgid_header : NULL,
+					 phase == DEDUPLICATE_PHASE_LOAD_OLD ?
+					 DOVEADM_MAIL_ITER_FLAG_READONLY : 0,
 					 &iter);
 	if (ret <= 0)
 		return ret;
 
+	mailbox_get_open_status(doveadm_mail_iter_get_mailbox(iter),
+				STATUS_UIDVALIDITY | STATUS_UIDNEXT, &status);
+	if (cmd_deduplicate_get_old_uidnext(ctx,
+			doveadm_mail_iter_get_mailbox(iter),
+			&status, &old_uidnext) < 0) {
+		doveadm_mail_iter_deinit_rollback(&iter);
+		return -1;
+	}
+	if (!ctx->cross_mailbox) {
+		cmd_deduplicate_hash_deinit(ctx);
+		cmd_deduplicate_hash_init(ctx);
+	}
+
 	ret = 0;
-	pool = pool_alloconly_create("deduplicate", 10240);
-	hash_table_create(&hash, pool, 0, str_hash, strcmp);
 	while (doveadm_mail_iter_next(iter, &mail)) {
+		/* Messages handled by the previous incremental run are
+		   known to be unique. They're only needed for finding
+		   duplicates among the new messages. */
+		bool old_mail = mail->uid < old_uidnext;
+
+		if (phase == DEDUPLICATE_PHASE_LOAD_OLD && !old_mail)
+			continue;
+		if (phase == DEDUPLICATE_PHASE_EXPUNGE_NEW && old_mail)
+			continue;
+
 		if (ctx->by_msgid) {
 			if (mail_get_first_header(mail, "Message-ID", &key) < 0) {
 				errstr = mail_get_last_internal_error(mail, &error);
@@ -62,26 +216,37 @@ cmd_deduplicate_box(struct doveadm_mail_cmd_context *_ctx,
 				break;
 			}
 		}
-		if (key != NULL && *key != '\0') {
-			if (hash_table_lookup(hash, key) != NULL)
+		if (key == NULL || *key == '\0')
+			continue;
+
+		/* Keep only a fixed size hash of the key in memory */
+		mail_generate_guid_128_hash(key, key_hash);
+		if (hash_table_lookup(ctx->hash, key_hash_p) != NULL) {
+			if (!old_mail)
 				mail_expunge(mail);
-			else {
-				key = p_strdup(pool, key);
-				hash_table_insert(hash, key, POINTER_CAST(1));
-			}
+		} else {
+			key_p = p_memdup(ctx->pool, key_hash, sizeof(key_hash));
+			hash_table_insert(ctx->hash, key_p, POINTER_CAST(1));
 		}
 	}
 
+	if (phase == DEDUPLICATE_PHASE_LOAD_OLD) {
+		if (doveadm_mail_iter_deinit(&iter) < 0)
+			ret = -1;
+		return ret;
+	}
+	if (ret == 0 && ctx->incremental) {
+		if (cmd_deduplicate_update_state(ctx, iter, &status) < 0)
+			ret = -1;
+	}
 	if (doveadm_mail_iter_deinit_sync(&iter) < 0)
 		ret = -1;
-
-	hash_table_destroy(&hash);
-	pool_unref(&pool);
 	return ret;
 }
 
 static int
-cmd_deduplicate_run(struct doveadm_mail_cmd_context *ctx, struct mail_user *user)
+cmd_deduplicate_run_phase(struct doveadm_mail_cmd_context *ctx,
+			  struct mail_user *user, enum deduplicate_phase phase)
 {
 	const enum mailbox_list_iter_flags iter_flags =
 		MAILBOX_LIST_ITER_NO_AUTO_BOXES |
@@ -93,7 +258,7 @@ cmd_deduplicate_run(struct doveadm_mail_cmd_context *ctx, struct mail_user *user
 	iter = doveadm_mailbox_list_iter_init(ctx, user, ctx->search_args,
 					      iter_flags);
 	while ((info = doveadm_mailbox_list_iter_next(iter)) != NULL) T_BEGIN {
-		if (cmd_deduplicate_box(ctx, info, ctx->search_args) < 0)
+		if (cmd_deduplicate_box(ctx, info, ctx->search_args, phase) < 0)
 			ret = -1;
 	} T_END;
 	if (doveadm_mailbox_list_iter_deinit(&iter) < 0)
@@ -101,6 +266,34 @@ cmd_deduplicate_run(struct doveadm_mail_cmd_context *ctx, struct mail_user *user
 	return ret;
 }
 
+static int
+cmd_deduplicate_run(struct doveadm_mail_cmd_context *_ctx,
+		    struct mail_user *user)
+{
+	struct deduplicate_cmd_context *ctx =
+		container_of(_ctx, struct deduplicate_cmd_context, ctx);
+	int ret;
+
+	cmd_deduplicate_hash_init(ctx);
+	if (ctx->incremental && ctx->cross_mailbox) {
+		/* New mails in one mailbox may be duplicates of old mails
+		   in a mailbox that is iterated later. Load the keys of all
+		   the old mails before expunging anything. */
+		ret = cmd_deduplicate_run_phase(_ctx, user,
+						DEDUPLICATE_PHASE_LOAD_OLD);
+		if (ret == 0) {
+			ret = cmd_deduplicate_run_phase(_ctx, user,
+				DEDUPLICATE_PHASE_EXPUNGE_NEW);
+		}
+	} else {
+		ret = cmd_deduplicate_run_phase(_ctx, user,
+						DEDUPLICATE_PHASE_ALL);
+	}
+
+	cmd_deduplicate_hash_deinit(ctx);
+	return ret;
+}
+
 static void cmd_deduplicate_init(struct doveadm_mail_cmd_context *_ctx)
 {
 	struct doveadm_cmd_context *cctx = _ctx->cctx;
@@ -109,10 +302,22 @@ static void cmd_deduplicate_init(struct doveadm_mail_cmd_context *_ctx)
 
 	const char *const *query;
 	ctx->by_msgid = doveadm_cmd_param_flag(cctx, "by-msgid");
+	ctx->cross_mailbox = doveadm_cmd_param_flag(cctx, "cross-mailbox");
+	ctx->incremental = doveadm_cmd_param_flag(cctx, "incremental");
 	if (!doveadm_cmd_param_array(cctx, "query", &query))
 		doveadm_mail_help_name("deduplicate");
 
 	_ctx->search_args = doveadm_mail_build_search_args(query);
+	if (ctx->incremental &&
+	    !doveadm_deduplicate_query_is_full(_ctx->search_args)) {
+		/* The mails skipped by the query would be treated as
+		   handled by the following incremental runs. */
+		e_warning(cctx->event, "Ignoring -i: "
+			  "The search query doesn't select whole mailboxes");
+		ctx->incremental = FALSE;
+	}
+	ctx->query_hash = p_strdup(_ctx->pool,
+				   doveadm_deduplicate_query_hash(query));
 }
 
 static struct doveadm_mail_cmd_context *cmd_deduplicate_alloc(void)
@@ -128,10 +333,12 @@ static struct doveadm_mail_cmd_context *cmd_deduplicate_alloc(void)
 struct doveadm_cmd_ver2 doveadm_cmd_deduplicate_ver2 = {
 	.name = "deduplicate",
 	.mail_cmd = cmd_deduplicate_alloc,
-	.usage = DOVEADM_CMD_MAIL_USAGE_PREFIX "[-m] <search query>",
+	.usage = DOVEADM_CMD_MAIL_USAGE_PREFIX "[-m] [-x] [-i] <search query>",
 DOVEADM_CMD_PARAMS_START
 DOVEADM_CMD_MAIL_COMMON
 DOVEADM_CMD_PARAM('m', "by-msgid", CMD_PARAM_BOOL, 0)
+DOVEADM_CMD_PARAM('x', "cross-mailbox", CMD_PARAM_BOOL, 0)
+DOVEADM_CMD_PARAM('i', "incremental", CMD_PARAM_BOOL, 0)
 DOVEADM_CMD_PARAM('\0', "query", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONAL)
 DOVEADM_CMD_PARAMS_END
 };
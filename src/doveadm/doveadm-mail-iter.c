@@ -176,3 +176,9 @@ struct mailbox *doveadm_mail_iter_get_mailbox(struct doveadm_mail_iter *iter)
 {
 	return iter->box;
 }
+
+struct mailbox_transaction_context *
+doveadm_mail_iter_get_transaction(struct doveadm_mail_iter *iter)
+{
+	return iter->t;
+}
@@ -27,6 +27,10 @@ int doveadm_mail_iter_deinit_keep_box(struct doveadm_mail_iter **iter,
 				      struct mailbox **box_r);
 void doveadm_mail_iter_deinit_rollback(struct doveadm_mail_iter **iter);
 struct mailbox *doveadm_mail_iter_get_mailbox(struct doveadm_mail_iter *iter);
+/* Returns the transaction used for iterating the mails. Changes done with it
+   are committed by doveadm_mail_iter_deinit*(). */
+struct mailbox_transaction_context *
+doveadm_mail_iter_get_transaction(struct doveadm_mail_iter *iter);
 
 bool doveadm_mail_iter_next(struct doveadm_mail_iter *iter,
 			    struct mail **mail_r);
@@ -10,6 +10,7 @@
 #include "doveadm-print.h"
 #include "doveadm-mail-iter.h"
 #include "doveadm-mailbox-list-iter.h"
+#include "doveadm-mailbox-cache.h"
 #include "doveadm-mail.h"
 
 struct mailbox_cache_cmd_context {
@@ -316,6 +317,110 @@ static void cmd_mailbox_cache_remove_init(struct doveadm_mail_cmd_context *_ctx)
 	ctx->ctx.search_args = doveadm_mail_build_search_args(query);
 }
 
+static const char *const pop3_cache_fields[] = {
+	"pop3.uidl", "pop3.order", NULL
+};
+
+static int cmd_mailbox_cache_pop3_box(struct mailbox_cache_cmd_context *ctx,
+				      const struct mailbox_info *info)
+{
+	struct event *event = ctx->ctx.cctx->event;
+	struct doveadm_mail_iter *iter;
+	struct mailbox *box;
+	struct mail *mail;
+	const char *str;
+	uoff_t size;
+	int ret;
+
+	/* Looking up the virtual size fills the "vsize" index extension,
+	   and the UIDL/POP3 order lookups add the backend's values to
+	   cache, so POP3 logins can later serve LIST/UIDL without opening
+	   the message files. */
+	ret = doveadm_mail_iter_init(&ctx->ctx, info, ctx->ctx.search_args,
+				     MAIL_FETCH_VIRTUAL_SIZE |
+				     MAIL_FETCH_UIDL_BACKEND |
+				     MAIL_FETCH_POP3_ORDER, NULL, 0, &iter);
+	if (ret <= 0)
+		return ret;
+
+	box = doveadm_mail_iter_get_mailbox(iter);
+	/* The backend values are only added to cache if the fields' caching
+	   decision allows it, so make sure they're cached. */
+	if (doveadm_mailbox_cache_want_fields(box, pop3_cache_fields) < 0) {
+		e_error(event, "Mailbox %s: Failed to open cache: %s",
+			mailbox_get_vname(box),
+			mailbox_get_last_internal_error(box, NULL));
+		doveadm_mail_failed_mailbox(&ctx->ctx, box);
+		(void)doveadm_mail_iter_deinit(&iter);
+		return -1;
+	}
+	while (doveadm_mail_iter_next(iter, &mail)) {
+		doveadm_print(mailbox_get_vname(box));
+		doveadm_print(dec2str(mail->uid));
+		if (mail_get_virtual_size(mail, &size) < 0 ||
+		    mail_get_special(mail, MAIL_FETCH_UIDL_BACKEND, &str) < 0 ||
+		    mail_get_special(mail, MAIL_FETCH_POP3_ORDER, &str) < 0) {
+			if (!mail->expunged) {
+				e_error(event, "Mailbox %s: "
+					"POP3 lookup for UID=%u failed: %s",
+					mailbox_get_vname(box), mail->uid,
+					mail_get_last_internal_error(mail, NULL));
+				doveadm_mail_failed_mailbox(&ctx->ctx, box);
+				ret = -1;
+			}
+			doveadm_print("");
+			continue;
+		}
+		doveadm_print(dec2str(size));
+	}
+
+	if (doveadm_mail_iter_deinit(&iter) < 0)
+		ret = -1;
+	return ret < 0 ? -1 : 0;
+}
+
+static int cmd_mailbox_cache_pop3_run(struct doveadm_mail_cmd_context *_ctx,
+				      struct mail_user *user)
+{
+	struct mailbox_cache_cmd_context *ctx =
+		container_of(_ctx, struct mailbox_cache_cmd_context, ctx);
+	const enum mailbox_list_iter_flags iter_flags =
+		MAILBOX_LIST_ITER_NO_AUTO_BOXES |
+		MAILBOX_LIST_ITER_RETURN_NO_FLAGS;
+	struct doveadm_mailbox_list_iter *iter;
+	const struct mailbox_info *info;
+	int ret = 0;
+
+	iter = doveadm_mailbox_list_iter_init(&ctx->ctx, user, ctx->ctx.search_args,
+					      iter_flags);
+	while ((info = doveadm_mailbox_list_iter_next(iter)) != NULL) T_BEGIN {
+		if (cmd_mailbox_cache_pop3_box(ctx, info) < 0)
+			ret = -1;
+	} T_END;
+	if (doveadm_mailbox_list_iter_deinit(&iter) < 0)
+		ret = -1;
+	return ret;
+}
+
+static void cmd_mailbox_cache_pop3_init(struct doveadm_mail_cmd_context *_ctx)
+{
+	struct doveadm_cmd_context *cctx = _ctx->cctx;
+	struct mailbox_cache_cmd_context *ctx =
+		container_of(_ctx, struct mailbox_cache_cmd_context, ctx);
+
+	const char *const *query;
+	if (!doveadm_cmd_param_array(cctx, "query", &query))
+		query = t_strsplit("mailbox INBOX", " ");
+
+	doveadm_print_header_simple("mailbox");
+	doveadm_print_header_simple("uid");
+	doveadm_print_header_simple("size");
+
+	/* don't let the backfill change the other cache decisions */
+	ctx->ctx.transaction_flags |= MAILBOX_TRANSACTION_FLAG_NO_CACHE_DEC;
+	ctx->ctx.search_args = doveadm_mail_build_search_args(query);
+}
+
 static int cmd_mailbox_cache_purge_run_box(struct mailbox_cache_cmd_context *ctx,
 					   struct mailbox *box)
 {
@@ -390,6 +495,16 @@ static struct doveadm_mail_cmd_context *cmd_mailbox_cache_purge_alloc(void)
 	return &ctx->ctx;
 }
 
+static struct doveadm_mail_cmd_context *cmd_mailbox_cache_pop3_alloc(void)
+{
+	struct mailbox_cache_cmd_context *ctx =
+		doveadm_mail_cmd_alloc(struct mailbox_cache_cmd_context);
+	ctx->ctx.v.init = cmd_mailbox_cache_pop3_init;
+	ctx->ctx.v.run = cmd_mailbox_cache_pop3_run;
+	doveadm_print_init(DOVEADM_PRINT_TYPE_TABLE);
+	return &ctx->ctx;
+}
+
 struct doveadm_cmd_ver2 doveadm_cmd_mailbox_cache_decision = {
 	.name = "mailbox cache decision",
 	.mail_cmd = cmd_mailbox_cache_decision_alloc,
@@ -425,3 +540,13 @@ DOVEADM_CMD_MAIL_COMMON
 DOVEADM_CMD_PARAM('\0', "mailbox", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONAL)
 DOVEADM_CMD_PARAMS_END
 };
+
+struct doveadm_cmd_ver2 doveadm_cmd_mailbox_cache_pop3 = {
+	.name = "mailbox cache pop3",
+	.mail_cmd = cmd_mailbox_cache_pop3_alloc,
+	.usage = DOVEADM_CMD_MAIL_USAGE_PREFIX"[<search string>]",
+DOVEADM_CMD_PARAMS_START
+DOVEADM_CMD_MAIL_COMMON
+DOVEADM_CMD_PARAM('\0', "query", CMD_PARAM_ARRAY, CMD_PARAM_FLAG_POSITIONAL)
+DOVEADM_CMD_PARAMS_END
+};
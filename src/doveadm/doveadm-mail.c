@@ -33,6 +33,8 @@
 #include <stdio.h>
 
 #define DOVEADM_MAIL_CMD_INPUT_TIMEOUT_MSECS (5*60*1000)
+/* Number of users whose userdb lookups are pipelined with -A / -F */
+#define DOVEADM_MAIL_USER_PREFETCH_COUNT 64
 
 struct force_resync_cmd_context {
 	struct doveadm_mail_cmd_context ctx;
@@ -516,14 +518,54 @@ int doveadm_mail_single_user(struct doveadm_mail_cmd_context *ctx,
 	return doveadm_mail_next_user(ctx, error_r);
 }
 
+static int
+doveadm_mail_next_user_batch(struct doveadm_mail_cmd_context *ctx,
+			     const char *wildcard_user, pool_t pool,
+			     ARRAY_TYPE(const_string) *users)
+{
+	const char *user;
+	int ret;
+
+	p_clear(pool);
+	array_clear(users);
+	while ((ret = ctx->v.get_next_user(ctx, &user)) > 0) {
+		if (wildcard_user != NULL) {
+			if (!wildcard_match_icase(user, wildcard_user))
+				continue;
+		}
+		user = p_strdup(pool, user);
+		array_push_back(users, &user);
+		if (array_count(users) == DOVEADM_MAIL_USER_PREFETCH_COUNT)
+			break;
+	}
+	if (array_count(users) < 2)
+		return ret;
+
+	/* Look up the batch's users from userdb at once, unless the
+	   commands are going to be run by doveadm workers. */
+	if (ctx->set->doveadm_worker_count == 0 || doveadm_server) {
+		struct mail_storage_service_input input;
+
+		doveadm_mail_ctx_to_storage_service_input(ctx, &input);
+		array_append_zero(users);
+		mail_storage_service_prefetch_userdb(ctx->storage_service,
+						     &input,
+						     array_front(users));
+		array_pop_back(users);
+	}
+	return ret;
+}
+
 static void
 doveadm_mail_all_users(struct doveadm_mail_cmd_context *ctx,
 		       const char *wildcard_user)
 {
 	struct doveadm_cmd_context *cctx = ctx->cctx;
+	ARRAY_TYPE(const_string) users;
 	unsigned int user_idx;
 	const char *ip, *user, *error;
-	int ret;
+	pool_t pool;
+	int ret, iter_ret;
 
 	ctx->service_flags |= MAIL_STORAGE_SERVICE_FLAG_USERDB_LOOKUP;
 
@@ -544,34 +586,44 @@ doveadm_mail_all_users(struct doveadm_mail_cmd_context *ctx,
 	if (hook_doveadm_mail_init != NULL)
 		hook_doveadm_mail_init(ctx);
 
+	pool = pool_alloconly_create("doveadm users", 1024);
+	i_array_init(&users, DOVEADM_MAIL_USER_PREFETCH_COUNT + 1);
 	user_idx = 0;
-	while ((ret = ctx->v.get_next_user(ctx, &user)) > 0) {
-		if (wildcard_user != NULL) {
-			if (!wildcard_match_icase(user, wildcard_user))
-				continue;
-		}
-		cctx->username = user;
-		T_BEGIN {
-			ret = doveadm_mail_next_user(ctx, &error);
-			if (ret < 0)
-				e_error(ctx->cctx->event, "%s", error);
-			else if (ret == 0)
-				e_info(ctx->cctx->event,
-				       "User no longer exists, skipping");
-		} T_END;
-		if (ret == -1)
-			break;
-		if (doveadm_verbose) {
-			if (++user_idx % 100 == 0) {
-				printf("\r%d", user_idx);
-				fflush(stdout);
+	ret = 0;
+	do {
+		iter_ret = doveadm_mail_next_user_batch(ctx, wildcard_user,
+							pool, &users);
+		array_foreach_elem(&users, user) {
+			cctx->username = user;
+			T_BEGIN {
+				ret = doveadm_mail_next_user(ctx, &error);
+				if (ret < 0)
+					e_error(ctx->cctx->event, "%s", error);
+				else if (ret == 0)
+					e_info(ctx->cctx->event,
+					       "User no longer exists, skipping");
+			} T_END;
+			if (ret == -1)
+				break;
+			if (doveadm_verbose) {
+				if (++user_idx % 100 == 0) {
+					printf("\r%d", user_idx);
+					fflush(stdout);
+				}
+			}
+			if (doveadm_is_killed()) {
+				ret = -1;
+				break;
 			}
 		}
-		if (doveadm_is_killed()) {
-			ret = -1;
-			break;
-		}
-	}
+	} while (ret != -1 && iter_ret > 0);
+	if (ret != -1)
+		ret = iter_ret;
+	/* don't leave the username pointing to the freed pool */
+	cctx->username = p_strdup(cctx->pool, cctx->username);
+	array_free(&users);
+	pool_unref(&pool);
+
 	if (doveadm_verbose)
 		printf("\n");
 	ip = net_ip2addr(&cctx->remote_ip);
@@ -795,6 +847,7 @@ static struct doveadm_cmd_ver2 *mail_commands_ver2[] = {
 	&doveadm_cmd_mailbox_cache_decision,
 	&doveadm_cmd_mailbox_cache_remove,
 	&doveadm_cmd_mailbox_cache_purge,
+	&doveadm_cmd_mailbox_cache_pop3,
 	&doveadm_cmd_rebuild_attachments,
 };
 
@@ -0,0 +1,37 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "mail-cache-private.h"
+#include "mail-storage-private.h"
+#include "doveadm-mailbox-cache.h"
+
+int doveadm_mailbox_cache_want_fields(struct mailbox *box,
+				      const char *const *fields)
+{
+	struct mail_cache *cache = box->cache;
+	struct mail_cache_field_private *field;
+	unsigned int idx;
+
+	/* read the current decisions from the cache file, if it exists */
+	if (mail_cache_open_and_verify(cache) < 0) {
+		mailbox_set_index_error(box);
+		return -1;
+	}
+
+	for (; *fields != NULL; fields++) {
+		idx = mail_cache_register_lookup(cache, *fields);
+		if (idx == UINT_MAX)
+			continue;
+		field = &cache->fields[idx];
+		if ((field->field.decision & MAIL_CACHE_DECISION_FORCED) != 0 ||
+		    field->field.decision == MAIL_CACHE_DECISION_YES)
+			continue;
+		field->field.decision = MAIL_CACHE_DECISION_YES;
+		/* purging drops fields that haven't been used recently */
+		field->field.last_used = ioloop_time32;
+		field->decision_dirty = TRUE;
+		cache->field_header_write_pending = TRUE;
+	}
+	return 0;
+}
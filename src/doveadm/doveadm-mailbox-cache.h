@@ -0,0 +1,12 @@
+#ifndef DOVEADM_MAILBOX_CACHE_H
+#define DOVEADM_MAILBOX_CACHE_H
+
+/* Change the caching decisions of the named fields to YES, unless they are
+   forced. Transactions with MAILBOX_TRANSACTION_FLAG_NO_CACHE_DEC don't
+   change the decisions themselves, so a field with a NO decision would
+   otherwise not be kept in the cache. Returns 0 on success, -1 if the cache
+   couldn't be opened. */
+int doveadm_mailbox_cache_want_fields(struct mailbox *box,
+				      const char *const *fields);
+
+#endif
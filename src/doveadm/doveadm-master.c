@@ -197,6 +197,9 @@ static void cmd_service_status(struct doveadm_cmd_context *cctx)
 	doveadm_print_header_simple("listening");
 	doveadm_print_header_simple("doveadm_stop");
 	doveadm_print_header_simple("process_total");
+	doveadm_print_header_simple("process_min_avail");
+	doveadm_print_header_simple("connect_rate");
+	doveadm_print_header_simple("process_startup_msecs");
 	fields_count = doveadm_print_get_headers_count();
 
 	alarm(5);
@@ -12,6 +12,8 @@
 
 struct doveadm_print_formatted_context {
 	pool_t pool;
+	/* streamed values of the current row, cleared after it's printed */
+	pool_t value_pool;
 	const char *format;
 	ARRAY(struct var_expand_table) headers;
 	string_t *buf;
@@ -30,7 +32,9 @@ static void doveadm_print_formatted_init(void)
 {
 	i_zero(&ctx);
 	ctx.pool = pool_alloconly_create("doveadm formatted print", 1024);
+	ctx.value_pool = pool_alloconly_create("doveadm formatted values", 1024);
 	ctx.buf = str_new(ctx.pool, 256);
+	ctx.vbuf = str_new(default_pool, 256);
 	p_array_init(&ctx.headers, ctx.pool, 8);
 	ctx.idx = 0;
 }
@@ -68,13 +72,30 @@ static void doveadm_print_formatted_print(const char *value)
 				ctx.format, error);
 		}
 		doveadm_print_formatted_flush();
+		p_clear(ctx.value_pool);
 		ctx.idx = 0;
 	}
 
 }
 
+static void
+doveadm_print_formatted_print_stream(const unsigned char *value, size_t size)
+{
+	/* The format may reference the value anywhere, so it has to be
+	   buffered until the whole row is known. */
+	if (size > 0) {
+		str_append_data(ctx.vbuf, value, size);
+		return;
+	}
+	const char *str = p_strdup(ctx.value_pool, str_c(ctx.vbuf));
+	str_truncate(ctx.vbuf, 0);
+	doveadm_print_formatted_print(str);
+}
+
 static void doveadm_print_formatted_deinit(void)
 {
+	str_free(&ctx.vbuf);
+	pool_unref(&ctx.value_pool);
 	pool_unref(&ctx.pool);
 }
 
@@ -85,7 +106,7 @@ struct doveadm_print_vfuncs doveadm_print_formatted_vfuncs = {
 	doveadm_print_formatted_deinit,
 	doveadm_print_formatted_header,
 	doveadm_print_formatted_print,
-	NULL,
+	doveadm_print_formatted_print_stream,
 	doveadm_print_formatted_flush
 };
 
@@ -21,6 +21,11 @@ struct doveadm_print_vfuncs {
 	void (*flush)(void);
 };
 
+/* If too much data is buffered in doveadm_print_ostream, wait until it has
+   been sent. This keeps the memory usage bounded when printing large
+   values to a slow reader. */
+void doveadm_print_output_wait(void);
+
 extern struct doveadm_print_vfuncs doveadm_print_flow_vfuncs;
 extern struct doveadm_print_vfuncs doveadm_print_tab_vfuncs;
 extern struct doveadm_print_vfuncs doveadm_print_table_vfuncs;
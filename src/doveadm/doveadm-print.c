@@ -2,10 +2,13 @@
 
 #include "lib.h"
 #include "array.h"
+#include "ioloop.h"
 #include "istream.h"
 #include "ostream.h"
 #include "doveadm-print-private.h"
 
+#define DOVEADM_PRINT_FLUSH_TIMEOUT_SECS 60
+
 struct doveadm_print_header_context {
 	const char *key;
 	char *sticky_value;
@@ -100,6 +103,51 @@ void doveadm_print_num(uintmax_t value)
 	} T_END;
 }
 
+static int doveadm_print_output_flush_callback(void *context ATTR_UNUSED)
+{
+	int ret;
+
+	/* Keep flushing until everything is sent */
+	if ((ret = o_stream_flush(doveadm_print_ostream)) != 0)
+		io_loop_stop(current_ioloop);
+	return ret;
+}
+
+static void doveadm_print_output_flush_timeout(void *context ATTR_UNUSED)
+{
+	io_loop_stop(current_ioloop);
+	o_stream_close(doveadm_print_ostream);
+	i_error("write(%s) failed: Timed out after %u seconds",
+		o_stream_get_name(doveadm_print_ostream),
+		DOVEADM_PRINT_FLUSH_TIMEOUT_SECS);
+}
+
+void doveadm_print_output_wait(void)
+{
+	if (o_stream_get_buffer_used_size(doveadm_print_ostream) < IO_BLOCK_SIZE ||
+	    doveadm_print_ostream->stream_errno != 0)
+		return;
+	/* Blocking outputs get flushed immediately */
+	if (o_stream_flush(doveadm_print_ostream) != 0)
+		return;
+
+	/* Wait until buffer is flushed to avoid it growing too large */
+	struct ioloop *prev_loop = current_ioloop;
+	struct ioloop *loop = io_loop_create();
+	/* Ensure we don't get stuck here forever */
+	struct timeout *to =
+		timeout_add(DOVEADM_PRINT_FLUSH_TIMEOUT_SECS*1000,
+			    doveadm_print_output_flush_timeout, NULL);
+	o_stream_switch_ioloop_to(doveadm_print_ostream, loop);
+	o_stream_set_flush_callback(doveadm_print_ostream,
+				    doveadm_print_output_flush_callback, NULL);
+	io_loop_run(loop);
+	timeout_remove(&to);
+	o_stream_unset_flush_callback(doveadm_print_ostream);
+	o_stream_switch_ioloop_to(doveadm_print_ostream, prev_loop);
+	io_loop_destroy(&loop);
+}
+
 void doveadm_print_stream(const void *value, size_t size)
 {
 	if (!ctx->print_stream_open) {
@@ -111,6 +159,9 @@ void doveadm_print_stream(const void *value, size_t size)
 		ctx->header_idx++;
 		ctx->print_stream_open = FALSE;
 	}
+	/* Streamed values can be large. Don't read the input any faster
+	   than the output can be written. */
+	doveadm_print_output_wait();
 }
 
 int doveadm_print_istream(struct istream *input)
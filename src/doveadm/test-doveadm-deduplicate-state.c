@@ -0,0 +1,115 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "mail-search.h"
+#include "doveadm-deduplicate-state.h"
+#include "test-common.h"
+
+static void test_deduplicate_query_is_full(void)
+{
+	struct mail_search_arg mailbox_arg, all_arg, seen_arg, sub_arg;
+	struct mail_search_args args;
+
+	test_begin("deduplicate query is full");
+	i_zero(&args);
+	i_zero(&mailbox_arg);
+	i_zero(&all_arg);
+	i_zero(&seen_arg);
+	i_zero(&sub_arg);
+	mailbox_arg.type = SEARCH_MAILBOX;
+	mailbox_arg.value.str = "INBOX";
+	all_arg.type = SEARCH_ALL;
+	seen_arg.type = SEARCH_FLAGS;
+	seen_arg.value.flags = MAIL_SEEN;
+
+	/* mailbox INBOX */
+	args.args = &mailbox_arg;
+	test_assert(doveadm_deduplicate_query_is_full(&args));
+	/* mailbox INBOX all */
+	mailbox_arg.next = &all_arg;
+	test_assert(doveadm_deduplicate_query_is_full(&args));
+	/* mailbox INBOX not all */
+	all_arg.match_not = TRUE;
+	test_assert(!doveadm_deduplicate_query_is_full(&args));
+	/* mailbox INBOX seen */
+	mailbox_arg.next = &seen_arg;
+	test_assert(!doveadm_deduplicate_query_is_full(&args));
+	/* mailbox INBOX (seen) */
+	sub_arg.type = SEARCH_SUB;
+	sub_arg.value.subargs = &seen_arg;
+	mailbox_arg.next = &sub_arg;
+	test_assert(!doveadm_deduplicate_query_is_full(&args));
+	/* mailbox INBOX (all) */
+	all_arg.match_not = FALSE;
+	sub_arg.value.subargs = &all_arg;
+	test_assert(doveadm_deduplicate_query_is_full(&args));
+	test_end();
+}
+
+static void test_deduplicate_query_hash(void)
+{
+	const char *const query1[] = { "mailbox", "INBOX", NULL };
+	const char *const query2[] = { "mailbox", "Trash", NULL };
+	const char *hash;
+
+	test_begin("deduplicate query hash");
+	hash = doveadm_deduplicate_query_hash(query1);
+	test_assert(strlen(hash) == 32);
+	test_assert_strcmp(doveadm_deduplicate_query_hash(query1), hash);
+	test_assert(strcmp(doveadm_deduplicate_query_hash(query2), hash) != 0);
+	test_end();
+}
+
+static void test_deduplicate_state(void)
+{
+	struct doveadm_deduplicate_state state = {
+		.uidvalidity = 1234,
+		.uidnext = 100,
+		.mode = "guid",
+		.query_hash = "0123456789abcdef0123456789abcdef",
+	};
+	struct doveadm_deduplicate_state cur_state = state;
+	const char *value;
+
+	test_begin("deduplicate state");
+	value = doveadm_deduplicate_state_export(&state);
+	test_assert_strcmp(value,
+			   "1234 100 guid 0123456789abcdef0123456789abcdef");
+
+	cur_state.uidnext = 200;
+	test_assert(doveadm_deduplicate_state_get_uidnext(value,
+							  &cur_state) == 100);
+
+	/* anything else changed invalidates the state */
+	cur_state.uidvalidity = 1235;
+	test_assert(doveadm_deduplicate_state_get_uidnext(value,
+							  &cur_state) == 0);
+	cur_state.uidvalidity = state.uidvalidity;
+	cur_state.mode = "msgid";
+	test_assert(doveadm_deduplicate_state_get_uidnext(value,
+							  &cur_state) == 0);
+	cur_state.mode = state.mode;
+	cur_state.query_hash = "fedcba9876543210fedcba9876543210";
+	test_assert(doveadm_deduplicate_state_get_uidnext(value,
+							  &cur_state) == 0);
+	cur_state.query_hash = state.query_hash;
+
+	/* states written before the query hash was added */
+	test_assert(doveadm_deduplicate_state_get_uidnext("1234 100 guid",
+							  &cur_state) == 0);
+	test_assert(doveadm_deduplicate_state_get_uidnext("", &cur_state) == 0);
+	test_assert(doveadm_deduplicate_state_get_uidnext(
+		"x 100 guid 0123456789abcdef0123456789abcdef", &cur_state) == 0);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_deduplicate_query_is_full,
+		test_deduplicate_query_hash,
+		test_deduplicate_state,
+		NULL
+	};
+	return test_run(test_functions);
+}
@@ -0,0 +1,178 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "istream.h"
+#include "master-service.h"
+#include "mail-cache-private.h"
+#include "test-common.h"
+#include "test-mail-storage-common.h"
+#include "doveadm-mailbox-cache.h"
+
+static void test_mail_save(struct mailbox *box)
+{
+	const char *mail_input = "Subject: test\n\nbody\n";
+	struct mailbox_transaction_context *t;
+	struct mail_save_context *save_ctx;
+	struct istream *input;
+	int ret;
+
+	input = i_stream_create_from_data(mail_input, strlen(mail_input));
+	t = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL,
+				      __func__);
+	save_ctx = mailbox_save_alloc(t);
+	ret = mailbox_save_begin(&save_ctx, input);
+	while (ret == 0 && i_stream_read(input) > 0)
+		ret = mailbox_save_continue(save_ctx);
+	if (ret == 0)
+		ret = mailbox_save_finish(&save_ctx);
+	else
+		mailbox_save_cancel(&save_ctx);
+	i_stream_unref(&input);
+	if (ret < 0)
+		mailbox_transaction_rollback(&t);
+	else
+		ret = mailbox_transaction_commit(&t);
+	if (ret < 0) {
+		i_fatal("Failed to save mail: %s",
+			mailbox_get_last_internal_error(box, NULL));
+	}
+	if (mailbox_sync(box, 0) < 0) {
+		i_fatal("Failed to sync mailbox: %s",
+			mailbox_get_last_internal_error(box, NULL));
+	}
+}
+
+/* Look up the mail's received date without changing the caching decisions,
+   purge the cache and return whether the date is still cached. */
+static bool test_mail_date_lookup_is_cached(struct mailbox *box)
+{
+	struct mailbox_transaction_context *t;
+	struct mail *mail;
+	time_t date;
+	unsigned int idx;
+	int ret;
+
+	t = mailbox_transaction_begin(box,
+				      MAILBOX_TRANSACTION_FLAG_NO_CACHE_DEC,
+				      __func__);
+	mail = mail_alloc(t, MAIL_FETCH_RECEIVED_DATE, NULL);
+	mail_set_seq(mail, 1);
+	test_assert(mail_get_received_date(mail, &date) == 0);
+	mail_free(&mail);
+	test_assert(mailbox_transaction_commit(&t) == 0);
+
+	test_assert(mail_cache_purge(box->cache, (uint32_t)-1, "test") == 0);
+	test_assert(mailbox_sync(box, 0) == 0);
+
+	idx = mail_cache_register_lookup(box->cache, "date.received");
+	test_assert(idx != UINT_MAX);
+	t = mailbox_transaction_begin(box, 0, __func__);
+	ret = mail_cache_field_exists(t->cache_view, 1, idx);
+	mailbox_transaction_rollback(&t);
+	return ret > 0;
+}
+
+static enum mail_cache_decision_type
+test_mail_cache_get_decision(struct mailbox *box, const char *name)
+{
+	unsigned int idx = mail_cache_register_lookup(box->cache, name);
+
+	test_assert(idx != UINT_MAX);
+	return box->cache->fields[idx].field.decision;
+}
+
+static void test_doveadm_mailbox_cache_want_fields(void)
+{
+	const char *const fields[] = { "date.received", "flags", "no-such-field", NULL };
+	struct test_mail_storage_ctx *ctx;
+	struct mailbox *box;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+	};
+
+	test_begin("doveadm mailbox cache want fields");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	box = mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_mail_save(box);
+	test_assert(test_mail_cache_get_decision(box, "date.received") ==
+		    MAIL_CACHE_DECISION_NO);
+
+	/* the field isn't kept with a NO decision */
+	test_assert(!test_mail_date_lookup_is_cached(box));
+
+	test_assert(doveadm_mailbox_cache_want_fields(box, fields) == 0);
+	test_assert(test_mail_cache_get_decision(box, "date.received") ==
+		    MAIL_CACHE_DECISION_YES);
+	test_assert(test_mail_date_lookup_is_cached(box));
+	mailbox_free(&box);
+
+	/* the decision was saved to the cache file */
+	box = mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_assert(mail_cache_open_and_verify(box->cache) == 1);
+	test_assert(test_mail_cache_get_decision(box, "date.received") ==
+		    MAIL_CACHE_DECISION_YES);
+	mailbox_free(&box);
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_doveadm_mailbox_cache_want_fields_forced(void)
+{
+	const char *const fields[] = { "date.received", NULL };
+	const char *const extra_input[] = {
+		"mail_never_cache_fields=date.received",
+		NULL
+	};
+	struct test_mail_storage_ctx *ctx;
+	struct mailbox *box;
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = extra_input,
+	};
+
+	test_begin("doveadm mailbox cache want fields forced");
+	ctx = test_mail_storage_init();
+	test_mail_storage_init_user(ctx, &set);
+
+	box = mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	test_mail_save(box);
+
+	/* forced decisions aren't changed */
+	test_assert(doveadm_mailbox_cache_want_fields(box, fields) == 0);
+	test_assert(test_mail_cache_get_decision(box, "date.received") ==
+		    (MAIL_CACHE_DECISION_NO | MAIL_CACHE_DECISION_FORCED));
+	test_assert(!test_mail_date_lookup_is_cached(box));
+	mailbox_free(&box);
+
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+int main(int argc, char **argv)
+{
+	void (*const tests[])(void) = {
+		test_doveadm_mailbox_cache_want_fields,
+		test_doveadm_mailbox_cache_want_fields_forced,
+		NULL
+	};
+	int ret;
+
+	master_service = master_service_init("test-doveadm-mailbox-cache",
+					     MASTER_SERVICE_FLAG_STANDALONE |
+					     MASTER_SERVICE_FLAG_DONT_SEND_STATS |
+					     MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS |
+					     MASTER_SERVICE_FLAG_NO_SSL_INIT |
+					     MASTER_SERVICE_FLAG_NO_INIT_DATASTACK_FRAME,
+					     &argc, &argv, "");
+	ret = test_run(tests);
+	master_service_deinit(&master_service);
+	return ret;
+}
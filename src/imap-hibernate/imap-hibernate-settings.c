@@ -52,6 +52,7 @@ struct service_settings imap_hibernate_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &imap_hibernate_unix_listeners_buf,
 			      sizeof(imap_hibernate_unix_listeners[0]) } },
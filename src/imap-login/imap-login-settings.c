@@ -67,6 +67,7 @@ struct service_settings imap_login_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &imap_login_unix_listeners_buf,
 			      sizeof(imap_login_unix_listeners[0]) } },
@@ -48,6 +48,7 @@ struct service_settings imap_urlauth_worker_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &imap_urlauth_worker_unix_listeners_buf,
 			      sizeof(imap_urlauth_worker_unix_listeners[0]) } },
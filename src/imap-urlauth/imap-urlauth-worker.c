@@ -8,6 +8,7 @@
 #include "istream.h"
 #include "istream-unix.h"
 #include "ostream.h"
+#include "ostream-unix.h"
 #include "str.h"
 #include "str-sanitize.h"
 #include "strescape.h"
@@ -33,6 +34,7 @@
 
 #include <unistd.h>
 #include <sysexits.h>
+#include <sys/stat.h>
 
 /* max. length of input lines (URLs) */
 #define MAX_INBUF_SIZE 2048
@@ -68,6 +70,8 @@ struct client {
 	const struct mail_storage_settings *mail_set;
 
 	bool finished:1;
+	/* message file descriptor was passed instead of sending the data */
+	bool msg_part_fd_passed:1;
 	bool waiting_input:1;
 	bool access_received:1;
 	bool access_anonymous:1;
@@ -246,36 +250,42 @@ static void client_destroy(struct client *client)
 
 static int client_run_url(struct client *client)
 {
-	const unsigned char *data;
-	size_t size;
-	ssize_t ret = 0;
-
-	while (i_stream_read_more(client->msg_part_input, &data, &size) > 0) {
-		if (client->conn.output == NULL ||
-		    (ret = o_stream_send(client->conn.output, data, size)) < 0)
-			break;
-		i_stream_skip(client->msg_part_input, ret);
+	struct ostream *output = client->conn.output;
+	struct istream *input = client->msg_part_input;
+	int ret;
 
-		if (o_stream_get_buffer_used_size(client->conn.output) >= 4096) {
-			if ((ret = o_stream_flush(client->conn.output)) < 0)
-				break;
-			if (ret == 0)
-				return 0;
-		}
+	if (output == NULL || output->closed) {
+		imap_msgpart_url_free(&client->url);
+		return -1;
 	}
 
-	if (client->conn.output == NULL || client->conn. output->closed ||
-	    ret < 0) {
+	if (client->msg_part_fd_passed) {
+		/* the fd is sent along with the response line, so keep the
+		   message open until the line is fully written */
+		if ((ret = o_stream_flush(output)) == 0)
+			return 0;
+		client->msg_part_fd_passed = FALSE;
 		imap_msgpart_url_free(&client->url);
-		return -1;
+		return ret < 0 ? -1 : 1;
 	}
 
-	if (client->msg_part_input->eof) {
-		o_stream_nsend(client->conn.output, "\n", 1);
+	switch (o_stream_send_istream(output, input)) {
+	case OSTREAM_SEND_ISTREAM_RESULT_FINISHED:
+		o_stream_nsend(output, "\n", 1);
 		imap_msgpart_url_free(&client->url);
 		return 1;
+	case OSTREAM_SEND_ISTREAM_RESULT_WAIT_INPUT:
+	case OSTREAM_SEND_ISTREAM_RESULT_WAIT_OUTPUT:
+		return 0;
+	case OSTREAM_SEND_ISTREAM_RESULT_ERROR_INPUT:
+		e_error(client->event, "read(%s) failed: %s",
+			i_stream_get_name(input), i_stream_get_error(input));
+		break;
+	case OSTREAM_SEND_ISTREAM_RESULT_ERROR_OUTPUT:
+		break;
 	}
-	return 0;
+	imap_msgpart_url_free(&client->url);
+	return -1;
 }
 
 static void ATTR_FORMAT(2, 3)
@@ -362,13 +372,40 @@ client_fetch_urlpart(struct client *client, const char *url,
 	return 1;
 }
 
+static int client_get_msg_part_fd(struct client *client)
+{
+	struct istream *input = client->msg_part_input;
+	struct stat st;
+	int fd;
+
+	if (!client->conn.unix_socket || !input->readable_fd)
+		return -1;
+	if ((fd = i_stream_get_fd(input)) == -1)
+		return -1;
+
+	/* Pass the file only if its contents are exactly the fetched data.
+	   The receiver can read the whole file, which must not give access
+	   to anything beyond what the URL grants. */
+	if (i_stream_get_absolute_offset(input) != 0)
+		return -1;
+	if (fstat(fd, &st) < 0) {
+		e_error(client->event, "fstat(%s) failed: %m",
+			i_stream_get_name(input));
+		return -1;
+	}
+	if (!S_ISREG(st.st_mode) || (uoff_t)st.st_size != client->msg_part_size)
+		return -1;
+	return fd;
+}
+
 static int client_fetch_url(struct client *client, const char *url,
-			    enum imap_urlauth_fetch_flags url_flags)
+			    enum imap_urlauth_fetch_flags url_flags,
+			    bool pass_fd)
 {
 	string_t *response;
 	const char *bpstruct, *errormsg;
 	bool binary_with_nuls;
-	int ret;
+	int fd, ret;
 
 	i_assert(client->url == NULL);
 
@@ -421,6 +458,24 @@ static int client_fetch_url(struct client *client, const char *url,
 		imap_msgpart_url_free(&client->url);
 		client->url = NULL;
 		e_debug(client->event, "Fetched URLAUTH yielded empty result");
+	} else if (pass_fd && (fd = client_get_msg_part_fd(client)) != -1) {
+		/* file descriptor passed instead of the content */
+		str_printfa(response, "\tfd\t%"PRIuUOFF_T,
+			    client->msg_part_size);
+		if (!o_stream_unix_write_fd(client->conn.output, fd))
+			i_unreached();
+		client_send_line(client, "%s", str_c(response));
+		client->msg_part_fd_passed = TRUE;
+
+		e_debug(client->event,
+			"Fetched URLAUTH yielded %"PRIuUOFF_T" bytes "
+			"of %smessage data (passing fd)", client->msg_part_size,
+			binary_with_nuls ? "binary " : "");
+		if (client_run_url(client) < 0) {
+			client_abort(client,
+				"Session aborted: Fatal failure while transferring URL");
+			return 0;
+		}
 	} else {
 
 		/* actual content */
@@ -455,10 +510,11 @@ client_handle_command(struct client *client, const char *cmd,
 
 	*error_r = NULL;
 
-	/* "URL"["\tbody"]["\tbinary"]["\tbpstruct"]"\t"<url>:
+	/* "URL""\t"<url>["\tbody"]["\tbinary"]["\tbpstruct"]["\tfd"]:
 	   fetch URL (meta)data */
 	if (strcmp(cmd, "URL") == 0) {
 		enum imap_urlauth_fetch_flags url_flags = 0;
+		bool pass_fd = FALSE;
 		const char *url;
 
 		if (*args == NULL) {
@@ -476,6 +532,8 @@ client_handle_command(struct client *client, const char *cmd,
 				url_flags |= IMAP_URLAUTH_FETCH_FLAG_BINARY;
 			else if (strcasecmp(*args, "bpstruct") == 0)
 				url_flags |= IMAP_URLAUTH_FETCH_FLAG_BODYPARTSTRUCTURE;
+			else if (strcasecmp(*args, "fd") == 0)
+				pass_fd = TRUE;
 
 			args++;
 		}
@@ -484,7 +542,7 @@ client_handle_command(struct client *client, const char *cmd,
 			url_flags = IMAP_URLAUTH_FETCH_FLAG_BODY;
 
 		T_BEGIN {
-			ret = client_fetch_url(client, url, url_flags);
+			ret = client_fetch_url(client, url, url_flags, pass_fd);
 		} T_END;
 		return ret;
 	}
@@ -748,6 +806,9 @@ static int client_ctrl_read_fds(struct client *client)
 		return -1;
 	}
 
+	/* a single fd is the client's UNIX socket connection, which allows
+	   passing message file descriptors to it */
+	client->conn.unix_socket = client->conn.fd_in == client->conn.fd_out;
 	connection_init_server(clist, &client->conn, NULL,
 			       client->conn.fd_in, client->conn.fd_out);
 	connection_input_halt(&client->conn);
@@ -5,6 +5,7 @@
 #include "str.h"
 #include "imap-commands.h"
 #include "imap-search-args.h"
+#include "imap-store.h"
 #include "imap-util.h"
 
 
@@ -124,17 +125,15 @@ bool cmd_store(struct client_command_context *cmd)
 	struct client *client = cmd->client;
 	const struct imap_arg *args;
 	struct mail_search_args *search_args;
-	struct mail_search_context *search_ctx;
         struct mailbox_transaction_context *t;
-	struct mail *mail;
 	struct imap_store_context ctx;
+	struct imap_store_update update;
 	ARRAY_TYPE(seq_range) modified_set, uids;
 	enum mailbox_transaction_flags flags = 0;
 	enum imap_sync_flags imap_sync_flags = 0;
 	const char *set, *reply, *tagged_reply;
 	string_t *str;
 	int ret;
-	bool update_deletes;
 	unsigned int deleted_count;
 
 	if (!client_read_args(cmd, 0, 0, &args))
@@ -176,58 +175,40 @@ bool cmd_store(struct client_command_context *cmd)
 		flags |= MAILBOX_TRANSACTION_FLAG_REFRESH;
 	}
 
-	t = mailbox_transaction_begin(client->mailbox, flags,
-				      imap_client_command_get_reason(cmd));
-
-	search_ctx = mailbox_search_init(t, search_args, NULL,
-					 MAIL_FETCH_FLAGS, NULL);
-	mail_search_args_unref(&search_args);
+	i_zero(&update);
+	update.modify_type = ctx.modify_type;
+	update.flags = ctx.flags;
+	update.keywords = ctx.keywords;
 
 	i_array_init(&modified_set, 64);
-	if (ctx.max_modseq < (uint64_t)-1) {
-		/* STORE UNCHANGEDSINCE is being used */
-		mailbox_transaction_set_max_modseq(t, ctx.max_modseq,
-						   &modified_set);
-	}
-
-	update_deletes = (ctx.flags & MAIL_DELETED) != 0 &&
-		ctx.modify_type != MODIFY_REMOVE;
-	deleted_count = 0;
-	while (mailbox_search_next(search_ctx, &mail)) {
-		if (ctx.max_modseq < (uint64_t)-1) {
-			/* check early so there's less work for transaction
-			   commit if something has to be cancelled */
-			if (mail_get_modseq(mail) > ctx.max_modseq) {
-				seq_range_array_add(&modified_set, mail->seq);
-				continue;
-			}
-		}
-		if (update_deletes) {
-			if ((mail_get_flags(mail) & MAIL_DELETED) == 0)
-				deleted_count++;
-		}
-		if (ctx.modify_type == MODIFY_REPLACE || ctx.flags != 0)
-			mail_update_flags(mail, ctx.modify_type, ctx.flags);
-		if (ctx.modify_type == MODIFY_REPLACE || ctx.keywords != NULL) {
-			mail_update_keywords(mail, ctx.modify_type,
-					     ctx.keywords);
-		}
+	if (ctx.max_modseq == (uint64_t)-1) {
+		/* committed together with the following pipelined STOREs */
+		ret = imap_store_batch_run(cmd, flags, search_args, &update);
+	} else {
+		/* STORE UNCHANGEDSINCE needs its own commit result. Commit
+		   the earlier STOREs first to keep the changes in order. */
+		(void)imap_store_batch_commit(client);
+		t = mailbox_transaction_begin(client->mailbox, flags,
+					      imap_client_command_get_reason(cmd));
+		ret = imap_store_update_mails(t, search_args, &update,
+					      ctx.max_modseq, &modified_set,
+					      &deleted_count);
+		if (ret < 0)
+			mailbox_transaction_rollback(&t);
+		else
+			ret = mailbox_transaction_commit(&t);
+		if (ret == 0)
+			client->deleted_count += deleted_count;
 	}
-
+	mail_search_args_unref(&search_args);
 	if (ctx.keywords != NULL)
 		mailbox_keywords_unref(&ctx.keywords);
 
-	ret = mailbox_search_deinit(&search_ctx);
-	if (ret < 0)
-		mailbox_transaction_rollback(&t);
-	 else
-		ret = mailbox_transaction_commit(&t);
 	if (ret < 0) {
 		array_free(&modified_set);
 		client_send_box_error(cmd, client->mailbox);
 		return TRUE;
 	}
-	client->deleted_count += deleted_count;
 
 	if (array_count(&modified_set) == 0)
 		tagged_reply = "OK Store completed.";
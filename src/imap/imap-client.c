@@ -26,6 +26,7 @@
 #include "imap-notify.h"
 #include "imap-commands.h"
 #include "imap-feature.h"
+#include "imap-store.h"
 
 #include <unistd.h>
 
@@ -552,6 +553,8 @@ static void client_default_destroy(struct client *client, const char *reason)
 		array_free(&client->search_saved_uidset);
 	if (array_is_created(&client->search_updates))
 		array_free(&client->search_updates);
+	if (array_is_created(&client->store_batch_cmds))
+		array_free(&client->store_batch_cmds);
 	pool_unref(&client->command_pool);
 
 	imap_client_count--;
@@ -1016,6 +1019,7 @@ void client_command_free(struct client_command_context **_cmd)
 		client->input_lock = NULL;
 	if (client->mailbox_change_lock == cmd)
 		client->mailbox_change_lock = NULL;
+	imap_store_batch_cmd_free(cmd);
 
 	if (!cmd->internal)
 		event_set_name(cmd->event, "imap_command_finished");
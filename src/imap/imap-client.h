@@ -17,6 +17,7 @@ struct lda_settings;
 struct imap_parser;
 struct imap_arg;
 struct imap_urlauth_context;
+struct imap_store_batch_cmd;
 
 struct mailbox_keywords {
 	/* All keyword names. The array itself exists in mail_index.
@@ -121,6 +122,7 @@ struct client_command_context {
 	bool tagline_sent:1;
 	bool executing:1;
 	bool internal:1;
+	bool store_batched:1; /* in client->store_batch_cmds */
 };
 
 struct imap_client_vfuncs {
@@ -195,6 +197,11 @@ struct client {
 	char *last_cmd_name;
 	struct client_command_stats last_cmd_stats;
 
+	/* Pending changes of pipelined STORE commands */
+	struct mailbox_transaction_context *store_trans;
+	enum mailbox_transaction_flags store_trans_flags;
+	ARRAY(struct imap_store_batch_cmd) store_batch_cmds;
+
 	uint64_t sync_last_full_modseq;
 	uint64_t highest_fetch_modseq;
 	ARRAY_TYPE(seq_range) fetch_failed_uids;
@@ -13,6 +13,7 @@
 #include "mail-storage.h"
 #include "mail-namespace.h"
 #include "imap-commands-util.h"
+#include "imap-store.h"
 
 struct mail_namespace *
 client_find_namespace_full(struct client *client,
@@ -82,6 +83,7 @@ void imap_client_close_mailbox(struct client *client)
 
 	i_assert(client->mailbox != NULL);
 
+	(void)imap_store_batch_commit(client);
 	if (array_is_created(&client->fetch_failed_uids))
 		array_clear(&client->fetch_failed_uids);
 	client_search_updates_free(client);
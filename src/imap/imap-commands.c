@@ -8,6 +8,7 @@
 #include "ostream.h"
 #include "time-util.h"
 #include "imap-commands.h"
+#include "imap-store.h"
 
 
 struct command_hook {
@@ -193,6 +194,11 @@ bool command_exec(struct client_command_context *cmd)
 	io_loop_time_refresh();
 	command_stats_start(cmd);
 
+	if (cmd->client->store_trans != NULL && cmd->func != cmd_store) {
+		/* other commands must see the pipelined STOREs' changes */
+		(void)imap_store_batch_commit(cmd->client);
+	}
+
 	event_push_global(cmd->global_event);
 	cmd->executing = TRUE;
 	array_foreach(&command_hooks, hook)
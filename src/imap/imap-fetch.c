@@ -699,28 +699,43 @@ void imap_fetch_free(struct imap_fetch_context **_ctx)
 	pool_unref(&ctx->ctx_pool);
 }
 
-static int fetch_body(struct imap_fetch_context *ctx, struct mail *mail,
-		      void *context ATTR_UNUSED)
+static int
+fetch_send_parenthesized(struct imap_fetch_context *ctx, const char *name,
+			 const char *value)
 {
-	const char *body;
-
-	if (mail_get_special(mail, MAIL_FETCH_IMAP_BODY, &body) < 0)
-		return -1;
+	struct const_iovec iov[4];
+	unsigned int iov_count = 0;
 
+	/* send the whole item with a single call */
 	if (ctx->state.cur_first)
 		ctx->state.cur_first = FALSE;
 	else {
-		if (o_stream_send(ctx->client->output, " ", 1) < 0)
-			return -1;
+		iov[iov_count].iov_base = " ";
+		iov[iov_count++].iov_len = 1;
 	}
-
-	if (o_stream_send(ctx->client->output, "BODY (", 6) < 0 ||
-	    o_stream_send_str(ctx->client->output, body) < 0 ||
-	    o_stream_send(ctx->client->output, ")", 1) < 0)
+	iov[iov_count].iov_base = name;
+	iov[iov_count++].iov_len = strlen(name);
+	iov[iov_count].iov_base = value;
+	iov[iov_count++].iov_len = strlen(value);
+	iov[iov_count].iov_base = ")";
+	iov[iov_count++].iov_len = 1;
+
+	if (o_stream_sendv(ctx->client->output, iov, iov_count) < 0)
 		return -1;
 	return 1;
 }
 
+static int fetch_body(struct imap_fetch_context *ctx, struct mail *mail,
+		      void *context ATTR_UNUSED)
+{
+	const char *body;
+
+	if (mail_get_special(mail, MAIL_FETCH_IMAP_BODY, &body) < 0)
+		return -1;
+
+	return fetch_send_parenthesized(ctx, "BODY (", body);
+}
+
 static bool fetch_body_init(struct imap_fetch_init_context *ctx)
 {
 	if (ctx->name[4] == '\0') {
@@ -741,19 +756,7 @@ static int fetch_bodystructure(struct imap_fetch_context *ctx,
 			     &bodystructure) < 0)
 		return -1;
 
-	if (ctx->state.cur_first)
-		ctx->state.cur_first = FALSE;
-	else {
-		if (o_stream_send(ctx->client->output, " ", 1) < 0)
-			return -1;
-	}
-
-	if (o_stream_send(ctx->client->output, "BODYSTRUCTURE (", 15) < 0 ||
-	    o_stream_send_str(ctx->client->output, bodystructure) < 0 ||
-	    o_stream_send(ctx->client->output, ")", 1) < 0)
-		return -1;
-
-	return 1;
+	return fetch_send_parenthesized(ctx, "BODYSTRUCTURE (", bodystructure);
 }
 
 static bool fetch_bodystructure_init(struct imap_fetch_init_context *ctx)
@@ -772,18 +775,7 @@ static int fetch_envelope(struct imap_fetch_context *ctx, struct mail *mail,
 	if (mail_get_special(mail, MAIL_FETCH_IMAP_ENVELOPE, &envelope) < 0)
 		return -1;
 
-	if (ctx->state.cur_first)
-		ctx->state.cur_first = FALSE;
-	else {
-		if (o_stream_send(ctx->client->output, " ", 1) < 0)
-			return -1;
-	}
-
-	if (o_stream_send(ctx->client->output, "ENVELOPE (", 10) < 0 ||
-	    o_stream_send_str(ctx->client->output, envelope) < 0 ||
-	    o_stream_send(ctx->client->output, ")", 1) < 0)
-		return -1;
-	return 1;
+	return fetch_send_parenthesized(ctx, "ENVELOPE (", envelope);
 }
 
 static bool fetch_envelope_init(struct imap_fetch_init_context *ctx)
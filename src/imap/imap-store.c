@@ -0,0 +1,212 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "imap-common.h"
+#include "array.h"
+#include "mail-search.h"
+#include "imap-commands-util.h"
+#include "imap-sync.h"
+#include "imap-store.h"
+
+struct imap_store_batch_cmd {
+	struct client_command_context *cmd;
+	struct mail_search_args *search_args;
+	struct imap_store_update update;
+	unsigned int deleted_count;
+};
+
+int imap_store_update_mails(struct mailbox_transaction_context *t,
+			    struct mail_search_args *search_args,
+			    const struct imap_store_update *update,
+			    uint64_t max_modseq,
+			    ARRAY_TYPE(seq_range) *modified_set,
+			    unsigned int *deleted_count_r)
+{
+	struct mail_search_context *search_ctx;
+	struct mail *mail;
+	bool update_deletes;
+
+	search_ctx = mailbox_search_init(t, search_args, NULL,
+					 MAIL_FETCH_FLAGS, NULL);
+	if (max_modseq < (uint64_t)-1) {
+		/* STORE UNCHANGEDSINCE is being used */
+		mailbox_transaction_set_max_modseq(t, max_modseq,
+						   modified_set);
+	}
+
+	update_deletes = (update->flags & MAIL_DELETED) != 0 &&
+		update->modify_type != MODIFY_REMOVE;
+	*deleted_count_r = 0;
+	while (mailbox_search_next(search_ctx, &mail)) {
+		if (max_modseq < (uint64_t)-1) {
+			/* check early so there's less work for transaction
+			   commit if something has to be cancelled */
+			if (mail_get_modseq(mail) > max_modseq) {
+				seq_range_array_add(modified_set, mail->seq);
+				continue;
+			}
+		}
+		if (update_deletes) {
+			if ((mail_get_flags(mail) & MAIL_DELETED) == 0)
+				(*deleted_count_r)++;
+		}
+		if (update->modify_type == MODIFY_REPLACE || update->flags != 0)
+			mail_update_flags(mail, update->modify_type,
+					  update->flags);
+		if (update->modify_type == MODIFY_REPLACE ||
+		    update->keywords != NULL) {
+			mail_update_keywords(mail, update->modify_type,
+					     update->keywords);
+		}
+	}
+	return mailbox_search_deinit(&search_ctx);
+}
+
+static void imap_store_batch_cmds_free(struct client *client)
+{
+	struct imap_store_batch_cmd *bcmd;
+
+	if (!array_is_created(&client->store_batch_cmds))
+		return;
+
+	array_foreach_modifiable(&client->store_batch_cmds, bcmd) {
+		bcmd->cmd->store_batched = FALSE;
+		mail_search_args_unref(&bcmd->search_args);
+		if (bcmd->update.keywords != NULL)
+			mailbox_keywords_unref(&bcmd->update.keywords);
+	}
+	array_clear(&client->store_batch_cmds);
+}
+
+static void imap_store_batch_cmd_failed(struct client_command_context *cmd)
+{
+	const char *error_string;
+	enum mail_error error;
+
+	error_string = mailbox_get_last_error(cmd->client->mailbox, &error);
+	/* the STORE is waiting for the sync that sends its tagged reply */
+	cmd_sync_set_tagline(cmd, imap_get_error_string(cmd, error_string,
+							error));
+}
+
+static void imap_store_batch_retry(struct client *client)
+{
+	struct mailbox_transaction_context *t;
+	const struct imap_store_batch_cmd *bcmd;
+	unsigned int deleted_count;
+	int ret;
+
+	array_foreach(&client->store_batch_cmds, bcmd) {
+		t = mailbox_transaction_begin(client->mailbox,
+			client->store_trans_flags,
+			imap_client_command_get_reason(bcmd->cmd));
+		ret = imap_store_update_mails(t, bcmd->search_args,
+					      &bcmd->update, (uint64_t)-1,
+					      NULL, &deleted_count);
+		if (ret < 0)
+			mailbox_transaction_rollback(&t);
+		else
+			ret = mailbox_transaction_commit(&t);
+		if (ret < 0)
+			imap_store_batch_cmd_failed(bcmd->cmd);
+		else
+			client->deleted_count += deleted_count;
+	}
+	imap_store_batch_cmds_free(client);
+}
+
+int imap_store_batch_run(struct client_command_context *cmd,
+			 enum mailbox_transaction_flags flags,
+			 struct mail_search_args *search_args,
+			 const struct imap_store_update *update)
+{
+	struct client *client = cmd->client;
+	struct mail_storage *storage;
+	struct imap_store_batch_cmd *bcmd;
+	unsigned int deleted_count;
+
+	if (client->store_trans != NULL && client->store_trans_flags != flags)
+		(void)imap_store_batch_commit(client);
+	if (client->store_trans == NULL) {
+		client->store_trans =
+			mailbox_transaction_begin(client->mailbox, flags,
+				imap_client_command_get_reason(cmd));
+		client->store_trans_flags = flags;
+	}
+
+	if (imap_store_update_mails(client->store_trans, search_args, update,
+				    (uint64_t)-1, NULL, &deleted_count) < 0) {
+		/* Some of this command's changes may already be in the
+		   transaction. Roll it back and redo the earlier STOREs
+		   without this one. Keep this command's error for its
+		   reply. */
+		mailbox_transaction_rollback(&client->store_trans);
+		storage = mailbox_get_storage(client->mailbox);
+		mail_storage_last_error_push(storage);
+		imap_store_batch_retry(client);
+		mail_storage_last_error_pop(storage);
+		return -1;
+	}
+
+	if (!array_is_created(&client->store_batch_cmds))
+		i_array_init(&client->store_batch_cmds, 8);
+	bcmd = array_append_space(&client->store_batch_cmds);
+	bcmd->cmd = cmd;
+	bcmd->search_args = search_args;
+	mail_search_args_ref(bcmd->search_args);
+	bcmd->update = *update;
+	if (bcmd->update.keywords != NULL)
+		mailbox_keywords_ref(bcmd->update.keywords);
+	bcmd->deleted_count = deleted_count;
+	cmd->store_batched = TRUE;
+	return 0;
+}
+
+int imap_store_batch_commit(struct client *client)
+{
+	const struct imap_store_batch_cmd *bcmd;
+
+	if (client->store_trans == NULL)
+		return 0;
+
+	if (mailbox_transaction_commit(&client->store_trans) < 0) {
+		if (array_count(&client->store_batch_cmds) == 1) {
+			bcmd = array_front(&client->store_batch_cmds);
+			imap_store_batch_cmd_failed(bcmd->cmd);
+			imap_store_batch_cmds_free(client);
+		} else {
+			/* find out which of the STOREs failed */
+			imap_store_batch_retry(client);
+		}
+		client_disconnect_if_inconsistent(client);
+		return -1;
+	}
+	array_foreach(&client->store_batch_cmds, bcmd)
+		client->deleted_count += bcmd->deleted_count;
+	imap_store_batch_cmds_free(client);
+	return 0;
+}
+
+void imap_store_batch_cmd_free(struct client_command_context *cmd)
+{
+	struct client *client = cmd->client;
+	struct imap_store_batch_cmd *bcmd;
+
+	if (!cmd->store_batched)
+		return;
+
+	/* The command is freed before the batch is committed only when the
+	   client is being destroyed. Its changes are still committed with
+	   the rest of the batch, but it can't be retried anymore. */
+	array_foreach_modifiable(&client->store_batch_cmds, bcmd) {
+		if (bcmd->cmd == cmd) {
+			mail_search_args_unref(&bcmd->search_args);
+			if (bcmd->update.keywords != NULL)
+				mailbox_keywords_unref(&bcmd->update.keywords);
+			array_delete(&client->store_batch_cmds,
+				     array_foreach_idx(&client->store_batch_cmds,
+						       bcmd), 1);
+			break;
+		}
+	}
+	cmd->store_batched = FALSE;
+}
@@ -0,0 +1,49 @@
+#ifndef IMAP_STORE_H
+#define IMAP_STORE_H
+
+#include "seq-range-array.h"
+
+/* Pipelined STORE commands add their flag changes to a single transaction,
+   which is committed once before the following mailbox sync or before
+   any other command is run. This keeps the changes in a single transaction
+   log write instead of one per command. */
+
+struct imap_store_update {
+	enum modify_type modify_type;
+	enum mail_flags flags;
+	struct mail_keywords *keywords;
+};
+
+/* Update the flags and keywords of the mails matching search_args.
+   If max_modseq isn't (uint64_t)-1, mails with a higher modseq aren't
+   updated and their sequences are added to modified_set. deleted_count_r
+   is set to the number of mails that got the \Deleted flag. Returns 0 on
+   success, -1 if the search failed. */
+int imap_store_update_mails(struct mailbox_transaction_context *t,
+			    struct mail_search_args *search_args,
+			    const struct imap_store_update *update,
+			    uint64_t max_modseq,
+			    ARRAY_TYPE(seq_range) *modified_set,
+			    unsigned int *deleted_count_r);
+
+/* Run the STORE in the client's shared STORE transaction, beginning a new
+   one if needed. If the existing transaction has different flags, it's
+   committed first. If this STORE fails, the transaction is rolled back and
+   the earlier STOREs in it are run again in their own transactions. Returns
+   0 on success, -1 if this STORE failed. The mailbox's last error is then
+   this STORE's error. */
+int imap_store_batch_run(struct client_command_context *cmd,
+			 enum mailbox_transaction_flags flags,
+			 struct mail_search_args *search_args,
+			 const struct imap_store_update *update);
+/* Commit the client's pending STORE transaction. If the commit fails, the
+   STOREs are run again in their own transactions, and only the STOREs
+   that fail again reply with their error instead of their original tagged
+   reply. Returns 0 on success or if there was nothing to commit, -1 if the
+   shared commit failed. */
+int imap_store_batch_commit(struct client *client);
+/* Forget the command's STORE in the pending transaction. Called when the
+   command is freed. */
+void imap_store_batch_cmd_free(struct client_command_context *cmd);
+
+#endif
@@ -11,6 +11,7 @@
 #include "imap-fetch.h"
 #include "imap-notify.h"
 #include "imap-commands.h"
+#include "imap-store.h"
 #include "imap-sync-private.h"
 
 static void uids_to_seqs(struct mailbox *box, ARRAY_TYPE(seq_range) *uids)
@@ -759,6 +760,15 @@ bool cmd_sync(struct client_command_context *cmd, enum mailbox_sync_flags flags,
 	return FALSE;
 }
 
+void cmd_sync_set_tagline(struct client_command_context *cmd,
+			  const char *tagline)
+{
+	i_assert(cmd->sync != NULL);
+
+	cmd->tagline_reply = p_strdup(cmd->pool, tagline);
+	cmd->sync->tagline = cmd->tagline_reply;
+}
+
 static bool cmd_sync_drop_fast(struct client *client)
 {
 	struct client_command_context *cmd, *prev;
@@ -793,6 +803,9 @@ static bool cmd_sync_delayed_real(struct client *client)
 		return FALSE;
 	}
 
+	/* commit pipelined STOREs now, so the sync sees their changes */
+	(void)imap_store_batch_commit(client);
+
 	if (!imap_sync_is_allowed(client)) {
 		/* wait until mailbox can be synced */
 		return cmd_sync_drop_fast(client);
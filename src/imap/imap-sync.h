@@ -21,5 +21,8 @@ bool imap_sync_is_allowed(struct client *client);
 bool cmd_sync(struct client_command_context *cmd, enum mailbox_sync_flags flags,
 	      enum imap_sync_flags imap_flags, const char *tagline);
 bool cmd_sync_delayed(struct client *client) ATTR_NOWARN_UNUSED_RESULT;
+/* Replace the tagged reply of a command that is waiting for sync. */
+void cmd_sync_set_tagline(struct client_command_context *cmd,
+			  const char *tagline);
 
 #endif
@@ -0,0 +1,449 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "net.h"
+#include "str.h"
+#include "istream.h"
+#include "ostream.h"
+#include "path-util.h"
+#include "unlink-directory.h"
+#include "settings-parser.h"
+#include "master-service.h"
+#include "smtp-submit.h"
+#include "mail-storage-service.h"
+#include "mail-storage-private.h"
+#include "mail-storage-hooks.h"
+#include "imap-common.h"
+#include "imap-settings.h"
+#include "imap-client.h"
+#include "imap-commands.h"
+#include "imap-feature.h"
+#include "test-common.h"
+
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+#define TEMP_DIRNAME ".test-imap-store"
+
+imap_client_created_func_t *hook_client_created = NULL;
+bool imap_debug = FALSE;
+
+void imap_refresh_proctitle(void) { }
+void imap_refresh_proctitle_delayed(void) { }
+int client_create_from_input(const struct mail_storage_service_input *input ATTR_UNUSED,
+			     int fd_in ATTR_UNUSED, int fd_out ATTR_UNUSED,
+			     bool unhibernated ATTR_UNUSED,
+			     struct client **client_r ATTR_UNUSED,
+			     const char **error_r ATTR_UNUSED) { return -1; }
+
+static const char *tmpdir;
+static struct mail_storage_service_ctx *storage_service;
+
+/* fail the n'th STORE search or commit, counting from 1 */
+static unsigned int search_count, fail_search_n;
+static unsigned int commit_count, fail_commit_n;
+static struct mailbox_vfuncs orig_vfuncs;
+
+struct test_imap_client {
+	struct client *client;
+	int fd;
+	struct istream *input;
+	struct ostream *output;
+};
+
+static int test_mailbox_search_deinit(struct mail_search_context *ctx)
+{
+	struct mailbox_transaction_context *t = ctx->transaction;
+	struct mailbox *box = t->box;
+
+	if (orig_vfuncs.search_deinit(ctx) < 0)
+		return -1;
+	if (!str_begins_with(t->reason, "STORE "))
+		return 0;
+	if (++search_count == fail_search_n) {
+		mail_storage_set_error(box->storage, MAIL_ERROR_TEMP,
+				       "Test search failure");
+		return -1;
+	}
+	return 0;
+}
+
+static int
+test_mailbox_transaction_commit(struct mailbox_transaction_context *t,
+				struct mail_transaction_commit_changes *changes_r)
+{
+	struct mailbox *box = t->box;
+
+	if (!str_begins_with(t->reason, "STORE "))
+		return orig_vfuncs.transaction_commit(t, changes_r);
+	if (++commit_count == fail_commit_n) {
+		orig_vfuncs.transaction_rollback(t);
+		mail_storage_set_error(box->storage, MAIL_ERROR_TEMP,
+				       "Test commit failure");
+		return -1;
+	}
+	return orig_vfuncs.transaction_commit(t, changes_r);
+}
+
+static void test_mailbox_allocated(struct mailbox *box)
+{
+	orig_vfuncs = box->v;
+	box->v.search_deinit = test_mailbox_search_deinit;
+	box->v.transaction_commit = test_mailbox_transaction_commit;
+}
+
+static const struct mail_storage_hooks test_hooks = {
+	.mailbox_allocated = test_mailbox_allocated,
+};
+
+static void test_reset_counters(void)
+{
+	search_count = fail_search_n = 0;
+	commit_count = fail_commit_n = 0;
+}
+
+static void test_ioloop_timeout(bool *timed_out)
+{
+	*timed_out = TRUE;
+	io_loop_stop(current_ioloop);
+}
+
+/* Returns the next line sent by the server, or "" on timeout. */
+static const char *test_client_read_line(struct test_imap_client *tclient)
+{
+	struct timeout *to, *to_step;
+	const char *line;
+	bool timed_out = FALSE;
+
+	to = timeout_add_short(5000, test_ioloop_timeout, &timed_out);
+	while ((line = i_stream_next_line(tclient->input)) == NULL &&
+	       !timed_out) {
+		to_step = timeout_add_short(10, io_loop_stop, current_ioloop);
+		io_loop_run(current_ioloop);
+		timeout_remove(&to_step);
+		(void)i_stream_read(tclient->input);
+	}
+	timeout_remove(&to);
+	return line == NULL ? "" : t_strdup(line);
+}
+
+/* Read the server's output until the tagged replies for all the tags are
+   found. Pipelined commands may be replied to in any order. The replies
+   are returned without the tags. */
+static void
+test_client_read_tagged_multi(struct test_imap_client *tclient,
+			      const char *const *tags, const char **replies_r)
+{
+	const char *line, *reply;
+	unsigned int i, found = 0, count = str_array_length(tags);
+
+	for (i = 0; i < count; i++)
+		replies_r[i] = "";
+	while (found < count) {
+		line = test_client_read_line(tclient);
+		if (line[0] == '\0')
+			break;
+		for (i = 0; i < count; i++) {
+			if (str_begins(line, t_strconcat(tags[i], " ", NULL),
+				       &reply)) {
+				replies_r[i] = reply;
+				found++;
+				break;
+			}
+		}
+	}
+}
+
+static const char *
+test_client_read_tagged(struct test_imap_client *tclient, const char *tag)
+{
+	const char *const tags[] = { tag, NULL };
+	const char *reply;
+
+	test_client_read_tagged_multi(tclient, tags, &reply);
+	return reply;
+}
+
+static void
+test_client_send(struct test_imap_client *tclient, const char *data)
+{
+	o_stream_nsend_str(tclient->output, data);
+	test_assert(o_stream_flush(tclient->output) > 0);
+}
+
+static void test_save_mails(struct mail_user *user, unsigned int count)
+{
+	const char *mail_input = "Subject: test\n\nbody\n";
+	struct mailbox *box;
+	struct mailbox_transaction_context *t;
+	struct mail_save_context *save_ctx;
+	struct istream *input;
+	unsigned int i;
+	int ret;
+
+	box = mailbox_alloc(user->namespaces->list, "INBOX", 0);
+	if (mailbox_open(box) < 0)
+		i_fatal("Failed to open INBOX");
+	t = mailbox_transaction_begin(box, MAILBOX_TRANSACTION_FLAG_EXTERNAL,
+				      __func__);
+	for (i = 0; i < count; i++) {
+		input = i_stream_create_from_data(mail_input,
+						  strlen(mail_input));
+		save_ctx = mailbox_save_alloc(t);
+		ret = mailbox_save_begin(&save_ctx, input);
+		while (ret == 0 && i_stream_read(input) > 0)
+			ret = mailbox_save_continue(save_ctx);
+		if (ret == 0)
+			ret = mailbox_save_finish(&save_ctx);
+		else
+			mailbox_save_cancel(&save_ctx);
+		i_stream_unref(&input);
+		if (ret < 0)
+			i_fatal("Failed to save mail");
+	}
+	if (mailbox_transaction_commit(&t) < 0)
+		i_fatal("Failed to commit mails");
+	mailbox_free(&box);
+}
+
+static void test_client_init(struct test_imap_client *tclient)
+{
+	struct smtp_submit_settings smtp_set;
+	struct mail_user *mail_user;
+	struct event *event;
+	const char *error;
+	int fds[2];
+
+	const char *const input_userdb[] = {
+		t_strdup_printf("mail=sdbox:%s/mail", tmpdir),
+		NULL
+	};
+	struct mail_storage_service_input input = {
+		.username = "testuser",
+		.userdb_fields = input_userdb,
+		.no_userdb_lookup = TRUE,
+	};
+	if (mail_storage_service_lookup_next(storage_service, &input,
+					     &mail_user, &error) < 0)
+		i_fatal("mail_storage_service_lookup_next() failed: %s", error);
+	test_save_mails(mail_user, 3);
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		i_fatal("socketpair() failed: %m");
+	net_set_nonblock(fds[0], TRUE);
+	net_set_nonblock(fds[1], TRUE);
+
+	i_zero(&smtp_set);
+	event = event_create(NULL);
+	tclient->client = client_create(fds[0], fds[0], FALSE, event,
+					mail_user,
+					imap_setting_parser_info.defaults,
+					&smtp_set);
+	event_unref(&event);
+	client_create_finish_io(tclient->client);
+
+	tclient->fd = fds[1];
+	tclient->input = i_stream_create_fd(fds[1], SIZE_MAX);
+	tclient->output = o_stream_create_fd(fds[1], SIZE_MAX);
+
+	test_client_send(tclient, "s SELECT INBOX\r\n");
+	test_assert(str_begins_with(test_client_read_tagged(tclient, "s"),
+				    "OK"));
+}
+
+static void test_client_deinit(struct test_imap_client *tclient)
+{
+	const char *error;
+
+	test_client_send(tclient, "l LOGOUT\r\n");
+	(void)test_client_read_tagged(tclient, "l");
+	i_stream_destroy(&tclient->input);
+	o_stream_destroy(&tclient->output);
+	i_close_fd(&tclient->fd);
+	/* let the client notice the disconnection */
+	struct timeout *to = timeout_add_short(10, io_loop_stop,
+					       current_ioloop);
+	io_loop_run(current_ioloop);
+	timeout_remove(&to);
+
+	if (unlink_directory(tmpdir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_error("unlink_directory() failed: %s", error);
+	if (mkdir(tmpdir, 0700) < 0)
+		i_fatal("mkdir() failed: %m");
+}
+
+/* Returns the UIDs of the \Seen mails */
+static const char *test_client_search_seen(struct test_imap_client *tclient)
+{
+	const char *line, *result = NULL;
+
+	test_client_send(tclient, "q UID SEARCH SEEN\r\n");
+	for (;;) {
+		line = test_client_read_line(tclient);
+		if (line[0] == '\0' || str_begins_with(line, "q "))
+			break;
+		if (str_begins(line, "* SEARCH", &line))
+			result = line;
+	}
+	return result == NULL ? "" : result;
+}
+
+static const char *const test_store_tags[] = { "a", "b", "c", NULL };
+#define TEST_STORE_CMDS \
+	"a STORE 1 +FLAGS.SILENT (\\Seen)\r\n" \
+	"b STORE 2 +FLAGS.SILENT (\\Seen)\r\n" \
+	"c STORE 3 +FLAGS.SILENT (\\Seen)\r\n"
+
+static void test_imap_store_batch(void)
+{
+	struct test_imap_client tclient;
+	const char *replies[3];
+
+	test_begin("imap store batch");
+	test_client_init(&tclient);
+	test_reset_counters();
+
+	test_client_send(&tclient, TEST_STORE_CMDS);
+	test_client_read_tagged_multi(&tclient, test_store_tags, replies);
+	test_assert(str_begins_with(replies[0], "OK Store completed"));
+	test_assert(str_begins_with(replies[1], "OK Store completed"));
+	test_assert(str_begins_with(replies[2], "OK Store completed"));
+	/* all three STOREs were committed at once */
+	test_assert(commit_count == 1);
+	test_assert_strcmp(test_client_search_seen(&tclient), " 1 2 3");
+
+	test_client_deinit(&tclient);
+	test_end();
+}
+
+static void test_imap_store_batch_search_failure(void)
+{
+	struct test_imap_client tclient;
+	const char *replies[3];
+
+	test_begin("imap store batch search failure");
+	test_client_init(&tclient);
+	test_reset_counters();
+
+	/* the second STORE fails. The first one is retried on its own and
+	   the third one gets a new batch. */
+	fail_search_n = 2;
+	test_client_send(&tclient, TEST_STORE_CMDS);
+	test_client_read_tagged_multi(&tclient, test_store_tags, replies);
+	test_assert(str_begins_with(replies[0], "OK Store completed"));
+	test_assert(str_begins_with(replies[1], "NO ") &&
+		    strstr(replies[1], "Test search failure") != NULL);
+	test_assert(str_begins_with(replies[2], "OK Store completed"));
+	test_assert(commit_count == 2);
+	test_assert_strcmp(test_client_search_seen(&tclient), " 1 3");
+
+	test_client_deinit(&tclient);
+	test_end();
+}
+
+static void test_imap_store_batch_commit_failure(void)
+{
+	struct test_imap_client tclient;
+	const char *replies[3];
+
+	test_begin("imap store batch commit failure");
+	test_client_init(&tclient);
+	test_reset_counters();
+
+	/* The batch commit fails and each STORE is retried. Of the retries
+	   only the second one fails. */
+	fail_commit_n = 1;
+	fail_search_n = 3 + 2;
+	test_client_send(&tclient, TEST_STORE_CMDS);
+	test_client_read_tagged_multi(&tclient, test_store_tags, replies);
+	test_assert(str_begins_with(replies[0], "OK Store completed"));
+	test_assert(str_begins_with(replies[1], "NO ") &&
+		    strstr(replies[1], "Test search failure") != NULL);
+	test_assert(str_begins_with(replies[2], "OK Store completed"));
+	test_assert(commit_count == 3);
+	test_assert_strcmp(test_client_search_seen(&tclient), " 1 3");
+
+	/* a single STORE isn't retried */
+	test_reset_counters();
+	fail_commit_n = 1;
+	test_client_send(&tclient, "d STORE 2 +FLAGS.SILENT (\\Seen)\r\n");
+	const char *reply = test_client_read_tagged(&tclient, "d");
+	test_assert(str_begins_with(reply, "NO ") &&
+		    strstr(reply, "Test commit failure") != NULL);
+	test_assert(commit_count == 1);
+	test_assert_strcmp(test_client_search_seen(&tclient), " 1 3");
+
+	test_client_deinit(&tclient);
+	test_end();
+}
+
+static void test_cleanup(void)
+{
+	const char *error;
+
+	if (unlink_directory(tmpdir, UNLINK_DIRECTORY_FLAG_RMDIR, &error) < 0)
+		i_error("unlink_directory() failed: %s", error);
+}
+
+static void test_init(void)
+{
+	const char *cwd, *error;
+
+	test_assert(t_get_working_dir(&cwd, &error) == 0);
+	tmpdir = t_strconcat(cwd, "/"TEMP_DIRNAME, NULL);
+
+	test_cleanup();
+	if (mkdir(tmpdir, 0700) < 0)
+		i_fatal("mkdir() failed: %m");
+
+	storage_service = mail_storage_service_init(master_service, NULL,
+		MAIL_STORAGE_SERVICE_FLAG_ALLOW_ROOT |
+		MAIL_STORAGE_SERVICE_FLAG_NO_LOG_INIT |
+		MAIL_STORAGE_SERVICE_FLAG_NO_CHDIR |
+		MAIL_STORAGE_SERVICE_FLAG_NO_RESTRICT_ACCESS);
+	mail_storage_hooks_add_internal(&test_hooks);
+	commands_init();
+	imap_features_init();
+	clients_init();
+}
+
+static void test_deinit(void)
+{
+	imap_features_deinit();
+	commands_deinit();
+	mail_storage_hooks_remove_internal(&test_hooks);
+	mail_storage_service_deinit(&storage_service);
+	test_cleanup();
+}
+
+int main(int argc, char *argv[])
+{
+	const enum master_service_flags service_flags =
+		MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS |
+		MASTER_SERVICE_FLAG_STANDALONE |
+		MASTER_SERVICE_FLAG_STD_CLIENT |
+		MASTER_SERVICE_FLAG_DONT_SEND_STATS;
+	int ret;
+
+	master_service = master_service_init("test-imap-store",
+					     service_flags, &argc, &argv, "");
+
+	/* each test creates a new client */
+	master_service_set_client_limit(master_service, 100);
+	master_service_set_service_count(master_service, 100);
+	master_service_init_finish(master_service);
+	test_init();
+
+	static void (*const test_functions[])(void) = {
+		test_imap_store_batch,
+		test_imap_store_batch_search_failure,
+		test_imap_store_batch_commit_failure,
+		NULL
+	};
+	ret = test_run(test_functions);
+
+	test_deinit();
+	master_service_deinit(&master_service);
+	return ret;
+}
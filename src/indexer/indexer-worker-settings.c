@@ -51,6 +51,7 @@ struct service_settings indexer_worker_service_settings = {
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &indexer_worker_unix_listeners_buf,
 			      sizeof(indexer_worker_unix_listeners[0]) } },
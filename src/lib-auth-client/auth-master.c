@@ -19,6 +19,9 @@
 #include <unistd.h>
 
 #define AUTH_MASTER_IDLE_SECS 60
+/* Maximum number of USER requests sent ahead of their replies by
+   auth_master_user_lookup_multi() */
+#define AUTH_MASTER_MAX_PIPELINED_REQUESTS 64
 
 #define MAX_INBUF_SIZE 8192
 #define MAX_OUTBUF_SIZE 1024
@@ -35,6 +38,10 @@ struct auth_master_connection {
 	struct timeout *to;
 
 	unsigned int request_counter;
+	/* When non-zero, replies with IDs first_pipelined_id..request_counter
+	   are accepted. reply_id is set to the ID of the reply being
+	   processed. */
+	unsigned int first_pipelined_id, reply_id;
 
 	bool (*reply_callback)(const char *cmd, const char *const *args,
 			       void *context);
@@ -57,6 +64,16 @@ struct auth_master_lookup_ctx {
 	const char **fields;
 };
 
+struct auth_master_user_lookup_multi_ctx {
+	struct auth_master_connection *conn;
+	const char *const *users;
+	const struct auth_user_info *info;
+	string_t *str;
+
+	struct auth_master_lookup_ctx *lookups;
+	unsigned int count, next_idx, pending;
+};
+
 struct auth_master_user_list_ctx {
 	struct auth_master_connection *conn;
 	string_t *username;
@@ -273,15 +290,13 @@ static const char *const *args_hide_passwords(const char *const *args)
 	return array_front(&new_args);
 }
 
-static bool auth_lookup_reply_callback(const char *cmd, const char *const *args,
-				       void *context)
+static void
+auth_lookup_reply_parse(struct auth_master_lookup_ctx *ctx, const char *cmd,
+			const char *const *args)
 {
-	struct auth_master_lookup_ctx *ctx = context;
 	const char *value;
 	unsigned int i, len;
 
-	io_loop_stop(ctx->conn->ioloop);
-
 	ctx->return_value = parse_reply(ctx, cmd, args);
 
 	len = str_array_length(args);
@@ -303,6 +318,15 @@ static bool auth_lookup_reply_callback(const char *cmd, const char *const *args,
 	args = args_hide_passwords(args);
 	e_debug(ctx->conn->event, "auth %s input: %s",
 		ctx->expected_reply, t_strarray_join(args, " "));
+}
+
+static bool auth_lookup_reply_callback(const char *cmd, const char *const *args,
+				       void *context)
+{
+	struct auth_master_lookup_ctx *ctx = context;
+
+	io_loop_stop(ctx->conn->ioloop);
+	auth_lookup_reply_parse(ctx, cmd, args);
 	return TRUE;
 }
 
@@ -312,7 +336,7 @@ auth_master_input_args(struct connection *_conn, const char *const *args)
 	struct auth_master_connection *conn =
 		container_of(_conn, struct auth_master_connection, conn);
 	const char *const *in_args = args;
-	const char *cmd, *id, *wanted_id;
+	const char *cmd, *id;
 
 	cmd = *args; args++;
 	if (*args == NULL)
@@ -322,8 +346,17 @@ auth_master_input_args(struct connection *_conn, const char *const *args)
 		args++;
 	}
 
-	wanted_id = dec2str(conn->request_counter);
-	if (strcmp(id, wanted_id) == 0) {
+	if (conn->first_pipelined_id != 0) {
+		if (str_to_uint(id, &conn->reply_id) == 0 &&
+		    conn->reply_id >= conn->first_pipelined_id &&
+		    conn->reply_id <= conn->request_counter) {
+			e_debug(conn->conn.event, "auth input: %s",
+				t_strarray_join(args, "\t"));
+			return (conn->reply_callback(cmd, args,
+						     conn->reply_context) ?
+				0 : 1);
+		}
+	} else if (strcmp(id, dec2str(conn->request_counter)) == 0) {
 		e_debug(conn->conn.event, "auth input: %s",
 			t_strarray_join(args, "\t"));
 		return (conn->reply_callback(cmd, args, conn->reply_context) ?
@@ -637,6 +670,56 @@ auth_master_event_finish(struct auth_master_connection *conn)
 	conn->event = conn->event_parent;
 }
 
+static void
+auth_master_user_lookup_started(struct auth_master_connection *conn)
+{
+	struct event_passthrough *e =
+		event_create_passthrough(conn->event)->
+		set_name("auth_client_userdb_lookup_started");
+	e_debug(e->event(), "Started userdb lookup");
+}
+
+static int
+auth_master_user_lookup_finish(struct auth_master_connection *conn,
+			       struct auth_master_lookup_ctx *ctx,
+			       const char **username_r,
+			       const char *const **fields_r)
+{
+	if (ctx->return_value <= 0 || ctx->fields[0] == NULL) {
+		*username_r = NULL;
+		*fields_r = ctx->fields != NULL ? ctx->fields :
+			p_new(ctx->pool, const char *, 1);
+
+		struct event_passthrough *e =
+			event_create_passthrough(conn->event)->
+			set_name("auth_client_userdb_lookup_finished");
+
+		if (ctx->return_value > 0) {
+			e->add_str("error", "Lookup didn't return username");
+			e_error(e->event(), "Userdb lookup failed: "
+				"Lookup didn't return username");
+			ctx->return_value = -2;
+		} else if ((*fields_r)[0] == NULL) {
+			e->add_str("error", "Lookup failed");
+			e_debug(e->event(), "Userdb lookup failed");
+		} else {
+			e->add_str("error", (*fields_r)[0]);
+			e_debug(e->event(), "Userdb lookup failed: %s",
+				(*fields_r)[0]);
+		}
+	} else {
+		*username_r = ctx->fields[0];
+		*fields_r = ctx->fields + 1;
+
+		struct event_passthrough *e =
+			event_create_passthrough(conn->event)->
+			set_name("auth_client_userdb_lookup_finished");
+		e_debug(e->event(), "Finished userdb lookup (username=%s %s)",
+			*username_r, t_strarray_join(*fields_r, " "));
+	}
+	return ctx->return_value;
+}
+
 int auth_master_user_lookup(struct auth_master_connection *conn,
 			    const char *user, const struct auth_user_info *info,
 			    pool_t pool, const char **username_r,
@@ -644,6 +727,7 @@ int auth_master_user_lookup(struct auth_master_connection *conn,
 {
 	struct auth_master_lookup_ctx ctx;
 	string_t *str;
+	int ret;
 
 	if (!is_valid_string(user) || !is_valid_string(info->service)) {
 		/* non-allowed characters, the user can't exist */
@@ -671,50 +755,162 @@ int auth_master_user_lookup(struct auth_master_connection *conn,
 	auth_master_user_event_create(
 		conn, t_strdup_printf("userdb lookup(%s): ", user), info);
 	event_add_str(conn->event, "user", user);
-
-	struct event_passthrough *e =
-		event_create_passthrough(conn->event)->
-		set_name("auth_client_userdb_lookup_started");
-	e_debug(e->event(), "Started userdb lookup");
+	auth_master_user_lookup_started(conn);
 
 	(void)auth_master_run_cmd(conn, str_c(str));
 
-	if (ctx.return_value <= 0 || ctx.fields[0] == NULL) {
-		*username_r = NULL;
-		*fields_r = ctx.fields != NULL ? ctx.fields :
-			p_new(pool, const char *, 1);
+	ret = auth_master_user_lookup_finish(conn, &ctx, username_r, fields_r);
+	auth_master_event_finish(conn);
 
-		struct event_passthrough *e =
-			event_create_passthrough(conn->event)->
-			set_name("auth_client_userdb_lookup_finished");
+	conn->reply_context = NULL;
+	return ret;
+}
 
-		if (ctx.return_value > 0) {
-			e->add_str("error", "Lookup didn't return username");
-			e_error(e->event(), "Userdb lookup failed: "
-				"Lookup didn't return username");
-			ctx.return_value = -2;
-		} else if ((*fields_r)[0] == NULL) {
-			e->add_str("error", "Lookup failed");
-			e_debug(e->event(), "Userdb lookup failed");
-		} else {
-			e->add_str("error", (*fields_r)[0]);
-			e_debug(e->event(), "Userdb lookup failed: %s",
-				(*fields_r)[0]);
+static void
+auth_master_user_lookup_multi_send(struct auth_master_user_lookup_multi_ctx *ctx)
+{
+	struct auth_master_connection *conn = ctx->conn;
+	struct ostream *output = conn->conn.output;
+	struct auth_master_lookup_ctx *lookup;
+	const char *user;
+
+	o_stream_cork(output);
+	while (ctx->next_idx < ctx->count &&
+	       ctx->pending < AUTH_MASTER_MAX_PIPELINED_REQUESTS) {
+		lookup = &ctx->lookups[ctx->next_idx];
+		user = ctx->users[ctx->next_idx];
+		if (!is_valid_string(user)) {
+			/* non-allowed characters, the user can't exist */
+			lookup->return_value = 0;
+			ctx->next_idx++;
+			continue;
 		}
-	} else {
-		*username_r = ctx.fields[0];
-		*fields_r = ctx.fields + 1;
 
-		struct event_passthrough *e =
-			event_create_passthrough(conn->event)->
-			set_name("auth_client_userdb_lookup_finished");
-		e_debug(e->event(), "Finished userdb lookup (username=%s %s)",
-			*username_r, t_strarray_join(*fields_r, " "));
+		str_truncate(ctx->str, 0);
+		str_printfa(ctx->str, "USER\t%u\t%s",
+			    conn->first_pipelined_id + ctx->next_idx, user);
+		auth_user_info_export(ctx->str, ctx->info);
+		str_append_c(ctx->str, '\n');
+		/* don't overflow the output buffer - the rest are sent once
+		   replies for the earlier requests start arriving */
+		if (ctx->pending > 0 &&
+		    o_stream_get_buffer_avail_size(output) < str_len(ctx->str))
+			break;
+		o_stream_nsend(output, str_data(ctx->str), str_len(ctx->str));
+
+		conn->request_counter = conn->first_pipelined_id + ctx->next_idx;
+		lookup->user = user;
+		ctx->next_idx++;
+		ctx->pending++;
+
+		auth_master_user_event_create(
+			conn, t_strdup_printf("userdb lookup(%s): ", user),
+			ctx->info);
+		event_add_str(conn->event, "user", user);
+		auth_master_user_lookup_started(conn);
+		auth_master_event_finish(conn);
 	}
-	auth_master_event_finish(conn);
+	o_stream_uncork(output);
+}
 
-	conn->reply_context = NULL;
-	return ctx.return_value;
+static bool
+auth_lookup_multi_reply_callback(const char *cmd, const char *const *args,
+				 void *context)
+{
+	struct auth_master_user_lookup_multi_ctx *ctx = context;
+	struct auth_master_connection *conn = ctx->conn;
+	struct auth_master_lookup_ctx *lookup;
+	unsigned int idx = conn->reply_id - conn->first_pipelined_id;
+
+	i_assert(idx < ctx->count);
+	lookup = &ctx->lookups[idx];
+	if (lookup->user == NULL || lookup->fields != NULL) {
+		e_error(conn->event, "BUG: Unexpected reply for request %u",
+			conn->reply_id);
+		auth_request_lookup_abort(conn);
+		return TRUE;
+	}
+	auth_lookup_reply_parse(lookup, cmd, args);
+	i_assert(ctx->pending > 0);
+	ctx->pending--;
+
+	timeout_reset(conn->to);
+	auth_master_user_lookup_multi_send(ctx);
+	if (ctx->pending == 0) {
+		io_loop_stop(conn->ioloop);
+		return TRUE;
+	}
+	return FALSE;
+}
+
+void auth_master_user_lookup_multi(struct auth_master_connection *conn,
+				   const char *const *users,
+				   const struct auth_user_info *info,
+				   pool_t pool,
+				   struct auth_master_user_lookup_result **results_r)
+{
+	struct auth_master_user_lookup_multi_ctx ctx;
+	struct auth_master_user_lookup_result *results;
+	unsigned int i;
+
+	i_zero(&ctx);
+	ctx.conn = conn;
+	ctx.users = users;
+	ctx.info = info;
+	ctx.count = str_array_length(users);
+	ctx.str = str_new(default_pool, 128);
+	ctx.lookups = i_new(struct auth_master_lookup_ctx, ctx.count);
+	for (i = 0; i < ctx.count; i++) {
+		ctx.lookups[i].conn = conn;
+		ctx.lookups[i].return_value = -1;
+		ctx.lookups[i].pool = pool;
+		ctx.lookups[i].expected_reply = "USER";
+	}
+
+	if (ctx.count > 0 && !is_valid_string(info->service)) {
+		/* non-allowed characters, none of the users can exist */
+		for (i = 0; i < ctx.count; i++)
+			ctx.lookups[i].return_value = 0;
+	} else if (ctx.count > 0) {
+		/* reserve a contiguous range of request IDs */
+		if (conn->request_counter >= UINT_MAX - ctx.count)
+			conn->request_counter = 0;
+		conn->first_pipelined_id = conn->request_counter + 1;
+		conn->reply_callback = auth_lookup_multi_reply_callback;
+		conn->reply_context = &ctx;
+
+		if (auth_master_run_cmd_pre(conn, "") == 0) {
+			auth_master_user_lookup_multi_send(&ctx);
+			if (ctx.pending > 0)
+				io_loop_run(conn->ioloop);
+			(void)auth_master_run_cmd_post(conn);
+		}
+		conn->first_pipelined_id = 0;
+		conn->reply_context = NULL;
+	}
+
+	results = p_new(pool, struct auth_master_user_lookup_result,
+			ctx.count);
+	for (i = 0; i < ctx.count; i++) {
+		results[i].user = p_strdup(pool, users[i]);
+		if (ctx.lookups[i].user == NULL) {
+			/* never sent */
+			results[i].ret = ctx.lookups[i].return_value;
+			results[i].fields = p_new(pool, const char *, 1);
+			continue;
+		}
+		auth_master_user_event_create(
+			conn, t_strdup_printf("userdb lookup(%s): ", users[i]),
+			info);
+		event_add_str(conn->event, "user", users[i]);
+		results[i].ret = auth_master_user_lookup_finish(
+			conn, &ctx.lookups[i], &results[i].username,
+			&results[i].fields);
+		auth_master_event_finish(conn);
+	}
+	str_free(&ctx.str);
+	i_free(ctx.lookups);
+	*results_r = results;
 }
 
 int auth_user_fields_parse(const char *const *fields, pool_t pool,
@@ -29,6 +29,14 @@ struct auth_user_reply {
 	bool anonymous:1;
 };
 
+struct auth_master_user_lookup_result {
+	const char *user;
+	/* Same as auth_master_user_lookup()'s return value */
+	int ret;
+	const char *username;
+	const char *const *fields;
+};
+
 struct auth_master_connection *
 auth_master_init(const char *auth_socket_path, enum auth_master_flags flags);
 void auth_master_deinit(struct auth_master_connection **conn);
@@ -47,6 +55,14 @@ int auth_master_user_lookup(struct auth_master_connection *conn,
 			    const char *user, const struct auth_user_info *info,
 			    pool_t pool, const char **username_r,
 			    const char *const **fields_r);
+/* Do USER lookups for all the given users. The requests are pipelined over
+   the connection, so the lookups run concurrently in the auth server. The
+   results are returned in the same order as users. */
+void auth_master_user_lookup_multi(struct auth_master_connection *conn,
+				   const char *const *users,
+				   const struct auth_user_info *info,
+				   pool_t pool,
+				   struct auth_master_user_lookup_result **results_r);
 /* Do a PASS lookup (the actual password isn't returned). */
 int auth_master_pass_lookup(struct auth_master_connection *conn,
 			    const char *user, const struct auth_user_info *info,
@@ -994,6 +994,154 @@ static void test_userdb_lookup(void)
 	test_end();
 }
 
+/*
+ * Userdb lookup multi
+ */
+
+/* server */
+
+#define USERDB_LOOKUP_MULTI_COUNT 3
+
+enum _userdb_lookup_multi_state {
+	USERDB_LOOKUP_MULTI_STATE_VERSION = 0,
+	USERDB_LOOKUP_MULTI_STATE_USER
+};
+
+struct _userdb_lookup_multi_server {
+	enum _userdb_lookup_multi_state state;
+	unsigned int ids[USERDB_LOOKUP_MULTI_COUNT];
+	const char *users[USERDB_LOOKUP_MULTI_COUNT];
+	unsigned int count;
+};
+
+static void test_userdb_lookup_multi_input(struct server_connection *conn)
+{
+	struct _userdb_lookup_multi_server *ctx =
+		(struct _userdb_lookup_multi_server *)conn->context;
+	const char *const *args;
+	unsigned int i, id;
+	const char *line;
+
+	for (;;) {
+		line = i_stream_read_next_line(conn->conn.input);
+		if (line == NULL) {
+			if (conn->conn.input->eof)
+				server_connection_deinit(&conn);
+			return;
+		}
+
+		switch (ctx->state) {
+		case USERDB_LOOKUP_MULTI_STATE_VERSION:
+			if (!str_begins_with(line, "VERSION\t")) {
+				i_error("Bad VERSION");
+				server_connection_deinit(&conn);
+				return;
+			}
+			ctx->state = USERDB_LOOKUP_MULTI_STATE_USER;
+			continue;
+		case USERDB_LOOKUP_MULTI_STATE_USER:
+			args = t_strsplit_tabescaped(line);
+			if (strcmp(args[0], "USER") != 0 || args[1] == NULL ||
+			    str_to_uint(args[1], &id) < 0 || args[2] == NULL) {
+				i_error("Bad USER request");
+				server_connection_deinit(&conn);
+				return;
+			}
+			ctx->ids[ctx->count] = id;
+			ctx->users[ctx->count] = p_strdup(conn->pool, args[2]);
+			if (++ctx->count < USERDB_LOOKUP_MULTI_COUNT)
+				continue;
+
+			/* all requests were pipelined - reply in reverse
+			   order */
+			for (i = ctx->count; i > 0; i--) {
+				if (strcmp(ctx->users[i-1], "nobody") == 0) {
+					line = t_strdup_printf("NOTFOUND\t%u\n",
+							       ctx->ids[i-1]);
+				} else {
+					line = t_strdup_printf(
+						"USER\t%u\t%s\thome=/home/%s\n",
+						ctx->ids[i-1], ctx->users[i-1],
+						ctx->users[i-1]);
+				}
+				o_stream_nsend_str(conn->conn.output, line);
+			}
+			server_connection_deinit(&conn);
+			return;
+		}
+		i_unreached();
+	}
+}
+
+static void test_userdb_lookup_multi_init(struct server_connection *conn)
+{
+	struct _userdb_lookup_multi_server *ctx;
+
+	ctx = p_new(conn->pool, struct _userdb_lookup_multi_server, 1);
+	conn->context = (void*)ctx;
+
+	o_stream_nsend_str(conn->conn.output, "VERSION\t1\t0\n");
+	o_stream_nsend_str(conn->conn.output, "SPID\t23234\n");
+}
+
+static void test_server_userdb_lookup_multi(void)
+{
+	test_server_init = test_userdb_lookup_multi_init;
+	test_server_input = test_userdb_lookup_multi_input;
+	test_server_run();
+}
+
+/* client */
+
+static bool test_client_userdb_lookup_multi(void)
+{
+	static const char *const users[] = {
+		"harrie", "nobody", "jan", NULL
+	};
+	struct auth_master_connection *auth_conn;
+	struct auth_master_user_lookup_result *results;
+	enum auth_master_flags flags = 0;
+	struct auth_user_info info;
+	pool_t pool;
+
+	i_zero(&info);
+	info.service = "test";
+	info.debug = debug;
+
+	if (debug)
+		flags |= AUTH_MASTER_FLAG_DEBUG;
+
+	pool = pool_alloconly_create("test", 1024);
+
+	auth_conn = auth_master_init(TEST_SOCKET, flags);
+	auth_master_set_timeout(auth_conn, 1000);
+	auth_master_user_lookup_multi(auth_conn, users, &info, pool, &results);
+	auth_master_deinit(&auth_conn);
+
+	test_out("harrie (ret > 0)", results[0].ret > 0);
+	test_out("harrie (fields)",
+		 null_strcmp(results[0].username, "harrie") == 0 &&
+		 null_strcmp(results[0].fields[0], "home=/home/harrie") == 0);
+	test_out("nobody (ret == 0)", results[1].ret == 0);
+	test_out("jan (ret > 0)", results[2].ret > 0);
+	test_out("jan (fields)",
+		 null_strcmp(results[2].username, "jan") == 0 &&
+		 null_strcmp(results[2].fields[0], "home=/home/jan") == 0);
+	pool_unref(&pool);
+
+	return FALSE;
+}
+
+/* test */
+
+static void test_userdb_lookup_multi(void)
+{
+	test_begin("userdb lookup multi");
+	test_run_client_server(test_client_userdb_lookup_multi,
+			       test_server_userdb_lookup_multi);
+	test_end();
+}
+
 /*
  * User list
  */
@@ -1113,6 +1261,7 @@ static void (*const test_functions[])(void) = {
 	test_user_list_fail,
 	test_passdb_lookup,
 	test_userdb_lookup,
+	test_userdb_lookup_multi,
 	test_user_list,
 	NULL
 };
@@ -0,0 +1,548 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "str.h"
+#include "strnum.h"
+#include "istream.h"
+#include "randgen.h"
+#include "stats-dist.h"
+#include "time-util.h"
+#include "imapc-client.h"
+
+#include <stdio.h>
+#include <unistd.h>
+
+/**
+ * Opens many concurrent IMAP sessions to a running server and has each of
+ * them run a random mix of SELECT, FETCH, SEARCH, STORE, APPEND and IDLE
+ * commands for the given time. The command mix is taken from a client
+ * profile and can be adjusted with -m. Each session runs one command at a
+ * time. The latency of each command type is reported at the end as
+ * percentiles and as a histogram.
+ */
+
+/* histogram bucket n contains latencies of 2^n .. 2^(n+1)-1 usecs */
+#define BENCH_HISTOGRAM_BUCKETS 24
+#define BENCH_FETCH_COUNT 10
+
+enum bench_cmd {
+	BENCH_CMD_SELECT,
+	BENCH_CMD_FETCH,
+	BENCH_CMD_SEARCH,
+	BENCH_CMD_STORE,
+	BENCH_CMD_APPEND,
+	BENCH_CMD_IDLE,
+
+	BENCH_CMD_COUNT
+};
+static const char *bench_cmd_names[BENCH_CMD_COUNT] = {
+	"select", "fetch", "search", "store", "append", "idle"
+};
+
+struct bench_profile {
+	const char *name;
+	unsigned int weights[BENCH_CMD_COUNT];
+};
+static const struct bench_profile bench_profiles[] = {
+	/*               select fetch search store append idle */
+	{ "desktop",   {      1,   10,     1,    4,     1,   2 } },
+	{ "mobile",    {      4,    6,     0,    2,     0,   4 } },
+	{ "webmail",   {      3,    8,     4,    3,     1,   0 } },
+	{ "delivery",  {      0,    0,     0,    0,     1,   0 } },
+};
+
+struct bench_cmd_stats {
+	struct stats_dist *latency;
+	unsigned int failures;
+	unsigned int histogram[BENCH_HISTOGRAM_BUCKETS];
+};
+
+struct bench_session {
+	unsigned int idx;
+	struct imapc_client *client;
+	struct imapc_client_mailbox *box;
+	struct timeout *to;
+
+	uint32_t exists;
+	enum bench_cmd cmd;
+	uint64_t cmd_start;
+
+	bool logged_in:1;
+	bool failed:1;
+};
+
+static struct imapc_client_settings bench_imapc_set = {
+	.dns_client_socket_path = "",
+	.temp_path_prefix = "/tmp/bench-imapc.",
+	.rawlog_dir = "",
+
+	.connect_timeout_msecs = 30000,
+	.connect_retry_count = 0,
+	.max_idle_time = IMAPC_DEFAULT_MAX_IDLE_TIME,
+};
+
+static unsigned int session_count = 10;
+static unsigned int user_count = 0;
+static unsigned int duration_secs = 10;
+static unsigned int think_msecs = 0;
+static unsigned int idle_msecs = 1000;
+static unsigned int append_size = 4096;
+static const char *mailbox = "INBOX";
+static const char *username;
+static unsigned int weights[BENCH_CMD_COUNT];
+static unsigned int weights_total;
+
+static struct bench_session *sessions;
+static struct bench_cmd_stats cmd_stats[BENCH_CMD_COUNT];
+static unsigned int sessions_failed;
+static buffer_t *append_msg;
+static bool stopping = FALSE;
+
+static void bench_session_next(struct bench_session *session);
+
+static void bench_stats_add(enum bench_cmd cmd, uint64_t usecs)
+{
+	struct bench_cmd_stats *stats = &cmd_stats[cmd];
+	unsigned int bucket = 0;
+
+	stats_dist_add(stats->latency, usecs);
+	while ((usecs >>= 1) > 0 && bucket < BENCH_HISTOGRAM_BUCKETS-1)
+		bucket++;
+	stats->histogram[bucket]++;
+}
+
+static void
+bench_session_fail(struct bench_session *session, const char *error)
+{
+	if (!session->failed) {
+		i_error("session %u: %s", session->idx, error);
+		session->failed = TRUE;
+		sessions_failed++;
+	}
+	timeout_remove(&session->to);
+}
+
+static void
+bench_cmd_callback(const struct imapc_command_reply *reply, void *context)
+{
+	struct bench_session *session = context;
+	uint64_t usecs = (i_nanoseconds() - session->cmd_start) / 1000;
+
+	if (reply->state == IMAPC_COMMAND_STATE_DISCONNECTED) {
+		if (!stopping)
+			bench_session_fail(session, reply->text_full);
+		return;
+	}
+	if (stopping)
+		return;
+
+	if (reply->state == IMAPC_COMMAND_STATE_OK)
+		bench_stats_add(session->cmd, usecs);
+	else {
+		cmd_stats[session->cmd].failures++;
+		if (session->cmd == BENCH_CMD_SELECT) {
+			bench_session_fail(session, t_strdup_printf(
+				"SELECT %s failed: %s", mailbox,
+				reply->text_full));
+			return;
+		}
+	}
+
+	if (think_msecs == 0)
+		bench_session_next(session);
+	else {
+		session->to = timeout_add(think_msecs,
+					  bench_session_next, session);
+	}
+}
+
+static struct imapc_command *
+bench_session_cmd(struct bench_session *session, enum bench_cmd cmd)
+{
+	session->cmd = cmd;
+	session->cmd_start = i_nanoseconds();
+	return imapc_client_mailbox_cmd(session->box, bench_cmd_callback,
+					session);
+}
+
+static void bench_session_select(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+
+	cmd = bench_session_cmd(session, BENCH_CMD_SELECT);
+	imapc_command_set_flags(cmd, IMAPC_COMMAND_FLAG_SELECT);
+	imapc_command_sendf(cmd, "SELECT %s", mailbox);
+}
+
+static void bench_session_append(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+	struct istream *input;
+
+	input = i_stream_create_from_buffer(append_msg);
+	cmd = bench_session_cmd(session, BENCH_CMD_APPEND);
+	imapc_command_sendf(cmd, "APPEND %s %p", mailbox, input);
+	i_stream_unref(&input);
+}
+
+static void bench_session_idle_end(struct bench_session *session)
+{
+	timeout_remove(&session->to);
+	bench_session_next(session);
+}
+
+static enum bench_cmd bench_cmd_choose(void)
+{
+	unsigned int i, n = i_rand_limit(weights_total);
+
+	for (i = 0; n >= weights[i]; i++)
+		n -= weights[i];
+	return i;
+}
+
+static void bench_session_next(struct bench_session *session)
+{
+	struct imapc_command *cmd;
+	enum bench_cmd bench_cmd;
+	uint32_t seq;
+
+	timeout_remove(&session->to);
+
+	bench_cmd = bench_cmd_choose();
+	if (session->exists == 0 &&
+	    (bench_cmd == BENCH_CMD_FETCH || bench_cmd == BENCH_CMD_STORE)) {
+		/* nothing to fetch or store - fill the mailbox */
+		bench_cmd = BENCH_CMD_APPEND;
+	}
+	seq = session->exists == 0 ? 0 : i_rand_minmax(1, session->exists);
+
+	switch (bench_cmd) {
+	case BENCH_CMD_SELECT:
+		bench_session_select(session);
+		break;
+	case BENCH_CMD_FETCH:
+		cmd = bench_session_cmd(session, bench_cmd);
+		imapc_command_sendf(cmd,
+			"FETCH %u:%u (UID FLAGS INTERNALDATE RFC822.SIZE "
+			"ENVELOPE BODYSTRUCTURE)", seq,
+			I_MIN(seq + BENCH_FETCH_COUNT - 1, session->exists));
+		break;
+	case BENCH_CMD_SEARCH:
+		cmd = bench_session_cmd(session, bench_cmd);
+		imapc_command_send(cmd, "SEARCH OR UNSEEN SUBJECT bench");
+		break;
+	case BENCH_CMD_STORE:
+		cmd = bench_session_cmd(session, bench_cmd);
+		imapc_command_sendf(cmd, "STORE %u %1sFLAGS (\\Seen)", seq,
+				    i_rand_limit(2) == 0 ? "+" : "-");
+		break;
+	case BENCH_CMD_APPEND:
+		bench_session_append(session);
+		break;
+	case BENCH_CMD_IDLE:
+		/* IDLE is ended by the next command, so there's no latency
+		   to measure. Just count it. */
+		stats_dist_add(cmd_stats[bench_cmd].latency, 0);
+		imapc_client_mailbox_idle(session->box);
+		session->to = timeout_add(idle_msecs,
+					  bench_session_idle_end, session);
+		break;
+	case BENCH_CMD_COUNT:
+		i_unreached();
+	}
+}
+
+static void
+bench_untagged_callback(const struct imapc_untagged_reply *reply,
+			void *context)
+{
+	struct bench_session *session = context;
+
+	if (strcasecmp(reply->name, "EXISTS") == 0)
+		session->exists = reply->num;
+	else if (strcasecmp(reply->name, "EXPUNGE") == 0 &&
+		 session->exists > 0)
+		session->exists--;
+}
+
+static void
+bench_login_callback(const struct imapc_command_reply *reply, void *context)
+{
+	struct bench_session *session = context;
+
+	if (reply->state != IMAPC_COMMAND_STATE_OK) {
+		bench_session_fail(session, t_strdup_printf(
+			"Login failed: %s", reply->text_full));
+		return;
+	}
+	session->logged_in = TRUE;
+	session->box = imapc_client_mailbox_open(session->client, session);
+	bench_session_select(session);
+}
+
+static void bench_session_init(struct bench_session *session, unsigned int idx)
+{
+	struct imapc_client_settings set = bench_imapc_set;
+
+	session->idx = idx;
+	if (user_count == 0)
+		set.username = username;
+	else {
+		set.username = t_strdup_printf("%s%u", username,
+					       idx % user_count + 1);
+	}
+	session->client = imapc_client_init(&set, NULL);
+	imapc_client_set_login_callback(session->client,
+					bench_login_callback, session);
+	imapc_client_register_untagged(session->client,
+				       bench_untagged_callback, session);
+	imapc_client_login(session->client);
+}
+
+static void bench_session_deinit(struct bench_session *session)
+{
+	timeout_remove(&session->to);
+	if (session->box != NULL)
+		imapc_client_mailbox_close(&session->box);
+	imapc_client_deinit(&session->client);
+}
+
+static void bench_append_msg_init(void)
+{
+	static const char *header =
+		"From: bench <bench@example.com>\r\n"
+		"To: bench <bench@example.com>\r\n"
+		"Subject: bench message\r\n"
+		"Date: Thu, 01 Jan 2015 00:00:00 +0000\r\n"
+		"Message-ID: <bench@example.com>\r\n"
+		"Content-Type: text/plain; charset=us-ascii\r\n"
+		"\r\n";
+	size_t line_len;
+
+	append_msg = buffer_create_dynamic(default_pool, append_size + 128);
+	buffer_append(append_msg, header, strlen(header));
+	while (append_msg->used < append_size) {
+		line_len = I_MIN(76, append_size - append_msg->used);
+		for (size_t i = 0; i < line_len; i++)
+			buffer_append_c(append_msg, 'a' + i_rand_limit(26));
+		buffer_append(append_msg, "\r\n", 2);
+	}
+}
+
+static void bench_print_results(unsigned int msecs)
+{
+	unsigned int i, j, total = 0;
+
+	printf("\n%-8s %8s %6s %9s %9s %9s %9s %9s %9s\n", "command",
+	       "count", "failed", "cmds/s", "avg ms", "p50 ms", "p90 ms",
+	       "p99 ms", "max ms");
+	for (i = 0; i < BENCH_CMD_COUNT; i++) {
+		struct stats_dist *latency = cmd_stats[i].latency;
+		unsigned int count = stats_dist_get_count(latency);
+
+		if (count == 0 && cmd_stats[i].failures == 0)
+			continue;
+		total += count;
+		printf("%-8s %8u %6u %9.1f", bench_cmd_names[i], count,
+		       cmd_stats[i].failures, count * 1000.0 / msecs);
+		if (i == BENCH_CMD_IDLE) {
+			printf("\n");
+			continue;
+		}
+		printf(" %9.3f %9.3f %9.3f %9.3f %9.3f\n",
+		       stats_dist_get_avg(latency) / 1000.0,
+		       stats_dist_get_median(latency) / 1000.0,
+		       stats_dist_get_percentile(latency, 0.9) / 1000.0,
+		       stats_dist_get_percentile(latency, 0.99) / 1000.0,
+		       stats_dist_get_max(latency) / 1000.0);
+	}
+	printf("%-8s %8u %6s %9.1f\n", "total", total, "",
+	       total * 1000.0 / msecs);
+
+	for (i = 0; i < BENCH_CMD_COUNT; i++) {
+		if (i == BENCH_CMD_IDLE ||
+		    stats_dist_get_count(cmd_stats[i].latency) == 0)
+			continue;
+		printf("\n%s latency:\n", bench_cmd_names[i]);
+		for (j = 0; j < BENCH_HISTOGRAM_BUCKETS; j++) {
+			if (cmd_stats[i].histogram[j] == 0)
+				continue;
+			printf("  %10.3f .. %10.3f ms: %u\n",
+			       j == 0 ? 0 : (1ULL << j) / 1000.0,
+			       ((1ULL << (j + 1)) - 1) / 1000.0,
+			       cmd_stats[i].histogram[j]);
+		}
+	}
+}
+
+static int bench_parse_mix(const char *mix)
+{
+	const char *const *args = t_strsplit(mix, ",");
+	const char *value;
+	unsigned int i;
+
+	for (; *args != NULL; args++) {
+		value = strchr(*args, '=');
+		if (value == NULL)
+			return -1;
+		for (i = 0; i < BENCH_CMD_COUNT; i++) {
+			if (strncasecmp(*args, bench_cmd_names[i],
+					value - *args) == 0 &&
+			    bench_cmd_names[i][value - *args] == '\0')
+				break;
+		}
+		if (i == BENCH_CMD_COUNT ||
+		    str_to_uint(value + 1, &weights[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+static int bench_set_profile(const char *name)
+{
+	for (unsigned int i = 0; i < N_ELEMENTS(bench_profiles); i++) {
+		if (strcmp(bench_profiles[i].name, name) == 0) {
+			memcpy(weights, bench_profiles[i].weights,
+			       sizeof(weights));
+			return 0;
+		}
+	}
+	return -1;
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr,
+		"Usage: %s [-c sessions] [-t secs] [-p profile] [-m mix]\n"
+		"       [-u user_count] [-w think_msecs] [-i idle_msecs]\n"
+		"       [-a append_size] [-b mailbox] host port user password\n"
+		"\n"
+		"Profiles: desktop (default), mobile, webmail, delivery\n"
+		"Mix overrides profile weights, e.g. -m fetch=5,idle=0\n"
+		"With -u, users are <user>1 .. <user><user_count>\n", prog);
+	lib_exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+	struct ioloop *ioloop;
+	struct timeout *to;
+	const char *mix = NULL;
+	in_port_t port;
+	uint64_t start;
+	unsigned int i, msecs;
+	int c;
+
+	lib_init();
+	if (bench_set_profile("desktop") < 0)
+		i_unreached();
+
+	while ((c = getopt(argc, argv, "a:b:c:i:m:p:t:u:w:")) > 0) {
+		switch (c) {
+		case 'a':
+			if (str_to_uint(optarg, &append_size) < 0)
+				print_usage(argv[0]);
+			break;
+		case 'b':
+			mailbox = optarg;
+			break;
+		case 'c':
+			if (str_to_uint(optarg, &session_count) < 0 ||
+			    session_count == 0)
+				print_usage(argv[0]);
+			break;
+		case 'i':
+			if (str_to_uint(optarg, &idle_msecs) < 0)
+				print_usage(argv[0]);
+			break;
+		case 'm':
+			mix = optarg;
+			break;
+		case 'p':
+			if (bench_set_profile(optarg) < 0) {
+				fprintf(stderr, "Unknown profile: %s\n", optarg);
+				print_usage(argv[0]);
+			}
+			break;
+		case 't':
+			if (str_to_uint(optarg, &duration_secs) < 0 ||
+			    duration_secs == 0)
+				print_usage(argv[0]);
+			break;
+		case 'u':
+			if (str_to_uint(optarg, &user_count) < 0)
+				print_usage(argv[0]);
+			break;
+		case 'w':
+			if (str_to_uint(optarg, &think_msecs) < 0)
+				print_usage(argv[0]);
+			break;
+		default:
+			print_usage(argv[0]);
+		}
+	}
+	if (argc - optind != 4)
+		print_usage(argv[0]);
+	if (mix != NULL && bench_parse_mix(mix) < 0) {
+		fprintf(stderr, "Invalid mix: %s\n", mix);
+		print_usage(argv[0]);
+	}
+	for (i = 0; i < BENCH_CMD_COUNT; i++)
+		weights_total += weights[i];
+	if (weights_total == 0) {
+		fprintf(stderr, "All command weights are 0\n");
+		print_usage(argv[0]);
+	}
+
+	bench_imapc_set.host = argv[optind];
+	if (net_str2port(argv[optind + 1], &port) < 0) {
+		fprintf(stderr, "Invalid port: %s\n", argv[optind + 1]);
+		print_usage(argv[0]);
+	}
+	bench_imapc_set.port = port;
+	username = argv[optind + 2];
+	bench_imapc_set.password = argv[optind + 3];
+
+	ioloop = io_loop_create();
+	for (i = 0; i < BENCH_CMD_COUNT; i++)
+		cmd_stats[i].latency = stats_dist_init_with_size(100000);
+	bench_append_msg_init();
+
+	printf("%u sessions for %u secs, command weights:", session_count,
+	       duration_secs);
+	for (i = 0; i < BENCH_CMD_COUNT; i++)
+		printf(" %s=%u", bench_cmd_names[i], weights[i]);
+	printf("\n");
+
+	start = i_nanoseconds();
+	sessions = i_new(struct bench_session, session_count);
+	for (i = 0; i < session_count; i++) T_BEGIN {
+		bench_session_init(&sessions[i], i + 1);
+	} T_END;
+
+	to = timeout_add(duration_secs * 1000, io_loop_stop, ioloop);
+	io_loop_run(ioloop);
+	timeout_remove(&to);
+	stopping = TRUE;
+	msecs = (i_nanoseconds() - start) / 1000000;
+
+	unsigned int logged_in = 0;
+	for (i = 0; i < session_count; i++) {
+		if (sessions[i].logged_in)
+			logged_in++;
+	}
+	printf("%u/%u sessions logged in, %u failed\n", logged_in,
+	       session_count, sessions_failed);
+	bench_print_results(msecs);
+
+	for (i = 0; i < session_count; i++)
+		bench_session_deinit(&sessions[i]);
+	i_free(sessions);
+	for (i = 0; i < BENCH_CMD_COUNT; i++)
+		stats_dist_deinit(&cmd_stats[i].latency);
+	buffer_free(&append_msg);
+	io_loop_destroy(&ioloop);
+	lib_deinit();
+	return 0;
+}
@@ -10,6 +10,7 @@
 #include "hostpid.h"
 #include "net.h"
 #include "istream.h"
+#include "istream-unix.h"
 #include "ostream.h"
 #include "write-full.h"
 #include "array.h"
@@ -78,6 +79,8 @@ struct imap_urlauth_connection {
 	struct imap_urlauth_target *targets_head, *targets_tail;
 
 	bool reading_literal:1;
+	/* literal_fd was passed by the service instead of the literal data */
+	bool literal_fd_passed:1;
 };
 
 #define IMAP_URLAUTH_RECONNECT_MIN_SECS 2
@@ -300,8 +303,12 @@ imap_urlauth_connection_send_request(struct imap_urlauth_connection *conn)
 		str_append(cmd, "\tbinary");
 	else if ((urlreq->flags & IMAP_URLAUTH_FETCH_FLAG_BODY) != 0)
 		str_append(cmd, "\tbody");
+	/* allow the service to pass the message file instead of copying
+	   the content through the socket */
+	str_append(cmd, "\tfd");
 	str_append_c(cmd, '\n');
 
+	i_stream_unix_set_read_fd(conn->conn.input);
 	conn->state = IMAP_URLAUTH_STATE_REQUEST_PENDING;
 	if (o_stream_send(conn->conn.output, str_data(cmd), str_len(cmd)) < 0) {
 		e_warning(conn->event,
@@ -679,7 +686,7 @@ imap_urlauth_connection_read_literal(struct imap_urlauth_connection *conn)
 	i_assert(conn->reading_literal);
 	i_assert(urlreq != NULL);
 
-	if (conn->literal_size > 0) {
+	if (conn->literal_size > 0 && !conn->literal_fd_passed) {
 		ret = imap_urlauth_connection_read_literal_data(conn);
 		if (ret <= 0)
 			return ret;
@@ -726,6 +733,7 @@ imap_urlauth_connection_read_literal(struct imap_urlauth_connection *conn)
 	conn->literal_fd = -1;
 	conn->literal_buf = NULL;
 	conn->reading_literal = FALSE;
+	conn->literal_fd_passed = FALSE;
 	return 1;
 }
 
@@ -752,6 +760,8 @@ static int imap_urlauth_input_pending(struct imap_urlauth_connection *conn)
 	struct imap_urlauth_request *urlreq;
 	const char *value, *response, *const *args, *bpstruct = NULL;
 	uoff_t literal_size;
+	bool fd_passed = FALSE;
+	int fd;
 
 	i_assert(conn->targets_head != NULL);
 	i_assert(conn->targets_head->requests_head != NULL);
@@ -768,6 +778,16 @@ static int imap_urlauth_input_pending(struct imap_urlauth_connection *conn)
 		return 0;
 	imap_urlauth_stop_response_timeout(conn);
 
+	/* the message fd arrives along with the response line */
+	fd = i_stream_unix_get_read_fd(conn->conn.input);
+	i_stream_unix_unset_read_fd(conn->conn.input);
+	if (fd != -1 && !str_begins_with(response, "OK\t")) {
+		i_close_fd(&fd);
+		e_error(conn->event, "Received unexpected fd with response: %s",
+			str_sanitize(response, 80));
+		return -1;
+	}
+
 	args = t_strsplit_tabescaped(response);
 	if (args[0] == NULL) {
 		e_error(conn->event, "Empty URL response: %s",
@@ -800,6 +820,8 @@ static int imap_urlauth_input_pending(struct imap_urlauth_connection *conn)
 
 		if (strcasecmp(param, "hasnuls") == 0) {
 			urlreq->binary_has_nuls = TRUE;
+		} else if (strcasecmp(param, "fd") == 0) {
+			fd_passed = TRUE;
 		} else if (str_begins_icase(param, "bpstruct=", &value) &&
 			   value[0] != '\0') {
 			bpstruct = value;
@@ -811,9 +833,29 @@ static int imap_urlauth_input_pending(struct imap_urlauth_connection *conn)
 		e_error(conn->event,
 			"Overflowing unsigned integer value for literal size: %s",
 			args[1]);
+		i_close_fd(&fd);
 		return -1;
 	}
 
+	if (fd_passed != (fd != -1)) {
+		e_error(conn->event, fd_passed ?
+			"Response is missing the passed fd" :
+			"Received unexpected fd with response");
+		i_close_fd(&fd);
+		return -1;
+	}
+	if (fd_passed) {
+		/* The literal is the whole passed file */
+		i_assert(conn->literal_fd == -1 && conn->literal_buf == NULL);
+		conn->literal_fd = fd;
+		conn->literal_size = literal_size;
+		conn->literal_bytes_left = 0;
+		conn->literal_fd_passed = TRUE;
+		conn->reading_literal = TRUE;
+		urlreq->bodypartstruct = i_strdup(bpstruct);
+		return imap_urlauth_connection_read_literal(conn);
+	}
+
 	/* Read literal */
 	if (imap_urlauth_connection_read_literal_init(conn, literal_size) < 0)
 		return -1;
@@ -19,15 +19,33 @@ struct imap_match_glob {
 
 	struct imap_match_pattern *patterns;
 
-	char sep;
-	char patterns_data[FLEXIBLE_ARRAY_MEMBER];
-};
-
-struct imap_match_context {
-	const char *inboxcase_end;
+	/* All the patterns are also compiled into a single automaton, which
+	   is run over the data once for all of them. Each state is an offset
+	   to patterns_data pointing to the next pattern character to match,
+	   and the set of active states is a bitmask of state_words words. */
+	unsigned int state_words;
+	bool have_inboxcase;
+	/* States with a literal matching the character */
+	uint64_t *char_masks; /* [256][state_words] */
+	/* Same, but including case-insensitive matches for inboxcase
+	   patterns */
+	uint64_t *char_masks_inboxcase; /* [256][state_words] */
+	uint64_t *star_mask, *percent_mask, *wildcard_mask;
+	uint64_t *start_mask;
+	/* States at the pattern's NUL, i.e. a full match */
+	uint64_t *accept_mask;
+	/* States at a '*' ending the pattern, which match anything */
+	uint64_t *star_end_mask;
+	/* Scratch space for running the automaton */
+	uint64_t *states, *next_states;
+	/* Literal prefix common to all the patterns and the single word
+	   state set after it has been matched. */
+	const char *prefix;
+	unsigned int prefix_len;
+	uint64_t prefix_states;
 
 	char sep;
-	bool inboxcase;
+	char patterns_data[FLEXIBLE_ARRAY_MEMBER];
 };
 
 /* name of "INBOX" - must not have repeated substrings */
@@ -108,6 +126,105 @@ static bool pattern_is_inboxcase(const char *pattern, char separator)
 	return TRUE;
 }
 
+#define STATE_BIT(masks, state) \
+	((masks)[(state) / 64] |= (uint64_t)1 << ((state) % 64))
+
+static void
+imap_match_compile_prefix(struct imap_match_glob *glob,
+			  const struct imap_match_pattern *patterns)
+{
+	const char *prefix = patterns[0].pattern;
+	unsigned int i, len;
+	uint64_t states;
+
+	len = strcspn(prefix, "*%");
+	for (i = 1; patterns[i].pattern != NULL && len > 0; i++) {
+		unsigned int j = 0;
+
+		while (j < len && patterns[i].pattern[j] == prefix[j])
+			j++;
+		len = j;
+	}
+
+	states = glob->start_mask[0];
+	for (i = 0; i < len; i++)
+		states = (states & glob->char_masks[(unsigned char)prefix[i]]) << 1;
+	states |= (states & glob->wildcard_mask[0]) << 1;
+
+	glob->prefix = prefix;
+	glob->prefix_len = len;
+	glob->prefix_states = states;
+}
+
+static void
+imap_match_compile(struct imap_match_glob *glob,
+		   const struct imap_match_pattern *patterns,
+		   size_t patterns_data_len)
+{
+	unsigned int i, words, state;
+	uint64_t *masks;
+	const char *p;
+	char chr;
+
+	words = patterns_data_len / 64 + 1;
+	masks = p_new(glob->pool, uint64_t, words * (256 * 2 + 8));
+	glob->state_words = words;
+	glob->char_masks = masks; masks += 256 * words;
+	glob->char_masks_inboxcase = masks; masks += 256 * words;
+	glob->star_mask = masks; masks += words;
+	glob->percent_mask = masks; masks += words;
+	glob->wildcard_mask = masks; masks += words;
+	glob->start_mask = masks; masks += words;
+	glob->accept_mask = masks; masks += words;
+	glob->star_end_mask = masks; masks += words;
+	glob->states = masks; masks += words;
+	glob->next_states = masks;
+
+	for (i = 0; patterns[i].pattern != NULL; i++) {
+		p = patterns[i].pattern;
+		state = p - glob->patterns_data;
+		STATE_BIT(glob->start_mask, state);
+		if (patterns[i].inboxcase)
+			glob->have_inboxcase = TRUE;
+		for (;; p++, state++) {
+			switch (*p) {
+			case '\0':
+				STATE_BIT(glob->accept_mask, state);
+				break;
+			case '*':
+				STATE_BIT(glob->star_mask, state);
+				STATE_BIT(glob->wildcard_mask, state);
+				if (p[1] == '\0')
+					STATE_BIT(glob->star_end_mask, state);
+				continue;
+			case '%':
+				STATE_BIT(glob->percent_mask, state);
+				STATE_BIT(glob->wildcard_mask, state);
+				continue;
+			default:
+				chr = *p;
+				STATE_BIT(&glob->char_masks[(unsigned char)chr * words],
+					  state);
+				STATE_BIT(&glob->char_masks_inboxcase[(unsigned char)chr * words],
+					  state);
+				if (patterns[i].inboxcase) {
+					chr = i_toupper(*p);
+					STATE_BIT(&glob->char_masks_inboxcase[(unsigned char)chr * words],
+						  state);
+					chr = i_tolower(*p);
+					STATE_BIT(&glob->char_masks_inboxcase[(unsigned char)chr * words],
+						  state);
+				}
+				continue;
+			}
+			break;
+		}
+	}
+
+	if (words == 1 && !glob->have_inboxcase)
+		imap_match_compile_prefix(glob, patterns);
+}
+
 static struct imap_match_glob *
 imap_match_init_multiple_real(pool_t pool, const char *const *patterns,
 			      bool inboxcase, char separator)
@@ -150,6 +267,8 @@ imap_match_init_multiple_real(pool_t pool, const char *const *patterns,
 		pos += len;
 	}
 	glob->patterns = match_patterns;
+
+	imap_match_compile(glob, match_patterns, patterns_data_len);
 	return glob;
 }
 
@@ -174,6 +293,7 @@ void imap_match_deinit(struct imap_match_glob **glob)
 {
 	if (glob == NULL || *glob == NULL)
 		return;
+	p_free((*glob)->pool, (*glob)->char_masks);
 	p_free((*glob)->pool, (*glob)->patterns);
 	p_free((*glob)->pool, *glob);
 	*glob = NULL;
@@ -230,153 +350,188 @@ bool imap_match_globs_equal(const struct imap_match_glob *glob1,
 	return p1->pattern == p2->pattern;
 }
 
-#define CMP_CUR_CHR(ctx, data, pattern) \
-	(*(data) == *(pattern) || \
-	 (i_toupper(*(data)) == i_toupper(*(pattern)) && \
-	 (data) < (ctx)->inboxcase_end))
-
-static enum imap_match_result
-match_sub(struct imap_match_context *ctx, const char **data_p,
-	  const char **pattern_p)
+static inline bool
+imap_match_states_any(const uint64_t *states, const uint64_t *mask,
+		      unsigned int words)
 {
-	enum imap_match_result ret, match;
-	unsigned int i;
-	const char *data = *data_p, *pattern = *pattern_p;
-
-	/* match all non-wildcards */
-	i = 0;
-	while (pattern[i] != '\0' && pattern[i] != '*' && pattern[i] != '%') {
-		if (!CMP_CUR_CHR(ctx, data+i, pattern+i)) {
-			if (data[i] != '\0')
-				return IMAP_MATCH_NO;
-			if (pattern[i] == ctx->sep)
-				return IMAP_MATCH_CHILDREN;
-			if (i > 0 && pattern[i-1] == ctx->sep) {
-				/* data="foo/" pattern = "foo/bar/%" */
-				return IMAP_MATCH_CHILDREN;
-			}
-			return IMAP_MATCH_NO;
-		}
-		i++;
-	}
-	data += i;
-	pattern += i;
-
-	if (*data == '\0' && *data_p != data && data[-1] == ctx->sep &&
-	    *pattern != '\0') {
-		/* data="/" pattern="/%..." */
-		match = IMAP_MATCH_CHILDREN;
-	} else {
-		match = IMAP_MATCH_NO;
+	for (unsigned int i = 0; i < words; i++) {
+		if ((states[i] & mask[i]) != 0)
+			return TRUE;
 	}
-	while (*pattern == '%') {
-		pattern++;
+	return FALSE;
+}
 
-		if (*pattern == '\0') {
-			/* match, if this is the last hierarchy */
-			while (*data != '\0' && *data != ctx->sep)
-				data++;
-			break;
-		}
+/* Wildcards may also match an empty string, so the state after them is
+   active as well. Compressed patterns never have two wildcards in a row. */
+static inline void
+imap_match_states_add_empty(const struct imap_match_glob *glob,
+			    uint64_t *states, unsigned int words)
+{
+	uint64_t carry = 0, wild;
 
-		/* skip over this hierarchy */
-		while (*data != '\0') {
-			if (CMP_CUR_CHR(ctx, data, pattern)) {
-				ret = match_sub(ctx, &data, &pattern);
-				if (ret == IMAP_MATCH_YES)
-					break;
+	for (unsigned int i = 0; i < words; i++) {
+		wild = states[i] & glob->wildcard_mask[i];
+		states[i] |= (wild << 1) | carry;
+		carry = wild >> 63;
+	}
+}
 
-				match |= ret;
-			}
+/* Move the active states over chr. Returns FALSE if no states remain. */
+static inline bool
+imap_match_states_step(struct imap_match_glob *glob, char chr, bool inboxcase,
+		       unsigned int words)
+{
+	const uint64_t *char_mask = inboxcase ?
+		&glob->char_masks_inboxcase[(unsigned char)chr * words] :
+		&glob->char_masks[(unsigned char)chr * words];
+	uint64_t *states = glob->states, carry = 0, lit, next, any = 0;
+	bool percent = chr != glob->sep;
+
+	for (unsigned int i = 0; i < words; i++) {
+		/* literals advance to the next state, wildcards stay */
+		lit = states[i] & char_mask[i];
+		next = (lit << 1) | carry;
+		carry = lit >> 63;
+		next |= states[i] & glob->star_mask[i];
+		if (percent)
+			next |= states[i] & glob->percent_mask[i];
+		glob->next_states[i] = next;
+		any |= next;
+	}
+	glob->states = glob->next_states;
+	glob->next_states = states;
+	if (any == 0)
+		return FALSE;
+	imap_match_states_add_empty(glob, glob->states, words);
+	return TRUE;
+}
 
-			if (*data == ctx->sep)
-				break;
+static inline enum imap_match_result
+imap_match_run(struct imap_match_glob *glob, const char *data,
+	       unsigned int words, bool *children_r)
+{
+	enum imap_match_result match = IMAP_MATCH_NO;
+	const char *p, *inboxcase_end = data;
 
-			data++;
-		}
+	if (glob->have_inboxcase && strncasecmp(data, inbox, INBOXLEN) == 0 &&
+	    (data[INBOXLEN] == '\0' || data[INBOXLEN] == glob->sep)) {
+		/* data begins with INBOX/, use case-insensitive comparison
+		   for it */
+		inboxcase_end += INBOXLEN;
 	}
 
-	if (*pattern != '*') {
-		if (*data == '\0' && *pattern != '\0') {
-			if (*pattern == ctx->sep)
-				match |= IMAP_MATCH_CHILDREN;
-			return match;
+	memcpy(glob->states, glob->start_mask, sizeof(uint64_t) * words);
+	imap_match_states_add_empty(glob, glob->states, words);
+	for (p = data; *p != '\0'; p++) {
+		if (imap_match_states_any(glob->states, glob->star_end_mask,
+					  words)) {
+			/* the rest of data and all its children match */
+			*children_r = TRUE;
+			return IMAP_MATCH_YES;
 		}
-
-		if (*data != '\0') {
-			if (*pattern == '\0' && *data == ctx->sep)
-				match |= IMAP_MATCH_PARENT;
+		if (*p == glob->sep &&
+		    imap_match_states_any(glob->states, glob->accept_mask,
+					  words)) {
+			/* data="foo/bar" pattern="foo" */
+			match = IMAP_MATCH_PARENT;
+		}
+		if (!imap_match_states_step(glob, *p, p < inboxcase_end,
+					    words)) {
+			/* none of the patterns can match this or its
+			   children */
+			*children_r = FALSE;
 			return match;
 		}
 	}
+	if (imap_match_states_any(glob->states, glob->accept_mask, words)) {
+		*children_r = imap_match_states_step(glob, glob->sep, FALSE,
+						     words);
+		return IMAP_MATCH_YES;
+	}
 
-	*data_p = data;
-	*pattern_p = pattern;
-	return IMAP_MATCH_YES;
+	if (p > data && p[-1] == glob->sep) {
+		/* data="foo/" pattern="foo/bar/%" */
+		match |= IMAP_MATCH_CHILDREN;
+	}
+	*children_r = imap_match_states_step(glob, glob->sep, FALSE, words);
+	if (*children_r)
+		match |= IMAP_MATCH_CHILDREN;
+	return match;
 }
 
+/* Same as imap_match_run(), but optimized for the common case of all the
+   states fitting into a single word. */
 static enum imap_match_result
-imap_match_pattern(struct imap_match_context *ctx,
-		   const char *data, const char *pattern)
+imap_match_run_word(const struct imap_match_glob *glob, const char *data,
+		    bool *children_r)
 {
-	enum imap_match_result ret, match;
-
-	ctx->inboxcase_end = data;
-	if (ctx->inboxcase && strncasecmp(data, inbox, INBOXLEN) == 0 &&
-	    (data[INBOXLEN] == '\0' || data[INBOXLEN] == ctx->sep)) {
-		/* data begins with INBOX/, use case-insensitive comparison
-		   for it */
-		ctx->inboxcase_end += INBOXLEN;
-	}
-
-	if (*pattern != '*') {
-		/* handle the pattern up to the first '*' */
-		ret = match_sub(ctx, &data, &pattern);
-		if (ret != IMAP_MATCH_YES || *pattern == '\0')
-			return ret;
+	enum imap_match_result match = IMAP_MATCH_NO;
+	const uint64_t *char_masks = glob->char_masks_inboxcase;
+	const char *p, *inboxcase_end = data;
+	const uint64_t wildcard = glob->wildcard_mask[0];
+	const uint64_t star = glob->star_mask[0];
+	const uint64_t percent = glob->percent_mask[0];
+	const uint64_t accept = glob->accept_mask[0];
+	const uint64_t star_end = glob->star_end_mask[0];
+	uint64_t states, next;
+
+	if (glob->have_inboxcase && strncasecmp(data, inbox, INBOXLEN) == 0 &&
+	    (data[INBOXLEN] == '\0' || data[INBOXLEN] == glob->sep))
+		inboxcase_end += INBOXLEN;
+
+	if (glob->prefix_len > 0 &&
+	    strncmp(data, glob->prefix, glob->prefix_len) == 0) {
+		/* skip over the common literal prefix */
+		p = data + glob->prefix_len;
+		states = glob->prefix_states;
+	} else {
+		p = data;
+		states = glob->start_mask[0];
+		states |= (states & wildcard) << 1;
 	}
-
-	match = IMAP_MATCH_CHILDREN;
-	while (*pattern == '*') {
-		pattern++;
-
-		if (*pattern == '\0')
+	for (; *p != '\0'; p++) {
+		if ((states & star_end) != 0) {
+			*children_r = TRUE;
 			return IMAP_MATCH_YES;
-
-		while (*data != '\0') {
-			if (CMP_CUR_CHR(ctx, data, pattern)) {
-				ret = match_sub(ctx, &data, &pattern);
-				if (ret == IMAP_MATCH_YES)
-					break;
-				match |= ret;
-			}
-
-			data++;
 		}
+		if (p == inboxcase_end)
+			char_masks = glob->char_masks;
+		next = (states & char_masks[(unsigned char)*p]) << 1;
+		next |= states & star;
+		if (*p != glob->sep)
+			next |= states & percent;
+		else if ((states & accept) != 0)
+			match = IMAP_MATCH_PARENT;
+		if (next == 0) {
+			*children_r = FALSE;
+			return match;
+		}
+		states = next | ((next & wildcard) << 1);
 	}
 
-	return *data == '\0' && *pattern == '\0' ?
-		IMAP_MATCH_YES : match;
+	next = (states & glob->char_masks[(unsigned char)glob->sep]) << 1;
+	next |= states & star;
+	*children_r = next != 0;
+	if ((states & accept) != 0)
+		return IMAP_MATCH_YES;
+	if ((p > data && p[-1] == glob->sep) || *children_r)
+		match |= IMAP_MATCH_CHILDREN;
+	return match;
+}
+
+enum imap_match_result
+imap_match_children(struct imap_match_glob *glob, const char *data,
+		    bool *children_r)
+{
+	if (glob->state_words == 1)
+		return imap_match_run_word(glob, data, children_r);
+	return imap_match_run(glob, data, glob->state_words, children_r);
 }
 
 enum imap_match_result
 imap_match(struct imap_match_glob *glob, const char *data)
 {
-	struct imap_match_context ctx;
-	unsigned int i;
-	enum imap_match_result ret, match;
-
-	match = IMAP_MATCH_NO;
-	ctx.sep = glob->sep;
-	for (i = 0; glob->patterns[i].pattern != NULL; i++) {
-		ctx.inboxcase = glob->patterns[i].inboxcase;
+	bool children;
 
-		ret = imap_match_pattern(&ctx, data, glob->patterns[i].pattern);
-		if (ret == IMAP_MATCH_YES)
-			return IMAP_MATCH_YES;
-
-		match |= ret;
-	}
-
-	return match;
+	return imap_match_children(glob, data, &children);
 }
@@ -38,5 +38,12 @@ bool imap_match_globs_equal(const struct imap_match_glob *glob1,
 
 enum imap_match_result
 imap_match(struct imap_match_glob *glob, const char *data);
+/* Same as imap_match(), but also return in children_r whether any of data's
+   children (data + separator + anything) could return IMAP_MATCH_YES. If not,
+   callers iterating a mailbox tree can skip the whole subtree, even when
+   data itself matched. */
+enum imap_match_result
+imap_match_children(struct imap_match_glob *glob, const char *data,
+		    bool *children_r);
 
 #endif
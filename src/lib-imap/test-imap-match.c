@@ -116,11 +116,78 @@ static void test_imap_match_globs_equal(void)
 	test_end();
 }
 
+static void test_imap_match_multiple(void)
+{
+	const char *patterns[] = { "INBOX", "Shared/%/%", "Archive/*", NULL };
+	const char *long_patterns[] = {
+		"this/is/a/rather/long/pattern/that/doesn't/fit/in/one/word/%",
+		"and/%/another/*/long/pattern/in/the/same/automaton/yes",
+		NULL
+	};
+	struct {
+		const char *input;
+		enum imap_match_result result;
+		bool children;
+	} test[] = {
+		{ "INBOX", IMAP_MATCH_YES, FALSE },
+		{ "inbox", IMAP_MATCH_YES, FALSE },
+		{ "INBOX/foo", IMAP_MATCH_PARENT, FALSE },
+		{ "Shared", IMAP_MATCH_CHILDREN, TRUE },
+		{ "Shared/user", IMAP_MATCH_CHILDREN, TRUE },
+		{ "Shared/user/", IMAP_MATCH_YES, FALSE },
+		{ "Shared/user/box", IMAP_MATCH_YES, FALSE },
+		{ "Shared/user/box/child", IMAP_MATCH_PARENT, FALSE },
+		{ "Archive", IMAP_MATCH_CHILDREN, TRUE },
+		{ "Archive/2024", IMAP_MATCH_YES, TRUE },
+		{ "Archive/2024/01", IMAP_MATCH_YES, TRUE },
+		{ "Other", IMAP_MATCH_NO, FALSE },
+	}, long_test[] = {
+		{ "this/is/a/rather/long/pattern/that/doesn't/fit/in/one/word",
+		  IMAP_MATCH_CHILDREN, TRUE },
+		{ "this/is/a/rather/long/pattern/that/doesn't/fit/in/one/word/x",
+		  IMAP_MATCH_YES, FALSE },
+		{ "this/is/a/rather/long/pattern/that/doesn't/fit/in/one/word/x/y",
+		  IMAP_MATCH_PARENT, FALSE },
+		{ "this/is/a/rather/long/pattern/that/doesn't/fit/in/one/wort",
+		  IMAP_MATCH_NO, FALSE },
+		{ "and/x/another/y/z/long/pattern/in/the/same/automaton/yes",
+		  IMAP_MATCH_YES, TRUE },
+		{ "and/x/another", IMAP_MATCH_CHILDREN, TRUE },
+		{ "and/x/y", IMAP_MATCH_NO, FALSE },
+	};
+	struct imap_match_glob *glob;
+	enum imap_match_result result;
+	unsigned int i;
+	bool children;
+	pool_t pool;
+
+	pool = pool_alloconly_create("imap match multiple", 1024);
+	test_begin("imap match multiple");
+	glob = imap_match_init_multiple(pool, patterns, TRUE, '/');
+	for (i = 0; i < N_ELEMENTS(test); i++) {
+		result = imap_match_children(glob, test[i].input, &children);
+		test_assert_idx(result == test[i].result, i);
+		test_assert_idx(children == test[i].children, i);
+		test_assert_idx(imap_match(glob, test[i].input) == result, i);
+	}
+
+	glob = imap_match_init_multiple(pool, long_patterns, FALSE, '/');
+	for (i = 0; i < N_ELEMENTS(long_test); i++) {
+		result = imap_match_children(glob, long_test[i].input,
+					     &children);
+		test_assert_idx(result == long_test[i].result, i);
+		test_assert_idx(children == long_test[i].children, i);
+	}
+	pool_unref(&pool);
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_imap_match,
 		test_imap_match_globs_equal,
+		test_imap_match_multiple,
 		NULL
 	};
 	return test_run(test_functions);
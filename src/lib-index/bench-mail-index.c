@@ -0,0 +1,426 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "buffer.h"
+#include "str.h"
+#include "strnum.h"
+#include "time-util.h"
+#include "unlink-directory.h"
+#include "mail-index-private.h"
+#include "mail-cache.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+/**
+ * Builds a synthetic index with the given number of messages, cache fields
+ * and keywords and measures how long the common index operations take on it:
+ * appending, opening, syncing, flag and keyword updates, cache additions and
+ * lookups, expunging and cache purging. fsyncs are disabled, so the results
+ * measure the index code and not the disk.
+ */
+
+#define BENCH_DIR ".bench-mail-index"
+#define BENCH_INDEX_PREFIX "dovecot.index"
+/* number of changes done in a single transaction */
+#define BENCH_BATCH_SIZE 10000
+#define BENCH_UID_VALIDITY 1234
+
+struct bench_ctx {
+	pool_t pool;
+	struct mail_index *index;
+	unsigned int message_count;
+	unsigned int field_count;
+	unsigned int keyword_count;
+
+	struct mail_cache_field *fields;
+	struct mail_keywords **keywords;
+
+	uint64_t ts_start;
+};
+
+static void bench_start(struct bench_ctx *ctx)
+{
+	ctx->ts_start = i_nanoseconds();
+}
+
+static void bench_end(struct bench_ctx *ctx, const char *name,
+		      unsigned int op_count)
+{
+	uint64_t diff = i_nanoseconds() - ctx->ts_start;
+	double msecs = (double)diff / 1000000.0;
+
+	if (op_count == 0)
+		printf("%-16s %12.3lf ms\n", name, msecs);
+	else {
+		printf("%-16s %12.3lf ms %14.0lf ops/s %10.3lf us/op\n",
+		       name, msecs, (double)op_count * 1000.0 / msecs,
+		       (double)diff / 1000.0 / op_count);
+	}
+	fflush(stdout);
+}
+
+static void bench_index_open(struct bench_ctx *ctx)
+{
+	ctx->index = mail_index_alloc(NULL, BENCH_DIR, BENCH_INDEX_PREFIX);
+	mail_index_set_fsync_mode(ctx->index, FSYNC_MODE_NEVER, 0);
+	if (mail_index_open_or_create(ctx->index,
+				      MAIL_INDEX_OPEN_FLAG_CREATE) < 0)
+		i_fatal("mail_index_open_or_create(%s) failed", BENCH_DIR);
+	mail_cache_register_fields(ctx->index->cache, ctx->fields,
+				   ctx->field_count,
+				   MAIL_CACHE_TRUNCATE_NAME_FAIL);
+}
+
+static void bench_index_close(struct bench_ctx *ctx)
+{
+	mail_index_close(ctx->index);
+	mail_index_free(&ctx->index);
+}
+
+static void
+bench_sync_begin(struct bench_ctx *ctx, struct mail_index_sync_ctx **sync_ctx_r,
+		 struct mail_index_view **view_r,
+		 struct mail_index_transaction **trans_r)
+{
+	if (mail_index_sync_begin(ctx->index, sync_ctx_r, view_r, trans_r,
+				  0) < 0)
+		i_fatal("mail_index_sync_begin() failed");
+}
+
+static void bench_sync_commit(struct mail_index_sync_ctx **sync_ctx)
+{
+	if (mail_index_sync_commit(sync_ctx) < 0)
+		i_fatal("mail_index_sync_commit() failed");
+}
+
+static void bench_transaction_commit(struct mail_index_transaction **trans)
+{
+	if (mail_index_transaction_commit(trans) < 0)
+		i_fatal("mail_index_transaction_commit() failed");
+}
+
+static void bench_append(struct bench_ctx *ctx)
+{
+	struct mail_index_sync_ctx *sync_ctx;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t uid_validity = BENCH_UID_VALIDITY;
+	uint32_t uid, seq;
+
+	bench_start(ctx);
+	for (uid = 1; uid <= ctx->message_count; ) {
+		bench_sync_begin(ctx, &sync_ctx, &view, &trans);
+		if (uid == 1) {
+			mail_index_update_header(trans,
+				offsetof(struct mail_index_header, uid_validity),
+				&uid_validity, sizeof(uid_validity), TRUE);
+		}
+		for (unsigned int i = 0; i < BENCH_BATCH_SIZE &&
+		     uid <= ctx->message_count; i++, uid++)
+			mail_index_append(trans, uid, &seq);
+		bench_sync_commit(&sync_ctx);
+	}
+	bench_end(ctx, "append", ctx->message_count);
+}
+
+static void bench_reopen(struct bench_ctx *ctx)
+{
+	bench_index_close(ctx);
+	bench_start(ctx);
+	bench_index_open(ctx);
+	bench_end(ctx, "open", 0);
+}
+
+static void bench_index_sync(struct bench_ctx *ctx, const char *name)
+{
+	struct mail_index_sync_ctx *sync_ctx;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_index_sync_rec sync_rec;
+	unsigned int count = 0;
+
+	bench_start(ctx);
+	bench_sync_begin(ctx, &sync_ctx, &view, &trans);
+	while (mail_index_sync_next(sync_ctx, &sync_rec))
+		count++;
+	bench_sync_commit(&sync_ctx);
+	bench_end(ctx, name, count);
+}
+
+static void bench_view_sync(struct bench_ctx *ctx, struct mail_index_view *view)
+{
+	struct mail_index_view_sync_ctx *sync_ctx;
+	struct mail_index_view_sync_rec sync_rec;
+	bool delayed_expunges;
+
+	bench_start(ctx);
+	sync_ctx = mail_index_view_sync_begin(view, 0);
+	while (mail_index_view_sync_next(sync_ctx, &sync_rec)) ;
+	if (mail_index_view_sync_commit(&sync_ctx, &delayed_expunges) < 0)
+		i_fatal("mail_index_view_sync_commit() failed");
+	bench_end(ctx, "view sync", 0);
+}
+
+static void bench_flags(struct bench_ctx *ctx)
+{
+	struct mail_index_view *view, *old_view;
+	struct mail_index_transaction *trans;
+	uint32_t seq, count;
+
+	old_view = mail_index_view_open(ctx->index);
+	view = mail_index_view_open(ctx->index);
+	count = mail_index_view_get_messages_count(view);
+
+	bench_start(ctx);
+	for (seq = 1; seq <= count; ) {
+		trans = mail_index_transaction_begin(view, 0);
+		for (unsigned int i = 0; i < BENCH_BATCH_SIZE && seq <= count;
+		     i++, seq++) {
+			mail_index_update_flags(trans, seq, MODIFY_ADD,
+				seq % 2 == 0 ? MAIL_SEEN : MAIL_FLAGGED);
+		}
+		bench_transaction_commit(&trans);
+	}
+	bench_end(ctx, "flag update", count);
+	mail_index_view_close(&view);
+
+	bench_view_sync(ctx, old_view);
+	mail_index_view_close(&old_view);
+	bench_index_sync(ctx, "index sync");
+}
+
+static void bench_keywords(struct bench_ctx *ctx)
+{
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t seq, count;
+
+	if (ctx->keyword_count == 0)
+		return;
+
+	ctx->keywords = p_new(ctx->pool, struct mail_keywords *,
+			      ctx->keyword_count);
+	for (unsigned int i = 0; i < ctx->keyword_count; i++) {
+		const char *names[] = { t_strdup_printf("keyword%u", i), NULL };
+
+		ctx->keywords[i] = mail_index_keywords_create(ctx->index, names);
+	}
+
+	view = mail_index_view_open(ctx->index);
+	count = mail_index_view_get_messages_count(view);
+
+	bench_start(ctx);
+	for (seq = 1; seq <= count; ) {
+		trans = mail_index_transaction_begin(view, 0);
+		for (unsigned int i = 0; i < BENCH_BATCH_SIZE && seq <= count;
+		     i++, seq++) {
+			mail_index_update_keywords(trans, seq, MODIFY_ADD,
+				ctx->keywords[seq % ctx->keyword_count]);
+		}
+		bench_transaction_commit(&trans);
+	}
+	bench_end(ctx, "keyword update", count);
+	mail_index_view_close(&view);
+
+	for (unsigned int i = 0; i < ctx->keyword_count; i++)
+		mail_index_keywords_unref(&ctx->keywords[i]);
+}
+
+static void bench_cache_add(struct bench_ctx *ctx)
+{
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	struct mail_cache_view *cache_view;
+	struct mail_cache_transaction_ctx *cache_trans;
+	string_t *value = t_str_new(64);
+	uint32_t seq, count;
+
+	if (ctx->field_count == 0)
+		return;
+
+	if (mail_index_refresh(ctx->index) < 0)
+		i_fatal("mail_index_refresh() failed");
+	view = mail_index_view_open(ctx->index);
+	cache_view = mail_cache_view_open(ctx->index->cache, view);
+	count = mail_index_view_get_messages_count(view);
+
+	bench_start(ctx);
+	for (seq = 1; seq <= count; ) {
+		trans = mail_index_transaction_begin(view, 0);
+		cache_trans = mail_cache_get_transaction(cache_view, trans);
+		for (unsigned int i = 0; i < BENCH_BATCH_SIZE && seq <= count;
+		     i++, seq++) {
+			for (unsigned int j = 0; j < ctx->field_count; j++) {
+				str_truncate(value, 0);
+				str_printfa(value, "value %u of message %u",
+					    j, seq);
+				mail_cache_add(cache_trans, seq,
+					       ctx->fields[j].idx,
+					       str_data(value), str_len(value));
+			}
+		}
+		bench_transaction_commit(&trans);
+	}
+	bench_end(ctx, "cache add", count * ctx->field_count);
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
+}
+
+static void bench_cache_lookup(struct bench_ctx *ctx, const char *name)
+{
+	struct mail_index_view *view;
+	struct mail_cache_view *cache_view;
+	buffer_t *buf = t_buffer_create(64);
+	uint32_t seq, count;
+	unsigned int found = 0;
+
+	if (ctx->field_count == 0)
+		return;
+
+	if (mail_index_refresh(ctx->index) < 0)
+		i_fatal("mail_index_refresh() failed");
+	view = mail_index_view_open(ctx->index);
+	cache_view = mail_cache_view_open(ctx->index->cache, view);
+	count = mail_index_view_get_messages_count(view);
+
+	bench_start(ctx);
+	for (seq = 1; seq <= count; seq++) {
+		for (unsigned int j = 0; j < ctx->field_count; j++) {
+			buffer_set_used_size(buf, 0);
+			if (mail_cache_lookup_field(cache_view, buf, seq,
+						    ctx->fields[j].idx) > 0)
+				found++;
+		}
+	}
+	bench_end(ctx, name, count * ctx->field_count);
+	if (found != count * ctx->field_count) {
+		printf("Warning: Found only %u/%u cached fields\n",
+		       found, count * ctx->field_count);
+	}
+	mail_cache_view_close(&cache_view);
+	mail_index_view_close(&view);
+}
+
+static void bench_expunge(struct bench_ctx *ctx)
+{
+	struct mail_index_sync_ctx *sync_ctx;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t seq, count;
+	unsigned int expunge_count = 0;
+
+	bench_start(ctx);
+	bench_sync_begin(ctx, &sync_ctx, &view, &trans);
+	count = mail_index_view_get_messages_count(view);
+	/* expunge every 10th message */
+	for (seq = 1; seq <= count; seq += 10) {
+		mail_index_expunge(trans, seq);
+		expunge_count++;
+	}
+	bench_sync_commit(&sync_ctx);
+	bench_end(ctx, "expunge", expunge_count);
+}
+
+static void bench_cache_purge(struct bench_ctx *ctx)
+{
+	if (ctx->field_count == 0)
+		return;
+
+	bench_start(ctx);
+	if (mail_cache_purge(ctx->index->cache, (uint32_t)-1, "benchmark") < 0)
+		i_fatal("mail_cache_purge() failed");
+	bench_end(ctx, "cache purge", 0);
+}
+
+static void bench_init(struct bench_ctx *ctx)
+{
+	const char *error;
+
+	ctx->pool = pool_alloconly_create("bench mail index", 1024);
+	ctx->fields = p_new(ctx->pool, struct mail_cache_field,
+			    I_MAX(ctx->field_count, 1));
+	for (unsigned int i = 0; i < ctx->field_count; i++) {
+		ctx->fields[i].name =
+			p_strdup_printf(ctx->pool, "bench-field-%u", i);
+		ctx->fields[i].type = MAIL_CACHE_FIELD_STRING;
+		ctx->fields[i].decision = MAIL_CACHE_DECISION_YES;
+	}
+
+	(void)unlink_directory(BENCH_DIR, UNLINK_DIRECTORY_FLAG_RMDIR, &error);
+	if (mkdir(BENCH_DIR, 0700) < 0)
+		i_fatal("mkdir(%s) failed: %m", BENCH_DIR);
+	bench_index_open(ctx);
+}
+
+static void bench_deinit(struct bench_ctx *ctx)
+{
+	const char *error;
+
+	bench_index_close(ctx);
+	pool_unref(&ctx->pool);
+
+	if (unlink_directory(BENCH_DIR, UNLINK_DIRECTORY_FLAG_RMDIR,
+			     &error) < 0)
+		i_error("unlink_directory(%s) failed: %s", BENCH_DIR, error);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s message_count [cache_fields [keywords]]\n",
+		prog);
+	fprintf(stderr, "Runs with 100000 messages, 5 cache fields and "
+		"10 keywords if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	struct bench_ctx ctx;
+	struct ioloop *ioloop;
+
+	lib_init();
+	i_zero(&ctx);
+	ctx.message_count = 100000;
+	ctx.field_count = 5;
+	ctx.keyword_count = 10;
+
+	if (argc > 4)
+		print_usage(argv[0]);
+	if ((argc > 1 && str_to_uint(argv[1], &ctx.message_count) < 0) ||
+	    (argc > 2 && str_to_uint(argv[2], &ctx.field_count) < 0) ||
+	    (argc > 3 && str_to_uint(argv[3], &ctx.keyword_count) < 0) ||
+	    ctx.message_count == 0) {
+		fprintf(stderr, "Invalid parameters\n");
+		print_usage(argv[0]);
+	}
+
+	/* cache decisions and purging use ioloop_time */
+	ioloop = io_loop_create();
+
+	printf("%u messages, %u cache fields, %u keywords\n\n",
+	       ctx.message_count, ctx.field_count, ctx.keyword_count);
+
+	T_BEGIN {
+		bench_init(&ctx);
+		bench_append(&ctx);
+		bench_reopen(&ctx);
+		bench_flags(&ctx);
+		bench_keywords(&ctx);
+		bench_index_sync(&ctx, "keyword sync");
+		bench_cache_add(&ctx);
+		bench_cache_lookup(&ctx, "cache lookup");
+		bench_reopen(&ctx);
+		bench_cache_lookup(&ctx, "cold lookup");
+		bench_expunge(&ctx);
+		bench_cache_purge(&ctx);
+		bench_cache_lookup(&ctx, "purged lookup");
+		bench_deinit(&ctx);
+	} T_END;
+
+	io_loop_destroy(&ioloop);
+	lib_deinit();
+	return 0;
+}
@@ -0,0 +1,334 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "read-full.h"
+#include "write-full.h"
+#include "mail-index-private.h"
+#include "mail-index-modseq.h"
+#include "mail-transaction-log-private.h"
+#include "mail-index-expunge-history.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+
+#define MAIL_INDEX_EXPUNGE_HISTORY_VERSION 2
+/* Merge the older half of the records when the history grows larger than
+   this. */
+#define MAIL_INDEX_EXPUNGE_HISTORY_MAX_RECORDS 1024
+
+struct mail_index_expunge_history_header {
+	uint8_t version;
+	uint8_t unused[3];
+	/* History is valid only while the mailbox's UIDVALIDITY stays the
+	   same */
+	uint32_t uid_validity;
+	/* The last transaction log file whose expunges were added */
+	uint32_t last_file_seq;
+	uint32_t unused2;
+	/* All expunges with modseq > start_modseq are in the history */
+	uint64_t start_modseq;
+	/* Records with modseq <= merged_modseq have been merged together.
+	   They may contain UIDs that were expunged earlier than their
+	   modseq. */
+	uint64_t merged_modseq;
+};
+
+struct mail_index_expunge_history_record {
+	uint64_t modseq;
+	uint32_t uid1, uid2;
+};
+ARRAY_DEFINE_TYPE(expunge_history_record,
+		  struct mail_index_expunge_history_record);
+
+static const char *mail_index_expunge_history_path(struct mail_index *index)
+{
+	return t_strconcat(index->filepath,
+			   MAIL_INDEX_EXPUNGE_HISTORY_SUFFIX, NULL);
+}
+
+static int
+mail_index_expunge_history_read(struct mail_index *index,
+				struct mail_index_expunge_history_header *hdr_r,
+				ARRAY_TYPE(expunge_history_record) *records)
+{
+	const char *path = mail_index_expunge_history_path(index);
+	struct mail_index_expunge_history_record *recs;
+	struct stat st;
+	unsigned int count;
+	int fd, ret;
+
+	i_zero(hdr_r);
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno == ENOENT)
+			return 0;
+		mail_index_file_set_syscall_error(index, path, "open()");
+		return -1;
+	}
+	if (fstat(fd, &st) < 0) {
+		mail_index_file_set_syscall_error(index, path, "fstat()");
+		i_close_fd(&fd);
+		return -1;
+	}
+	if (st.st_size < (off_t)sizeof(*hdr_r) ||
+	    (st.st_size - sizeof(*hdr_r)) % sizeof(*recs) != 0) {
+		i_close_fd(&fd);
+		return 0;
+	}
+	count = (st.st_size - sizeof(*hdr_r)) / sizeof(*recs);
+
+	ret = read_full(fd, hdr_r, sizeof(*hdr_r));
+	if (ret > 0 && count > 0) {
+		recs = i_new(struct mail_index_expunge_history_record, count);
+		ret = read_full(fd, recs, count * sizeof(*recs));
+		if (ret > 0)
+			array_append(records, recs, count);
+		i_free(recs);
+	}
+	if (ret < 0)
+		mail_index_file_set_syscall_error(index, path, "read()");
+	i_close_fd(&fd);
+	if (ret <= 0) {
+		/* truncated by another process - just ignore */
+		i_zero(hdr_r);
+		array_clear(records);
+		return ret < 0 ? -1 : 0;
+	}
+	if (hdr_r->version != MAIL_INDEX_EXPUNGE_HISTORY_VERSION ||
+	    hdr_r->uid_validity != index->map->hdr.uid_validity) {
+		i_zero(hdr_r);
+		array_clear(records);
+		return 0;
+	}
+	return 1;
+}
+
+static int
+mail_index_expunge_history_write(struct mail_index *index,
+				 const struct mail_index_expunge_history_header *hdr,
+				 const ARRAY_TYPE(expunge_history_record) *records)
+{
+	const char *path = mail_index_expunge_history_path(index);
+	const char *temp_path;
+	int fd, ret = 0;
+
+	fd = mail_index_create_tmp_file(index, path, &temp_path);
+	if (fd == -1)
+		return -1;
+
+	if (write_full(fd, hdr, sizeof(*hdr)) < 0 ||
+	    write_full(fd, array_front(records),
+		       array_count(records) * sizeof(*array_front(records))) < 0) {
+		mail_index_file_set_syscall_error(index, temp_path, "write()");
+		ret = -1;
+	}
+	if (close(fd) < 0) {
+		mail_index_file_set_syscall_error(index, temp_path, "close()");
+		ret = -1;
+	}
+	if (ret == 0 && rename(temp_path, path) < 0) {
+		mail_index_set_error(index, "rename(%s, %s) failed: %m",
+				     temp_path, path);
+		ret = -1;
+	}
+	if (ret < 0)
+		i_unlink(temp_path);
+	return ret;
+}
+
+static void
+expunge_history_add(ARRAY_TYPE(expunge_history_record) *records,
+		    uint64_t modseq, uint32_t uid1, uint32_t uid2)
+{
+	struct mail_index_expunge_history_record *rec;
+
+	if (array_count(records) > 0) {
+		rec = array_back_modifiable(records);
+		if (rec->modseq == modseq && rec->uid2 + 1 == uid1) {
+			rec->uid2 = uid2;
+			return;
+		}
+	}
+	rec = array_append_space(records);
+	rec->modseq = modseq;
+	rec->uid1 = uid1;
+	rec->uid2 = uid2;
+}
+
+static int
+expunge_history_add_file(struct mail_index *index,
+			 struct mail_transaction_log_file *file,
+			 ARRAY_TYPE(expunge_history_record) *records)
+{
+	struct mail_transaction_log_view *log_view;
+	const struct mail_transaction_header *thdr;
+	const struct mail_transaction_expunge *exp, *exp_end;
+	const struct mail_transaction_expunge_guid *exp_guid, *exp_guid_end;
+	const void *tdata;
+	const char *reason;
+	uint64_t modseq;
+	bool reset;
+	int ret;
+
+	log_view = mail_transaction_log_view_open(index->log);
+	ret = mail_transaction_log_view_set(log_view, file->hdr.file_seq, 0,
+					    file->hdr.file_seq,
+					    file->sync_offset, &reset, &reason);
+	if (ret <= 0) {
+		mail_transaction_log_view_close(&log_view);
+		return -1;
+	}
+	while ((ret = mail_transaction_log_view_next(log_view, &thdr,
+						     &tdata)) > 0) {
+		if ((thdr->type & MAIL_TRANSACTION_EXTERNAL) == 0)
+			continue;
+		modseq = mail_transaction_log_view_get_prev_modseq(log_view);
+		switch (thdr->type & MAIL_TRANSACTION_TYPE_MASK) {
+		case MAIL_TRANSACTION_EXPUNGE:
+			exp = tdata;
+			exp_end = exp + thdr->size / sizeof(*exp);
+			for (; exp != exp_end; exp++) {
+				expunge_history_add(records, modseq,
+						    exp->uid1, exp->uid2);
+			}
+			break;
+		case MAIL_TRANSACTION_EXPUNGE_GUID:
+			exp_guid = tdata;
+			exp_guid_end = exp_guid + thdr->size / sizeof(*exp_guid);
+			for (; exp_guid != exp_guid_end; exp_guid++) {
+				expunge_history_add(records, modseq,
+						    exp_guid->uid,
+						    exp_guid->uid);
+			}
+			break;
+		}
+	}
+	mail_transaction_log_view_close(&log_view);
+	return ret < 0 ? -1 : 0;
+}
+
+static void
+expunge_history_compress(struct mail_index_expunge_history_header *hdr,
+			 ARRAY_TYPE(expunge_history_record) *records)
+{
+	ARRAY_TYPE(expunge_history_record) new_records;
+	ARRAY_TYPE(seq_range) uids;
+	const struct mail_index_expunge_history_record *recs;
+	const struct seq_range *range;
+	unsigned int i, count, merge_count;
+	uint64_t modseq = 0;
+
+	recs = array_get(records, &count);
+	if (count <= MAIL_INDEX_EXPUNGE_HISTORY_MAX_RECORDS)
+		return;
+
+	/* Merge the older half of the records into UID ranges that all use
+	   the highest modseq among them. Expunged UIDs never come back, so
+	   the ranges can also be merged over the gaps - the lookups drop the
+	   UIDs that still exist. */
+	merge_count = count / 2;
+	t_array_init(&uids, merge_count);
+	for (i = 0; i < merge_count; i++) {
+		seq_range_array_add_range(&uids, recs[i].uid1, recs[i].uid2);
+		modseq = I_MAX(modseq, recs[i].modseq);
+	}
+	if (array_count(&uids) > MAIL_INDEX_EXPUNGE_HISTORY_MAX_RECORDS / 4) {
+		const struct seq_range *first = array_front(&uids);
+		const struct seq_range *last = array_back(&uids);
+		uint32_t uid1 = first->seq1, uid2 = last->seq2;
+
+		array_clear(&uids);
+		seq_range_array_add_range(&uids, uid1, uid2);
+	}
+
+	t_array_init(&new_records, count - merge_count + array_count(&uids));
+	array_foreach(&uids, range)
+		expunge_history_add(&new_records, modseq,
+				    range->seq1, range->seq2);
+	array_append(&new_records, recs + merge_count, count - merge_count);
+
+	array_clear(records);
+	array_append_array(records, &new_records);
+	hdr->merged_modseq = I_MAX(hdr->merged_modseq, modseq);
+}
+
+void mail_index_expunge_history_update(struct mail_index *index)
+{
+	struct mail_transaction_log_file *file = index->log->head;
+	struct mail_index_expunge_history_header hdr;
+	ARRAY_TYPE(expunge_history_record) records;
+
+	if (MAIL_INDEX_IS_IN_MEMORY(index) || index->readonly ||
+	    !mail_index_have_modseq_tracking(index) ||
+	    index->map->hdr.uid_validity == 0)
+		return;
+
+	T_BEGIN {
+		t_array_init(&records, 128);
+		if (mail_index_expunge_history_read(index, &hdr,
+						    &records) < 0) {
+			/* error already logged */
+		} else if (hdr.last_file_seq >= file->hdr.file_seq) {
+			/* already added - previous rotation failed? */
+		} else {
+			if (hdr.last_file_seq == 0 ||
+			    hdr.last_file_seq + 1 != file->hdr.file_seq) {
+				/* (re)start the history from this file */
+				array_clear(&records);
+				i_zero(&hdr);
+				hdr.version = MAIL_INDEX_EXPUNGE_HISTORY_VERSION;
+				hdr.uid_validity =
+					index->map->hdr.uid_validity;
+				hdr.start_modseq = file->hdr.initial_modseq;
+			}
+			hdr.last_file_seq = file->hdr.file_seq;
+			if (file->hdr.initial_modseq == 0 &&
+			    file->hdr.file_seq != 1) {
+				/* old log format - we can't know where the
+				   history starts */
+			} else if (expunge_history_add_file(index, file,
+							    &records) == 0) {
+				expunge_history_compress(&hdr, &records);
+				(void)mail_index_expunge_history_write(index,
+							&hdr, &records);
+			}
+		}
+	} T_END;
+}
+
+int mail_index_expunge_history_lookup(struct mail_index *index,
+				      uint64_t prev_modseq,
+				      ARRAY_TYPE(seq_range) *expunged_uids,
+				      uint32_t *last_file_seq_r)
+{
+	struct mail_index_expunge_history_header hdr;
+	ARRAY_TYPE(expunge_history_record) records;
+	const struct mail_index_expunge_history_record *rec;
+	int ret;
+
+	*last_file_seq_r = 0;
+	if (MAIL_INDEX_IS_IN_MEMORY(index))
+		return 0;
+
+	i_array_init(&records, 128);
+	ret = mail_index_expunge_history_read(index, &hdr, &records);
+	if (ret > 0 && prev_modseq >= hdr.start_modseq) {
+		array_foreach(&records, rec) {
+			if (rec->modseq > prev_modseq) {
+				seq_range_array_add_range(expunged_uids,
+							  rec->uid1, rec->uid2);
+			}
+		}
+		*last_file_seq_r = hdr.last_file_seq;
+		if (prev_modseq < hdr.merged_modseq) {
+			/* the merged records may contain UIDs that were
+			   expunged before prev_modseq */
+			ret = 0;
+		}
+	} else if (ret > 0) {
+		ret = 0;
+	}
+	array_free(&records);
+	return ret;
+}
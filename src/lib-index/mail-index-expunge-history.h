@@ -0,0 +1,33 @@
+#ifndef MAIL_INDEX_EXPUNGE_HISTORY_H
+#define MAIL_INDEX_EXPUNGE_HISTORY_H
+
+#include "seq-range-array.h"
+
+#define MAIL_INDEX_EXPUNGE_HISTORY_SUFFIX ".expunges"
+
+struct mail_index;
+
+/* The expunge history keeps the external expunges from rotated transaction
+   log files in dovecot.index.expunges as (modseq, UID range) records. This
+   allows answering QRESYNC / VANISHED (EARLIER) queries for modseqs older
+   than the oldest transaction log. The oldest records get merged together
+   when the history grows too large, so lookups may return UIDs that still
+   exist. Lookups reaching the merged records may also return UIDs that
+   were expunged earlier than asked. */
+
+/* Add the expunges in the current head transaction log file to the history.
+   Called while the index is locked, just before the log is rotated. */
+void mail_index_expunge_history_update(struct mail_index *index);
+
+/* Add all UIDs that were expunged after prev_modseq to expunged_uids.
+   last_file_seq_r is set to the last transaction log file that was added to
+   the history. Returns 1 if the history covers prev_modseq exactly, 0 if not
+   and -1 on error. If prev_modseq falls within the merged records, 0 is
+   returned but expunged_uids and last_file_seq_r are still set. The UIDs
+   are then a superset of the ones expunged after prev_modseq. */
+int mail_index_expunge_history_lookup(struct mail_index *index,
+				      uint64_t prev_modseq,
+				      ARRAY_TYPE(seq_range) *expunged_uids,
+				      uint32_t *last_file_seq_r);
+
+#endif
@@ -9,6 +9,9 @@
 
 ARRAY_DEFINE_TYPE(modseqs, uint64_t);
 
+/* Number of records summarized by one block's highest modseq */
+#define MODSEQ_BLOCK_RECORD_COUNT 128
+
 enum modseq_metadata_idx {
 	/* must be in the same order as enum mail_flags */
 	METADATA_MODSEQ_IDX_ANSWERED = 0,
@@ -27,6 +30,13 @@ struct metadata_modseqs {
 struct mail_index_map_modseq {
 	/* indexes use enum modseq_metadata_idx */
 	ARRAY(struct metadata_modseqs) metadata_modseqs;
+
+	/* Highest modseq within each full block of MODSEQ_BLOCK_RECORD_COUNT
+	   records. Only the first valid_block_count blocks are up to date.
+	   Modseq updates raise the block's value, while expunges invalidate
+	   all the blocks after them. */
+	ARRAY_TYPE(modseqs) block_modseqs;
+	unsigned int valid_block_count;
 };
 
 struct mail_index_modseq_sync {
@@ -196,6 +206,106 @@ uint64_t mail_index_modseq_lookup(struct mail_index_view *view, uint32_t seq)
 	return *modseqp;
 }
 
+static void
+modseq_block_update(struct mail_index_map_modseq *mmap, uint32_t seq,
+		    uint64_t modseq)
+{
+	unsigned int idx = (seq - 1) / MODSEQ_BLOCK_RECORD_COUNT;
+	uint64_t *block_modseq;
+
+	if (idx < mmap->valid_block_count) {
+		block_modseq = array_idx_modifiable(&mmap->block_modseqs, idx);
+		if (*block_modseq < modseq)
+			*block_modseq = modseq;
+	}
+}
+
+static void
+modseq_blocks_build(struct mail_index_map *map,
+		    struct mail_index_map_modseq *mmap,
+		    const struct mail_index_ext *ext)
+{
+	const struct mail_index_record *rec;
+	const uint64_t *modseqp;
+	unsigned int idx, block_count;
+	uint64_t highest;
+	uint32_t seq, end_seq;
+
+	block_count = map->rec_map->records_count / MODSEQ_BLOCK_RECORD_COUNT;
+	if (!array_is_created(&mmap->block_modseqs))
+		i_array_init(&mmap->block_modseqs, block_count + 16);
+	for (idx = mmap->valid_block_count; idx < block_count; idx++) {
+		seq = idx * MODSEQ_BLOCK_RECORD_COUNT + 1;
+		end_seq = seq + MODSEQ_BLOCK_RECORD_COUNT;
+		highest = 0;
+		for (; seq < end_seq; seq++) {
+			rec = MAIL_INDEX_REC_AT_SEQ(map, seq);
+			modseqp = CONST_PTR_OFFSET(rec, ext->record_offset);
+			if (*modseqp == 0) {
+				/* looked up as the current highest modseq */
+				highest = (uint64_t)-1;
+				break;
+			}
+			if (highest < *modseqp)
+				highest = *modseqp;
+		}
+		array_idx_set(&mmap->block_modseqs, idx, &highest);
+	}
+	mmap->valid_block_count = block_count;
+}
+
+uint32_t mail_index_modseq_find_next(struct mail_index_view *view,
+				     uint32_t seq, uint32_t last_seq,
+				     uint64_t min_modseq)
+{
+	struct mail_index_map_modseq *mmap = mail_index_map_modseq(view);
+	struct mail_index_map *map = view->map;
+	const struct mail_index_ext *ext;
+	const struct mail_index_record *rec;
+	const uint64_t *block_modseqs, *modseqp;
+	unsigned int idx, block_count;
+	uint32_t ext_map_idx, end_seq;
+
+	/* the lookups return the latest records from the head map, so the
+	   summaries can be used only when the view is up to date */
+	if (mmap == NULL || map != view->index->map ||
+	    !mail_index_map_get_ext_idx(map, view->index->modseq_ext_id,
+					&ext_map_idx))
+		return seq;
+	ext = array_idx(&map->extensions, ext_map_idx);
+
+	modseq_blocks_build(map, mmap, ext);
+	block_modseqs = array_get(&mmap->block_modseqs, &block_count);
+	i_assert(block_count >= mmap->valid_block_count);
+
+	end_seq = I_MIN(last_seq, map->rec_map->records_count);
+	while (seq <= end_seq) {
+		idx = (seq - 1) / MODSEQ_BLOCK_RECORD_COUNT;
+		if (idx < mmap->valid_block_count &&
+		    block_modseqs[idx] < min_modseq) {
+			/* nothing changed within this block */
+			seq = (idx + 1) * MODSEQ_BLOCK_RECORD_COUNT + 1;
+			continue;
+		}
+		rec = MAIL_INDEX_REC_AT_SEQ(map, seq);
+		modseqp = CONST_PTR_OFFSET(rec, ext->record_offset);
+		if (*modseqp == 0 || *modseqp >= min_modseq)
+			return seq;
+		seq++;
+	}
+	return I_MIN(seq, last_seq + 1);
+}
+
+void mail_index_map_modseq_invalidate(struct mail_index_map *map,
+				      uint32_t seq)
+{
+	struct mail_index_map_modseq *mmap = map->rec_map->modseq;
+	unsigned int idx = (seq - 1) / MODSEQ_BLOCK_RECORD_COUNT;
+
+	if (mmap != NULL && mmap->valid_block_count > idx)
+		mmap->valid_block_count = idx;
+}
+
 int mail_index_modseq_set(struct mail_index_view *view,
 			  uint32_t seq, uint64_t min_modseq)
 {
@@ -219,6 +329,7 @@ int mail_index_modseq_set(struct mail_index_view *view,
 		return 0;
 	else {
 		*modseqp = min_modseq;
+		modseq_block_update(mmap, seq, min_modseq);
 		return 1;
 	}
 }
@@ -297,6 +408,7 @@ mail_index_modseq_update(struct mail_index_modseq_sync *ctx,
 			 uint64_t modseq, bool nonzeros,
 			 uint32_t seq1, uint32_t seq2)
 {
+	struct mail_index_map_modseq *mmap;
 	const struct mail_index_ext *ext;
 	struct mail_index_record *rec;
 	uint32_t ext_map_idx;
@@ -308,11 +420,15 @@ mail_index_modseq_update(struct mail_index_modseq_sync *ctx,
 		return;
 
 	ext = array_idx(&ctx->view->map->extensions, ext_map_idx);
+	mmap = ctx->view->map->rec_map->modseq;
 	for (; seq1 <= seq2; seq1++) {
 		rec = MAIL_INDEX_REC_AT_SEQ(ctx->view->map, seq1);
 		modseqp = PTR_OFFSET(rec, ext->record_offset);
-		if (*modseqp == 0 || (nonzeros && *modseqp < modseq))
+		if (*modseqp == 0 || (nonzeros && *modseqp < modseq)) {
 			*modseqp = modseq;
+			if (mmap != NULL)
+				modseq_block_update(mmap, seq1, modseq);
+		}
 	}
 }
 
@@ -561,6 +677,7 @@ void mail_index_modseq_expunge(struct mail_index_modseq_sync *ctx,
 {
 	struct metadata_modseqs *metadata;
 
+	mail_index_map_modseq_invalidate(ctx->view->map, seq1);
 	if (ctx->mmap == NULL)
 		return;
 
@@ -665,6 +782,13 @@ mail_index_map_modseq_clone(const struct mail_index_map_modseq *mmap)
 					   &src_metadata[i].modseqs);
 		}
 	}
+	if (array_is_created(&mmap->block_modseqs)) {
+		i_array_init(&new_mmap->block_modseqs,
+			     array_count(&mmap->block_modseqs));
+		array_append_array(&new_mmap->block_modseqs,
+				   &mmap->block_modseqs);
+		new_mmap->valid_block_count = mmap->valid_block_count;
+	}
 	return new_mmap;
 }
 
@@ -680,6 +804,7 @@ void mail_index_map_modseq_free(struct mail_index_map_modseq **_mmap)
 			array_free(&metadata->modseqs);
 	}
 	array_free(&mmap->metadata_modseqs);
+	array_free(&mmap->block_modseqs);
 	i_free(mmap);
 }
 
@@ -36,6 +36,15 @@ uint64_t mail_index_modseq_lookup_keywords(struct mail_index_view *view,
 					   uint32_t seq);
 int mail_index_modseq_set(struct mail_index_view *view,
 			  uint32_t seq, uint64_t min_modseq);
+/* Returns the first sequence in seq..last_seq whose modseq may be
+   min_modseq or higher, or last_seq+1 if there are none. Blocks of messages
+   without such changes are skipped using their highest modseq summaries. */
+uint32_t mail_index_modseq_find_next(struct mail_index_view *view,
+				     uint32_t seq, uint32_t last_seq,
+				     uint64_t min_modseq);
+/* Forget the highest modseq summaries for sequences seq and later. */
+void mail_index_map_modseq_invalidate(struct mail_index_map *map,
+				      uint32_t seq);
 
 struct mail_index_modseq_sync *
 mail_index_modseq_sync_begin(struct mail_index_sync_map_ctx *sync_map_ctx);
@@ -7,6 +7,7 @@
 #include "mail-index-transaction-private.h"
 #include "mail-transaction-log-private.h"
 #include "mail-cache-private.h"
+#include "mail-index-expunge-history.h"
 
 #include <stdio.h>
 
@@ -980,6 +981,8 @@ int mail_index_sync_commit(struct mail_index_sync_ctx **_ctx)
 	    (want_rotate || mail_index_sync_want_index_write(index, &reason))) {
 		i_free(index->need_recreate);
 		index->index_min_write = FALSE;
+		if (want_rotate)
+			mail_index_expunge_history_update(index);
 		mail_index_write(index, want_rotate, reason);
 	}
 	mail_index_sync_end(_ctx);
@@ -1,9 +1,11 @@
 /* Copyright (c) 2016-2018 Dovecot authors, see the included COPYING file */
 
 #include "lib.h"
+#include "array.h"
 #include "test-common.h"
 #include "test-mail-index.h"
 #include "mail-index-modseq.h"
+#include "mail-index-expunge-history.h"
 #include "mail-transaction-log-private.h"
 
 static void test_mail_index_modseq_get_next_log_offset(void)
@@ -67,10 +69,206 @@ static void test_mail_index_modseq_get_next_log_offset(void)
 	test_end();
 }
 
+static void test_mail_index_modseq_find_next(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	uint32_t seq, uid;
+	uint64_t modseq;
+
+	test_begin("mail_index_modseq_find_next()");
+	index = test_mail_index_init();
+	view = mail_index_view_open(index);
+	mail_index_modseq_enable(index);
+
+	trans = mail_index_transaction_begin(view, 0);
+	uid = 1234;
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid, sizeof(uid), TRUE);
+	for (uid = 1; uid <= 300; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	view = mail_index_view_open(index);
+	modseq = mail_index_modseq_get_highest(view);
+	/* build the block summaries before the changes */
+	test_assert(mail_index_modseq_find_next(view, 1, 300, modseq + 1) == 301);
+	trans = mail_index_transaction_begin(view,
+		MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_update_flags(trans, 10, MODIFY_ADD, MAIL_SEEN);
+	mail_index_update_flags(trans, 250, MODIFY_ADD, MAIL_SEEN);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	view = mail_index_view_open(index);
+	test_assert(mail_index_modseq_find_next(view, 1, 300, modseq + 1) == 10);
+	test_assert(mail_index_modseq_find_next(view, 11, 300, modseq + 1) == 250);
+	test_assert(mail_index_modseq_find_next(view, 251, 300, modseq + 1) == 301);
+	test_assert(mail_index_modseq_find_next(view, 11, 200, modseq + 1) == 201);
+	test_assert(mail_index_modseq_find_next(view, 1, 300, 1) == 1);
+
+	/* expunging moves the later messages to earlier blocks */
+	trans = mail_index_transaction_begin(view,
+		MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_expunge(trans, 5);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	view = mail_index_view_open(index);
+	modseq = mail_index_modseq_get_highest(view);
+	test_assert(mail_index_modseq_find_next(view, 1, 299, modseq) == 300);
+	test_assert(mail_index_modseq_find_next(view, 1, 299, modseq - 1) == 9);
+	test_assert(mail_index_modseq_find_next(view, 10, 299, modseq - 1) == 249);
+	mail_index_view_close(&view);
+
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_expunge_history(void)
+{
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	ARRAY_TYPE(seq_range) uids;
+	const struct seq_range *range;
+	uint32_t seq, uid, file_seq, last_file_seq;
+	uint64_t modseq;
+
+	test_begin("mail index expunge history");
+	index = test_mail_index_init();
+	view = mail_index_view_open(index);
+	mail_index_modseq_enable(index);
+
+	trans = mail_index_transaction_begin(view, 0);
+	uid = 1234;
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid, sizeof(uid), TRUE);
+	for (uid = 1; uid <= 6; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	view = mail_index_view_open(index);
+	modseq = mail_index_modseq_get_highest(view);
+	trans = mail_index_transaction_begin(view,
+		MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+	mail_index_expunge(trans, 2);
+	mail_index_expunge(trans, 3);
+	mail_index_expunge(trans, 5);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	/* nothing is in the history before the log is rotated */
+	t_array_init(&uids, 8);
+	test_assert(mail_index_expunge_history_lookup(index, modseq, &uids,
+						      &last_file_seq) == 0);
+
+	test_assert(mail_transaction_log_file_lock(index->log->head) == 0);
+	test_assert(mail_index_map(index, MAIL_INDEX_SYNC_HANDLER_HEAD) > 0);
+	file_seq = index->log->head->hdr.file_seq;
+	mail_index_expunge_history_update(index);
+	test_assert(mail_transaction_log_rotate(index->log, FALSE) == 0);
+	mail_transaction_log_file_unlock(index->log->head, "rotating");
+
+	test_assert(mail_index_expunge_history_lookup(index, modseq, &uids,
+						      &last_file_seq) == 1);
+	test_assert(last_file_seq == file_seq);
+	range = array_get(&uids, &seq);
+	test_assert(seq == 2);
+	test_assert(range[0].seq1 == 2 && range[0].seq2 == 3);
+	test_assert(range[1].seq1 == 5 && range[1].seq2 == 5);
+
+	array_clear(&uids);
+	test_assert(mail_index_expunge_history_lookup(index, modseq + 1, &uids,
+						      &last_file_seq) == 1);
+	test_assert(array_count(&uids) == 0);
+
+	test_mail_index_deinit(&index);
+	test_end();
+}
+
+static void test_mail_index_expunge_history_merged(void)
+{
+#define TEST_EXPUNGE_COUNT 1050
+	struct mail_index *index;
+	struct mail_index_view *view;
+	struct mail_index_transaction *trans;
+	ARRAY_TYPE(seq_range) uids;
+	const struct seq_range *range;
+	uint64_t modseqs[TEST_EXPUNGE_COUNT];
+	uint32_t seq, uid, last_file_seq;
+	unsigned int i;
+
+	test_begin("mail index expunge history merged");
+	index = test_mail_index_init();
+	view = mail_index_view_open(index);
+	mail_index_modseq_enable(index);
+
+	trans = mail_index_transaction_begin(view, 0);
+	uid = 1234;
+	mail_index_update_header(trans,
+		offsetof(struct mail_index_header, uid_validity),
+		&uid, sizeof(uid), TRUE);
+	for (uid = 1; uid <= TEST_EXPUNGE_COUNT * 2; uid++)
+		mail_index_append(trans, uid, &seq);
+	test_assert(mail_index_transaction_commit(&trans) == 0);
+	mail_index_view_close(&view);
+
+	/* expunge the odd UIDs, each with its own modseq */
+	for (i = 0; i < TEST_EXPUNGE_COUNT; i++) {
+		view = mail_index_view_open(index);
+		modseqs[i] = mail_index_modseq_get_highest(view);
+		trans = mail_index_transaction_begin(view,
+			MAIL_INDEX_TRANSACTION_FLAG_EXTERNAL);
+		/* UID i*2+1 is at sequence i+1 */
+		mail_index_expunge(trans, i + 1);
+		test_assert(mail_index_transaction_commit(&trans) == 0);
+		mail_index_view_close(&view);
+	}
+
+	test_assert(mail_transaction_log_file_lock(index->log->head) == 0);
+	test_assert(mail_index_map(index, MAIL_INDEX_SYNC_HANDLER_HEAD) > 0);
+	mail_index_expunge_history_update(index);
+	test_assert(mail_transaction_log_rotate(index->log, FALSE) == 0);
+	mail_transaction_log_file_unlock(index->log->head, "rotating");
+
+	/* the older half of the records was merged - lookups newer than
+	   them are still exact */
+	t_array_init(&uids, 8);
+	test_assert(mail_index_expunge_history_lookup(index,
+		modseqs[TEST_EXPUNGE_COUNT / 2], &uids, &last_file_seq) == 1);
+	range = array_get(&uids, &seq);
+	test_assert(seq == TEST_EXPUNGE_COUNT / 2);
+	test_assert(range[0].seq1 == TEST_EXPUNGE_COUNT + 1);
+	test_assert(!seq_range_exists(&uids, TEST_EXPUNGE_COUNT - 1));
+
+	/* lookups reaching the merged records return a superset */
+	array_clear(&uids);
+	test_assert(mail_index_expunge_history_lookup(index,
+		modseqs[TEST_EXPUNGE_COUNT / 2 - 1], &uids,
+		&last_file_seq) == 0);
+	test_assert(last_file_seq != 0);
+	test_assert(seq_range_exists(&uids, 1));
+	test_assert(seq_range_exists(&uids, TEST_EXPUNGE_COUNT - 1));
+	test_assert(seq_range_exists(&uids, TEST_EXPUNGE_COUNT + 1));
+
+	test_mail_index_deinit(&index);
+	test_end();
+#undef TEST_EXPUNGE_COUNT
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mail_index_modseq_get_next_log_offset,
+		test_mail_index_modseq_find_next,
+		test_mail_index_expunge_history,
+		test_mail_index_expunge_history_merged,
 		NULL
 	};
 	return test_run(test_functions);
@@ -0,0 +1,582 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "str.h"
+#include "strnum.h"
+#include "base64.h"
+#include "istream.h"
+#include "time-util.h"
+#include "qp-encoder.h"
+#include "qp-decoder.h"
+#include "message-parser.h"
+#include "message-decoder.h"
+#include "message-header-decode.h"
+#include "mail-html2text.h"
+
+#include <stdio.h>
+#include <ctype.h>
+
+/**
+ * Generates a deterministic corpus of messages shaped like real-world mail
+ * (plain text, many and encoded headers, deeply nested multiparts, large
+ * base64 attachments, quoted-printable HTML in various charsets) and runs the
+ * lib-mail parsers and decoders over it. For each of them it reports the
+ * throughput and the number of allocations made from default_pool per
+ * message.
+ */
+
+#define BENCH_SEED 0x2545f491
+#define BENCH_ATTACHMENT_SIZE (1024*1024)
+#define BENCH_HTML_SIZE (64*1024)
+#define BENCH_NESTED_DEPTH 20
+#define BENCH_HEADER_COUNT 200
+
+struct bench_msg {
+	const char *name;
+	buffer_t *data;
+};
+
+struct bench_result {
+	uint64_t ts_start;
+	unsigned int allocs_start;
+	uoff_t bytes;
+	unsigned int msg_count;
+};
+
+static pool_t bench_pool;
+static ARRAY(struct bench_msg) corpus;
+static buffer_t *header_values, *qp_data, *base64_data, *html_data;
+static uint32_t rand_state = BENCH_SEED;
+
+static unsigned int alloc_count;
+static pool_t orig_default_pool;
+
+static const char *words[] = {
+	"lorem", "ipsum", "dolor", "sit", "amet", "consectetur", "adipiscing",
+	"elit", "sed", "do", "eiusmod", "tempor", "incididunt", "ut", "labore",
+	"et", "dolore", "magna", "aliqua", "Übermut", "café", "naïve", "Ωmega",
+	"Пример", "データ",
+};
+
+/* Count allocations done via default_pool (i_malloc() etc.) by wrapping it
+   with a pool that forwards everything to the original one. */
+static const char *bench_pool_get_name(pool_t pool ATTR_UNUSED)
+{
+	return "bench counting pool";
+}
+
+static void bench_pool_ref(pool_t pool ATTR_UNUSED)
+{
+}
+
+static void bench_pool_unref(pool_t *pool ATTR_UNUSED)
+{
+}
+
+static void *bench_pool_malloc(pool_t pool ATTR_UNUSED, size_t size)
+{
+	alloc_count++;
+	return p_malloc(orig_default_pool, size);
+}
+
+static void bench_pool_free(pool_t pool ATTR_UNUSED, void *mem)
+{
+	p_free(orig_default_pool, mem);
+}
+
+static void *bench_pool_realloc(pool_t pool ATTR_UNUSED, void *mem,
+				size_t old_size, size_t new_size)
+{
+	alloc_count++;
+	return p_realloc(orig_default_pool, mem, old_size, new_size);
+}
+
+static void bench_pool_clear(pool_t pool ATTR_UNUSED)
+{
+	i_unreached();
+}
+
+static size_t bench_pool_get_max_easy_alloc_size(pool_t pool ATTR_UNUSED)
+{
+	return 0;
+}
+
+static struct pool_vfuncs bench_counting_pool_vfuncs = {
+	bench_pool_get_name,
+
+	bench_pool_ref,
+	bench_pool_unref,
+
+	bench_pool_malloc,
+	bench_pool_free,
+
+	bench_pool_realloc,
+
+	bench_pool_clear,
+	bench_pool_get_max_easy_alloc_size
+};
+
+static struct pool bench_counting_pool = {
+	.v = &bench_counting_pool_vfuncs,
+
+	.alloconly_pool = FALSE,
+	.datastack_pool = FALSE
+};
+
+static uint32_t bench_rand(void)
+{
+	/* xorshift32 - the corpus must be the same in every run */
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+	return rand_state;
+}
+
+static const char *bench_word(void)
+{
+	return words[bench_rand() % N_ELEMENTS(words)];
+}
+
+static void bench_append_text(string_t *str, size_t size)
+{
+	size_t line_start = str_len(str), end = str_len(str) + size;
+
+	while (str_len(str) < end) {
+		str_append(str, bench_word());
+		if (str_len(str) - line_start >= 72) {
+			str_append(str, "\r\n");
+			line_start = str_len(str);
+		} else {
+			str_append_c(str, ' ');
+		}
+	}
+	str_append(str, "\r\n");
+}
+
+static void bench_append_html(string_t *str, size_t size)
+{
+	size_t end = str_len(str) + size;
+
+	str_append(str, "<html><head><style>p { color: red; }</style>"
+		   "</head><body>\n");
+	while (str_len(str) < end) {
+		str_printfa(str, "<p class=\"c%u\">", bench_rand() % 10);
+		for (unsigned int i = bench_rand() % 20; i > 0; i--) {
+			switch (bench_rand() % 4) {
+			case 0:
+				str_printfa(str, "<b>%s</b> ", bench_word());
+				break;
+			case 1:
+				str_printfa(str, "<a href=\"https://example.com/%s\">"
+					    "%s</a> ", bench_word(),
+					    bench_word());
+				break;
+			case 2:
+				str_append(str, "&amp; &lt;&gt; &nbsp; ");
+				break;
+			default:
+				str_printfa(str, "%s ", bench_word());
+				break;
+			}
+		}
+		str_append(str, "</p>\n");
+	}
+	str_append(str, "<blockquote>quoted text</blockquote></body></html>\n");
+}
+
+static void bench_append_encoded_word(string_t *str)
+{
+	string_t *value = t_str_new(64);
+
+	for (unsigned int i = bench_rand() % 5 + 1; i > 0; i--) {
+		str_append(value, bench_word());
+		str_append_c(value, ' ');
+	}
+	if (bench_rand() % 2 == 0) {
+		str_append(str, "=?utf-8?b?");
+		base64_encode(str_data(value), str_len(value), str);
+	} else {
+		str_append(str, "=?utf-8?q?");
+		for (size_t i = 0; i < str_len(value); i++) {
+			unsigned char c = str_data(value)[i];
+
+			if (c == ' ')
+				str_append_c(str, '_');
+			else if (i_isalnum(c))
+				str_append_c(str, c);
+			else
+				str_printfa(str, "=%02X", c);
+		}
+	}
+	str_append(str, "?=");
+}
+
+static void bench_append_headers(string_t *str, const char *subject)
+{
+	str_append(str, "From: Sender <sender@example.com>\r\n"
+		   "To: Recipient <rcpt@example.com>, "
+		   "Another <another@example.org>\r\n"
+		   "Date: Thu, 01 Jan 2015 00:00:00 +0000\r\n"
+		   "Message-ID: <bench@example.com>\r\n"
+		   "MIME-Version: 1.0\r\n");
+	str_printfa(str, "Subject: %s ", subject);
+	bench_append_encoded_word(str);
+	str_append(str, "\r\n");
+}
+
+static void bench_add(const char *name, string_t *data)
+{
+	struct bench_msg *msg = array_append_space(&corpus);
+
+	msg->name = name;
+	msg->data = data;
+}
+
+static string_t *bench_msg_plain(void)
+{
+	string_t *str = str_new(bench_pool, 8192);
+
+	bench_append_headers(str, "plain");
+	str_append(str, "Content-Type: text/plain; charset=us-ascii\r\n\r\n");
+	bench_append_text(str, 4096);
+	return str;
+}
+
+static string_t *bench_msg_many_headers(void)
+{
+	string_t *str = str_new(bench_pool, 32768);
+
+	bench_append_headers(str, "many headers");
+	for (unsigned int i = 0; i < BENCH_HEADER_COUNT; i++) {
+		if (i % 10 == 0) {
+			str_printfa(str, "Received: from host%u.example.com "
+				    "(host%u.example.com [192.0.2.%u])\r\n"
+				    "\tby mx.example.com with ESMTPS id %x\r\n"
+				    "\tfor <rcpt@example.com>; "
+				    "Thu, 01 Jan 2015 00:00:00 +0000\r\n",
+				    i, i, i % 256, bench_rand());
+		} else {
+			str_printfa(str, "X-Header-%u: ", i);
+			bench_append_encoded_word(str);
+			str_printfa(str, " %s\r\n", bench_word());
+		}
+	}
+	str_append(str, "\r\n");
+	bench_append_text(str, 1024);
+	return str;
+}
+
+static void bench_append_nested(string_t *str, unsigned int depth)
+{
+	const char *boundary = t_strdup_printf("=_bench_%u", depth);
+
+	if (depth == 0) {
+		str_append(str, "Content-Type: text/plain; charset=utf-8\r\n"
+			   "Content-Transfer-Encoding: 8bit\r\n\r\n");
+		bench_append_text(str, 256);
+		return;
+	}
+	str_printfa(str, "Content-Type: multipart/mixed; "
+		    "boundary=\"%s\"\r\n\r\nprologue\r\n", boundary);
+	str_printfa(str, "--%s\r\n", boundary);
+	str_append(str, "Content-Type: text/plain\r\n\r\n");
+	bench_append_text(str, 128);
+	str_printfa(str, "--%s\r\n", boundary);
+	bench_append_nested(str, depth - 1);
+	str_printfa(str, "--%s--\r\nepilogue\r\n", boundary);
+}
+
+static string_t *bench_msg_nested(void)
+{
+	string_t *str = str_new(bench_pool, 16384);
+
+	bench_append_headers(str, "nested");
+	bench_append_nested(str, BENCH_NESTED_DEPTH);
+	return str;
+}
+
+static string_t *bench_msg_attachment(void)
+{
+	string_t *str = str_new(bench_pool, BENCH_ATTACHMENT_SIZE * 4 / 3 +
+				BENCH_ATTACHMENT_SIZE / 38 + 4096);
+	unsigned char *attachment;
+
+	attachment = t_malloc_no0(BENCH_ATTACHMENT_SIZE);
+	for (size_t i = 0; i < BENCH_ATTACHMENT_SIZE; i++)
+		attachment[i] = bench_rand() & 0xff;
+
+	bench_append_headers(str, "attachment");
+	str_append(str, "Content-Type: multipart/mixed; boundary=\"b1\"\r\n\r\n"
+		   "--b1\r\nContent-Type: text/plain; charset=utf-8\r\n\r\n");
+	bench_append_text(str, 1024);
+	str_append(str, "--b1\r\nContent-Type: application/octet-stream\r\n"
+		   "Content-Disposition: attachment; "
+		   "filename=\"bench.bin\"\r\n"
+		   "Content-Transfer-Encoding: base64\r\n\r\n");
+	base64_scheme_encode(&base64_scheme, BASE64_ENCODE_FLAG_CRLF, 76,
+			     attachment, BENCH_ATTACHMENT_SIZE, str);
+	str_append(str, "\r\n--b1--\r\n");
+	return str;
+}
+
+static string_t *bench_msg_html(const char *charset)
+{
+	string_t *str = str_new(bench_pool, BENCH_HTML_SIZE * 2);
+	string_t *html = t_str_new(BENCH_HTML_SIZE + 1024);
+	struct qp_encoder *qp;
+
+	bench_append_html(html, BENCH_HTML_SIZE);
+	bench_append_headers(str, "html");
+	str_printfa(str, "Content-Type: multipart/alternative; "
+		    "boundary=\"b2\"\r\n\r\n--b2\r\n"
+		    "Content-Type: text/plain; charset=%s\r\n"
+		    "Content-Transfer-Encoding: quoted-printable\r\n\r\n",
+		    charset);
+	qp = qp_encoder_init(str, 76, 0);
+	qp_encoder_more(qp, "plain text alternative\r\n", 24);
+	qp_encoder_finish(qp);
+	qp_encoder_deinit(&qp);
+
+	str_printfa(str, "\r\n--b2\r\n"
+		    "Content-Type: text/html; charset=%s\r\n"
+		    "Content-Transfer-Encoding: quoted-printable\r\n\r\n",
+		    charset);
+	qp = qp_encoder_init(str, 76, 0);
+	qp_encoder_more(qp, str_data(html), str_len(html));
+	qp_encoder_finish(qp);
+	qp_encoder_deinit(&qp);
+	str_append(str, "\r\n--b2--\r\n");
+	return str;
+}
+
+static void bench_corpus_init(void)
+{
+	bench_pool = pool_alloconly_create("bench corpus",
+					   BENCH_ATTACHMENT_SIZE * 3);
+	p_array_init(&corpus, bench_pool, 16);
+
+	bench_add("plain", bench_msg_plain());
+	bench_add("many headers", bench_msg_many_headers());
+	bench_add("nested", bench_msg_nested());
+	bench_add("attachment", bench_msg_attachment());
+	bench_add("html utf-8", bench_msg_html("utf-8"));
+	bench_add("html latin1", bench_msg_html("iso-8859-1"));
+	bench_add("html koi8-r", bench_msg_html("koi8-r"));
+
+	/* separate inputs for the individual decoders */
+	header_values = str_new(bench_pool, 8192);
+	for (unsigned int i = 0; i < BENCH_HEADER_COUNT; i++) {
+		str_printfa(header_values, "%s ", bench_word());
+		bench_append_encoded_word(header_values);
+		str_append_c(header_values, '\n');
+	}
+	html_data = str_new(bench_pool, BENCH_HTML_SIZE + 1024);
+	bench_append_html(html_data, BENCH_HTML_SIZE);
+	qp_data = str_new(bench_pool, BENCH_HTML_SIZE * 2);
+	struct qp_encoder *qp = qp_encoder_init(qp_data, 76, 0);
+	qp_encoder_more(qp, str_data(html_data), str_len(html_data));
+	qp_encoder_finish(qp);
+	qp_encoder_deinit(&qp);
+	base64_data = str_new(bench_pool, BENCH_ATTACHMENT_SIZE / 2);
+	base64_scheme_encode(&base64_scheme, BASE64_ENCODE_FLAG_CRLF, 76,
+			     str_data(html_data), str_len(html_data),
+			     base64_data);
+}
+
+static void bench_start(struct bench_result *result)
+{
+	i_zero(result);
+	result->allocs_start = alloc_count;
+	result->ts_start = i_nanoseconds();
+}
+
+static void bench_end(struct bench_result *result, const char *name)
+{
+	uint64_t diff = i_nanoseconds() - result->ts_start;
+	double secs = diff / 1000000000.0;
+	unsigned int allocs = alloc_count - result->allocs_start;
+
+	printf("%-24s %10.1f MB/s %10.1f msgs/s %10.1f allocs/msg\n", name,
+	       result->bytes / (1024.0 * 1024.0) / secs,
+	       result->msg_count / secs,
+	       (double)allocs / result->msg_count);
+	fflush(stdout);
+}
+
+static void bench_parse_msg(const struct bench_msg *msg, bool decode)
+{
+	const struct message_parser_settings set = {
+		.hdr_flags = MESSAGE_HEADER_PARSER_FLAG_CLEAN_ONELINE,
+	};
+	struct message_parser_ctx *parser;
+	struct message_decoder_context *decoder = NULL;
+	struct message_block block, output;
+	struct message_part *parts;
+	struct istream *input;
+	pool_t pool;
+	int ret;
+
+	pool = pool_alloconly_create("bench message parts", 1024);
+	input = i_stream_create_from_buffer(msg->data);
+	parser = message_parser_init(pool, input, &set);
+	if (decode)
+		decoder = message_decoder_init(NULL, 0);
+	while ((ret = message_parser_parse_next_block(parser, &block)) > 0) {
+		if (decoder != NULL)
+			(void)message_decoder_decode_next_block(decoder, &block,
+								&output);
+	}
+	i_assert(ret < 0 && input->stream_errno == 0);
+	if (decoder != NULL)
+		message_decoder_deinit(&decoder);
+	message_parser_deinit(&parser, &parts);
+	i_stream_unref(&input);
+	pool_unref(&pool);
+}
+
+static void bench_parser(unsigned int iterations, bool decode)
+{
+	const struct bench_msg *msg;
+	struct bench_result total, result;
+	const char *prefix = decode ? "decode" : "parse";
+
+	bench_start(&total);
+	array_foreach(&corpus, msg) {
+		bench_start(&result);
+		for (unsigned int i = 0; i < iterations; i++) T_BEGIN {
+			bench_parse_msg(msg, decode);
+		} T_END;
+		result.bytes = msg->data->used * iterations;
+		result.msg_count = iterations;
+		bench_end(&result, t_strdup_printf("%s %s", prefix, msg->name));
+		total.bytes += result.bytes;
+		total.msg_count += result.msg_count;
+	}
+	bench_end(&total, t_strdup_printf("%s all", prefix));
+}
+
+static void bench_header_decode(unsigned int iterations)
+{
+	const char *const *lines =
+		t_strsplit(str_c(header_values), "\n");
+	struct bench_result result;
+	string_t *dest = t_str_new(256);
+
+	bench_start(&result);
+	for (unsigned int i = 0; i < iterations; i++) {
+		for (unsigned int j = 0; lines[j] != NULL; j++) {
+			str_truncate(dest, 0);
+			message_header_decode_utf8((const void *)lines[j],
+						   strlen(lines[j]), dest,
+						   NULL);
+		}
+	}
+	result.bytes = header_values->used * iterations;
+	result.msg_count = iterations;
+	bench_end(&result, "header decode");
+}
+
+static void bench_qp_decode(unsigned int iterations)
+{
+	struct bench_result result;
+	buffer_t *dest = buffer_create_dynamic(default_pool, qp_data->used);
+	struct qp_decoder *qp;
+	const char *error;
+	size_t error_pos;
+
+	bench_start(&result);
+	for (unsigned int i = 0; i < iterations; i++) {
+		buffer_set_used_size(dest, 0);
+		qp = qp_decoder_init(dest);
+		if (qp_decoder_more(qp, qp_data->data, qp_data->used,
+				    &error_pos, &error) < 0 ||
+		    qp_decoder_finish(qp, &error) < 0)
+			i_fatal("qp_decoder failed: %s", error);
+		qp_decoder_deinit(&qp);
+	}
+	result.bytes = qp_data->used * iterations;
+	result.msg_count = iterations;
+	bench_end(&result, "quoted-printable decode");
+	buffer_free(&dest);
+}
+
+static void bench_base64_decode(unsigned int iterations)
+{
+	struct bench_result result;
+	buffer_t *dest = buffer_create_dynamic(default_pool,
+					       base64_data->used);
+
+	bench_start(&result);
+	for (unsigned int i = 0; i < iterations; i++) {
+		buffer_set_used_size(dest, 0);
+		if (base64_decode(base64_data->data, base64_data->used,
+				  dest) < 0)
+			i_fatal("base64_decode() failed");
+	}
+	result.bytes = base64_data->used * iterations;
+	result.msg_count = iterations;
+	bench_end(&result, "base64 decode");
+	buffer_free(&dest);
+}
+
+static void bench_html2text(unsigned int iterations)
+{
+	struct bench_result result;
+	buffer_t *dest = buffer_create_dynamic(default_pool, html_data->used);
+	struct mail_html2text *ht;
+
+	bench_start(&result);
+	for (unsigned int i = 0; i < iterations; i++) {
+		buffer_set_used_size(dest, 0);
+		ht = mail_html2text_init(0);
+		mail_html2text_more(ht, html_data->data, html_data->used,
+				    dest);
+		mail_html2text_deinit(&ht);
+	}
+	result.bytes = html_data->used * iterations;
+	result.msg_count = iterations;
+	bench_end(&result, "html2text");
+	buffer_free(&dest);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [iterations]\n", prog);
+	fprintf(stderr, "Runs 100 iterations if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	unsigned int iterations = 100;
+
+	lib_init();
+	if (argc > 2)
+		print_usage(argv[0]);
+	if (argc == 2 && (str_to_uint(argv[1], &iterations) < 0 ||
+			  iterations == 0)) {
+		fprintf(stderr, "Invalid parameters\n");
+		print_usage(argv[0]);
+	}
+
+	T_BEGIN {
+		bench_corpus_init();
+	} T_END;
+	orig_default_pool = default_pool;
+	default_pool = &bench_counting_pool;
+
+	T_BEGIN {
+		bench_parser(iterations, FALSE);
+		bench_parser(iterations, TRUE);
+		bench_header_decode(iterations);
+		bench_qp_decode(iterations);
+		bench_base64_decode(iterations);
+		bench_html2text(iterations);
+	} T_END;
+
+	default_pool = orig_default_pool;
+	pool_unref(&bench_pool);
+	lib_deinit();
+	return 0;
+}
@@ -5,6 +5,7 @@
 #include "event-filter.h"
 #include "path-util.h"
 #include "mmap-util.h"
+#include "memfd-temp.h"
 #include "fdpass.h"
 #include "write-full.h"
 #include "str.h"
@@ -51,6 +52,7 @@ static const struct setting_define master_service_setting_defines[] = {
 	DEF(STR, import_environment),
 	DEF(STR, stats_writer_socket_path),
 	DEF(SIZE, config_cache_size),
+	DEF(SIZE, mail_temp_memfd_max_size),
 	DEF(BOOL, version_ignore),
 	DEF(BOOL, shutdown_clients),
 	DEF(BOOL, verbose_proctitle),
@@ -89,6 +91,7 @@ static const struct master_service_settings master_service_default_settings = {
 	.import_environment = "TZ CORE_OUTOFMEM CORE_ERROR" ENV_SYSTEMD ENV_GDB,
 	.stats_writer_socket_path = "stats-writer",
 	.config_cache_size = 1024*1024,
+	.mail_temp_memfd_max_size = 64*1024*1024,
 	.version_ignore = FALSE,
 	.shutdown_clients = TRUE,
 	.verbose_proctitle = FALSE,
@@ -688,6 +691,7 @@ int master_service_settings_read(struct master_service *service,
 
 	if (service->set->shutdown_clients)
 		master_service_set_die_with_master(master_service, TRUE);
+	memfd_temp_set_max_size(service->set->mail_temp_memfd_max_size);
 
 	/* if we change any settings afterwards, they're in expanded form.
 	   especially all settings from userdb are already expanded. */
@@ -24,6 +24,7 @@ struct master_service_settings {
 	const char *import_environment;
 	const char *stats_writer_socket_path;
 	uoff_t config_cache_size;
+	uoff_t mail_temp_memfd_max_size;
 	bool version_ignore;
 	bool shutdown_clients;
 	bool verbose_proctitle;
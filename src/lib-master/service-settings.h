@@ -58,11 +58,13 @@ struct service_settings {
 	bool drop_priv_before_exec;
 
 	unsigned int process_min_avail;
+	bool process_min_avail_auto;
 	unsigned int process_limit;
 	unsigned int client_limit;
 	unsigned int service_count;
 	unsigned int idle_kill;
 	uoff_t vsz_limit;
+	const char *cpu_affinity;
 
 	ARRAY_TYPE(file_listener_settings) unix_listeners;
 	ARRAY_TYPE(file_listener_settings) fifo_listeners;
@@ -72,6 +74,8 @@ struct service_settings {
 	struct master_settings *master_set;
 	enum service_type parsed_type;
 	enum service_user_default user_default;
+	/* cpu_affinity parsed into lists of CPUs */
+	ARRAY(ARRAY_TYPE(uint)) parsed_cpu_sets;
 	bool login_dump_core:1;
 
 	/* -- flags that can be set internally -- */
@@ -1076,6 +1076,10 @@ static bool search_limit_by_hdr(struct index_search_context *ctx,
 			highest_modseq = mail_index_modseq_get_highest(ctx->view);
 			if (args->value.modseq->modseq > highest_modseq)
 				return FALSE;
+			/* messages with lower modseqs can be skipped */
+			if (!args->match_not &&
+			    ctx->min_modseq < args->value.modseq->modseq)
+				ctx->min_modseq = args->value.modseq->modseq;
 			continue;
 		default:
 			continue;
@@ -1915,6 +1919,13 @@ bool index_storage_search_next_update_seq(struct mail_search_context *_ctx)
 
 	ret = 0;
 	while (_ctx->seq <= ctx->seq2) {
+		if (ctx->min_modseq != 0) {
+			/* skip over messages that haven't changed */
+			_ctx->seq = mail_index_modseq_find_next(ctx->view,
+					_ctx->seq, ctx->seq2, ctx->min_modseq);
+			if (_ctx->seq > ctx->seq2)
+				break;
+		}
 		/* check if the sequence matches */
 		ret = mail_search_args_foreach(ctx->mail_ctx.args->args,
 					       search_seqset_arg, ctx);
@@ -3,6 +3,8 @@
 #include "lib.h"
 #include "array.h"
 #include "dict.h"
+#include "mail-index-modseq.h"
+#include "mailbox-notify-client.h"
 #include "index-storage.h"
 #include "index-sync-private.h"
 #include "index-pop3-uidl.h"
@@ -215,6 +217,11 @@ int index_transaction_commit(struct mailbox_transaction_context *t,
 
 	if (ret < 0 && mail_index_is_deleted(box->index))
 		mailbox_set_deleted(box);
+	else if (ret == 0 && result.commit_size > 0 &&
+		 box->storage->set->mailbox_notify_broker) {
+		mailbox_notify_client_changed(box,
+			mail_index_map_modseq_get_highest(box->index->map));
+	}
 
 	changes_r->ignored_modseq_changes = result.ignored_modseq_changes;
 	return ret;
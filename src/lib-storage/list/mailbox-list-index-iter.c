@@ -218,10 +218,10 @@ mailbox_list_index_iter_next(struct mailbox_list_iterate_context *_ctx)
 		T_BEGIN {
 			mailbox_list_index_update_info(ctx);
 		} T_END;
-		match = imap_match(_ctx->glob, ctx->info.vname);
-
-		follow_children = (match & (IMAP_MATCH_YES |
-					    IMAP_MATCH_CHILDREN)) != 0;
+		/* skip the whole subtree when none of the children can
+		   match, even if this mailbox itself matched */
+		match = imap_match_children(_ctx->glob, ctx->info.vname,
+					    &follow_children);
 		if (match == IMAP_MATCH_YES && iter_subscriptions_ok(ctx)) {
 			/* If this is a) \NoSelect leaf, b) not LAYOUT=index
 			   and c) NO-NOSELECT is set, try to rmdir the leaf
@@ -235,7 +235,8 @@ mailbox_list_index_iter_next(struct mailbox_list_iterate_context *_ctx)
 				   as well. */
 				mailbox_list_index_refresh_later(_ctx->list);
 			} else {
-				mailbox_list_index_update_next(ctx, TRUE);
+				mailbox_list_index_update_next(ctx,
+							       follow_children);
 				return &ctx->info;
 			}
 		} else if ((_ctx->flags & MAILBOX_LIST_ITER_SELECT_SUBSCRIBED) != 0 &&
@@ -454,6 +454,8 @@ struct mailbox {
 	void *notify_context;
 	struct timeout *to_notify, *to_notify_delay;
 	struct mailbox_notify_file *notify_files;
+	/* Mailbox GUID used with the mailbox-notify service */
+	const char *notify_broker_guid;
 
 	/* Increased by one for each new struct mailbox. */
 	unsigned int generation_sequence;
@@ -4,6 +4,7 @@
 #include "ioloop.h"
 #include "array.h"
 #include "base64.h"
+#include "hash.h"
 #include "hostpid.h"
 #include "module-dir.h"
 #include "restrict-access.h"
@@ -61,6 +62,11 @@ struct mail_storage_service_ctx {
 	pool_t userdb_next_pool;
 	const char *const **userdb_next_fieldsp;
 
+	/* username => struct auth_master_user_lookup_result */
+	pool_t userdb_prefetch_pool;
+	HASH_TABLE(const char *, struct auth_master_user_lookup_result *)
+		userdb_prefetch;
+
 	bool debug:1;
 	bool log_initialized:1;
 	bool config_permission_denied:1;
@@ -315,28 +321,52 @@ user_reply_handle(struct mail_storage_service_ctx *ctx,
 	return ret;
 }
 
+static void
+service_auth_user_info_init(struct mail_storage_service_ctx *ctx,
+			    const struct mail_storage_service_input *input,
+			    struct auth_user_info *info_r)
+{
+	i_zero(info_r);
+	info_r->service = input->service != NULL ? input->service :
+		ctx->service->name;
+	info_r->local_ip = input->local_ip;
+	info_r->remote_ip = input->remote_ip;
+	info_r->local_port = input->local_port;
+	info_r->remote_port = input->remote_port;
+	info_r->forward_fields = input->forward_fields;
+	info_r->debug = input->debug;
+}
+
 static int
 service_auth_userdb_lookup(struct mail_storage_service_ctx *ctx,
 			   const struct mail_storage_service_input *input,
 			   pool_t pool, struct event *event, const char **user,
 			   const char *const **fields_r, const char **error_r)
 {
+	struct auth_master_user_lookup_result *result = NULL;
 	struct auth_user_info info;
 	const char *new_username;
 	int ret;
 
-	i_zero(&info);
-	info.service = input->service != NULL ? input->service :
-		ctx->service->name;
-	info.local_ip = input->local_ip;
-	info.remote_ip = input->remote_ip;
-	info.local_port = input->local_port;
-	info.remote_port = input->remote_port;
-	info.forward_fields = input->forward_fields;
-	info.debug = input->debug;
-
-	ret = auth_master_user_lookup(ctx->conn, *user, &info, pool,
-				      &new_username, fields_r);
+	if (hash_table_is_created(ctx->userdb_prefetch))
+		result = hash_table_lookup(ctx->userdb_prefetch, *user);
+	if (result != NULL) {
+		/* use the prefetched reply only once */
+		hash_table_remove(ctx->userdb_prefetch, *user);
+		if (result->ret < 0) {
+			/* retry failures the same way as without prefetching */
+			result = NULL;
+		}
+	}
+	if (result != NULL) {
+		ret = result->ret;
+		new_username = p_strdup(pool, result->username);
+		*fields_r = p_strarray_dup(pool, result->fields);
+	} else {
+		service_auth_user_info_init(ctx, input, &info);
+		ret = auth_master_user_lookup(ctx->conn, *user, &info, pool,
+					      &new_username, fields_r);
+	}
 	if (ret > 0) {
 		if (strcmp(*user, new_username) != 0) {
 			e_debug(event, "changed username to %s", new_username);
@@ -1449,6 +1479,44 @@ int mail_storage_service_lookup(struct mail_storage_service_ctx *ctx,
 	return ret;
 }
 
+static void
+mail_storage_service_prefetch_free(struct mail_storage_service_ctx *ctx)
+{
+	if (hash_table_is_created(ctx->userdb_prefetch))
+		hash_table_destroy(&ctx->userdb_prefetch);
+	pool_unref(&ctx->userdb_prefetch_pool);
+}
+
+void mail_storage_service_prefetch_userdb(struct mail_storage_service_ctx *ctx,
+					  const struct mail_storage_service_input *input,
+					  const char *const *users)
+{
+	struct auth_master_user_lookup_result *results;
+	struct auth_user_info info;
+	unsigned int i, count = str_array_length(users);
+
+	i_assert((mail_storage_service_input_get_flags(ctx, input) &
+		  MAIL_STORAGE_SERVICE_FLAG_USERDB_LOOKUP) != 0);
+
+	mail_storage_service_prefetch_free(ctx);
+	if (count == 0)
+		return;
+	mail_storage_service_init_settings(ctx, input);
+
+	ctx->userdb_prefetch_pool =
+		pool_alloconly_create("userdb prefetch", 1024);
+	hash_table_create(&ctx->userdb_prefetch, ctx->userdb_prefetch_pool,
+			  count, str_hash, strcmp);
+
+	service_auth_user_info_init(ctx, input, &info);
+	auth_master_user_lookup_multi(ctx->conn, users, &info,
+				      ctx->userdb_prefetch_pool, &results);
+	for (i = 0; i < count; i++) {
+		hash_table_update(ctx->userdb_prefetch, results[i].user,
+				  &results[i]);
+	}
+}
+
 void mail_storage_service_save_userdb_fields(struct mail_storage_service_ctx *ctx,
 					     pool_t pool, const char *const **userdb_fields_r)
 {
@@ -1733,6 +1801,7 @@ void mail_storage_service_deinit(struct mail_storage_service_ctx **_ctx)
 
 	*_ctx = NULL;
 	(void)mail_storage_service_all_iter_deinit(ctx);
+	mail_storage_service_prefetch_free(ctx);
 	if (ctx->conn != NULL) {
 		if (mail_user_auth_master_conn == ctx->conn)
 			mail_user_auth_master_conn = NULL;
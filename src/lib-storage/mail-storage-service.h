@@ -105,6 +105,14 @@ int mail_storage_service_lookup(struct mail_storage_service_ctx *ctx,
 				const struct mail_storage_service_input *input,
 				struct mail_storage_service_user **user_r,
 				const char **error_r);
+/* Look up the given users from userdb with pipelined requests over the auth
+   connection. The following mail_storage_service_lookup() calls for these
+   users use the replies instead of looking them up one at a time. The input
+   is expected to differ only by the username in those calls. Each reply is
+   used only once, and any unused replies are forgotten by the next call. */
+void mail_storage_service_prefetch_userdb(struct mail_storage_service_ctx *ctx,
+					  const struct mail_storage_service_input *input,
+					  const char *const *users);
 /* The next mail_storage_service_lookup() will save the userdb fields into the
    given pointer, allocated from the given pool. */
 void mail_storage_service_save_userdb_fields(struct mail_storage_service_ctx *ctx,
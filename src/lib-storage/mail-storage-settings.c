@@ -79,6 +79,7 @@ static const struct setting_define mail_storage_setting_defines[] = {
 	DEF(BOOL, mail_full_filesystem_access),
 	DEF(BOOL, maildir_stat_dirs),
 	DEF(BOOL, mail_shared_explicit_inbox),
+	DEF(BOOL, mailbox_notify_broker),
 	DEF(ENUM, lock_method),
 	DEF(STR, pop3_uidl_format),
 
@@ -137,6 +138,7 @@ const struct mail_storage_settings mail_storage_default_settings = {
 	.mail_full_filesystem_access = FALSE,
 	.maildir_stat_dirs = FALSE,
 	.mail_shared_explicit_inbox = FALSE,
+	.mailbox_notify_broker = FALSE,
 	.lock_method = "fcntl:flock:dotlock",
 	.pop3_uidl_format = "%08Xu%08Xv",
 
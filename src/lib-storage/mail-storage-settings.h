@@ -59,6 +59,7 @@ struct mail_storage_settings {
 	bool mail_full_filesystem_access;
 	bool maildir_stat_dirs;
 	bool mail_shared_explicit_inbox;
+	bool mailbox_notify_broker;
 	const char *lock_method;
 	const char *pop3_uidl_format;
 
@@ -33,6 +33,7 @@
 #include "mail-search-mime-register.h"
 #include "mailbox-search-result-private.h"
 #include "mailbox-guid-cache.h"
+#include "mailbox-notify-client.h"
 #include "mail-cache.h"
 #include "utc-mktime.h"
 
@@ -90,6 +91,7 @@ void mail_storage_deinit(void)
 	mail_search_mime_register_deinit();
 	if (array_is_created(&mail_storage_classes))
 		array_free(&mail_storage_classes);
+	mailbox_notify_client_deinit();
 	mail_storage_hooks_deinit();
 	mailbox_lists_deinit();
 	mailbox_attributes_deinit();
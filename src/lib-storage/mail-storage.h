@@ -721,7 +721,12 @@ void mailbox_get_uid_range(struct mailbox *box,
 /* Get list of messages' that have been expunged after prev_modseq and that
    exist in uids_filter range. UIDs that have been expunged after the last
    mailbox sync aren't returned. Returns TRUE if ok, FALSE if modseq is lower
-   than we can check for (but expunged_uids is still set as best as it can). */
+   than we can check for (but expunged_uids is still set as best as it can,
+   which may include UIDs that were expunged before prev_modseq).
+
+   Expunges older than the transaction logs are looked up from the index's
+   expunge history. It doesn't store GUIDs, so those expunges have an empty
+   guid_128. */
 bool mailbox_get_expunges(struct mailbox *box, uint64_t prev_modseq,
 			  const ARRAY_TYPE(seq_range) *uids_filter,
 			  ARRAY_TYPE(mailbox_expunge_rec) *expunges);
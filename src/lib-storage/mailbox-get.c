@@ -3,6 +3,7 @@
 #include "lib.h"
 #include "array.h"
 #include "mail-index-modseq.h"
+#include "mail-index-expunge-history.h"
 #include "mail-storage-private.h"
 
 void mailbox_get_seq_range(struct mailbox *box, uint32_t uid1, uint32_t uid2,
@@ -161,6 +162,58 @@ mailbox_get_expunged_guids(struct mail_transaction_log_view *log_view,
 	}
 }
 
+static bool
+mailbox_get_history_expunges(struct mailbox *box, uint64_t prev_modseq,
+			     uint32_t first_log_seq,
+			     const ARRAY_TYPE(seq_range) *uids_filter,
+			     ARRAY_TYPE(seq_range) *expunged_uids)
+{
+	const struct mail_index_header *hdr;
+	ARRAY_TYPE(seq_range) history_uids, existing_uids;
+	const struct seq_range *range;
+	uint32_t last_file_seq, seq, seq1, seq2, uid;
+	int ret;
+
+	i_array_init(&history_uids, 32);
+	ret = mail_index_expunge_history_lookup(box->index, prev_modseq,
+						&history_uids, &last_file_seq);
+	if (ret < 0 || last_file_seq == 0 ||
+	    last_file_seq + 1 < first_log_seq) {
+		/* the history doesn't reach the oldest log file */
+		array_free(&history_uids);
+		return FALSE;
+	}
+	/* ret == 0: prev_modseq is within the merged history records. The
+	   UIDs are still returned, but they may include ones that were
+	   expunged before prev_modseq. */
+
+	/* drop UIDs that don't match the filter or that haven't been synced
+	   yet */
+	seq_range_array_intersect(&history_uids, uids_filter);
+	hdr = mail_index_get_header(box->view);
+	seq_range_array_remove_range(&history_uids, hdr->next_uid,
+				     (uint32_t)-1);
+
+	/* merged history records may contain UIDs that still exist */
+	i_array_init(&existing_uids, 32);
+	array_foreach(&history_uids, range) {
+		if (!mail_index_lookup_seq_range(box->view,
+						 range->seq1, range->seq2,
+						 &seq1, &seq2))
+			continue;
+		for (seq = seq1; seq <= seq2; seq++) {
+			mail_index_lookup_uid(box->view, seq, &uid);
+			seq_range_array_add(&existing_uids, uid);
+		}
+	}
+	seq_range_array_remove_seq_range(&history_uids, &existing_uids);
+	seq_range_array_merge(expunged_uids, &history_uids);
+
+	array_free(&existing_uids);
+	array_free(&history_uids);
+	return ret > 0;
+}
+
 static bool ATTR_NULL(4, 5)
 mailbox_get_expunges_full(struct mailbox *box, uint64_t prev_modseq,
 			  const ARRAY_TYPE(seq_range) *uids_filter,
@@ -172,7 +225,8 @@ mailbox_get_expunges_full(struct mailbox *box, uint64_t prev_modseq,
 	const struct mail_transaction_header *thdr;
 	const struct seq_range *range;
 	const void *tdata;
-	uint32_t min_uid;
+	uint32_t min_uid, first_log_seq;
+	uoff_t first_log_offset;
 	bool modseq_too_old;
 	int ret;
 
@@ -191,6 +245,8 @@ mailbox_get_expunges_full(struct mailbox *box, uint64_t prev_modseq,
 		i_array_init(&tmp_expunged_uids, 64);
 		expunged_uids = &tmp_expunged_uids;
 	}
+	mail_transaction_log_view_get_prev_pos(log_view, &first_log_seq,
+					       &first_log_offset);
 	mail_transaction_log_view_mark(log_view);
 	while ((ret = mail_transaction_log_view_next(log_view,
 						     &thdr, &tdata)) > 0) {
@@ -213,6 +269,12 @@ mailbox_get_expunges_full(struct mailbox *box, uint64_t prev_modseq,
 	/* drop UIDs that don't match the filter */
 	seq_range_array_intersect(expunged_uids, uids_filter);
 
+	/* the rest of the expunges may be found from the expunge history */
+	if (ret == 0 && modseq_too_old &&
+	    mailbox_get_history_expunges(box, prev_modseq, first_log_seq,
+					 uids_filter, expunged_uids))
+		modseq_too_old = FALSE;
+
 	if (expunges != NULL) {
 		mailbox_get_expunged_guids(log_view, expunged_uids, expunges);
 		array_free(&tmp_expunged_uids);
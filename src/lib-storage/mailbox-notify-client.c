@@ -0,0 +1,310 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "hash.h"
+#include "str.h"
+#include "ioloop.h"
+#include "ostream.h"
+#include "connection.h"
+#include "guid.h"
+#include "mail-storage-private.h"
+#include "mailbox-watch.h"
+#include "mailbox-notify-client.h"
+
+#define MAILBOX_NOTIFY_SOCKET_NAME "mailbox-notify"
+#define MAILBOX_NOTIFY_RECONNECT_INTERVAL_MSECS (10*1000)
+
+/* Mailboxes in this process with the same GUID */
+struct mailbox_notify_guid {
+	char *guid;
+	ARRAY_TYPE(mailboxes) boxes;
+};
+
+struct mailbox_notify_client {
+	struct connection conn;
+	struct timeout *to_reconnect;
+	bool connected;
+
+	HASH_TABLE(char *, struct mailbox_notify_guid *) guids;
+};
+
+static struct connection_list *mailbox_notify_clients = NULL;
+static struct mailbox_notify_client *mailbox_notify_client = NULL;
+
+static void
+mailbox_notify_client_reconnect(struct mailbox_notify_client *client);
+
+static void
+mailbox_notify_guid_send(struct mailbox_notify_client *client,
+			 const char *cmd, const char *guid)
+{
+	if (!client->connected)
+		return;
+	o_stream_nsend_str(client->conn.output,
+			   t_strdup_printf("%s\t%s\n", cmd, guid));
+}
+
+static void
+mailbox_notify_guid_notify(struct mailbox_notify_guid *notify_guid,
+			   struct mailbox *except_box)
+{
+	struct mailbox *box;
+
+	array_foreach_elem(&notify_guid->boxes, box) {
+		if (box != except_box)
+			mailbox_watch_notify(box);
+	}
+}
+
+static void
+mailbox_notify_client_notify_all(struct mailbox_notify_client *client)
+{
+	struct hash_iterate_context *iter;
+	struct mailbox_notify_guid *notify_guid;
+	char *guid;
+
+	iter = hash_table_iterate_init(client->guids);
+	while (hash_table_iterate(iter, client->guids, &guid, &notify_guid))
+		mailbox_notify_guid_notify(notify_guid, NULL);
+	hash_table_iterate_deinit(&iter);
+}
+
+static void mailbox_notify_client_connect(struct mailbox_notify_client *client)
+{
+	struct hash_iterate_context *iter;
+	struct mailbox_notify_guid *notify_guid;
+	char *guid;
+
+	if (connection_client_connect(&client->conn) < 0) {
+		if (errno != ENOENT && errno != ECONNREFUSED) {
+			e_error(client->conn.event,
+				"net_connect_unix(%s) failed: %m",
+				client->conn.name);
+		}
+		client->to_reconnect =
+			timeout_add_to(io_loop_get_root(),
+				       MAILBOX_NOTIFY_RECONNECT_INTERVAL_MSECS,
+				       mailbox_notify_client_reconnect, client);
+		return;
+	}
+	/* the connection is shared by everything in the process, so it
+	   must not be tied to any temporary ioloop */
+	connection_switch_ioloop_to(&client->conn, io_loop_get_root());
+	client->connected = TRUE;
+
+	iter = hash_table_iterate_init(client->guids);
+	while (hash_table_iterate(iter, client->guids, &guid, &notify_guid))
+		mailbox_notify_guid_send(client, "WATCH", guid);
+	hash_table_iterate_deinit(&iter);
+}
+
+static void mailbox_notify_client_reconnect(struct mailbox_notify_client *client)
+{
+	timeout_remove(&client->to_reconnect);
+	mailbox_notify_client_connect(client);
+}
+
+static int
+mailbox_notify_client_input_args(struct connection *conn,
+				 const char *const *args)
+{
+	struct mailbox_notify_client *client =
+		container_of(conn, struct mailbox_notify_client, conn);
+	struct mailbox_notify_guid *notify_guid;
+
+	/* CHANGED <mailbox guid> <highest modseq> */
+	if (args[0] == NULL || args[1] == NULL ||
+	    strcmp(args[0], "CHANGED") != 0) {
+		e_error(conn->event, "mailbox-notify: Received invalid input");
+		return -1;
+	}
+	notify_guid = hash_table_lookup(client->guids, args[1]);
+	if (notify_guid != NULL)
+		mailbox_notify_guid_notify(notify_guid, NULL);
+	return 1;
+}
+
+static void mailbox_notify_client_destroy(struct connection *conn)
+{
+	struct mailbox_notify_client *client =
+		container_of(conn, struct mailbox_notify_client, conn);
+
+	connection_disconnect(conn);
+	client->connected = FALSE;
+
+	/* Changes may have been lost while reconnecting. Have all the
+	   watchers check their mailboxes. */
+	mailbox_notify_client_notify_all(client);
+	if (client->to_reconnect == NULL) {
+		client->to_reconnect =
+			timeout_add_to(io_loop_get_root(),
+				       MAILBOX_NOTIFY_RECONNECT_INTERVAL_MSECS,
+				       mailbox_notify_client_reconnect, client);
+	}
+}
+
+static const struct connection_settings mailbox_notify_client_set = {
+	.service_name_in = "mailbox-notify-server",
+	.service_name_out = "mailbox-notify-client",
+	.major_version = 1,
+	.minor_version = 0,
+
+	.input_max_size = 1024,
+	.output_max_size = SIZE_MAX,
+	.client = TRUE
+};
+
+static const struct connection_vfuncs mailbox_notify_client_vfuncs = {
+	.destroy = mailbox_notify_client_destroy,
+	.input_args = mailbox_notify_client_input_args,
+};
+
+static struct mailbox_notify_client *
+mailbox_notify_client_get(struct mailbox *box)
+{
+	struct mailbox_notify_client *client;
+	const char *path;
+
+	if (mailbox_notify_client != NULL)
+		return mailbox_notify_client;
+
+	mailbox_notify_clients =
+		connection_list_init(&mailbox_notify_client_set,
+				     &mailbox_notify_client_vfuncs);
+	client = i_new(struct mailbox_notify_client, 1);
+	hash_table_create(&client->guids, default_pool, 0, str_hash, strcmp);
+	path = t_strconcat(box->storage->user->set->base_dir,
+			   "/"MAILBOX_NOTIFY_SOCKET_NAME, NULL);
+	connection_init_client_unix(mailbox_notify_clients, &client->conn,
+				    path);
+	mailbox_notify_client = client;
+	mailbox_notify_client_connect(client);
+	return client;
+}
+
+static int mailbox_notify_get_guid(struct mailbox *box, const char **guid_r)
+{
+	static bool looking_up = FALSE;
+	struct mailbox_metadata metadata;
+	int ret;
+
+	if (box->notify_broker_guid == NULL) {
+		/* looking up the GUID may need to commit a transaction
+		   itself */
+		if (looking_up)
+			return -1;
+		looking_up = TRUE;
+		ret = mailbox_get_metadata(box, MAILBOX_METADATA_GUID,
+					   &metadata);
+		looking_up = FALSE;
+		if (ret < 0)
+			return -1;
+		box->notify_broker_guid =
+			p_strdup(box->pool, guid_128_to_string(metadata.guid));
+	}
+	*guid_r = box->notify_broker_guid;
+	return 0;
+}
+
+bool mailbox_notify_client_watch(struct mailbox *box)
+{
+	struct mailbox_notify_client *client;
+	struct mailbox_notify_guid *notify_guid;
+	struct mailbox *const *boxp;
+	const char *guid;
+
+	if (mailbox_notify_get_guid(box, &guid) < 0)
+		return FALSE;
+
+	client = mailbox_notify_client_get(box);
+	notify_guid = hash_table_lookup(client->guids, guid);
+	if (notify_guid == NULL) {
+		notify_guid = i_new(struct mailbox_notify_guid, 1);
+		notify_guid->guid = i_strdup(guid);
+		i_array_init(&notify_guid->boxes, 4);
+		hash_table_insert(client->guids, notify_guid->guid,
+				  notify_guid);
+		mailbox_notify_guid_send(client, "WATCH", guid);
+	} else {
+		array_foreach(&notify_guid->boxes, boxp) {
+			if (*boxp == box)
+				return client->connected;
+		}
+	}
+	array_push_back(&notify_guid->boxes, &box);
+	/* Keep the watch even while disconnected, so it's sent again after
+	   reconnecting. Until then the caller needs to watch the mailbox
+	   some other way. */
+	return client->connected;
+}
+
+void mailbox_notify_client_unwatch(struct mailbox *box)
+{
+	struct mailbox_notify_client *client = mailbox_notify_client;
+	struct mailbox_notify_guid *notify_guid;
+	struct mailbox *const *boxp;
+
+	if (client == NULL || box->notify_broker_guid == NULL)
+		return;
+	notify_guid = hash_table_lookup(client->guids, box->notify_broker_guid);
+	if (notify_guid == NULL)
+		return;
+
+	array_foreach(&notify_guid->boxes, boxp) {
+		if (*boxp == box) {
+			array_delete(&notify_guid->boxes,
+				     array_foreach_idx(&notify_guid->boxes, boxp), 1);
+			break;
+		}
+	}
+	if (array_count(&notify_guid->boxes) > 0)
+		return;
+
+	mailbox_notify_guid_send(client, "UNWATCH", notify_guid->guid);
+	hash_table_remove(client->guids, notify_guid->guid);
+	array_free(&notify_guid->boxes);
+	i_free(notify_guid->guid);
+	i_free(notify_guid);
+}
+
+void mailbox_notify_client_changed(struct mailbox *box, uint64_t modseq)
+{
+	struct mailbox_notify_client *client;
+	struct mailbox_notify_guid *notify_guid;
+	const char *guid;
+
+	if (mailbox_notify_get_guid(box, &guid) < 0)
+		return;
+
+	client = mailbox_notify_client_get(box);
+	if (client->connected) {
+		o_stream_nsend_str(client->conn.output,
+			t_strdup_printf("CHANGED\t%s\t%"PRIu64"\n",
+					guid, modseq));
+	}
+
+	/* the broker doesn't send our own changes back to us */
+	notify_guid = hash_table_lookup(client->guids, guid);
+	if (notify_guid != NULL)
+		mailbox_notify_guid_notify(notify_guid, box);
+}
+
+void mailbox_notify_client_deinit(void)
+{
+	struct mailbox_notify_client *client = mailbox_notify_client;
+
+	if (client == NULL)
+		return;
+	mailbox_notify_client = NULL;
+
+	/* all mailboxes have been closed by now */
+	i_assert(hash_table_count(client->guids) == 0);
+	hash_table_destroy(&client->guids);
+	if (client->connected)
+		(void)o_stream_flush(client->conn.output);
+	connection_deinit(&client->conn);
+	timeout_remove(&client->to_reconnect);
+	i_free(client);
+	connection_list_deinit(&mailbox_notify_clients);
+}
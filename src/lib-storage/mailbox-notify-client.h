@@ -0,0 +1,21 @@
+#ifndef MAILBOX_NOTIFY_CLIENT_H
+#define MAILBOX_NOTIFY_CLIENT_H
+
+struct mailbox;
+
+/* Client for the mailbox-notify service. Writers send the mailbox GUID and
+   modseq after each committed change, and the service forwards them to all
+   processes watching the mailbox. All mailboxes in the process share one
+   connection. */
+
+/* Start receiving change notifications for the mailbox via the broker.
+   Returns FALSE if the mailbox can't be watched this way, including when
+   the broker isn't currently connected. */
+bool mailbox_notify_client_watch(struct mailbox *box);
+void mailbox_notify_client_unwatch(struct mailbox *box);
+/* Notify other watchers that the mailbox was changed. */
+void mailbox_notify_client_changed(struct mailbox *box, uint64_t modseq);
+
+void mailbox_notify_client_deinit(void);
+
+#endif
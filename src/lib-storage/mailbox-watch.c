@@ -4,6 +4,7 @@
 #include "ioloop.h"
 #include "mail-storage-private.h"
 #include "mailbox-watch.h"
+#include "mailbox-notify-client.h"
 
 #include <unistd.h>
 #include <fcntl.h>
@@ -45,7 +46,8 @@ static void notify_timeout(struct mailbox *box)
 
 static void notify_callback(struct mailbox *box)
 {
-	timeout_reset(box->to_notify);
+	if (box->to_notify != NULL)
+		timeout_reset(box->to_notify);
 
 	if (box->to_notify_delay == NULL) {
 		box->to_notify_delay =
@@ -63,7 +65,11 @@ void mailbox_watch_add(struct mailbox *box, const char *path)
 
 	i_assert(set->mailbox_idle_check_interval > 0);
 
-	(void)io_add_notify(path, notify_callback, box, &io);
+	/* With the notify broker the changes are received via the
+	   mailbox-notify service. Fall back to inotify if the mailbox can't
+	   be watched that way. */
+	if (!set->mailbox_notify_broker || !mailbox_notify_client_watch(box))
+		(void)io_add_notify(path, notify_callback, box, &io);
 
 	file = i_new(struct mailbox_notify_file, 1);
 	file->path = i_strdup(path);
@@ -97,10 +103,16 @@ void mailbox_watch_remove_all(struct mailbox *box)
 		i_free(file);
 	}
 
+	mailbox_notify_client_unwatch(box);
 	timeout_remove(&box->to_notify_delay);
 	timeout_remove(&box->to_notify);
 }
 
+void mailbox_watch_notify(struct mailbox *box)
+{
+	notify_callback(box);
+}
+
 static void notify_extract_callback(struct mailbox *box ATTR_UNUSED)
 {
 	i_unreached();
@@ -3,6 +3,9 @@
 
 void mailbox_watch_add(struct mailbox *box, const char *path);
 void mailbox_watch_remove_all(struct mailbox *box);
+/* Notify the mailbox about a change the same way as if one of its watched
+   files had changed. */
+void mailbox_watch_notify(struct mailbox *box);
 
 /* Create a new temporary ioloop, add all the watches back and call
    io_loop_extract_notify_fd() on it. Returns fd on success, -1 on error. */
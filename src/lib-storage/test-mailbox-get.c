@@ -4,6 +4,7 @@
 #include "array.h"
 #include "test-common.h"
 #include "mail-index-modseq.h"
+#include "mail-index-expunge-history.h"
 #include "mail-storage-private.h"
 
 static uint32_t expunge_uids[] = { 25, 15, 7, 3, 11, 1, 53, 33 };
@@ -11,24 +12,65 @@ static guid_128_t mail_guids[N_ELEMENTS(expunge_uids)];
 static unsigned int expunge_idx;
 static unsigned int nonexternal_idx;
 
+static uint32_t existing_uids[] = { 5, 54 };
+static uint32_t history_last_file_seq;
+static int history_lookup_ret = 1;
+
 uint32_t mail_index_view_get_messages_count(struct mail_index_view *view ATTR_UNUSED)
 {
-	return 0;
+	return N_ELEMENTS(existing_uids);
 }
 
 void mail_index_lookup_uid(struct mail_index_view *view ATTR_UNUSED,
 			   uint32_t seq, uint32_t *uid_r)
 {
-	*uid_r = seq;
+	*uid_r = existing_uids[seq-1];
 }
 
 bool mail_index_lookup_seq_range(struct mail_index_view *view ATTR_UNUSED,
 				 uint32_t first_uid, uint32_t last_uid,
 				 uint32_t *first_seq_r, uint32_t *last_seq_r)
 {
-	*first_seq_r = first_uid;
-	*last_seq_r = last_uid;
-	return TRUE;
+	unsigned int i;
+
+	*first_seq_r = 0;
+	for (i = 0; i < N_ELEMENTS(existing_uids); i++) {
+		if (existing_uids[i] < first_uid ||
+		    existing_uids[i] > last_uid)
+			continue;
+		if (*first_seq_r == 0)
+			*first_seq_r = i + 1;
+		*last_seq_r = i + 1;
+	}
+	return *first_seq_r != 0;
+}
+
+const struct mail_index_header *
+mail_index_get_header(struct mail_index_view *view ATTR_UNUSED)
+{
+	static struct mail_index_header hdr = { .next_uid = 55 };
+	return &hdr;
+}
+
+int mail_index_expunge_history_lookup(struct mail_index *index ATTR_UNUSED,
+				      uint64_t prev_modseq ATTR_UNUSED,
+				      ARRAY_TYPE(seq_range) *expunged_uids,
+				      uint32_t *last_file_seq_r)
+{
+	seq_range_array_add_range(expunged_uids, 4, 6);
+	seq_range_array_add(expunged_uids, 9);
+	seq_range_array_add(expunged_uids, 53);
+	seq_range_array_add(expunged_uids, 60);
+	*last_file_seq_r = history_last_file_seq;
+	return history_lookup_ret;
+}
+
+void mail_transaction_log_view_get_prev_pos(struct mail_transaction_log_view *view ATTR_UNUSED,
+					    uint32_t *file_seq_r,
+					    uoff_t *file_offset_r)
+{
+	*file_seq_r = 100;
+	*file_offset_r = 0;
 }
 
 bool mail_index_modseq_get_next_log_offset(struct mail_index_view *view ATTR_UNUSED,
@@ -146,10 +188,69 @@ static void test_mailbox_get_expunges(void)
 	test_end();
 }
 
+static void test_mailbox_get_expunges_history(void)
+{
+	struct mailbox *box;
+	ARRAY_TYPE(seq_range) uids_filter, expunged_uids;
+	const struct seq_range *range;
+	unsigned int count;
+	uint64_t modseq = 98ULL << 32;
+
+	box = t_new(struct mailbox, 1);
+	box->index = t_new(struct mail_index, 1);
+	box->view = t_new(struct mail_index_view, 1);
+
+	box->view->log_file_head_seq = 101;
+	box->view->log_file_head_offset = 1024;
+
+	test_begin("mailbox get expunges from history");
+
+	nonexternal_idx = 1;
+	t_array_init(&uids_filter, 32);
+	seq_range_array_add_range(&uids_filter, 1, 20);
+	seq_range_array_add_range(&uids_filter, 53, 60);
+
+	/* history doesn't reach the oldest log file */
+	history_last_file_seq = 98;
+	t_array_init(&expunged_uids, 32);
+	test_assert(!mailbox_get_expunged_uids(box, modseq, &uids_filter,
+					       &expunged_uids));
+	test_assert(!seq_range_exists(&expunged_uids, 4));
+
+	/* history continues where the logs begin: the existing UID 5 and the
+	   not yet seen UID 60 are dropped */
+	history_last_file_seq = 99;
+	array_clear(&expunged_uids);
+	test_assert(mailbox_get_expunged_uids(box, modseq, &uids_filter,
+					      &expunged_uids));
+	range = array_get(&expunged_uids, &count);
+	test_assert(count == 6);
+	test_assert(range[0].seq1 == 1 && range[0].seq2 == 1);
+	test_assert(range[1].seq1 == 3 && range[1].seq2 == 4);
+	test_assert(range[2].seq1 == 6 && range[2].seq2 == 7);
+	test_assert(range[3].seq1 == 9 && range[3].seq2 == 9);
+	test_assert(range[4].seq1 == 11 && range[4].seq2 == 11);
+	test_assert(range[5].seq1 == 53 && range[5].seq2 == 53);
+
+	/* prev_modseq is within the merged history records: the UIDs are
+	   still returned, but they may have been expunged earlier */
+	history_lookup_ret = 0;
+	array_clear(&expunged_uids);
+	test_assert(!mailbox_get_expunged_uids(box, modseq, &uids_filter,
+					       &expunged_uids));
+	test_assert(seq_range_exists(&expunged_uids, 4));
+	test_assert(seq_range_exists(&expunged_uids, 9));
+	test_assert(!seq_range_exists(&expunged_uids, 5));
+	history_lookup_ret = 1;
+
+	test_end();
+}
+
 int main(void)
 {
 	static void (*const test_functions[])(void) = {
 		test_mailbox_get_expunges,
+		test_mailbox_get_expunges_history,
 		NULL
 	};
 	unsigned int i, j;
@@ -0,0 +1,310 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "net.h"
+#include "str.h"
+#include "istream.h"
+#include "ostream.h"
+#include "connection.h"
+#include "master-service.h"
+#include "mailbox-notify-client.h"
+#include "test-common.h"
+#include "test-mail-storage-common.h"
+
+#include <unistd.h>
+
+struct test_broker {
+	struct connection_list *clients;
+	struct connection conn;
+	char *path;
+	int listen_fd;
+	struct io *io_listen;
+
+	bool connected;
+	string_t *received;
+};
+
+static struct test_broker broker;
+static unsigned int notify_count;
+
+static int
+test_broker_input_args(struct connection *conn ATTR_UNUSED,
+		       const char *const *args)
+{
+	str_append(broker.received, t_strarray_join(args, "\t"));
+	str_append_c(broker.received, '\n');
+	return 1;
+}
+
+static void test_broker_destroy(struct connection *conn)
+{
+	connection_deinit(conn);
+	broker.connected = FALSE;
+}
+
+static const struct connection_settings test_broker_set = {
+	.service_name_in = "mailbox-notify-client",
+	.service_name_out = "mailbox-notify-server",
+	.major_version = 1,
+	.minor_version = 0,
+
+	.input_max_size = 1024,
+	.output_max_size = SIZE_MAX,
+	.client = FALSE
+};
+
+static const struct connection_vfuncs test_broker_vfuncs = {
+	.destroy = test_broker_destroy,
+	.input_args = test_broker_input_args,
+};
+
+static void test_broker_accept(void *context ATTR_UNUSED)
+{
+	int fd;
+
+	fd = net_accept(broker.listen_fd, NULL, NULL);
+	if (fd < 0)
+		return;
+	i_assert(!broker.connected);
+	net_set_nonblock(fd, TRUE);
+	connection_init_server(broker.clients, &broker.conn, "broker", fd, fd);
+	broker.connected = TRUE;
+}
+
+static void test_broker_init(const char *base_dir)
+{
+	i_zero(&broker);
+	broker.path = i_strconcat(base_dir, "/mailbox-notify", NULL);
+	broker.listen_fd = net_listen_unix(broker.path, 1);
+	if (broker.listen_fd == -1)
+		i_fatal("net_listen_unix(%s) failed: %m", broker.path);
+	broker.io_listen = io_add(broker.listen_fd, IO_READ,
+				  test_broker_accept, NULL);
+	broker.clients = connection_list_init(&test_broker_set,
+					      &test_broker_vfuncs);
+	broker.received = str_new(default_pool, 128);
+}
+
+static void test_broker_deinit(void)
+{
+	if (broker.connected)
+		test_broker_destroy(&broker.conn);
+	connection_list_deinit(&broker.clients);
+	io_remove(&broker.io_listen);
+	i_close_fd(&broker.listen_fd);
+	i_unlink(broker.path);
+	i_free(broker.path);
+	str_free(&broker.received);
+}
+
+static void test_ioloop_timeout(bool *timed_out)
+{
+	*timed_out = TRUE;
+	io_loop_stop(current_ioloop);
+}
+
+/* Run the ioloop until cond() returns TRUE or the timeout is reached. */
+static bool test_ioloop_run_until(bool (*cond)(void))
+{
+	struct timeout *to;
+	bool timed_out = FALSE;
+
+	to = timeout_add_short(2000, test_ioloop_timeout, &timed_out);
+	while (!cond() && !timed_out) {
+		struct timeout *to_step =
+			timeout_add_short(10, io_loop_stop, current_ioloop);
+		io_loop_run(current_ioloop);
+		timeout_remove(&to_step);
+	}
+	timeout_remove(&to);
+	return !timed_out;
+}
+
+static bool test_broker_received_line(void)
+{
+	return strchr(str_c(broker.received), '\n') != NULL;
+}
+
+static bool test_notified(void)
+{
+	return notify_count > 0;
+}
+
+static const char *test_broker_next_line(void)
+{
+	const char *data = str_c(broker.received);
+	const char *p = strchr(data, '\n');
+	const char *line;
+
+	if (p == NULL)
+		return "";
+	line = t_strdup_until(data, p);
+	str_delete(broker.received, 0, p - data + 1);
+	return line;
+}
+
+static void test_notify_callback(struct mailbox *box ATTR_UNUSED,
+				 void *context ATTR_UNUSED)
+{
+	notify_count++;
+}
+
+static void test_mail_save(struct mailbox *box)
+{
+	const char *mail_input = "Subject: test\n\nbody\n";
+	struct mailbox_transaction_context *trans;
+	struct mail_save_context *save_ctx;
+	struct istream *input;
+	int ret;
+
+	input = i_stream_create_from_data(mail_input, strlen(mail_input));
+	trans = mailbox_transaction_begin(box,
+			MAILBOX_TRANSACTION_FLAG_EXTERNAL, __func__);
+	save_ctx = mailbox_save_alloc(trans);
+	ret = mailbox_save_begin(&save_ctx, input);
+	while (ret == 0 && i_stream_read(input) > 0)
+		ret = mailbox_save_continue(save_ctx);
+	if (ret == 0)
+		ret = mailbox_save_finish(&save_ctx);
+	else
+		mailbox_save_cancel(&save_ctx);
+	i_stream_unref(&input);
+	if (ret < 0)
+		mailbox_transaction_rollback(&trans);
+	else
+		ret = mailbox_transaction_commit(&trans);
+	if (ret < 0) {
+		i_fatal("Failed to save mail: %s",
+			mailbox_get_last_internal_error(box, NULL));
+	}
+}
+
+static const char *test_mailbox_get_guid(struct mailbox *box)
+{
+	struct mailbox_metadata metadata;
+
+	if (mailbox_get_metadata(box, MAILBOX_METADATA_GUID, &metadata) < 0) {
+		i_fatal("mailbox_get_metadata() failed: %s",
+			mailbox_get_last_internal_error(box, NULL));
+	}
+	return guid_128_to_string(metadata.guid);
+}
+
+static struct test_mail_storage_ctx *test_init(const char **base_dir_r)
+{
+	struct test_mail_storage_ctx *ctx;
+	const char *base_dir;
+
+	ctx = test_mail_storage_init();
+	base_dir = t_strndup(ctx->home_root, strlen(ctx->home_root) - 1);
+	const char *const extra_input[] = {
+		"mailbox_notify_broker=yes",
+		t_strdup_printf("base_dir=%s", base_dir),
+		NULL
+	};
+	struct test_mail_storage_settings set = {
+		.driver = "sdbox",
+		.extra_input = extra_input,
+	};
+	test_mail_storage_init_user(ctx, &set);
+	*base_dir_r = base_dir;
+	return ctx;
+}
+
+static void test_mailbox_notify_client_not_connected(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct mailbox *box;
+	const char *base_dir;
+
+	test_begin("mailbox-notify client not connected");
+	ctx = test_init(&base_dir);
+	box = mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+
+	/* no broker listening - the caller needs to fall back to
+	   watching the mailbox some other way */
+	test_assert(!mailbox_notify_client_watch(box));
+	mailbox_notify_client_unwatch(box);
+
+	/* saving works without the broker */
+	test_mail_save(box);
+
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+static void test_mailbox_notify_client_connected(void)
+{
+	struct test_mail_storage_ctx *ctx;
+	struct mailbox *box;
+	const char *base_dir, *guid, *line;
+
+	test_begin("mailbox-notify client connected");
+	ctx = test_init(&base_dir);
+	/* the client connection is always moved to the root ioloop */
+	io_loop_set_current(io_loop_get_root());
+	test_broker_init(base_dir);
+
+	box = mailbox_alloc(ctx->user->namespaces->list, "INBOX", 0);
+	test_assert(mailbox_open(box) == 0);
+	guid = test_mailbox_get_guid(box);
+	notify_count = 0;
+	mailbox_notify_changes(box, test_notify_callback, NULL);
+	test_assert(mailbox_notify_client_watch(box));
+
+	test_assert(test_ioloop_run_until(test_broker_received_line));
+	test_assert_strcmp(test_broker_next_line(),
+			   t_strconcat("WATCH\t", guid, NULL));
+
+	/* changes from other processes are received via the broker */
+	o_stream_nsend_str(broker.conn.output,
+			   t_strdup_printf("CHANGED\t%s\t5\n", guid));
+	test_assert(test_ioloop_run_until(test_notified));
+
+	/* our own changes are sent to the broker */
+	test_mail_save(box);
+	test_assert(test_ioloop_run_until(test_broker_received_line));
+	line = test_broker_next_line();
+	test_assert(str_begins_with(line, t_strconcat("CHANGED\t", guid,
+						      "\t", NULL)));
+
+	/* losing the connection makes the watchers check their mailboxes,
+	   and the mailbox can't be watched via the broker anymore */
+	notify_count = 0;
+	test_broker_destroy(&broker.conn);
+	test_assert(test_ioloop_run_until(test_notified));
+	test_assert(!mailbox_notify_client_watch(box));
+
+	mailbox_notify_changes_stop(box);
+	mailbox_free(&box);
+	test_mail_storage_deinit_user(ctx);
+	test_broker_deinit();
+	io_loop_set_current(ctx->ioloop);
+	test_mail_storage_deinit(&ctx);
+	test_end();
+}
+
+int main(int argc, char **argv)
+{
+	void (*const tests[])(void) = {
+		test_mailbox_notify_client_not_connected,
+		test_mailbox_notify_client_connected,
+		NULL
+	};
+	int ret;
+
+	master_service = master_service_init("test-mailbox-notify-client",
+					     MASTER_SERVICE_FLAG_STANDALONE |
+					     MASTER_SERVICE_FLAG_DONT_SEND_STATS |
+					     MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS |
+					     MASTER_SERVICE_FLAG_NO_SSL_INIT |
+					     MASTER_SERVICE_FLAG_NO_INIT_DATASTACK_FRAME,
+					     &argc, &argv, "");
+	ret = test_run(tests);
+	master_service_deinit(&master_service);
+	return ret;
+}
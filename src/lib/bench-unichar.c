@@ -0,0 +1,73 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "strnum.h"
+#include "time-util.h"
+#include "unichar.h"
+
+#include <stdio.h>
+
+/**
+ * Runs uni_utf8_to_decomposed_titlecase() over short strings shaped like
+ * mail headers (mostly ASCII, some Latin-1 and some other scripts) and
+ * reports the throughput.
+ */
+
+static const char *const inputs[] = {
+	"Re: Fwd: quarterly report for the infrastructure team meeting",
+	"John Smith <john.smith@example.com>",
+	"Caf\xc3\xa9 na\xc3\xafve \xc3\x9c" "bermut \xc3\xa5ngstr\xc3\xb6m",
+	"\xd0\x9f\xd1\x80\xd0\xb8\xd0\xbc\xd0\xb5\xd1\x80 "
+	"\xce\xa9mega \xe3\x83\x87\xe3\x83\xbc\xe3\x82\xbf",
+	"\xea\xb0\x80 \xef\xbc\xa1\xef\xbd\x82 \xe2\x84\xab",
+};
+
+static void bench_decomposed_titlecase(unsigned int iterations)
+{
+	buffer_t *output = t_buffer_create(256);
+	uint64_t start, usecs, bytes = 0;
+	unsigned int i, n;
+
+	start = i_microseconds();
+	for (n = 0; n < iterations; n++) {
+		for (i = 0; i < N_ELEMENTS(inputs); i++) {
+			size_t len = strlen(inputs[i]);
+
+			buffer_set_used_size(output, 0);
+			uni_utf8_to_decomposed_titlecase(inputs[i], len, output);
+			bytes += len;
+		}
+	}
+	usecs = i_microseconds() - start;
+	printf("uni_utf8_to_decomposed_titlecase(): %"PRIu64" bytes in "
+	       "%"PRIu64" usecs (%.1f MB/s)\n", bytes, usecs,
+	       usecs == 0 ? 0.0 : (double)bytes / usecs);
+}
+
+static void print_usage(const char *prog)
+{
+	fprintf(stderr, "Usage: %s [iterations]\n", prog);
+	fprintf(stderr, "Runs 100000 iterations if nothing given\n");
+	lib_exit(1);
+}
+
+int main(int argc, const char *argv[])
+{
+	unsigned int iterations = 100000;
+
+	lib_init();
+	if (argc > 2)
+		print_usage(argv[0]);
+	if (argc == 2 && (str_to_uint(argv[1], &iterations) < 0 ||
+			  iterations == 0)) {
+		fprintf(stderr, "Invalid parameters\n");
+		print_usage(argv[0]);
+	}
+
+	T_BEGIN {
+		bench_decomposed_titlecase(iterations);
+	} T_END;
+	lib_deinit();
+	return 0;
+}
@@ -74,6 +74,10 @@ struct timeout {
 
         unsigned int msecs;
 	struct timeval next_run;
+	/* If non-zero, the timeout was reset after it was placed in the
+	   queue. next_run is still the queue position, but the timeout isn't
+	   run before this time. */
+	struct timeval reset_next_run;
 
 	timeout_callback_t *callback;
         void *context;
@@ -18,6 +18,10 @@
    Dovecot generally doesn't have very important short timeouts, so to avoid
    logging many warnings about this, use a rather high value. */
 #define IOLOOP_TIME_MOVED_FORWARDS_MIN_USECS (100000)
+/* timeout_reset() for timeouts with at least this long interval only marks
+   the new run time. The timeout is repositioned in the queue only when it
+   reaches the head of the queue. */
+#define IOLOOP_TIMEOUT_LAZY_RESET_MIN_MSECS 1000
 
 time_t ioloop_time = 0;
 struct timeval ioloop_timeval;
@@ -376,6 +380,7 @@ timeout_copy(const struct timeout *old_to, struct ioloop *ioloop)
 	new_to->one_shot = old_to->one_shot;
 	new_to->msecs = old_to->msecs;
 	new_to->next_run = old_to->next_run;
+	new_to->reset_next_run = old_to->reset_next_run;
 
 	if (old_to->item.idx != UINT_MAX)
 		priorityq_add(new_to->ioloop->timeouts, &new_to->item);
@@ -426,7 +431,24 @@ timeout_reset_timeval(struct timeout *timeout, struct timeval *tv_now)
 	if (timeout->item.idx == UINT_MAX)
 		return;
 
-	timeout_update_next(timeout, tv_now);
+	if (tv_now == NULL &&
+	    timeout->msecs >= IOLOOP_TIMEOUT_LAZY_RESET_MIN_MSECS) {
+		/* Idle timeouts are commonly reset after every input. Avoid
+		   updating the queue each time - the new next_run is always
+		   later, so it's enough to check it once the old next_run is
+		   reached. */
+		struct timeval old_next_run = timeout->next_run;
+
+		timeout_update_next(timeout, NULL);
+		if (timeval_cmp(&timeout->next_run, &old_next_run) >= 0) {
+			timeout->reset_next_run = timeout->next_run;
+			timeout->next_run = old_next_run;
+			return;
+		}
+	} else {
+		timeout_update_next(timeout, tv_now);
+	}
+	i_zero(&timeout->reset_next_run);
 	/* If we came here from io_loop_handle_timeouts_real(), next_run must
 	   be larger than tv_now or it can go to infinite loop. This would
 	   mainly happen with 0 ms timeouts. Avoid this by making sure
@@ -491,15 +513,33 @@ static int timeout_get_wait_time(struct timeout *timeout, struct timeval *tv_r,
 	return ret;
 }
 
+static struct timeout *io_loop_peek_timeout(struct ioloop *ioloop)
+{
+	struct priorityq_item *item;
+	struct timeout *timeout;
+
+	/* Move the lazily reset timeouts to their actual positions in the
+	   queue once they reach the head. */
+	while ((item = priorityq_peek(ioloop->timeouts)) != NULL) {
+		timeout = (struct timeout *)item;
+		if (timeout->reset_next_run.tv_sec == 0)
+			return timeout;
+
+		timeout->next_run = timeout->reset_next_run;
+		i_zero(&timeout->reset_next_run);
+		priorityq_remove(ioloop->timeouts, &timeout->item);
+		priorityq_add(ioloop->timeouts, &timeout->item);
+	}
+	return NULL;
+}
+
 static int io_loop_get_wait_time(struct ioloop *ioloop, struct timeval *tv_r)
 {
 	struct timeval tv_now;
-	struct priorityq_item *item;
 	struct timeout *timeout;
 	int msecs;
 
-	item = priorityq_peek(ioloop->timeouts);
-	timeout = (struct timeout *)item;
+	timeout = io_loop_peek_timeout(ioloop);
 
 	/* we need to see if there are pending IO waiting,
 	   if there is, we set msecs = 0 to ensure they are
@@ -602,10 +642,19 @@ static void io_loop_timeouts_update(struct ioloop *ioloop, long long diff_usecs)
 	for (i = 0; i < count; i++) {
 		struct timeout *to = (struct timeout *)items[i];
 
-		if (diff_usecs > 0)
+		if (diff_usecs > 0) {
 			timeval_add_usecs(&to->next_run, diff_usecs);
-		else
+			if (to->reset_next_run.tv_sec != 0) {
+				timeval_add_usecs(&to->reset_next_run,
+						  diff_usecs);
+			}
+		} else {
 			timeval_sub_usecs(&to->next_run, -diff_usecs);
+			if (to->reset_next_run.tv_sec != 0) {
+				timeval_sub_usecs(&to->reset_next_run,
+						  -diff_usecs);
+			}
+		}
 	}
 }
 
@@ -637,7 +686,7 @@ static void ioloop_add_wait_time(struct ioloop *ioloop)
 
 static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 {
-	struct priorityq_item *item;
+	struct timeout *timeout;
 	struct timeval tv_old, tv, tv_call;
 	long long diff_usecs;
 	data_stack_frame_t t_id;
@@ -670,9 +719,7 @@ static void io_loop_handle_timeouts_real(struct ioloop *ioloop)
 	tv_call = ioloop_timeval;
 
 	while (ioloop->running &&
-	       (item = priorityq_peek(ioloop->timeouts)) != NULL) {
-		struct timeout *timeout = (struct timeout *)item;
-
+	       (timeout = io_loop_peek_timeout(ioloop)) != NULL) {
 		/* use tv_call to make sure we don't get to infinite loop in
 		   case callbacks update ioloop_timeval. */
 		if (timeout_get_wait_time(timeout, &tv, &tv_call, TRUE) > 0)
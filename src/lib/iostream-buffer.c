@@ -0,0 +1,129 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "iostream-buffer.h"
+
+#ifdef HAVE_VALGRIND_VALGRIND_H
+#  include <valgrind/valgrind.h>
+/* let valgrind catch accesses to freed buffers */
+#  define IOSTREAM_BUFFER_CACHE_ENABLED (!RUNNING_ON_VALGRIND)
+#else
+#  define IOSTREAM_BUFFER_CACHE_ENABLED TRUE
+#endif
+
+/* Number of size classes: IO_BLOCK_SIZE, IO_BLOCK_SIZE*2, ... */
+#define IOSTREAM_BUFFER_CLASS_COUNT 8
+/* Maximum number of cached buffers in each size class */
+#define IOSTREAM_BUFFER_CACHE_MAX_COUNT 4
+
+/* The buffer's size is stored before the returned memory */
+#define IOSTREAM_BUFFER_HDR_SIZE MEM_ALIGN(sizeof(size_t))
+
+static void *cache[IOSTREAM_BUFFER_CLASS_COUNT][IOSTREAM_BUFFER_CACHE_MAX_COUNT];
+static unsigned int cache_count[IOSTREAM_BUFFER_CLASS_COUNT];
+static bool cache_atexit_registered = FALSE;
+
+static bool iostream_buffer_get_class(size_t size, unsigned int *class_r)
+{
+	size_t class_size = IO_BLOCK_SIZE;
+	unsigned int i;
+
+	if (size > IOSTREAM_BUFFER_CACHE_MAX_SIZE)
+		return FALSE;
+	for (i = 0; i < IOSTREAM_BUFFER_CLASS_COUNT; i++) {
+		if (size == class_size) {
+			*class_r = i;
+			return TRUE;
+		}
+		class_size *= 2;
+	}
+	return FALSE;
+}
+
+static void iostream_buffer_cache_free(void)
+{
+	unsigned int i;
+
+	for (i = 0; i < IOSTREAM_BUFFER_CLASS_COUNT; i++) {
+		while (cache_count[i] > 0)
+			free(cache[i][--cache_count[i]]);
+	}
+}
+
+static unsigned char *iostream_buffer_alloc_nonzero(size_t size)
+{
+	unsigned char *mem;
+	unsigned int class_idx;
+
+	i_assert(size > 0);
+
+	if (iostream_buffer_get_class(size, &class_idx) &&
+	    cache_count[class_idx] > 0)
+		mem = cache[class_idx][--cache_count[class_idx]];
+	else {
+		mem = malloc(IOSTREAM_BUFFER_HDR_SIZE + size);
+		if (unlikely(mem == NULL)) {
+			i_fatal_status(FATAL_OUTOFMEM,
+				"iostream_buffer_alloc(%zu): Out of memory",
+				size);
+		}
+		memcpy(mem, &size, sizeof(size));
+	}
+	return mem + IOSTREAM_BUFFER_HDR_SIZE;
+}
+
+void *iostream_buffer_alloc(size_t size)
+{
+	unsigned char *buf = iostream_buffer_alloc_nonzero(size);
+
+	memset(buf, 0, size);
+	return buf;
+}
+
+void *iostream_buffer_realloc(void *buf, size_t old_size, size_t new_size)
+{
+	unsigned char *mem;
+
+	i_assert(old_size <= new_size);
+
+	if (buf == NULL)
+		return iostream_buffer_alloc(new_size);
+
+	/* grow in place if possible, like i_realloc() */
+	mem = realloc((unsigned char *)buf - IOSTREAM_BUFFER_HDR_SIZE,
+		      IOSTREAM_BUFFER_HDR_SIZE + new_size);
+	if (unlikely(mem == NULL)) {
+		i_fatal_status(FATAL_OUTOFMEM,
+			"iostream_buffer_realloc(%zu): Out of memory",
+			new_size);
+	}
+	memcpy(mem, &new_size, sizeof(new_size));
+	memset(mem + IOSTREAM_BUFFER_HDR_SIZE + old_size, 0,
+	       new_size - old_size);
+	return mem + IOSTREAM_BUFFER_HDR_SIZE;
+}
+
+void iostream_buffer_free(void *buf)
+{
+	unsigned char *mem;
+	unsigned int class_idx;
+	size_t size;
+
+	if (buf == NULL)
+		return;
+
+	mem = (unsigned char *)buf - IOSTREAM_BUFFER_HDR_SIZE;
+	memcpy(&size, mem, sizeof(size));
+	if (!IOSTREAM_BUFFER_CACHE_ENABLED ||
+	    !iostream_buffer_get_class(size, &class_idx) ||
+	    cache_count[class_idx] == IOSTREAM_BUFFER_CACHE_MAX_COUNT) {
+		free(mem);
+		return;
+	}
+	if (!cache_atexit_registered) {
+		lib_atexit_priority(iostream_buffer_cache_free,
+				    LIB_ATEXIT_PRIORITY_LOW);
+		cache_atexit_registered = TRUE;
+	}
+	cache[class_idx][cache_count[class_idx]++] = mem;
+}
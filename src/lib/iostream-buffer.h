@@ -0,0 +1,22 @@
+#ifndef IOSTREAM_BUFFER_H
+#define IOSTREAM_BUFFER_H
+
+/* Buffers for istream and ostream implementations. Freed buffers are kept
+   in a small per-process cache, so streams that are created and destroyed
+   repeatedly (e.g. one for each mail in FETCH 1:*) can reuse the same
+   buffers instead of allocating new ones. Only power-of-two sizes between
+   IO_BLOCK_SIZE and IOSTREAM_BUFFER_CACHE_MAX_SIZE are cached.
+
+   Like with i_malloc(), the returned memory is zeroed. */
+
+#define IOSTREAM_BUFFER_CACHE_MAX_SIZE (256*1024)
+
+void *iostream_buffer_alloc(size_t size);
+/* Grow buf to new_size, keeping its first old_size bytes. Like i_realloc(),
+   the buffer is grown in place if possible. buf may be NULL if old_size
+   is 0. */
+void *iostream_buffer_realloc(void *buf, size_t old_size, size_t new_size);
+/* Free the buffer, or put it to the cache. buf may be NULL. */
+void iostream_buffer_free(void *buf);
+
+#endif
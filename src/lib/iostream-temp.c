@@ -4,6 +4,7 @@
 #include "buffer.h"
 #include "str.h"
 #include "safe-mkstemp.h"
+#include "memfd-temp.h"
 #include "write-full.h"
 #include "istream-private.h"
 #include "ostream-private.h"
@@ -28,11 +29,23 @@ struct temp_ostream {
 	int fd;
 	bool fd_tried;
 	uoff_t fd_size;
+	/* Bytes reserved from the memfd budget, if fd is a memfd */
+	uoff_t memfd_reserved;
+	bool fd_is_memfd;
 };
 
 static bool o_stream_temp_dup_cancel(struct temp_ostream *tstream,
 				     enum ostream_send_istream_result *res_r);
 
+static void o_stream_temp_memfd_release(struct temp_ostream *tstream)
+{
+	if (tstream->fd_is_memfd) {
+		memfd_temp_release(tstream->memfd_reserved);
+		tstream->memfd_reserved = 0;
+		tstream->fd_is_memfd = FALSE;
+	}
+}
+
 static void
 o_stream_temp_close(struct iostream_private *stream,
 		    bool close_parent ATTR_UNUSED)
@@ -40,33 +53,56 @@ o_stream_temp_close(struct iostream_private *stream,
 	struct temp_ostream *tstream =
 		container_of(stream, struct temp_ostream, ostream.iostream);
 
+	o_stream_temp_memfd_release(tstream);
 	i_close_fd(&tstream->fd);
 	buffer_free(&tstream->buf);
 	i_free(tstream->temp_path_prefix);
 	i_free(tstream->name);
 }
 
-static int o_stream_temp_move_to_fd(struct temp_ostream *tstream)
+static int o_stream_temp_create_file(struct temp_ostream *tstream)
 {
 	string_t *path;
-
-	if (tstream->fd_tried)
-		return -1;
-	tstream->fd_tried = TRUE;
+	int fd;
 
 	path = t_str_new(128);
 	str_append(path, tstream->temp_path_prefix);
-	tstream->fd = safe_mkstemp_hostpid(path, 0600, (uid_t)-1, (gid_t)-1);
-	if (tstream->fd == -1) {
+	fd = safe_mkstemp_hostpid(path, 0600, (uid_t)-1, (gid_t)-1);
+	if (fd == -1) {
 		i_error("safe_mkstemp(%s) failed: %m", str_c(path));
 		return -1;
 	}
 	if (i_unlink(str_c(path)) < 0) {
-		i_close_fd(&tstream->fd);
+		i_close_fd(&fd);
+		return -1;
+	}
+	return fd;
+}
+
+static int o_stream_temp_move_to_fd(struct temp_ostream *tstream)
+{
+	if (tstream->fd_tried)
 		return -1;
+	tstream->fd_tried = TRUE;
+
+	/* Prefer keeping the data in a memory-backed memfd as long as the
+	   per-process budget allows it. It avoids creating, writing and
+	   unlinking real files on disk. */
+	tstream->fd = memfd_temp_create(o_stream_get_name(&tstream->ostream.ostream),
+					tstream->buf->used);
+	if (tstream->fd != -1) {
+		tstream->fd_is_memfd = TRUE;
+		tstream->memfd_reserved = tstream->buf->used;
+	} else {
+		tstream->fd = o_stream_temp_create_file(tstream);
+		if (tstream->fd == -1)
+			return -1;
 	}
 	if (write_full(tstream->fd, tstream->buf->data, tstream->buf->used) < 0) {
-		i_error("write(%s) failed: %m", str_c(path));
+		i_error("iostream-temp %s: write(%s*) failed: %m",
+			o_stream_get_name(&tstream->ostream.ostream),
+			tstream->temp_path_prefix);
+		o_stream_temp_memfd_release(tstream);
 		i_close_fd(&tstream->fd);
 		return -1;
 	}
@@ -78,6 +114,54 @@ static int o_stream_temp_move_to_fd(struct temp_ostream *tstream)
 	return 0;
 }
 
+static int o_stream_temp_memfd_spill(struct temp_ostream *tstream)
+{
+	unsigned char buf[IO_BLOCK_SIZE];
+	uoff_t offset = 0;
+	off_t pos;
+	ssize_t ret = 0;
+	int fd;
+
+	fd = o_stream_temp_create_file(tstream);
+	if (fd == -1)
+		return -1;
+
+	while (offset < tstream->fd_size &&
+	       (ret = pread(tstream->fd, buf, sizeof(buf), offset)) > 0) {
+		if (write_full(fd, buf, ret) < 0)
+			break;
+		offset += ret;
+	}
+	if (offset < tstream->fd_size ||
+	    (pos = lseek(tstream->fd, 0, SEEK_CUR)) < 0 ||
+	    lseek(fd, pos, SEEK_SET) < 0) {
+		i_error("iostream-temp %s: Moving memfd to %s* failed: %m",
+			o_stream_get_name(&tstream->ostream.ostream),
+			tstream->temp_path_prefix);
+		i_close_fd(&fd);
+		return -1;
+	}
+	o_stream_temp_memfd_release(tstream);
+	i_close_fd(&tstream->fd);
+	tstream->fd = fd;
+	tstream->ostream.fd = fd;
+	return 0;
+}
+
+static void
+o_stream_temp_memfd_grow(struct temp_ostream *tstream, uoff_t new_size)
+{
+	if (!tstream->fd_is_memfd || new_size <= tstream->memfd_reserved)
+		return;
+	if (memfd_temp_reserve(new_size - tstream->memfd_reserved)) {
+		tstream->memfd_reserved = new_size;
+		return;
+	}
+	/* Memory budget is used up. Move the data to a real temp file.
+	   If that fails, just keep using the memfd. */
+	(void)o_stream_temp_memfd_spill(tstream);
+}
+
 int o_stream_temp_move_to_memory(struct ostream *output)
 {
 	struct temp_ostream *tstream =
@@ -103,6 +187,7 @@ int o_stream_temp_move_to_memory(struct ostream *output)
 		tstream->ostream.ostream.stream_errno = EIO;
 		return -1;
 	}
+	o_stream_temp_memfd_release(tstream);
 	i_close_fd(&tstream->fd);
 	tstream->ostream.fd = -1;
 	return 0;
@@ -115,6 +200,11 @@ o_stream_temp_fd_sendv(struct temp_ostream *tstream,
 	size_t bytes = 0;
 	unsigned int i;
 
+	for (i = 0; i < iov_count; i++)
+		bytes += iov[i].iov_len;
+	o_stream_temp_memfd_grow(tstream, tstream->fd_size + bytes);
+
+	bytes = 0;
 	for (i = 0; i < iov_count; i++) {
 		if (write_full(tstream->fd, iov[i].iov_base, iov[i].iov_len) < 0) {
 			i_error("iostream-temp %s: write(%s*) failed: %m - moving to memory",
@@ -276,6 +366,7 @@ o_stream_temp_write_at(struct ostream_private *stream,
 		buffer_write(tstream->buf, offset, data, size);
 		stream->ostream.offset = tstream->buf->used;
 	} else {
+		o_stream_temp_memfd_grow(tstream, offset + size);
 		if (pwrite_full(tstream->fd, data, size, offset) < 0) {
 			stream->ostream.stream_errno = errno;
 			i_close_fd(&tstream->fd);
@@ -345,6 +436,12 @@ static void iostream_temp_buf_destroyed(buffer_t *buf)
 	buffer_free(&buf);
 }
 
+static void iostream_temp_memfd_destroyed(uoff_t *reserved)
+{
+	memfd_temp_release(*reserved);
+	i_free(reserved);
+}
+
 struct istream *iostream_temp_finish(struct ostream **output,
 				     size_t max_buffer_size)
 {
@@ -383,6 +480,21 @@ struct istream *iostream_temp_finish(struct ostream **output,
 	} else if (tstream->dupstream != NULL) {
 		/* return the original failed stream. */
 		input = tstream->dupstream;
+	} else if (tstream->fd != -1 && tstream->fd_is_memfd) {
+		int fd = tstream->fd;
+		uoff_t *reserved = i_new(uoff_t, 1);
+
+		/* The contents won't change anymore. Sealing guarantees that
+		   also to anyone the fd is passed to. */
+		(void)memfd_temp_seal(tstream->fd);
+		*reserved = tstream->memfd_reserved;
+		tstream->fd_is_memfd = FALSE;
+		input = i_stream_create_fd_autoclose(&tstream->fd, max_buffer_size);
+		i_stream_set_name(input, t_strdup_printf(
+			"(Temp memfd %d for %s%s, %"PRIuUOFF_T" bytes)",
+			fd, tstream->temp_path_prefix, for_path, tstream->fd_size));
+		i_stream_add_destroy_callback(input, iostream_temp_memfd_destroyed,
+					      reserved);
 	} else if (tstream->fd != -1) {
 		int fd = tstream->fd;
 		input = i_stream_create_fd_autoclose(&tstream->fd, max_buffer_size);
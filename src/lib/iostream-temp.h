@@ -9,7 +9,9 @@ enum iostream_temp_flags {
 };
 
 /* Start writing to given output stream. The data is initially written to
-   memory, and later to a temporary file that is immediately unlinked. */
+   memory, and later to a memfd or to a temporary file that is immediately
+   unlinked. memfds are used as long as the memfd_temp_set_max_size() budget
+   allows it. After that the data is moved to the temporary file. */
 struct ostream *iostream_temp_create(const char *temp_path_prefix,
 				     enum iostream_temp_flags flags);
 struct ostream *iostream_temp_create_named(const char *temp_path_prefix,
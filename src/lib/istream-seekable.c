@@ -7,6 +7,7 @@
 #include "read-full.h"
 #include "write-full.h"
 #include "safe-mkstemp.h"
+#include "memfd-temp.h"
 #include "istream-private.h"
 #include "istream-concat.h"
 #include "istream-seekable.h"
@@ -28,9 +29,22 @@ struct seekable_istream {
 	struct istream *fd_input;
 	unsigned int cur_idx;
 	int fd;
+	/* Bytes reserved from the memfd budget, if fd is a memfd */
+	uoff_t memfd_reserved;
 	bool free_context;
+	bool try_memfd;
+	bool fd_is_memfd;
 };
 
+static void i_stream_seekable_memfd_release(struct seekable_istream *sstream)
+{
+	if (sstream->fd_is_memfd) {
+		memfd_temp_release(sstream->memfd_reserved);
+		sstream->memfd_reserved = 0;
+		sstream->fd_is_memfd = FALSE;
+	}
+}
+
 static void i_stream_seekable_close(struct iostream_private *stream,
 				    bool close_parent ATTR_UNUSED)
 {
@@ -38,6 +52,7 @@ static void i_stream_seekable_close(struct iostream_private *stream,
 		container_of(stream, struct seekable_istream, istream.iostream);
 
 	sstream->fd = -1;
+	i_stream_seekable_memfd_release(sstream);
 	i_stream_close(sstream->fd_input);
 }
 
@@ -55,6 +70,7 @@ static void i_stream_seekable_destroy(struct iostream_private *stream)
 		container_of(stream, struct seekable_istream, istream.iostream);
 
 	i_stream_free_buffer(&sstream->istream);
+	i_stream_seekable_memfd_release(sstream);
 	i_stream_unref(&sstream->fd_input);
 	unref_streams(sstream);
 
@@ -87,15 +103,24 @@ static int copy_to_temp_file(struct seekable_istream *sstream)
 	size_t size;
 	int fd;
 
-	fd = sstream->fd_callback(&path, sstream->context);
-	if (fd == -1)
-		return -1;
+	if (sstream->try_memfd &&
+	    (fd = memfd_temp_create("istream-seekable",
+				    sstream->buffer_peak)) != -1) {
+		path = "memfd";
+		sstream->fd_is_memfd = TRUE;
+		sstream->memfd_reserved = sstream->buffer_peak;
+	} else {
+		fd = sstream->fd_callback(&path, sstream->context);
+		if (fd == -1)
+			return -1;
+	}
 
 	/* copy our currently read buffer to it */
 	i_assert(stream->pos <= sstream->buffer_peak);
 	if (write_full(fd, stream->buffer, sstream->buffer_peak) < 0) {
 		if (!ENOSPACE(errno))
 			i_error("istream-seekable: write_full(%s) failed: %m", path);
+		i_stream_seekable_memfd_release(sstream);
 		i_close_fd(&fd);
 		return -1;
 	}
@@ -122,6 +147,7 @@ static int copy_to_temp_file(struct seekable_istream *sstream)
 				"in-memory input %s: %s",
 				i_stream_get_name(&stream->istream),
 				i_stream_get_error(sstream->fd_input));
+			i_stream_seekable_memfd_release(sstream);
 			i_stream_destroy(&sstream->fd_input);
 			sstream->fd = -1; /* autoclosed by fd_input */
 			return -1;
@@ -259,6 +285,7 @@ static int i_stream_seekable_write_failed(struct seekable_istream *sstream)
 				    sstream->temp_path);
 		return -1;
 	}
+	i_stream_seekable_memfd_release(sstream);
 	i_stream_destroy(&sstream->fd_input);
 	sstream->fd = -1; /* autoclosed by fd_input */
 
@@ -266,6 +293,86 @@ static int i_stream_seekable_write_failed(struct seekable_istream *sstream)
 	return 0;
 }
 
+static int i_stream_seekable_memfd_spill(struct seekable_istream *sstream)
+{
+	struct istream_private *stream = &sstream->istream;
+	unsigned char buf[IO_BLOCK_SIZE];
+	struct istream *new_input;
+	const unsigned char *buffer;
+	uoff_t offset = 0;
+	const char *path;
+	size_t size;
+	ssize_t ret = 0;
+	int fd, new_fd;
+
+	fd = sstream->fd_callback(&path, sstream->context);
+	if (fd == -1)
+		return -1;
+
+	while (offset < sstream->write_peak &&
+	       (ret = pread(sstream->fd, buf, sizeof(buf), offset)) > 0) {
+		if (write_full(fd, buf, ret) < 0)
+			break;
+		offset += ret;
+	}
+	if (offset < sstream->write_peak) {
+		if (!ENOSPACE(errno)) {
+			i_error("istream-seekable: Moving memfd to %s failed: %m",
+				path);
+		}
+		i_close_fd(&fd);
+		return -1;
+	}
+	new_fd = fd;
+	new_input = i_stream_create_fd_autoclose(&fd,
+		I_MAX(stream->pos, stream->max_buffer_size));
+	i_stream_set_name(new_input, t_strdup_printf(
+		"(seekable temp-istream for: %s)", i_stream_get_name(&stream->istream)));
+
+	/* read back the data that is still in our buffer, which points to
+	   the memfd's fd_input */
+	i_stream_seek(new_input, stream->istream.v_offset);
+	for (;;) {
+		buffer = i_stream_get_data(new_input, &size);
+		if (size >= stream->pos)
+			break;
+		if ((ret = i_stream_read_memarea(new_input)) <= 0) {
+			i_assert(ret != 0);
+			i_assert(ret != -2);
+			i_error("istream-seekable: Couldn't read back "
+				"moved memfd data from %s: %s", path,
+				i_stream_get_error(new_input));
+			i_stream_destroy(&new_input);
+			return -1;
+		}
+	}
+	i_stream_set_max_buffer_size(new_input, stream->max_buffer_size);
+
+	i_stream_seekable_memfd_release(sstream);
+	i_stream_destroy(&sstream->fd_input);
+	i_free(sstream->temp_path);
+	sstream->temp_path = i_strdup(path);
+
+	sstream->fd = new_fd;
+	sstream->fd_input = new_input;
+	stream->buffer = buffer;
+	return 0;
+}
+
+static void
+i_stream_seekable_memfd_grow(struct seekable_istream *sstream, size_t size)
+{
+	if (!sstream->fd_is_memfd)
+		return;
+	if (memfd_temp_reserve(size)) {
+		sstream->memfd_reserved += size;
+		return;
+	}
+	/* Memory budget is used up. Move the data to a real temp file.
+	   If that fails, just keep using the memfd. */
+	(void)i_stream_seekable_memfd_spill(sstream);
+}
+
 static ssize_t i_stream_seekable_read(struct istream_private *stream)
 {
 	struct seekable_istream *sstream =
@@ -304,6 +411,7 @@ static ssize_t i_stream_seekable_read(struct istream_private *stream)
 
 		/* save to our file */
 		data = i_stream_get_data(sstream->cur_input, &size);
+		i_stream_seekable_memfd_grow(sstream, size);
 		ret = write(sstream->fd, data, size);
 		if (ret <= 0) {
 			if (ret < 0 && !ENOSPACE(errno)) {
@@ -552,5 +660,6 @@ i_stream_create_seekable_path(struct istream *input[],
 	sstream = container_of(stream->real_stream,
 			       struct seekable_istream, istream);
 	sstream->free_context = TRUE;
+	sstream->try_memfd = TRUE;
 	return stream;
 }
@@ -20,6 +20,10 @@ i_stream_create_seekable(struct istream *input[],
 			 int (*fd_callback)(const char **path_r, void *context),
 			 void *context) ATTR_NULL(4);
 
+/* Same as i_stream_create_seekable(), but the data is first written to a
+   memfd as long as the memfd_temp_set_max_size() budget allows it. After
+   that it's moved to an unlinked temporary file created with
+   temp_path_prefix. */
 struct istream *
 i_stream_create_seekable_path(struct istream *input[],
 			      size_t max_buffer_size,
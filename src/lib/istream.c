@@ -5,6 +5,7 @@
 #include "array.h"
 #include "str.h"
 #include "memarea.h"
+#include "iostream-buffer.h"
 #include "istream-private.h"
 
 static bool i_stream_is_buffer_invalid(const struct istream_private *stream);
@@ -845,7 +846,7 @@ void i_stream_compress(struct istream_private *stream)
 
 static void i_stream_w_buffer_free(void *buf)
 {
-	i_free(buf);
+	iostream_buffer_free(buf);
 }
 
 static void
@@ -854,14 +855,18 @@ i_stream_w_buffer_realloc(struct istream_private *stream, size_t old_size)
 	void *new_buffer;
 
 	if (stream->memarea != NULL &&
-	    memarea_get_refcount(stream->memarea) == 1) {
-		/* Nobody else is referencing the memarea.
-		   We can just reallocate it. */
+	    memarea_get_refcount(stream->memarea) == 1 &&
+	    memarea_has_free_callback(stream->memarea,
+				      i_stream_w_buffer_free)) {
+		/* Nobody else is referencing the memarea, and the buffer
+		   was allocated by us. We can just reallocate it. */
 		memarea_free_without_callback(&stream->memarea);
-		new_buffer = i_realloc(stream->w_buffer, old_size,
-				       stream->buffer_size);
+		new_buffer = iostream_buffer_realloc(stream->w_buffer, old_size,
+						     stream->buffer_size);
 	} else {
-		new_buffer = i_malloc(stream->buffer_size);
+		/* The old buffer is freed (or goes back to the buffer cache)
+		   when its memarea is no longer referenced. */
+		new_buffer = iostream_buffer_alloc(stream->buffer_size);
 		if (old_size > 0) {
 			i_assert(stream->w_buffer != NULL);
 			memcpy(new_buffer, stream->w_buffer, old_size);
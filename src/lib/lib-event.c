@@ -12,6 +12,20 @@
 
 #include <ctype.h>
 
+#ifdef HAVE_VALGRIND_VALGRIND_H
+#  include <valgrind/valgrind.h>
+/* let valgrind catch accesses to freed events */
+#  define EVENT_POOL_FREELIST_ENABLED (!RUNNING_ON_VALGRIND)
+#else
+#  define EVENT_POOL_FREELIST_ENABLED TRUE
+#endif
+
+#define EVENT_POOL_INITIAL_SIZE 1024
+/* Maximum number of freed event pools kept for reuse */
+#define EVENT_POOL_FREELIST_MAX_COUNT 32
+/* Pools that have grown larger than this aren't reused */
+#define EVENT_POOL_FREELIST_MAX_SIZE 4096
+
 enum event_code {
 	EVENT_CODE_ALWAYS_LOG_SOURCE	= 'a',
 	EVENT_CODE_CATEGORY		= 'c',
@@ -73,6 +87,8 @@ static ARRAY(struct event_internal_category *) event_registered_categories_inter
 static ARRAY(struct event_category *) event_registered_categories_representative;
 static ARRAY(struct event *) global_event_stack;
 static uint64_t event_id_counter = 0;
+static pool_t event_pool_freelist[EVENT_POOL_FREELIST_MAX_COUNT];
+static unsigned int event_pool_freelist_count = 0;
 
 static void get_self_rusage(struct rusage *ru_r)
 {
@@ -393,12 +409,36 @@ struct event *event_minimize(struct event *event)
 	return new_event;
 }
 
+static pool_t event_pool_get(void)
+{
+	if (event_pool_freelist_count > 0)
+		return event_pool_freelist[--event_pool_freelist_count];
+	return pool_alloconly_create(MEMPOOL_GROWING"event",
+				     EVENT_POOL_INITIAL_SIZE);
+}
+
+static void event_pool_put(pool_t pool)
+{
+	/* Events are created and freed constantly, so keep some of the
+	   freed pools for reuse. Nothing else references the event's pool,
+	   so it can be cleared. */
+	if (EVENT_POOL_FREELIST_ENABLED &&
+	    event_pool_freelist_count < EVENT_POOL_FREELIST_MAX_COUNT &&
+	    pool_alloconly_get_total_alloc_size(pool) <=
+	    EVENT_POOL_FREELIST_MAX_SIZE) {
+		p_clear(pool);
+		event_pool_freelist[event_pool_freelist_count++] = pool;
+	} else {
+		pool_unref(&pool);
+	}
+}
+
 static struct event *
 event_create_internal(struct event *parent, const char *source_filename,
 		      unsigned int source_linenum)
 {
 	struct event *event;
-	pool_t pool = pool_alloconly_create(MEMPOOL_GROWING"event", 1024);
+	pool_t pool = event_pool_get();
 
 	event = p_new(pool, struct event, 1);
 	event->refcount = 1;
@@ -487,7 +527,8 @@ void event_unref(struct event **_event)
 	event_unref(&event->parent);
 
 	DLLIST_REMOVE(&events, event);
-	pool_unref(&event->pool);
+	/* the event itself is allocated from the pool */
+	event_pool_put(event->pool);
 }
 
 struct event *events_get_head(void)
@@ -1836,4 +1877,6 @@ void lib_event_deinit(void)
 	array_free(&event_registered_categories_internal);
 	array_free(&event_registered_categories_representative);
 	array_free(&global_event_stack);
+	while (event_pool_freelist_count > 0)
+		pool_unref(&event_pool_freelist[--event_pool_freelist_count]);
 }
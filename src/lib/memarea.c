@@ -77,6 +77,12 @@ unsigned int memarea_get_refcount(struct memarea *area)
 	return area->refcount;
 }
 
+bool memarea_has_free_callback(struct memarea *area,
+			       memarea_free_callback_t *callback)
+{
+	return area->callback == callback;
+}
+
 const void *memarea_get(struct memarea *area, size_t *size_r)
 {
 	*size_r = area->size;
@@ -22,6 +22,9 @@ void memarea_unref(struct memarea **area);
 void memarea_free_without_callback(struct memarea **area);
 
 unsigned int memarea_get_refcount(struct memarea *area);
+/* Returns TRUE if the memory area was created with the given free callback. */
+bool memarea_has_free_callback(struct memarea *area,
+			       memarea_free_callback_t *callback);
 const void *memarea_get(struct memarea *area, size_t *size_r);
 size_t memarea_get_size(struct memarea *area);
 
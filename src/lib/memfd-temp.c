@@ -0,0 +1,77 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#define _GNU_SOURCE /* for memfd_create() */
+#include "lib.h"
+#include "memfd-temp.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+
+static uoff_t memfd_temp_max_size = MEMFD_TEMP_DEFAULT_MAX_SIZE;
+static uoff_t memfd_temp_used_size = 0;
+static bool memfd_temp_unsupported = FALSE;
+
+void memfd_temp_set_max_size(uoff_t max_size)
+{
+	memfd_temp_max_size = max_size;
+}
+
+bool memfd_temp_reserve(uoff_t size)
+{
+	if (memfd_temp_used_size + size > memfd_temp_max_size ||
+	    memfd_temp_used_size + size < memfd_temp_used_size)
+		return FALSE;
+	memfd_temp_used_size += size;
+	return TRUE;
+}
+
+void memfd_temp_release(uoff_t size)
+{
+	i_assert(memfd_temp_used_size >= size);
+	memfd_temp_used_size -= size;
+}
+
+#ifdef HAVE_MEMFD_CREATE
+int memfd_temp_create(const char *name, uoff_t size)
+{
+	int fd;
+
+	if (memfd_temp_unsupported || memfd_temp_max_size == 0)
+		return -1;
+	if (!memfd_temp_reserve(size))
+		return -1;
+
+	fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd == -1) {
+		if (errno == ENOSYS || errno == EINVAL)
+			memfd_temp_unsupported = TRUE;
+		else
+			i_error("memfd_create(%s) failed: %m", name);
+		memfd_temp_release(size);
+		return -1;
+	}
+	return fd;
+}
+
+int memfd_temp_seal(int fd)
+{
+	return fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+		     F_SEAL_WRITE | F_SEAL_SEAL);
+}
+#else
+int memfd_temp_create(const char *name ATTR_UNUSED, uoff_t size ATTR_UNUSED)
+{
+	memfd_temp_unsupported = TRUE;
+	return -1;
+}
+
+int memfd_temp_seal(int fd ATTR_UNUSED)
+{
+	errno = ENOSYS;
+	return -1;
+}
+#endif
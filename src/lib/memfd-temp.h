@@ -0,0 +1,29 @@
+#ifndef MEMFD_TEMP_H
+#define MEMFD_TEMP_H
+
+/* Default for memfd_temp_set_max_size() */
+#define MEMFD_TEMP_DEFAULT_MAX_SIZE (64*1024*1024)
+
+/* Set the maximum number of bytes that all memfd temporary files may use
+   in total in this process. Temporary streams that would exceed the limit
+   spill to a real temporary file instead. 0 disables using memfds. */
+void memfd_temp_set_max_size(uoff_t max_size);
+
+/* Create an anonymous memory-backed temporary file (memfd) and reserve size
+   bytes of the per-process budget for it. Returns fd on success, -1 if
+   memfds aren't supported or the budget would be exceeded. Unexpected
+   errors are logged. The fd can be passed to other processes and mmap()ed
+   like any other file. */
+int memfd_temp_create(const char *name, uoff_t size);
+/* Reserve more bytes for an existing memfd. Returns FALSE if this would
+   exceed the budget, in which case the caller should move the data to a
+   real temporary file. */
+bool memfd_temp_reserve(uoff_t size);
+/* Release bytes reserved by memfd_temp_create() or memfd_temp_reserve(). */
+void memfd_temp_release(uoff_t size);
+/* Seal the memfd so its contents can't be modified anymore. This makes it
+   safe to give the fd to other processes. Returns 0 on success, -1 if
+   sealing isn't supported (errno is set, nothing is logged). */
+int memfd_temp_seal(int fd);
+
+#endif
@@ -7,6 +7,7 @@
 #include "write-full.h"
 #include "net.h"
 #include "sendfile-util.h"
+#include "iostream-buffer.h"
 #include "istream.h"
 #include "istream-private.h"
 #include "ostream-file-private.h"
@@ -65,7 +66,7 @@ static void o_stream_file_destroy(struct iostream_private *stream)
 	struct file_ostream *fstream =
 		container_of(stream, struct file_ostream, ostream.iostream);
 
-	i_free(fstream->buffer);
+	iostream_buffer_free(fstream->buffer);
 }
 
 static size_t file_buffer_get_used_size(struct file_ostream *fstream)
@@ -350,6 +351,35 @@ static int buffer_flush(struct file_ostream *fstream)
 	return IS_STREAM_EMPTY(fstream) ? 1 : 0;
 }
 
+/* Write the buffered data followed by the new data with a single writev().
+   Returns how much of the new data was sent, or -1 on error. */
+static ssize_t
+o_stream_file_writev_with_buffer(struct file_ostream *fstream,
+				 const struct const_iovec *iov,
+				 unsigned int iov_count)
+{
+	struct const_iovec *full_iov;
+	size_t buffered;
+	int buf_iov_count;
+	ssize_t ret;
+
+	full_iov = t_new(struct const_iovec, iov_count + 2);
+	buf_iov_count = o_stream_fill_iovec(fstream, full_iov);
+	memcpy(full_iov + buf_iov_count, iov, sizeof(*iov) * iov_count);
+	buffered = file_buffer_get_used_size(fstream);
+
+	ret = o_stream_file_writev_full(fstream, full_iov,
+					buf_iov_count + iov_count);
+	if (ret < 0)
+		return -1;
+	if ((size_t)ret < buffered) {
+		update_buffer(fstream, ret);
+		return 0;
+	}
+	update_buffer(fstream, buffered);
+	return ret - buffered;
+}
+
 static void o_stream_tcp_flush_via_nodelay(struct file_ostream *fstream)
 {
 	if (net_set_tcp_nodelay(fstream->fd, TRUE) < 0) {
@@ -505,8 +535,8 @@ static void o_stream_grow_buffer(struct file_ostream *fstream, size_t bytes)
 	if (size <= fstream->buffer_size)
 		return;
 
-	fstream->buffer = i_realloc(fstream->buffer,
-				    fstream->buffer_size, size);
+	fstream->buffer = iostream_buffer_realloc(fstream->buffer,
+						  fstream->buffer_size, size);
 
 	if (fstream->tail <= fstream->head && !IS_STREAM_EMPTY(fstream)) {
 		/* move head forward to end of buffer */
@@ -613,25 +643,31 @@ ssize_t o_stream_file_sendv(struct ostream_private *stream,
 	size_t size, total_size, added, optimal_size;
 	unsigned int i;
 	ssize_t ret = 0;
+	bool sent = FALSE;
 
 	for (i = 0, size = 0; i < iov_count; i++)
 		size += iov[i].iov_len;
 	total_size = size;
 
-	if (size > get_unused_space(fstream) && !IS_STREAM_EMPTY(fstream)) {
-		if (o_stream_file_flush(stream) < 0)
-			return -1;
-	}
-
 	optimal_size = I_MIN(fstream->optimal_block_size,
 			     fstream->ostream.max_buffer_size);
-	if (IS_STREAM_EMPTY(fstream) &&
-	    (!stream->corked || size >= optimal_size)) {
+	if (size > get_unused_space(fstream) && !IS_STREAM_EMPTY(fstream)) {
+		/* the data doesn't fit into the buffer. instead of flushing
+		   the buffer first, send both of them at once. */
+		ret = o_stream_file_writev_with_buffer(fstream, iov, iov_count);
+		if (ret < 0)
+			return -1;
+		sent = TRUE;
+	} else if (IS_STREAM_EMPTY(fstream) &&
+		   (!stream->corked || size >= optimal_size)) {
 		/* send immediately */
 		ret = o_stream_file_writev_full(fstream, iov, iov_count);
 		if (ret < 0)
 			return -1;
+		sent = TRUE;
+	}
 
+	if (sent) {
 		size = ret;
 		while (size > 0 && iov_count > 0 && size >= iov[0].iov_len) {
 			size -= iov[0].iov_len;
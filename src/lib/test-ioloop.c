@@ -132,6 +132,92 @@ static void test_ioloop_timeout(void)
 	test_end();
 }
 
+struct test_timeout_reset_ctx {
+	struct timeout *to, *to_reset;
+	struct timeval tv_reset;
+	struct timeval tv_callback;
+};
+
+static void test_timeout_reset_callback(struct test_timeout_reset_ctx *ctx)
+{
+	i_gettimeofday(&ctx->tv_reset);
+	timeout_reset(ctx->to);
+	timeout_remove(&ctx->to_reset);
+}
+
+static void test_timeout_reset_stop(struct test_timeout_reset_ctx *ctx)
+{
+	i_gettimeofday(&ctx->tv_callback);
+	io_loop_stop(current_ioloop);
+}
+
+static void test_ioloop_timeout_reset(void)
+{
+	struct test_timeout_reset_ctx ctx;
+	struct ioloop *ioloop;
+
+	test_begin("ioloop timeout reset");
+
+	i_zero(&ctx);
+	ioloop = io_loop_create();
+	ctx.to = timeout_add(1000, test_timeout_reset_stop, &ctx);
+	ctx.to_reset = timeout_add_short(500, test_timeout_reset_callback,
+					 &ctx);
+	io_loop_run(ioloop);
+
+	/* the reset must have postponed the timeout by a full second */
+	test_assert(ctx.tv_reset.tv_sec != 0);
+	test_assert(timeval_diff_msecs(&ctx.tv_callback, &ctx.tv_reset) >= 900);
+
+	timeout_remove(&ctx.to);
+	test_assert(io_loop_is_empty(ioloop));
+	io_loop_destroy(&ioloop);
+
+	test_end();
+}
+
+static void test_ioloop_timeout_reset_many(void)
+{
+#define TEST_TIMEOUT_RESET_COUNT 10000
+	struct timeout *tos[TEST_TIMEOUT_RESET_COUNT];
+	struct timeval tv_callback;
+	struct ioloop *ioloop;
+	struct timeout *to;
+	unsigned int i, j;
+
+	test_begin("ioloop timeout reset many");
+
+	ioloop = io_loop_create();
+	for (i = 0; i < N_ELEMENTS(tos); i++)
+		tos[i] = timeout_add(10000 + i, timeout_callback, &tv_callback);
+	/* start the timeouts */
+	to = timeout_add_short(0, timeout_callback, &tv_callback);
+	io_loop_run(ioloop);
+	timeout_remove(&to);
+
+	/* This is what idle connections do after each input. Each reset
+	   used to reposition the timeout in the queue. */
+	for (j = 0; j < 100; j++) {
+		for (i = 0; i < N_ELEMENTS(tos); i++)
+			timeout_reset(tos[i]);
+	}
+	test_assert(!io_loop_have_immediate_timeouts(ioloop));
+
+	/* the short timeout must still run first */
+	to = timeout_add_short(10, timeout_callback, &tv_callback);
+	i_zero(&tv_callback);
+	io_loop_run(ioloop);
+	test_assert(tv_callback.tv_sec != 0);
+	timeout_remove(&to);
+
+	for (i = 0; i < N_ELEMENTS(tos); i++)
+		timeout_remove(&tos[i]);
+	test_assert(io_loop_is_empty(ioloop));
+	io_loop_destroy(&ioloop);
+
+	test_end();
+}
+
 static void zero_timeout_callback(unsigned int *counter)
 {
 	*counter += 1;
@@ -394,6 +480,8 @@ static void test_ioloop_context_events(void)
 void test_ioloop(void)
 {
 	test_ioloop_timeout();
+	test_ioloop_timeout_reset();
+	test_ioloop_timeout_reset_many();
 	test_ioloop_zero_timeout();
 	test_ioloop_zero_timeout_recreate();
 	test_ioloop_find_fd_conditions();
@@ -0,0 +1,49 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "test-lib.h"
+#include "iostream-buffer.h"
+
+static void test_iostream_buffer_cache(void)
+{
+	unsigned char *buf, *buf2;
+
+	test_begin("iostream buffer cache");
+	buf = iostream_buffer_alloc(IO_BLOCK_SIZE);
+	memset(buf, 'x', IO_BLOCK_SIZE);
+	iostream_buffer_free(buf);
+
+	/* the same size class reuses the freed buffer, zeroed */
+	buf2 = iostream_buffer_alloc(IO_BLOCK_SIZE);
+	if (!ON_VALGRIND)
+		test_assert(buf2 == buf);
+	test_assert(buf2[0] == '\0' && buf2[IO_BLOCK_SIZE-1] == '\0');
+	memset(buf2, 'x', IO_BLOCK_SIZE);
+
+	/* growing keeps the data */
+	buf = iostream_buffer_realloc(buf2, IO_BLOCK_SIZE, IO_BLOCK_SIZE*2);
+	test_assert(buf[0] == 'x' && buf[IO_BLOCK_SIZE-1] == 'x');
+	test_assert(buf[IO_BLOCK_SIZE] == '\0' &&
+		    buf[IO_BLOCK_SIZE*2-1] == '\0');
+	iostream_buffer_free(buf);
+
+	/* the grown buffer goes to the cache of its new size */
+	buf2 = iostream_buffer_alloc(IO_BLOCK_SIZE*2);
+	if (!ON_VALGRIND)
+		test_assert(buf2 == buf);
+	iostream_buffer_free(buf2);
+
+	/* uncached sizes work too */
+	buf = iostream_buffer_alloc(100);
+	buf = iostream_buffer_realloc(buf, 100, IOSTREAM_BUFFER_CACHE_MAX_SIZE*2);
+	iostream_buffer_free(buf);
+	buf = iostream_buffer_realloc(NULL, 0, 100);
+	test_assert(buf[0] == '\0' && buf[99] == '\0');
+	iostream_buffer_free(buf);
+	iostream_buffer_free(NULL);
+	test_end();
+}
+
+void test_iostream_buffer(void)
+{
+	test_iostream_buffer_cache();
+}
@@ -1,8 +1,14 @@
 /* Copyright (c) 2016-2018 Dovecot authors, see the included COPYING file */
 
+#ifdef HAVE_CONFIG_H
+#  include "config.h"
+#endif
+
+#define _GNU_SOURCE /* for F_GET_SEALS */
 #include "test-lib.h"
 #include "istream.h"
 #include "ostream.h"
+#include "memfd-temp.h"
 #include "iostream-temp.h"
 
 #include <unistd.h>
@@ -141,10 +147,100 @@ static void test_iostream_temp_istream(void)
 	test_end();
 }
 
+#ifdef HAVE_MEMFD_CREATE
+static bool test_fd_is_memfd(int fd)
+{
+	return fcntl(fd, F_GET_SEALS) >= 0;
+}
+
+static void test_iostream_temp_memfd(void)
+{
+	struct ostream *output;
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+	int fd;
+
+	test_begin("iostream_temp memfd");
+	memfd_temp_set_max_size(10);
+	output = iostream_temp_create_sized(".intentional-nonexistent-error/",
+					    0, "test", 4);
+	test_assert(o_stream_send(output, "12345", 5) == 5);
+	fd = o_stream_get_fd(output);
+	test_assert(fd != -1 && test_fd_is_memfd(fd));
+	test_assert(o_stream_send(output, "67890", 5) == 5);
+	test_assert(o_stream_get_fd(output) == fd);
+
+	/* the whole budget is used by the first stream */
+	struct ostream *output2 =
+		iostream_temp_create_sized(".", 0, "test", 0);
+	test_assert(o_stream_send(output2, "1", 1) == 1);
+	test_assert(o_stream_get_fd(output2) != -1 &&
+		    !test_fd_is_memfd(o_stream_get_fd(output2)));
+	o_stream_destroy(&output2);
+
+	input = iostream_temp_finish(&output, 128);
+	fd = i_stream_get_fd(input);
+	test_assert((fcntl(fd, F_GET_SEALS) & F_SEAL_WRITE) != 0);
+	test_assert(i_stream_read_bytes(input, &data, &size, 10) == 1 &&
+		    memcmp(data, "1234567890", 10) == 0);
+	i_stream_destroy(&input);
+
+	/* destroying the istream released the budget */
+	output = iostream_temp_create_sized(".", 0, "test", 0);
+	test_assert(o_stream_send(output, "1234567890", 10) == 10);
+	test_assert(test_fd_is_memfd(o_stream_get_fd(output)));
+	o_stream_destroy(&output);
+	memfd_temp_set_max_size(MEMFD_TEMP_DEFAULT_MAX_SIZE);
+	test_end();
+}
+
+static void test_iostream_temp_memfd_spill(void)
+{
+	struct ostream *output;
+	struct istream *input;
+	const unsigned char *data;
+	size_t size;
+
+	test_begin("iostream_temp memfd spill");
+	memfd_temp_set_max_size(8);
+	output = iostream_temp_create_sized(".", 0, "test", 4);
+	test_assert(o_stream_send(output, "12345", 5) == 5);
+	test_assert(test_fd_is_memfd(o_stream_get_fd(output)));
+	test_assert(o_stream_send(output, "678", 3) == 3);
+	test_assert(test_fd_is_memfd(o_stream_get_fd(output)));
+	/* exceeding the budget moves the data to a temp file */
+	test_assert(o_stream_send(output, "90", 2) == 2);
+	test_assert(o_stream_get_fd(output) != -1 &&
+		    !test_fd_is_memfd(o_stream_get_fd(output)));
+	test_assert(o_stream_send(output, "abc", 3) == 3);
+
+	input = iostream_temp_finish(&output, 128);
+	test_assert(i_stream_read_bytes(input, &data, &size, 13) == 1 &&
+		    memcmp(data, "1234567890abc", 13) == 0);
+	i_stream_destroy(&input);
+
+	/* the budget was released by the spill */
+	output = iostream_temp_create_sized(".", 0, "test", 0);
+	test_assert(o_stream_send(output, "12345678", 8) == 8);
+	test_assert(test_fd_is_memfd(o_stream_get_fd(output)));
+	o_stream_destroy(&output);
+	memfd_temp_set_max_size(MEMFD_TEMP_DEFAULT_MAX_SIZE);
+	test_end();
+}
+#endif
+
 void test_iostream_temp(void)
 {
+	/* these test the temp file handling */
+	memfd_temp_set_max_size(0);
 	test_iostream_temp_create_sized_memory();
 	test_iostream_temp_create_sized_disk();
 	test_iostream_temp_create_write_error();
 	test_iostream_temp_istream();
+	memfd_temp_set_max_size(MEMFD_TEMP_DEFAULT_MAX_SIZE);
+#ifdef HAVE_MEMFD_CREATE
+	test_iostream_temp_memfd();
+	test_iostream_temp_memfd_spill();
+#endif
 }
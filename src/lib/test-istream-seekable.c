@@ -1,11 +1,13 @@
 /* Copyright (c) 2009-2018 Dovecot authors, see the included COPYING file */
 
 #include "test-lib.h"
+#include "str.h"
 #include "sha2.h"
 #include "istream-private.h"
 #include "istream-sized.h"
 #include "istream-hash.h"
 #include "istream-seekable.h"
+#include "memfd-temp.h"
 
 #include <fcntl.h>
 #include <unistd.h>
@@ -267,6 +269,101 @@ static void test_istream_seekable_failed_writes(void)
 	test_end();
 }
 
+static void test_istream_seekable_memfd_spill(void)
+{
+	static const char data[] = "0123456789abcdef";
+	struct istream *input, *streams[2];
+	const unsigned char *buf;
+	size_t size;
+	unsigned int i;
+
+	test_begin("istream seekable memfd spill");
+	memfd_temp_set_max_size(6);
+	streams[0] = test_istream_create(data);
+	test_istream_set_allow_eof(streams[0], FALSE);
+	streams[0]->seekable = FALSE;
+	streams[1] = NULL;
+
+	input = i_stream_create_seekable_path(streams, 2, ".test-seekable.");
+	for (i = 1; i <= sizeof(data)-1; i++) {
+		test_istream_set_size(streams[0], i);
+		while (i_stream_read(input) > 0) ;
+		i_stream_skip(input, i_stream_get_data_size(input));
+	}
+	test_istream_set_allow_eof(streams[0], TRUE);
+	test_assert(i_stream_read(input) == -1);
+	test_assert(input->v_offset == sizeof(data)-1);
+
+	string_t *str = t_str_new(32);
+	i_stream_seek(input, 0);
+	while (i_stream_read_more(input, &buf, &size) > 0) {
+		str_append_data(str, buf, size);
+		i_stream_skip(input, size);
+	}
+	test_assert(input->stream_errno == 0);
+	test_assert_strcmp(str_c(str), data);
+	/* the data was moved to a temp file, which released the budget */
+	test_assert(memfd_temp_reserve(6));
+	memfd_temp_release(6);
+	i_stream_unref(&input);
+	i_stream_unref(&streams[0]);
+	memfd_temp_set_max_size(MEMFD_TEMP_DEFAULT_MAX_SIZE);
+	test_end();
+}
+
+static void test_istream_seekable_memfd_spill_buffered(void)
+{
+	struct istream *input, *streams[2];
+	const unsigned char *buf;
+	unsigned char *data;
+	size_t size;
+	uoff_t offset = 0;
+	unsigned int i;
+	ssize_t ret;
+
+	test_begin("istream seekable memfd spill with buffered data");
+	data = t_malloc_no0(40000);
+	for (i = 0; i < 40000; i++)
+		data[i] = i % 251;
+	memfd_temp_set_max_size(20000);
+	streams[0] = test_istream_create_data(data, 40000);
+	streams[0]->seekable = FALSE;
+	streams[1] = NULL;
+
+	/* keep part of the buffer unskipped while the memfd is moved to
+	   a temp file */
+	input = i_stream_create_seekable_path(streams, 16384,
+					      ".test-seekable.");
+	while ((ret = i_stream_read(input)) > 0 || ret == -2) {
+		buf = i_stream_get_data(input, &size);
+		test_assert(memcmp(buf, data + offset, size) == 0);
+		size = I_MIN(size, 4000);
+		i_stream_skip(input, size);
+		offset += size;
+	}
+	while ((buf = i_stream_get_data(input, &size)), size > 0) {
+		test_assert(memcmp(buf, data + offset, size) == 0);
+		i_stream_skip(input, size);
+		offset += size;
+	}
+	test_assert(input->stream_errno == 0);
+	test_assert(offset == 40000);
+
+	i_stream_seek(input, 0);
+	offset = 0;
+	while (i_stream_read_more(input, &buf, &size) > 0) {
+		test_assert(memcmp(buf, data + offset, size) == 0);
+		i_stream_skip(input, size);
+		offset += size;
+	}
+	test_assert(input->stream_errno == 0);
+	test_assert(offset == 40000);
+	i_stream_unref(&input);
+	i_stream_unref(&streams[0]);
+	memfd_temp_set_max_size(MEMFD_TEMP_DEFAULT_MAX_SIZE);
+	test_end();
+}
+
 void test_istream_seekable(void)
 {
 	unsigned int i;
@@ -287,4 +384,8 @@ void test_istream_seekable(void)
 	test_istream_seekable_invalid_read();
 	test_istream_seekable_get_size();
 	test_istream_seekable_failed_writes();
+	test_istream_seekable_memfd_spill();
+	T_BEGIN {
+		test_istream_seekable_memfd_spill_buffered();
+	} T_END;
 }
@@ -86,6 +86,35 @@ static void test_event_strlist(void)
 	test_end();
 }
 
+static void test_event_pool_reuse(void)
+{
+	static struct event_category category = { .name = "reuse" };
+	struct event *event, *parent;
+	unsigned int count;
+
+	test_begin("event pool reuse");
+	parent = event_create(NULL);
+	event = event_create(parent);
+	event_add_category(event, &category);
+	event_add_str(event, "key", "value");
+	event_set_append_log_prefix(event, "prefix: ");
+	event_set_min_log_level(event, LOG_TYPE_ERROR);
+	event_unref(&event);
+
+	/* a new event must not see anything from the freed one */
+	event = event_create(NULL);
+	test_assert(event_get_parent(event) == NULL);
+	test_assert(event_find_field_nonrecursive(event, "key") == NULL);
+	test_assert(event_get_categories(event, &count) == NULL || count == 0);
+	test_assert(event_get_min_log_level(event) == LOG_TYPE_INFO);
+	event_add_str(event, "key2", "value2");
+	test_assert_strcmp(event_find_field_recursive_str(event, "key2"),
+			   "value2");
+	event_unref(&event);
+	event_unref(&parent);
+	test_end();
+}
+
 static void test_lib_event_reason_code(void)
 {
 	test_begin("event reason codes");
@@ -100,6 +129,7 @@ void test_lib_event(void)
 {
 	test_event_fields();
 	test_event_strlist();
+	test_event_pool_reuse();
 	test_lib_event_reason_code();
 }
 
@@ -181,9 +181,55 @@ static void test_ostream_file_send_istream_sendfile(void)
 	test_end();
 }
 
+static void test_ostream_file_sendv_with_buffer(void)
+{
+	struct ostream *output;
+	struct const_iovec iov[2];
+	char data[100], buf[sizeof(data)*2];
+	int sock_fd[2];
+	size_t pos = 0;
+	ssize_t ret;
+
+	test_begin("ostream file sendv with buffered data");
+	i_assert(socketpair(AF_UNIX, SOCK_STREAM, 0, sock_fd) == 0);
+	output = o_stream_create_fd(sock_fd[0], 16);
+	memset(data, 'x', sizeof(data));
+
+	o_stream_cork(output);
+	test_assert(o_stream_send(output, "{100}", 5) == 5);
+	test_assert(o_stream_get_buffer_used_size(output) == 5);
+
+	/* doesn't fit into the buffer - both are sent at once */
+	iov[0].iov_base = data;
+	iov[0].iov_len = sizeof(data) - 1;
+	iov[1].iov_base = ")";
+	iov[1].iov_len = 1;
+	test_assert(o_stream_sendv(output, iov, 2) == sizeof(data));
+	test_assert(o_stream_get_buffer_used_size(output) == 0);
+	test_assert(output->offset == 5 + sizeof(data));
+	o_stream_uncork(output);
+
+	while (pos < 5 + sizeof(data)) {
+		ret = read(sock_fd[1], buf + pos, sizeof(buf) - pos);
+		if (ret <= 0)
+			break;
+		pos += ret;
+	}
+	test_assert(pos == 5 + sizeof(data));
+	test_assert(memcmp(buf, "{100}", 5) == 0);
+	test_assert(memcmp(buf + 5, data, sizeof(data) - 1) == 0);
+	test_assert(buf[pos-1] == ')');
+
+	o_stream_destroy(&output);
+	i_close_fd(&sock_fd[0]);
+	i_close_fd(&sock_fd[1]);
+	test_end();
+}
+
 void test_ostream_file(void)
 {
 	test_ostream_file_random();
 	test_ostream_file_send_istream_file();
 	test_ostream_file_send_istream_sendfile();
+	test_ostream_file_sendv_with_buffer();
 }
@@ -5,6 +5,8 @@
 #include "buffer.h"
 #include "unichar.h"
 
+#include <ctype.h>
+
 static void test_unichar_uni_utf8_strlen(void)
 {
 	static const char input[] = "\xC3\xA4\xC3\xA4\0a";
@@ -121,6 +123,67 @@ static void test_unichar_surrogates(void)
 	test_end();
 }
 
+static void test_unichar_decomposed_titlecase_ascii(void)
+{
+	unsigned char input[128 + 3];
+	buffer_t *output = t_buffer_create(sizeof(input));
+	unsigned int i;
+
+	test_begin("uni_utf8_to_decomposed_titlecase() ASCII");
+	for (i = 0; i < 128; i++)
+		input[i] = i;
+	/* non-ASCII in the middle of a word */
+	memcpy(input + 128, "\xc3\xa4", 2);
+	input[130] = 'z';
+
+	for (i = 0; i < 128; i++) {
+		/* different alignments and lengths */
+		buffer_set_used_size(output, 0);
+		test_assert_idx(uni_utf8_to_decomposed_titlecase(
+			input + i, sizeof(input) - i, output) == 0, i);
+		const unsigned char *data = output->data;
+		for (unsigned int j = i; j < 128; j++)
+			test_assert_idx(data[j - i] == i_toupper(j), j);
+		test_assert_idx(output->used == 128 - i + 4 &&
+				memcmp(data + 128 - i, "A\xcc\x88Z", 4) == 0, i);
+	}
+	test_end();
+}
+
+static void test_unichar_decomposed_titlecase_per_char(void)
+{
+	static const char *const inputs[] = {
+		"Re: Fwd: quarterly report for the infrastructure team meeting",
+		"John Smith <john.smith@example.com>",
+		"Caf\xc3\xa9 na\xc3\xafve \xc3\x9c" "bermut \xc3\xa5ngstr\xc3\xb6m",
+		"\xd0\x9f\xd1\x80\xd0\xb8\xd0\xbc\xd0\xb5\xd1\x80 "
+		"\xce\xa9mega \xe3\x83\x87\xe3\x83\xbc\xe3\x82\xbf",
+		"\xea\xb0\x80 \xef\xbc\xa1\xef\xbd\x82 \xe2\x84\xab",
+	};
+	buffer_t *output = t_buffer_create(256);
+	buffer_t *expected = t_buffer_create(256);
+	unsigned int i;
+
+	test_begin("uni_utf8_to_decomposed_titlecase() per character");
+	for (i = 0; i < N_ELEMENTS(inputs); i++) {
+		const unsigned char *input = (const unsigned char *)inputs[i];
+		size_t len = strlen(inputs[i]), pos, char_len;
+
+		/* converting one character at a time must give the same
+		   result as converting the whole string */
+		buffer_set_used_size(expected, 0);
+		for (pos = 0; pos < len; pos += char_len) {
+			char_len = uni_utf8_char_bytes(input[pos]);
+			uni_utf8_to_decomposed_titlecase(input + pos, char_len,
+							 expected);
+		}
+		buffer_set_used_size(output, 0);
+		uni_utf8_to_decomposed_titlecase(input, len, output);
+		test_assert_idx(buffer_cmp(output, expected), i);
+	}
+	test_end();
+}
+
 void test_unichar(void)
 {
 	static const char overlong_utf8[] = "\xf8\x80\x95\x81\xa1";
@@ -182,4 +245,6 @@ void test_unichar(void)
 	test_unichar_uni_utf8_partial_strlen_n();
 	test_unichar_valid_unicode();
 	test_unichar_surrogates();
+	test_unichar_decomposed_titlecase_ascii();
+	test_unichar_decomposed_titlecase_per_char();
 }
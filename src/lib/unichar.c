@@ -2,9 +2,10 @@
 
 #include "lib.h"
 #include "array.h"
-#include "bsearch-insert-pos.h"
 #include "unichar.h"
 
+#include <ctype.h>
+
 #include "unicodemap.c"
 
 #define HANGUL_FIRST 0xac00
@@ -220,61 +221,25 @@ unsigned int uni_utf8_partial_strlen_n(const void *_input, size_t size,
 	return len;
 }
 
-static bool uint16_find(const uint16_t *data, unsigned int count,
-			uint16_t value, unsigned int *idx_r)
-{
-	BINARY_NUMBER_SEARCH(data, count, value, idx_r);
-}
-
-static bool uint32_find(const uint32_t *data, unsigned int count,
-			uint32_t value, unsigned int *idx_r)
-{
-	BINARY_NUMBER_SEARCH(data, count, value, idx_r);
-}
+#define UNICODEMAP_LOOKUP(name, chr) \
+	((chr) >> UNICODEMAP_BLOCK_SHIFT >= N_ELEMENTS(name##_stage1) ? 0 : \
+	 name##_stage2[name##_stage1[(chr) >> UNICODEMAP_BLOCK_SHIFT]] \
+		[(chr) & (UNICODEMAP_BLOCK_SIZE-1)])
 
 unichar_t uni_ucs4_to_titlecase(unichar_t chr)
 {
-	unsigned int idx;
-
-	if (chr <= 0xff)
-		return titlecase8_map[chr];
-	else if (chr <= 0xffff) {
-		if (!uint16_find(titlecase16_keys, N_ELEMENTS(titlecase16_keys),
-				 chr, &idx))
-			return chr;
-		else
-			return titlecase16_values[idx];
-	} else {
-		if (!uint32_find(titlecase32_keys, N_ELEMENTS(titlecase32_keys),
-				 chr, &idx))
-			return chr;
-		else
-			return titlecase32_values[idx];
-	}
+	unichar_t title_chr = UNICODEMAP_LOOKUP(titlecase, chr);
+
+	return title_chr == 0 ? chr : title_chr;
 }
 
 static bool uni_ucs4_decompose_uni(unichar_t *chr)
 {
-	unsigned int idx;
-
-	if (*chr <= 0xff) {
-		if (uni8_decomp_map[*chr] == *chr)
-			return FALSE;
-		*chr = uni8_decomp_map[*chr];
-	} else if (*chr <= 0xffff) {
-		if (*chr < uni16_decomp_keys[0])
-			return FALSE;
-
-		if (!uint16_find(uni16_decomp_keys,
-				 N_ELEMENTS(uni16_decomp_keys), *chr, &idx))
-			return FALSE;
-		*chr = uni16_decomp_values[idx];
-	} else {
-		if (!uint32_find(uni32_decomp_keys,
-				 N_ELEMENTS(uni32_decomp_keys), *chr, &idx))
-			return FALSE;
-		*chr = uni32_decomp_values[idx];
-	}
+	unichar_t decomp_chr = UNICODEMAP_LOOKUP(uni_decomp, *chr);
+
+	if (decomp_chr == 0)
+		return FALSE;
+	*chr = decomp_chr;
 	return TRUE;
 }
 
@@ -300,16 +265,17 @@ static void uni_ucs4_decompose_hangul_utf8(unichar_t chr, buffer_t *output)
 static bool uni_ucs4_decompose_multi_utf8(unichar_t chr, buffer_t *output)
 {
 	const uint32_t *value;
-	unsigned int idx;
+	uint32_t offset;
 
-	if (chr < multidecomp_keys[0] || chr > 0xffff)
+	if (chr > 0xffff)
 		return FALSE;
 
-	if (!uint32_find(multidecomp_keys, N_ELEMENTS(multidecomp_keys),
-			 chr, &idx))
+	/* offset is stored +1, so that 0 means no decomposition */
+	offset = UNICODEMAP_LOOKUP(multidecomp, chr);
+	if (offset == 0)
 		return FALSE;
 
-	value = &multidecomp_values[multidecomp_offsets[idx]];
+	value = &multidecomp_values[offset - 1];
 	for (; *value != 0; value++)
 		uni_ucs4_to_utf8_c(*value, output);
 	return TRUE;
@@ -327,14 +293,56 @@ static void output_add_replacement_char(buffer_t *output)
 	buffer_append(output, utf8_replacement_char, UTF8_REPLACEMENT_CHAR_LEN);
 }
 
+static size_t ascii_run_to_titlecase(const unsigned char *input, size_t size,
+				     buffer_t *output)
+{
+	unsigned char *dest;
+	uint64_t word, lower_mask;
+	size_t i = 0;
+
+	for (; i + sizeof(word) <= size; i += sizeof(word)) {
+		memcpy(&word, input + i, sizeof(word));
+		if ((word & 0x8080808080808080ULL) != 0)
+			break;
+	}
+	while (i < size && input[i] < 0x80)
+		i++;
+
+	/* ASCII characters have no decompositions, and their titlecase is
+	   simply uppercase. Convert 8 bytes at a time: for each byte in
+	   'a'..'z' the high bit of lower_mask gets set, which is shifted
+	   to 0x20 and cleared from the byte. */
+	dest = buffer_append_space_unsafe(output, i);
+	size = i;
+	for (i = 0; i + sizeof(word) <= size; i += sizeof(word)) {
+		memcpy(&word, input + i, sizeof(word));
+		lower_mask = ((word + 0x1f1f1f1f1f1f1f1fULL) ^
+			      (word + 0x0505050505050505ULL)) &
+			0x8080808080808080ULL;
+		word ^= lower_mask >> 2;
+		memcpy(dest + i, &word, sizeof(word));
+	}
+	for (; i < size; i++)
+		dest[i] = i_toupper(input[i]);
+	return size;
+}
+
 int uni_utf8_to_decomposed_titlecase(const void *_input, size_t size,
 				     buffer_t *output)
 {
 	const unsigned char *input = _input;
 	unichar_t chr;
+	size_t ascii_len;
 	int ret = 0;
 
 	while (size > 0) {
+		if (*input < 0x80) {
+			ascii_len = ascii_run_to_titlecase(input, size, output);
+			input += ascii_len;
+			size -= ascii_len;
+			continue;
+		}
+
 		int bytes = uni_utf8_get_char_n(input, size, &chr);
 		if (bytes <= 0) {
 			/* invalid input. try the next byte. */
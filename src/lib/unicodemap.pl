@@ -1,12 +1,8 @@
 #!/usr/bin/env perl
 use strict;
 
-my (%titlecase8, %uni8_decomp);
-my (@titlecase16_keys, @titlecase16_values);
-my (@titlecase32_keys, @titlecase32_values);
-my (@uni16_decomp_keys, @uni16_decomp_values);
-my (@uni32_decomp_keys, @uni32_decomp_values);
-my (@multidecomp_keys, @multidecomp_offsets, @multidecomp_values);
+my (%titlecase, %uni_decomp, %multidecomp);
+my @multidecomp_values;
 while (<>) {
   chomp $_;
   my @arr = split(";");
@@ -19,16 +15,8 @@ while (<>) {
     my $value = eval("0x$titlecode");
     if ($value == $code) { 
       # the same character, ignore
-    } elsif ($code <= 0xff) {
-      die "Error: We've assumed 8bit keys have max. 16bit values" if ($value > 0xffff);
-      $titlecase8{$code} = $value;
-    } elsif ($code <= 0xffff) {
-      die "Error: We've assumed 16bit keys have max. 16bit values" if ($value > 0xffff);
-      push @titlecase16_keys, $code;
-      push @titlecase16_values, $value;
     } else {
-      push @titlecase32_keys, $code;
-      push @titlecase32_values, $value;
+      $titlecase{$code} = $value;
     }
   } elsif ($decomp =~ /(?:\<[^>]*> )?(.+)/) {
     # decompositions
@@ -40,15 +28,7 @@ while (<>) {
 	print STDERR "Error: We've assumed decomposition codes are max. 32bit\n";
 	exit 1;
       }
-      if ($code <= 0xff) {
-        $uni8_decomp{$code} = $value;
-      } elsif ($code <= 0xffff) {
-	push @uni16_decomp_keys, $code;
-	push @uni16_decomp_values, $value;
-      } else {
-	push @uni32_decomp_keys, $code;
-	push @uni32_decomp_values, $value;
-      }
+      $uni_decomp{$code} = $value;
     } else {
       # multicharacter decomposition.
       if ($code > 0xffffffff) {
@@ -56,8 +36,8 @@ while (<>) {
 	exit 1;
       }
       
-      push @multidecomp_keys, $code;
-      push @multidecomp_offsets, scalar(@multidecomp_values);
+      # store offset+1, so that 0 means there's no decomposition
+      $multidecomp{$code} = scalar(@multidecomp_values) + 1;
 
       foreach my $dcode (split(" ", $decomp_codes)) {
 	my $value = eval("0x$dcode");
@@ -91,71 +71,63 @@ sub print_list {
   }
 }
 
-print "/* This file is automatically generated by unicodemap.pl from UnicodeData.txt
-
-   NOTE: decompositions for characters having titlecase characters
-   are not included, because we first translate everything to titlecase */\n";
-
-sub print_map8 {
-  my %map = %{$_[0]};
-  my @list;
-  for (my $i = 0; $i <= 0xff; $i++) {
-    if (defined($map{$i})) {
-      push @list, $map{$i};
-    } else {
-      push @list, $i;
+# Print a two-stage lookup table for the code => value map. The code points
+# are split into blocks of UNICODEMAP_BLOCK_SIZE. The first stage maps the
+# block number to a block in the second stage. Identical blocks (most
+# importantly the ones without any mappings) are stored only once. Unmapped
+# code points have value 0.
+my $block_shift = 5;
+my $block_size = 1 << $block_shift;
+
+sub print_stage_map {
+  my ($name, $map) = @_;
+  my $max_code = 0;
+  foreach my $code (keys %{$map}) {
+    $max_code = $code if ($code > $max_code);
+  }
+  my $block_count = ($max_code >> $block_shift) + 1;
+
+  my (@stage1, @stage2, %block_idx);
+  for (my $block = 0; $block < $block_count; $block++) {
+    my @values;
+    for (my $i = 0; $i < $block_size; $i++) {
+      my $value = $map->{($block << $block_shift) + $i};
+      push @values, defined($value) ? $value : 0;
+    }
+    my $key = join(",", @values);
+    if (!defined($block_idx{$key})) {
+      $block_idx{$key} = scalar(@stage2);
+      push @stage2, \@values;
     }
+    push @stage1, $block_idx{$key};
   }
-  print_list(\@list);
+  die "Error: We've assumed there are max. 65536 unique blocks"
+    if (scalar(@stage2) > 65536);
+
+  print "static const uint16_t ${name}_stage1[] = {\n\t";
+  print_list(\@stage1);
+  print "\n};\n";
+
+  print "static const uint32_t ${name}_stage2[][UNICODEMAP_BLOCK_SIZE] = {\n";
+  foreach my $values (@stage2) {
+    print "\t{ ";
+    print_list($values);
+    print " },\n";
+  }
+  print "};\n";
 }
 
-print "static const uint16_t titlecase8_map[256] = {\n\t";
-print_map8(\%titlecase8);
-print "\n};\n";
-
-print "static const uint16_t titlecase16_keys[] = {\n\t";
-print_list(\@titlecase16_keys);
-print "\n};\n";
-
-print "static const uint16_t titlecase16_values[] = {\n\t";
-print_list(\@titlecase16_values);
-print "\n};\n";
-
-print "static const uint32_t titlecase32_keys[] = {\n\t";
-print_list(\@titlecase32_keys);
-print "\n};\n";
-
-print "static const uint32_t titlecase32_values[] = {\n\t";
-print_list(\@titlecase32_values);
-print "\n};\n";
-
-print "static const uint16_t uni8_decomp_map[256] = {\n\t";
-print_map8(\%uni8_decomp);
-print "\n};\n";
-
-print "static const uint16_t uni16_decomp_keys[] = {\n\t";
-print_list(\@uni16_decomp_keys);
-print "\n};\n";
-
-print "static const uint32_t uni16_decomp_values[] = {\n\t";
-print_list(\@uni16_decomp_values);
-print "\n};\n";
-
-print "static const uint32_t uni32_decomp_keys[] = {\n\t";
-print_list(\@uni32_decomp_keys);
-print "\n};\n";
+print "/* This file is automatically generated by unicodemap.pl from UnicodeData.txt
 
-print "static const uint32_t uni32_decomp_values[] = {\n\t";
-print_list(\@uni32_decomp_values);
-print "\n};\n";
+   NOTE: decompositions for characters having titlecase characters
+   are not included, because we first translate everything to titlecase */\n";
 
-print "static const uint32_t multidecomp_keys[] = {\n\t";
-print_list(\@multidecomp_keys);
-print "\n};\n";
+print "#define UNICODEMAP_BLOCK_SHIFT $block_shift\n";
+print "#define UNICODEMAP_BLOCK_SIZE (1 << UNICODEMAP_BLOCK_SHIFT)\n";
 
-print "static const uint16_t multidecomp_offsets[] = {\n\t";
-print_list(\@multidecomp_offsets);
-print "\n};\n";
+print_stage_map("titlecase", \%titlecase);
+print_stage_map("uni_decomp", \%uni_decomp);
+print_stage_map("multidecomp", \%multidecomp);
 
 print "static const uint32_t multidecomp_values[] = {\n\t";
 print_list(\@multidecomp_values);
@@ -44,6 +44,7 @@ struct service_settings log_service_settings = {
 	.service_count = 0,
 	.idle_kill = UINT_MAX,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &log_unix_listeners_buf,
 			      sizeof(log_unix_listeners[0]) } },
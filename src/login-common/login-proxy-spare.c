@@ -0,0 +1,121 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "istream.h"
+#include "llist.h"
+#include "login-proxy-state.h"
+#include "login-proxy-spare.h"
+
+/* Connection to a backend that has been established in advance. A new proxy
+   session to the same backend claims it instead of doing connect(). */
+struct login_proxy_spare {
+	struct login_proxy_spare *prev, *next;
+
+	struct login_proxy_record *state_rec;
+	struct ip_addr source_ip;
+	int fd;
+	size_t max_input_size;
+	struct istream *input;
+	struct io *io;
+	struct timeout *to;
+
+	bool connected:1;
+	bool greeted:1;
+};
+
+static struct login_proxy_spare *login_proxy_spares = NULL;
+
+static void login_proxy_spare_destroy(struct login_proxy_spare *spare)
+{
+	DLLIST_REMOVE(&login_proxy_spares, spare);
+	i_assert(spare->state_rec->num_spare_connections > 0);
+	spare->state_rec->num_spare_connections--;
+
+	io_remove(&spare->io);
+	timeout_remove(&spare->to);
+	i_stream_unref(&spare->input);
+	if (spare->fd != -1)
+		net_disconnect(spare->fd);
+	i_free(spare);
+}
+
+static void login_proxy_spare_input(struct login_proxy_spare *spare)
+{
+	ssize_t ret;
+
+	/* The banner is read into the istream, which the proxy session
+	   claiming this connection continues reading from. Keep watching
+	   the socket afterwards, so a disconnection is noticed before the
+	   spare is claimed. */
+	ret = i_stream_read(spare->input);
+	if (ret < 0) {
+		/* backend disconnected, or it sent more than a banner */
+		login_proxy_spare_destroy(spare);
+	} else if (ret > 0) {
+		spare->greeted = TRUE;
+	}
+}
+
+static void login_proxy_spare_connected(struct login_proxy_spare *spare)
+{
+	if (net_geterror(spare->fd) != 0) {
+		login_proxy_spare_destroy(spare);
+		return;
+	}
+	spare->connected = TRUE;
+	spare->input = i_stream_create_fd(spare->fd, spare->max_input_size);
+	io_remove(&spare->io);
+	spare->io = io_add(spare->fd, IO_READ, login_proxy_spare_input, spare);
+}
+
+void login_proxy_spare_add(struct login_proxy_record *rec,
+			   const struct ip_addr *source_ip, int fd,
+			   size_t max_input_size)
+{
+	struct login_proxy_spare *spare;
+
+	spare = i_new(struct login_proxy_spare, 1);
+	spare->state_rec = rec;
+	spare->source_ip = *source_ip;
+	spare->fd = fd;
+	spare->max_input_size = max_input_size;
+	spare->io = io_add(fd, IO_WRITE, login_proxy_spare_connected, spare);
+	spare->to = timeout_add(LOGIN_PROXY_SPARE_MAX_IDLE_SECS * 1000,
+				login_proxy_spare_destroy, spare);
+	rec->num_spare_connections++;
+	DLLIST_PREPEND(&login_proxy_spares, spare);
+}
+
+int login_proxy_spare_claim(struct login_proxy_record *rec,
+			    const struct ip_addr *source_ip,
+			    struct istream **input_r)
+{
+	struct login_proxy_spare *spare, *found = NULL;
+	int fd;
+
+	for (spare = login_proxy_spares; spare != NULL; spare = spare->next) {
+		if (spare->state_rec != rec || !spare->connected ||
+		    !net_ip_compare(&spare->source_ip, source_ip))
+			continue;
+		/* prefer connections that already received the banner */
+		found = spare;
+		if (spare->greeted)
+			break;
+	}
+	if (found == NULL)
+		return -1;
+
+	fd = found->fd;
+	found->fd = -1;
+	*input_r = found->input;
+	found->input = NULL;
+	login_proxy_spare_destroy(found);
+	return fd;
+}
+
+void login_proxy_spares_destroy_all(void)
+{
+	while (login_proxy_spares != NULL)
+		login_proxy_spare_destroy(login_proxy_spares);
+}
@@ -0,0 +1,29 @@
+#ifndef LOGIN_PROXY_SPARE_H
+#define LOGIN_PROXY_SPARE_H
+
+#include "net.h"
+
+struct istream;
+struct login_proxy_record;
+
+/* Close spare backend connections that haven't been claimed within this
+   many seconds, so backends don't time them out first. */
+#define LOGIN_PROXY_SPARE_MAX_IDLE_SECS 30
+
+/* Add a spare connection to the backend of rec. The fd is still connecting.
+   The backend's banner is read into an istream created with max_input_size,
+   and the spare is closed if the backend disconnects it. */
+void login_proxy_spare_add(struct login_proxy_record *rec,
+			   const struct ip_addr *source_ip, int fd,
+			   size_t max_input_size);
+/* Claim a connected spare connection to the backend of rec, preferring ones
+   that already received the banner. Returns the fd, or -1 if there are no
+   spares. input_r is set to the istream containing the already read input,
+   which may be empty. */
+int login_proxy_spare_claim(struct login_proxy_record *rec,
+			    const struct ip_addr *source_ip,
+			    struct istream **input_r);
+/* Close all spare connections. */
+void login_proxy_spares_destroy_all(void);
+
+#endif
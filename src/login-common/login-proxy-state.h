@@ -23,6 +23,8 @@ struct login_proxy_record {
 	unsigned int num_waiting_connections;
 	/* number of connections we're proxying now (post-login) */
 	unsigned int num_proxying_connections;
+	/* number of pre-connected spare connections waiting to be claimed */
+	unsigned int num_spare_connections;
 	struct timeval last_failure;
 	struct timeval last_success;
 };
@@ -18,6 +18,7 @@
 #include "master-service-ssl-settings.h"
 #include "client-common.h"
 #include "login-proxy-state.h"
+#include "login-proxy-spare.h"
 #include "login-proxy.h"
 
 
@@ -164,6 +165,24 @@ static void login_proxy_free_errstr(struct login_proxy **_proxy,
 			      server ? LOGIN_PROXY_FREE_FLAG_DELAYED : 0);
 }
 
+static void login_proxy_spares_fill(struct login_proxy *proxy)
+{
+	struct login_proxy_record *rec = proxy->state_rec;
+	unsigned int max_spares =
+		proxy->client->set->login_proxy_spare_connections;
+	int fd;
+
+	while (rec->num_spare_connections < max_spares) {
+		fd = net_connect_ip(&proxy->ip, proxy->port,
+				    proxy->source_ip.family == 0 ? NULL :
+				    &proxy->source_ip);
+		if (fd == -1)
+			break;
+		login_proxy_spare_add(rec, &proxy->source_ip, fd,
+				      MAX_PROXY_INPUT_SIZE);
+	}
+}
+
 static void proxy_client_disconnected_input(struct login_proxy *proxy)
 {
 	/* we're already disconnected from server. either wait for
@@ -183,14 +202,21 @@ static void proxy_prelogin_input(struct login_proxy *proxy)
 
 static void proxy_plain_connected(struct login_proxy *proxy)
 {
-	proxy->server_input =
-		i_stream_create_fd(proxy->server_fd, MAX_PROXY_INPUT_SIZE);
+	if (proxy->server_input == NULL) {
+		proxy->server_input =
+			i_stream_create_fd(proxy->server_fd,
+					   MAX_PROXY_INPUT_SIZE);
+	}
 	proxy->server_output =
 		o_stream_create_fd(proxy->server_fd, SIZE_MAX);
 	o_stream_set_no_error_handling(proxy->server_output, TRUE);
 
 	proxy->server_io =
 		io_add(proxy->server_fd, IO_READ, proxy_prelogin_input, proxy);
+	if (i_stream_get_data_size(proxy->server_input) > 0) {
+		/* a claimed spare connection already read the banner */
+		io_set_pending(proxy->server_io);
+	}
 
 	if (proxy->rawlog_dir != NULL) {
 		if (iostream_rawlog_create(proxy->rawlog_dir,
@@ -356,6 +382,7 @@ static void proxy_wait_connect(struct login_proxy *proxy)
 
 	io_remove(&proxy->server_io);
 	proxy_plain_connected(proxy);
+	login_proxy_spares_fill(proxy);
 
 	if ((proxy->ssl_flags & AUTH_PROXY_SSL_FLAG_YES) != 0 &&
 	    (proxy->ssl_flags & AUTH_PROXY_SSL_FLAG_STARTTLS) == 0) {
@@ -408,9 +435,18 @@ static int login_proxy_connect(struct login_proxy *proxy)
 		return -1;
 	}
 
-	proxy->server_fd = net_connect_ip(&proxy->ip, proxy->port,
-					  proxy->source_ip.family == 0 ? NULL :
-					  &proxy->source_ip);
+	proxy->server_fd = login_proxy_spare_claim(rec, &proxy->source_ip,
+						   &proxy->server_input);
+	if (proxy->server_fd != -1) {
+		e_debug(proxy->event,
+			"Using pre-connected %s backend connection",
+			i_stream_get_data_size(proxy->server_input) > 0 ?
+			"greeted" : "connected");
+	} else {
+		proxy->server_fd = net_connect_ip(&proxy->ip, proxy->port,
+						  proxy->source_ip.family == 0 ?
+						  NULL : &proxy->source_ip);
+	}
 	if (proxy->server_fd == -1) {
 		if (!proxy_connect_failed(proxy))
 			return -1;
@@ -1096,6 +1132,9 @@ void login_proxy_kill_idle(void)
 	time_t stop_timestamp = now - LOGIN_PROXY_DIE_IDLE_SECS;
 	unsigned int stop_msecs;
 
+	/* no new proxy sessions are going to be created anymore */
+	login_proxy_spares_destroy_all();
+
 	for (proxy = login_proxies; proxy != NULL; proxy = next) {
 		next = proxy->next;
 		time_t last_io = proxy_last_io(proxy);
@@ -1181,6 +1220,7 @@ void login_proxy_deinit(void)
 
 	while (login_proxies_disconnecting != NULL)
 		login_proxy_free_final(login_proxies_disconnecting);
+	login_proxy_spares_destroy_all();
 
 	i_assert(hash_table_count(login_proxies_hash) == 0);
 	hash_table_destroy(&login_proxies_hash);
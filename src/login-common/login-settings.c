@@ -30,6 +30,7 @@ static const struct setting_define login_setting_defines[] = {
 	DEF(TIME_MSECS, login_proxy_timeout),
 	DEF(UINT, login_proxy_max_reconnects),
 	DEF(TIME, login_proxy_max_disconnect_delay),
+	DEF(UINT, login_proxy_spare_connections),
 	DEF(STR, login_proxy_rawlog_dir),
 	DEF(STR, login_socket_path),
 
@@ -60,6 +61,7 @@ static const struct login_settings login_default_settings = {
 	.login_proxy_timeout = 30*1000,
 	.login_proxy_max_reconnects = 3,
 	.login_proxy_max_disconnect_delay = 0,
+	.login_proxy_spare_connections = 0,
 	.login_proxy_rawlog_dir = "",
 	.login_socket_path = "",
 
@@ -0,0 +1,171 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "istream.h"
+#include "write-full.h"
+#include "test-common.h"
+#include "login-proxy-state.h"
+#include "login-proxy-spare.h"
+
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_BANNER "* OK ready\r\n"
+
+static struct ioloop *ioloop;
+static struct login_proxy_record test_rec;
+static struct ip_addr test_source_ip;
+
+/* Add a spare connection and return the backend's side of it */
+static int test_spare_add(void)
+{
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		i_fatal("socketpair() failed: %m");
+	net_set_nonblock(fds[0], TRUE);
+	login_proxy_spare_add(&test_rec, &test_source_ip, fds[0], 1024);
+	return fds[1];
+}
+
+/* Let the spares handle everything they have received so far */
+static void test_spares_run(void)
+{
+	struct timeout *to;
+
+	to = timeout_add_short(10, io_loop_stop, ioloop);
+	io_loop_run(ioloop);
+	timeout_remove(&to);
+}
+
+static void test_login_proxy_spare_greeted(void)
+{
+	struct istream *input;
+	int backend_fd, fd;
+
+	test_begin("login proxy spare greeted");
+	backend_fd = test_spare_add();
+	test_spares_run();
+	if (write_full(backend_fd, TEST_BANNER, strlen(TEST_BANNER)) < 0)
+		i_fatal("write() failed: %m");
+	test_spares_run();
+	test_assert(test_rec.num_spare_connections == 1);
+
+	/* the banner was already read and is given to the claimer */
+	fd = login_proxy_spare_claim(&test_rec, &test_source_ip, &input);
+	test_assert(fd != -1);
+	test_assert(test_rec.num_spare_connections == 0);
+	test_assert_strcmp(i_stream_next_line(input), "* OK ready");
+
+	/* the connection still works */
+	if (write_full(backend_fd, "more\r\n", 6) < 0)
+		i_fatal("write() failed: %m");
+	test_assert(i_stream_read(input) > 0);
+	test_assert_strcmp(i_stream_next_line(input), "more");
+
+	i_stream_unref(&input);
+	i_close_fd(&fd);
+	i_close_fd(&backend_fd);
+	test_end();
+}
+
+static void test_login_proxy_spare_disconnected(void)
+{
+	struct istream *input;
+	int backend_fd;
+
+	test_begin("login proxy spare disconnected after banner");
+	backend_fd = test_spare_add();
+	test_spares_run();
+	if (write_full(backend_fd, TEST_BANNER, strlen(TEST_BANNER)) < 0)
+		i_fatal("write() failed: %m");
+	test_spares_run();
+	test_assert(test_rec.num_spare_connections == 1);
+
+	/* the backend closing a greeted spare is noticed */
+	i_close_fd(&backend_fd);
+	test_spares_run();
+	test_assert(test_rec.num_spare_connections == 0);
+	test_assert(login_proxy_spare_claim(&test_rec, &test_source_ip,
+					    &input) == -1);
+	test_end();
+}
+
+static void test_login_proxy_spare_prefer_greeted(void)
+{
+	struct istream *input;
+	int backend_fd1, backend_fd2, fd;
+
+	test_begin("login proxy spare prefer greeted");
+	backend_fd1 = test_spare_add();
+	backend_fd2 = test_spare_add();
+	test_spares_run();
+	if (write_full(backend_fd1, TEST_BANNER, strlen(TEST_BANNER)) < 0)
+		i_fatal("write() failed: %m");
+	test_spares_run();
+
+	fd = login_proxy_spare_claim(&test_rec, &test_source_ip, &input);
+	test_assert(fd != -1);
+	test_assert(i_stream_get_data_size(input) == strlen(TEST_BANNER));
+	i_stream_unref(&input);
+	i_close_fd(&fd);
+
+	/* the other one hasn't received anything yet */
+	fd = login_proxy_spare_claim(&test_rec, &test_source_ip, &input);
+	test_assert(fd != -1);
+	test_assert(i_stream_get_data_size(input) == 0);
+	i_stream_unref(&input);
+	i_close_fd(&fd);
+	test_assert(test_rec.num_spare_connections == 0);
+
+	i_close_fd(&backend_fd1);
+	i_close_fd(&backend_fd2);
+	test_end();
+}
+
+static void test_login_proxy_spare_source_ip(void)
+{
+	struct login_proxy_record other_rec;
+	struct istream *input;
+	struct ip_addr other_ip;
+	int backend_fd;
+
+	test_begin("login proxy spare source ip");
+	backend_fd = test_spare_add();
+	test_spares_run();
+
+	/* spares are only given to the same backend and source IP */
+	i_zero(&other_rec);
+	test_assert(login_proxy_spare_claim(&other_rec, &test_source_ip,
+					    &input) == -1);
+	test_assert(net_addr2ip("10.0.0.2", &other_ip) == 0);
+	test_assert(login_proxy_spare_claim(&test_rec, &other_ip,
+					    &input) == -1);
+	test_assert(test_rec.num_spare_connections == 1);
+
+	login_proxy_spares_destroy_all();
+	test_assert(test_rec.num_spare_connections == 0);
+	i_close_fd(&backend_fd);
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_login_proxy_spare_greeted,
+		test_login_proxy_spare_disconnected,
+		test_login_proxy_spare_prefer_greeted,
+		test_login_proxy_spare_source_ip,
+		NULL
+	};
+	int ret;
+
+	if (net_addr2ip("10.0.0.1", &test_source_ip) < 0)
+		i_unreached();
+	ioloop = io_loop_create();
+	ret = test_run(test_functions);
+	login_proxy_spares_destroy_all();
+	io_loop_destroy(&ioloop);
+	return ret;
+}
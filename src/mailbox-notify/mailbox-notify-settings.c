@@ -0,0 +1,56 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "buffer.h"
+#include "settings-parser.h"
+#include "service-settings.h"
+
+#include <stddef.h>
+
+/* <settings checks> */
+static struct file_listener_settings mailbox_notify_unix_listeners_array[] = {
+	{
+		.path = "mailbox-notify",
+		.mode = 0660,
+		.user = "",
+		.group = "$default_internal_group",
+	},
+};
+static struct file_listener_settings *mailbox_notify_unix_listeners[] = {
+	&mailbox_notify_unix_listeners_array[0]
+};
+static buffer_t mailbox_notify_unix_listeners_buf = {
+	{ { mailbox_notify_unix_listeners,
+	    sizeof(mailbox_notify_unix_listeners) } }
+};
+/* </settings checks> */
+
+struct service_settings mailbox_notify_service_settings = {
+	.name = "mailbox-notify",
+	.protocol = "",
+	.type = "",
+	.executable = "mailbox-notify",
+	.user = "$default_internal_user",
+	.group = "",
+	.privileged_group = "",
+	.extra_groups = "",
+	.chroot = "",
+
+	.drop_priv_before_exec = FALSE,
+
+	.process_min_avail = 0,
+	.process_limit = 1,
+	/* each process with an IDLEing client keeps a connection */
+	.client_limit = 10000,
+	.service_count = 0,
+	.idle_kill = 0,
+	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
+
+	.unix_listeners = { { &mailbox_notify_unix_listeners_buf,
+			      sizeof(mailbox_notify_unix_listeners[0]) } },
+	.fifo_listeners = ARRAY_INIT,
+	.inet_listeners = ARRAY_INIT,
+
+	.process_limit_1 = TRUE
+};
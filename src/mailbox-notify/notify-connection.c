@@ -0,0 +1,234 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "hash.h"
+#include "str.h"
+#include "ostream.h"
+#include "connection.h"
+#include "guid.h"
+#include "master-service.h"
+#include "notify-connection.h"
+
+#define MAILBOX_NOTIFY_PROTOCOL_MAJOR_VERSION 1
+#define MAILBOX_NOTIFY_PROTOCOL_MINOR_VERSION 0
+/* Disconnect clients that have this much unsent output. They reconnect and
+   check all their watched mailboxes afterwards. */
+#define NOTIFY_CONNECTION_OUTPUT_MAX_SIZE (128*1024)
+
+/* Processes watching changes to one mailbox */
+struct notify_watch {
+	char *guid;
+	ARRAY(struct notify_connection *) conns;
+};
+
+struct notify_connection {
+	struct connection conn;
+
+	/* Mailboxes this connection is watching */
+	ARRAY(struct notify_watch *) watches;
+};
+
+static struct connection_list *notify_connections = NULL;
+static HASH_TABLE(char *, struct notify_watch *) notify_watches;
+
+static void notify_connection_destroy(struct connection *_conn);
+
+static bool notify_guid_is_valid(const char *guid)
+{
+	guid_128_t guid_128;
+
+	return guid_128_from_string(guid, guid_128) == 0;
+}
+
+static void
+notify_connection_watch(struct notify_connection *conn, const char *guid)
+{
+	struct notify_watch *watch;
+
+	watch = hash_table_lookup(notify_watches, guid);
+	if (watch == NULL) {
+		watch = i_new(struct notify_watch, 1);
+		watch->guid = i_strdup(guid);
+		i_array_init(&watch->conns, 4);
+		hash_table_insert(notify_watches, watch->guid, watch);
+	} else {
+		struct notify_connection *watch_conn;
+
+		array_foreach_elem(&watch->conns, watch_conn) {
+			if (watch_conn == conn)
+				return;
+		}
+	}
+	array_push_back(&watch->conns, &conn);
+	array_push_back(&conn->watches, &watch);
+}
+
+static void
+notify_watch_remove_conn(struct notify_watch *watch,
+			 struct notify_connection *conn)
+{
+	struct notify_connection *const *connp;
+
+	array_foreach(&watch->conns, connp) {
+		if (*connp == conn) {
+			array_delete(&watch->conns,
+				     array_foreach_idx(&watch->conns, connp), 1);
+			break;
+		}
+	}
+	if (array_count(&watch->conns) > 0)
+		return;
+
+	hash_table_remove(notify_watches, watch->guid);
+	array_free(&watch->conns);
+	i_free(watch->guid);
+	i_free(watch);
+}
+
+static void
+notify_connection_unwatch(struct notify_connection *conn, const char *guid)
+{
+	struct notify_watch *const *watchp;
+
+	array_foreach(&conn->watches, watchp) {
+		if (strcmp((*watchp)->guid, guid) == 0) {
+			notify_watch_remove_conn(*watchp, conn);
+			array_delete(&conn->watches,
+				     array_foreach_idx(&conn->watches, watchp), 1);
+			return;
+		}
+	}
+}
+
+static void
+notify_connection_changed(struct notify_connection *conn, const char *guid,
+			  const char *modseq)
+{
+	struct notify_watch *watch;
+	struct notify_connection *watch_conn;
+	ARRAY(struct notify_connection *) slow_conns;
+	string_t *str;
+
+	watch = hash_table_lookup(notify_watches, guid);
+	if (watch == NULL)
+		return;
+
+	str = t_str_new(64);
+	str_printfa(str, "CHANGED\t%s\t%s\n", guid, modseq);
+	t_array_init(&slow_conns, 4);
+	array_foreach_elem(&watch->conns, watch_conn) {
+		/* the sender has already notified its own watchers */
+		if (watch_conn == conn)
+			continue;
+		if (o_stream_get_buffer_used_size(watch_conn->conn.output) +
+		    str_len(str) > NOTIFY_CONNECTION_OUTPUT_MAX_SIZE) {
+			array_push_back(&slow_conns, &watch_conn);
+			continue;
+		}
+		o_stream_nsend(watch_conn->conn.output,
+			       str_data(str), str_len(str));
+	}
+	/* destroying modifies watch->conns, so do it only afterwards */
+	array_foreach_elem(&slow_conns, watch_conn) {
+		e_error(watch_conn->conn.event,
+			"Client is too slow to read notifications - disconnecting");
+		connection_disconnect(&watch_conn->conn);
+		notify_connection_destroy(&watch_conn->conn);
+	}
+}
+
+static int
+notify_connection_input_args(struct connection *_conn, const char *const *args)
+{
+	struct notify_connection *conn =
+		container_of(_conn, struct notify_connection, conn);
+	const char *cmd = args[0];
+	uint64_t modseq;
+
+	if (cmd == NULL || args[1] == NULL || !notify_guid_is_valid(args[1])) {
+		e_error(_conn->event, "Client sent invalid input");
+		return -1;
+	}
+
+	if (strcmp(cmd, "WATCH") == 0)
+		notify_connection_watch(conn, args[1]);
+	else if (strcmp(cmd, "UNWATCH") == 0)
+		notify_connection_unwatch(conn, args[1]);
+	else if (strcmp(cmd, "CHANGED") == 0) {
+		/* CHANGED <mailbox guid> <highest modseq> */
+		if (args[2] == NULL || str_to_uint64(args[2], &modseq) < 0) {
+			e_error(_conn->event, "Client sent invalid modseq");
+			return -1;
+		}
+		notify_connection_changed(conn, args[1], args[2]);
+	} else {
+		e_error(_conn->event, "Unknown command: %s", cmd);
+		return -1;
+	}
+	return 1;
+}
+
+static void notify_connection_destroy(struct connection *_conn)
+{
+	struct notify_connection *conn =
+		container_of(_conn, struct notify_connection, conn);
+	struct notify_watch *watch;
+
+	array_foreach_elem(&conn->watches, watch)
+		notify_watch_remove_conn(watch, conn);
+	array_free(&conn->watches);
+
+	connection_deinit(&conn->conn);
+	i_free(conn);
+	master_service_client_connection_destroyed(master_service);
+}
+
+static const struct connection_vfuncs notify_connection_vfuncs = {
+	.destroy = notify_connection_destroy,
+	.input_args = notify_connection_input_args,
+};
+
+static const struct connection_settings notify_connection_set = {
+	.service_name_in = "mailbox-notify-client",
+	.service_name_out = "mailbox-notify-server",
+	.major_version = MAILBOX_NOTIFY_PROTOCOL_MAJOR_VERSION,
+	.minor_version = MAILBOX_NOTIFY_PROTOCOL_MINOR_VERSION,
+	.input_max_size = 1024,
+	.output_max_size = NOTIFY_CONNECTION_OUTPUT_MAX_SIZE,
+};
+
+void notify_connection_create(struct master_service_connection *master_conn)
+{
+	struct notify_connection *conn;
+
+	if (notify_connections == NULL) {
+		notify_connections =
+			connection_list_init(&notify_connection_set,
+					     &notify_connection_vfuncs);
+		hash_table_create(&notify_watches, default_pool, 0,
+				  str_hash, strcmp);
+	}
+
+	conn = i_new(struct notify_connection, 1);
+	i_array_init(&conn->watches, 8);
+	connection_init_server(notify_connections, &conn->conn,
+			       master_conn->name, master_conn->fd,
+			       master_conn->fd);
+}
+
+unsigned int notify_connections_get_count(void)
+{
+	if (notify_connections == NULL)
+		return 0;
+	return notify_connections->connections_count;
+}
+
+void notify_connections_destroy_all(void)
+{
+	if (notify_connections == NULL)
+		return;
+	connection_list_deinit(&notify_connections);
+	i_assert(hash_table_count(notify_watches) == 0);
+	hash_table_destroy(&notify_watches);
+}
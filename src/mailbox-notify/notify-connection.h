@@ -0,0 +1,11 @@
+#ifndef NOTIFY_CONNECTION_H
+#define NOTIFY_CONNECTION_H
+
+struct master_service_connection;
+
+void notify_connection_create(struct master_service_connection *conn);
+
+unsigned int notify_connections_get_count(void);
+void notify_connections_destroy_all(void);
+
+#endif
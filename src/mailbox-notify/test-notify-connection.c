@@ -0,0 +1,198 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "ioloop.h"
+#include "net.h"
+#include "istream.h"
+#include "ostream.h"
+#include "master-service-private.h"
+#include "test-common.h"
+#include "notify-connection.h"
+
+#include <sys/socket.h>
+
+#define TEST_GUID "0123456789abcdef0123456789abcdef"
+
+struct test_client {
+	int fd;
+	struct istream *input;
+	struct ostream *output;
+};
+
+static struct ioloop *ioloop;
+
+static void test_client_init(struct test_client *client)
+{
+	struct master_service_connection master_conn;
+	int fds[2];
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) < 0)
+		i_fatal("socketpair() failed: %m");
+	net_set_nonblock(fds[0], TRUE);
+	net_set_nonblock(fds[1], TRUE);
+
+	i_zero(&master_conn);
+	master_conn.fd = fds[0];
+	master_conn.name = "test";
+	notify_connection_create(&master_conn);
+
+	client->fd = fds[1];
+	client->input = i_stream_create_fd(fds[1], SIZE_MAX);
+	client->output = o_stream_create_fd(fds[1], SIZE_MAX);
+	o_stream_nsend_str(client->output,
+			   "VERSION\tmailbox-notify-client\t1\t0\n");
+}
+
+static void test_client_deinit(struct test_client *client)
+{
+	i_stream_destroy(&client->input);
+	o_stream_destroy(&client->output);
+	i_close_fd(&client->fd);
+}
+
+static void test_client_send(struct test_client *client, const char *line)
+{
+	o_stream_nsend_str(client->output, t_strconcat(line, "\n", NULL));
+	test_assert(o_stream_flush(client->output) > 0);
+}
+
+/* Let the broker handle everything it has received so far */
+static void test_broker_run(void)
+{
+	struct timeout *to;
+
+	to = timeout_add_short(10, io_loop_stop, ioloop);
+	io_loop_run(ioloop);
+	timeout_remove(&to);
+}
+
+/* Returns the next line sent by the broker, "" if nothing was sent or NULL
+   if the broker disconnected. */
+static const char *test_client_read(struct test_client *client)
+{
+	const char *line;
+
+	(void)i_stream_read(client->input);
+	line = i_stream_next_line(client->input);
+	if (line != NULL)
+		return line;
+	return client->input->eof ? NULL : "";
+}
+
+static void test_client_handshake(struct test_client *client)
+{
+	test_assert_strcmp(test_client_read(client),
+			   "VERSION\tmailbox-notify-server\t1\t0");
+}
+
+static void test_notify_connection_changed(void)
+{
+	struct test_client watcher, writer;
+
+	test_begin("mailbox-notify changed");
+	test_client_init(&watcher);
+	test_client_init(&writer);
+	test_client_send(&watcher, "WATCH\t"TEST_GUID);
+	test_broker_run();
+	test_client_send(&writer, "CHANGED\t"TEST_GUID"\t5");
+	test_broker_run();
+
+	test_client_handshake(&watcher);
+	test_client_handshake(&writer);
+	test_assert_strcmp(test_client_read(&watcher),
+			   "CHANGED\t"TEST_GUID"\t5");
+	test_assert_strcmp(test_client_read(&writer), "");
+
+	/* the writer's own changes aren't sent back to it */
+	test_client_send(&writer, "WATCH\t"TEST_GUID);
+	test_client_send(&writer, "CHANGED\t"TEST_GUID"\t6");
+	test_broker_run();
+	test_assert_strcmp(test_client_read(&watcher),
+			   "CHANGED\t"TEST_GUID"\t6");
+	test_assert_strcmp(test_client_read(&writer), "");
+
+	/* nothing is sent after UNWATCH */
+	test_client_send(&watcher, "UNWATCH\t"TEST_GUID);
+	test_client_send(&writer, "CHANGED\t"TEST_GUID"\t7");
+	test_broker_run();
+	test_assert_strcmp(test_client_read(&watcher), "");
+	test_assert(notify_connections_get_count() == 2);
+
+	test_client_deinit(&watcher);
+	test_client_deinit(&writer);
+	test_broker_run();
+	test_assert(notify_connections_get_count() == 0);
+	test_end();
+}
+
+static void test_notify_connection_invalid_input(void)
+{
+	struct test_client client;
+
+	test_begin("mailbox-notify invalid input");
+	test_client_init(&client);
+	test_client_send(&client, "WATCH\tnot-a-guid");
+	test_expect_error_string("Client sent invalid input");
+	test_broker_run();
+	test_expect_no_more_errors();
+
+	test_client_handshake(&client);
+	test_assert(test_client_read(&client) == NULL);
+	test_assert(notify_connections_get_count() == 0);
+	test_client_deinit(&client);
+	test_end();
+}
+
+static void test_notify_connection_slow_client(void)
+{
+	struct test_client watcher, writer;
+	unsigned int i;
+
+	test_begin("mailbox-notify slow client");
+	test_client_init(&watcher);
+	test_client_init(&writer);
+	test_client_send(&watcher, "WATCH\t"TEST_GUID);
+	test_broker_run();
+
+	/* the watcher never reads, so the broker's output buffer for it
+	   fills up and it gets disconnected */
+	test_expect_error_string("Client is too slow");
+	for (i = 0; i < 100000 && notify_connections_get_count() == 2; i++) {
+		test_client_send(&writer, t_strdup_printf(
+			"CHANGED\t"TEST_GUID"\t%u", i));
+		if (i % 100 == 0)
+			test_broker_run();
+	}
+	test_broker_run();
+	test_expect_no_more_errors();
+	test_assert(notify_connections_get_count() == 1);
+
+	test_client_deinit(&watcher);
+	test_client_deinit(&writer);
+	test_broker_run();
+	test_end();
+}
+
+int main(void)
+{
+	static void (*const test_functions[])(void) = {
+		test_notify_connection_changed,
+		test_notify_connection_invalid_input,
+		test_notify_connection_slow_client,
+		NULL
+	};
+	/* fake master service to pretend destroying connections */
+	struct master_service local_master_service = {
+		.stopping = TRUE,
+		.total_available_count = 100,
+		.service_count_left = 100,
+	};
+	int ret;
+
+	master_service = &local_master_service;
+	ioloop = io_loop_create();
+	ret = test_run(test_functions);
+	notify_connections_destroy_all();
+	io_loop_destroy(&ioloop);
+	return ret;
+}
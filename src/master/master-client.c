@@ -21,7 +21,8 @@ master_client_service_status_output(string_t *str,
 				    const struct service *service)
 {
 	str_append_tabescaped(str, service->set->name);
-	str_printfa(str, "\t%u\t%u\t%u\t%u\t%u\t%ld\t%u\t%ld\t%c\t%c\t%c\t%"PRIu64"\n",
+	str_printfa(str, "\t%u\t%u\t%u\t%u\t%u\t%ld\t%u\t%ld\t%c\t%c\t%c\t%"PRIu64
+		    "\t%u\t%.2f\t%u\n",
 		    service->process_count, service->process_avail,
 		    service->process_limit, service->client_limit,
 		    (service->to_throttle == NULL ?
@@ -32,7 +33,9 @@ master_client_service_status_output(string_t *str,
 		    service->listen_pending ? 'y' : 'n',
 		    service->listening ? 'y' : 'n',
 		    service->doveadm_stop ? 'y' : 'n',
-		    service->process_count_total);
+		    service->process_count_total,
+		    service->process_min_avail, service->connect_rate,
+		    service->process_startup_msecs);
 }
 
 static int
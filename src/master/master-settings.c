@@ -115,11 +115,13 @@ static const struct setting_define service_setting_defines[] = {
 	DEF(BOOL, drop_priv_before_exec),
 
 	DEF(UINT, process_min_avail),
+	DEF(BOOL, process_min_avail_auto),
 	DEF(UINT, process_limit),
 	DEF(UINT, client_limit),
 	DEF(UINT, service_count),
 	DEF(TIME, idle_kill),
 	DEF(SIZE, vsz_limit),
+	DEF(STR, cpu_affinity),
 
 	DEFLIST_UNIQUE(unix_listeners, "unix_listener",
 		       &file_listener_setting_parser_info),
@@ -145,11 +147,13 @@ static const struct service_settings service_default_settings = {
 	.drop_priv_before_exec = FALSE,
 
 	.process_min_avail = 0,
+	.process_min_avail_auto = FALSE,
 	.process_limit = 0,
 	.client_limit = 0,
 	.service_count = 0,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = ARRAY_INIT,
 	.fifo_listeners = ARRAY_INIT,
@@ -249,6 +253,12 @@ const struct setting_parser_info master_setting_parser_info = {
 };
 
 /* <settings checks> */
+#ifdef HAVE_SCHED_SETAFFINITY
+#  include <sched.h>
+/* same as CPU_SETSIZE, which isn't visible without _GNU_SOURCE */
+#  define SERVICE_CPU_SETSIZE (sizeof(cpu_set_t) * CHAR_BIT)
+#endif
+
 static void
 expand_user(const char **user, enum service_user_default *default_r,
 	    const struct master_settings *set)
@@ -418,6 +428,78 @@ static bool service_is_enabled(const struct master_settings *set,
 			       service->protocol);
 }
 
+#ifdef HAVE_SCHED_SETAFFINITY
+static bool
+cpu_list_parse(const char *str, ARRAY_TYPE(uint) *cpus,
+	       const char **error_r)
+{
+	const char *const *items, *p;
+	unsigned int first, last, cpu;
+
+	for (items = t_strsplit(str, ","); *items != NULL; items++) {
+		p = strchr(*items, '-');
+		if (p == NULL) {
+			if (str_to_uint(*items, &first) < 0) {
+				*error_r = t_strdup_printf(
+					"Invalid CPU number: %s", *items);
+				return FALSE;
+			}
+			last = first;
+		} else if (str_to_uint(t_strdup_until(*items, p), &first) < 0 ||
+			   str_to_uint(p + 1, &last) < 0 || first > last) {
+			*error_r = t_strdup_printf(
+				"Invalid CPU range: %s", *items);
+			return FALSE;
+		}
+		/* sched_setaffinity() can't be given CPUs outside cpu_set_t */
+		if (last >= SERVICE_CPU_SETSIZE) {
+			*error_r = t_strdup_printf(
+				"CPU number in %s is too large (max %zu)",
+				*items, SERVICE_CPU_SETSIZE - 1);
+			return FALSE;
+		}
+		for (cpu = first; cpu <= last; cpu++)
+			array_push_back(cpus, &cpu);
+	}
+	return TRUE;
+}
+#endif
+
+static bool
+service_cpu_affinity_parse(struct service_settings *service, pool_t pool,
+			   const char **error_r)
+{
+	if (service->cpu_affinity[0] == '\0')
+		return TRUE;
+#ifndef HAVE_SCHED_SETAFFINITY
+	*error_r = t_strdup_printf("service(%s): "
+		"cpu_affinity isn't supported on this OS", service->name);
+	return FALSE;
+#else
+	const char *const *sets, *error;
+	ARRAY_TYPE(uint) *cpus;
+
+	sets = t_strsplit_spaces(service->cpu_affinity, " ");
+	if (sets[0] == NULL) {
+		*error_r = t_strdup_printf("service(%s): "
+			"cpu_affinity doesn't contain any CPUs", service->name);
+		return FALSE;
+	}
+	p_array_init(&service->parsed_cpu_sets, pool, 4);
+	for (; *sets != NULL; sets++) {
+		cpus = array_append_space(&service->parsed_cpu_sets);
+		p_array_init(cpus, pool, 16);
+		if (!cpu_list_parse(*sets, cpus, &error)) {
+			*error_r = t_strdup_printf("service(%s): "
+				"Invalid cpu_affinity: %s",
+				service->name, error);
+			return FALSE;
+		}
+	}
+	return TRUE;
+#endif
+}
+
 static bool
 master_settings_verify(void *_set, pool_t pool, const char **error_r)
 {
@@ -560,6 +642,8 @@ master_settings_verify(void *_set, pool_t pool, const char **error_r)
 				"vsz_limit is too low", service->name);
 			return FALSE;
 		}
+		if (!service_cpu_affinity_parse(service, pool, error_r))
+			return FALSE;
 
 #ifdef CONFIG_BINARY
 		default_service =
@@ -29,6 +29,16 @@
 #define SERVICE_MAX_EXIT_FAILURES_IN_SEC 10
 #define SERVICE_MIN_SUCCESSFUL_AGE_SECS 10
 #define SERVICE_PREFORK_MAX_AT_ONCE 10
+/* process_min_avail_auto: how often to recalculate process_min_avail */
+#define SERVICE_MIN_AVAIL_UPDATE_MSECS 1000
+/* Weights for moving connect_rate towards the latest measured rate. Follow
+   increasing rates quickly, but decreasing rates slowly, so that the extra
+   processes aren't killed too early after a short pause. */
+#define SERVICE_CONNECT_RATE_UP_WEIGHT 0.5
+#define SERVICE_CONNECT_RATE_DOWN_WEIGHT 0.05
+/* Keep this many times the processes that are predicted to be needed while
+   a new process is starting up. */
+#define SERVICE_MIN_AVAIL_AUTO_HEADROOM 2
 
 static void service_monitor_start_extra_avail(struct service *service);
 static void service_status_more(struct service_process *process,
@@ -59,12 +69,12 @@ static void service_kill_idle(struct service *service)
 
 	/* Always try to leave process_min_avail processes */
 	i_assert(processes_to_kill <= service->process_avail);
-	if (processes_to_kill <= service->set->process_min_avail) {
+	if (processes_to_kill <= service->process_min_avail) {
 		if (service->process_idling == 0)
 			timeout_remove(&service->to_idle);
 		return;
 	}
-	processes_to_kill -= service->set->process_min_avail;
+	processes_to_kill -= service->process_min_avail;
 
 	/* Now, kill the processes with the oldest idle_start time.
 
@@ -121,6 +131,8 @@ static void service_status_more(struct service_process *process,
 	}
 	process->total_count +=
 		process->available_count - status->available_count;
+	service->connect_count +=
+		process->available_count - status->available_count;
 
 	if (status->available_count != 0)
 		return;
@@ -160,7 +172,7 @@ static void service_check_idle(struct service_process *process)
 		       &service->idle_processes_tail, process);
 	process->idle_start = ioloop_time;
 
-	if (service->process_avail > service->set->process_min_avail &&
+	if (service->process_avail > service->process_min_avail &&
 	    service->to_idle == NULL &&
 	    service->idle_kill != UINT_MAX) {
 		/* We have more processes than we really need. Start a timer
@@ -188,6 +200,22 @@ static void service_status_less(struct service_process *process)
 		service_login_notify(service, FALSE);
 }
 
+static void service_process_startup_finished(struct service_process *process)
+{
+	struct service *service = process->service;
+	int msecs;
+
+	msecs = timeval_diff_msecs(&ioloop_timeval, &process->create_timeval);
+	if (msecs < 0)
+		return; /* time moved backwards */
+	if (service->process_startup_msecs == 0)
+		service->process_startup_msecs = msecs;
+	else {
+		service->process_startup_msecs =
+			(service->process_startup_msecs * 4 + msecs) / 5;
+	}
+}
+
 static void
 service_status_input_one(struct service *service,
 			 const struct master_status *status)
@@ -219,7 +247,10 @@ service_status_input_one(struct service *service,
 	timeout_remove(&process->to_idle_kill);
 
 	/* first status notification */
-	timeout_remove(&process->to_status);
+	if (process->to_status != NULL) {
+		service_process_startup_finished(process);
+		timeout_remove(&process->to_status);
+	}
 
 	if (process->available_count != status->available_count) {
 		if (process->available_count > status->available_count) {
@@ -400,9 +431,9 @@ service_monitor_start_count(struct service *service, unsigned int limit)
 {
 	unsigned int i, count;
 
-	i_assert(service->set->process_min_avail >= service->process_avail);
+	i_assert(service->process_min_avail >= service->process_avail);
 
-	count = service->set->process_min_avail - service->process_avail;
+	count = service->process_min_avail - service->process_avail;
 	if (service->process_count + count > service->process_limit)
 		count = service->process_limit - service->process_count;
 	if (count > limit)
@@ -430,9 +461,9 @@ static void service_monitor_prefork_timeout(struct service *service)
 		service->prefork_counter = service->list->fork_counter;
 		return;
 	}
-	if (service->process_avail < service->set->process_min_avail) {
+	if (service->process_avail < service->process_min_avail) {
 		if (service_monitor_start_count(service, SERVICE_PREFORK_MAX_AT_ONCE) &&
-		    service->process_avail < service->set->process_min_avail) {
+		    service->process_avail < service->process_min_avail) {
 			/* All SERVICE_PREFORK_MAX_AT_ONCE were created, but
 			   it still wasn't enough. Launch more in the next
 			   timeout. */
@@ -444,7 +475,7 @@ static void service_monitor_prefork_timeout(struct service *service)
 
 static void service_monitor_start_extra_avail(struct service *service)
 {
-	if (service->process_avail >= service->set->process_min_avail ||
+	if (service->process_avail >= service->process_min_avail ||
 	    service->process_count >= service->process_limit ||
 	    service->list->destroying)
 		return;
@@ -453,7 +484,7 @@ static void service_monitor_start_extra_avail(struct service *service)
 		/* quickly start one process now */
 		if (!service_monitor_start_count(service, 1))
 			return;
-		if (service->process_avail >= service->set->process_min_avail)
+		if (service->process_avail >= service->process_min_avail)
 			return;
 	}
 	if (service->to_prefork == NULL) {
@@ -465,6 +496,57 @@ static void service_monitor_start_extra_avail(struct service *service)
 	}
 }
 
+static unsigned int service_min_avail_auto_calc(struct service *service)
+{
+	double startup_secs = service->process_startup_msecs / 1000.0;
+	double clients;
+	unsigned int min_avail;
+
+	/* Clients that are expected to connect while a new process is
+	   starting up must be handled by the already available processes. */
+	clients = service->connect_rate * startup_secs *
+		SERVICE_MIN_AVAIL_AUTO_HEADROOM;
+	min_avail = (unsigned int)(clients / service->client_limit + 0.999);
+	if (min_avail == 0 && service->connect_rate >= 0.5)
+		min_avail = 1;
+
+	if (min_avail < service->set->process_min_avail)
+		min_avail = service->set->process_min_avail;
+	if (min_avail > service->process_limit)
+		min_avail = service->process_limit;
+	return min_avail;
+}
+
+static void service_min_avail_update(struct service *service)
+{
+	double rate, weight;
+	unsigned int old_min_avail = service->process_min_avail;
+
+	rate = service->connect_count * 1000.0 / SERVICE_MIN_AVAIL_UPDATE_MSECS;
+	service->connect_count = 0;
+	weight = rate > service->connect_rate ?
+		SERVICE_CONNECT_RATE_UP_WEIGHT :
+		SERVICE_CONNECT_RATE_DOWN_WEIGHT;
+	service->connect_rate += (rate - service->connect_rate) * weight;
+
+	service->process_min_avail = service_min_avail_auto_calc(service);
+	if (service->process_min_avail > old_min_avail) {
+		e_debug(service->event, "process_min_avail increased to %u "
+			"(%.1f connections/s, %u ms process startup)",
+			service->process_min_avail, service->connect_rate,
+			service->process_startup_msecs);
+		service_monitor_start_extra_avail(service);
+	} else if (service->process_min_avail < old_min_avail &&
+		   service->process_avail > service->process_min_avail &&
+		   service->process_idling > 0 &&
+		   service->to_idle == NULL &&
+		   service->idle_kill != UINT_MAX) {
+		/* demand dropped - let idle_kill reduce the processes */
+		service->to_idle = timeout_add(service->idle_kill * 1000,
+					       service_kill_idle, service);
+	}
+}
+
 static void service_monitor_listen_start_force(struct service *service)
 {
 	struct service_listener *l;
@@ -583,6 +665,12 @@ void services_monitor_start(struct service_list *service_list)
 				io_add(service->status_fd[0], IO_READ,
 				       service_status_input, service);
 		}
+		if (service->set->process_min_avail_auto &&
+		    service->to_min_avail == NULL) {
+			service->to_min_avail =
+				timeout_add(SERVICE_MIN_AVAIL_UPDATE_MSECS,
+					    service_min_avail_update, service);
+		}
 		service_monitor_listen_start(service);
 		array_push_back(&listener_services, &service);
 	}
@@ -644,6 +732,7 @@ void service_monitor_stop(struct service *service)
 	timeout_remove(&service->to_throttle);
 	timeout_remove(&service->to_prefork);
 	timeout_remove(&service->to_idle);
+	timeout_remove(&service->to_min_avail);
 }
 
 void service_monitor_stop_close(struct service *service)
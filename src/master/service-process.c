@@ -1,5 +1,6 @@
 /* Copyright (c) 2005-2018 Dovecot authors, see the included COPYING file */
 
+#define _GNU_SOURCE /* for sched_setaffinity() */
 #include "common.h"
 #include "array.h"
 #include "aqueue.h"
@@ -33,6 +34,9 @@
 #include <syslog.h>
 #include <signal.h>
 #include <sys/wait.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#  include <sched.h>
+#endif
 
 static void service_reopen_inet_listeners(struct service *service)
 {
@@ -279,6 +283,51 @@ drop_privileges(struct service *service)
 	}
 }
 
+static int service_cpu_set_choose(struct service *service)
+{
+	unsigned int i, count, min_idx = 0;
+
+	if (!array_is_created(&service->set->parsed_cpu_sets))
+		return -1;
+
+	/* spread the processes evenly across the CPU sets */
+	count = array_count(&service->set->parsed_cpu_sets);
+	for (i = 1; i < count; i++) {
+		if (service->cpu_set_process_counts[i] <
+		    service->cpu_set_process_counts[min_idx])
+			min_idx = i;
+	}
+	return (int)min_idx;
+}
+
+static void service_set_cpu_affinity(struct service *service, int cpu_set_idx)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	const ARRAY_TYPE(uint) *cpus;
+	unsigned int cpu;
+	cpu_set_t cpu_set;
+
+	if (cpu_set_idx < 0)
+		return;
+
+	cpus = array_idx(&service->set->parsed_cpu_sets, cpu_set_idx);
+	CPU_ZERO(&cpu_set);
+	array_foreach_elem(cpus, cpu) {
+		/* verified by the settings check */
+		i_assert(cpu < CPU_SETSIZE);
+		CPU_SET(cpu, &cpu_set);
+	}
+	if (sched_setaffinity(0, sizeof(cpu_set), &cpu_set) < 0) {
+		i_error("service(%s): sched_setaffinity(%s) failed: %m",
+			service->set->name,
+			t_strsplit_spaces(service->set->cpu_affinity,
+					  " ")[cpu_set_idx]);
+	}
+#else
+	i_assert(cpu_set_idx < 0);
+#endif
+}
+
 static void service_process_setup_config_environment(struct service *service)
 {
 	switch (service->type) {
@@ -364,6 +413,7 @@ struct service_process *service_process_create(struct service *service)
 	unsigned int uid = ++uid_counter;
 	const char *hostdomain;
 	pid_t pid;
+	int cpu_set_idx;
 	bool process_forked;
 
 	i_assert(service->status_fd[0] != -1);
@@ -386,7 +436,9 @@ struct service_process *service_process_create(struct service *service)
 		pid = service_anvil_global->pid;
 		uid = service_anvil_global->uid;
 		process_forked = FALSE;
+		cpu_set_idx = -1;
 	} else {
+		cpu_set_idx = service_cpu_set_choose(service);
 		pid = fork();
 		process_forked = TRUE;
 		service->list->fork_counter++;
@@ -411,6 +463,7 @@ struct service_process *service_process_create(struct service *service)
 		service_process_setup_environment(service, uid, hostdomain);
 		service_reopen_inet_listeners(service);
 		service_dup_fds(service);
+		service_set_cpu_affinity(service, cpu_set_idx);
 		drop_privileges(service);
 		process_exec(service->executable);
 	}
@@ -422,6 +475,10 @@ struct service_process *service_process_create(struct service *service)
 	process->pid = pid;
 	process->uid = uid;
 	process->create_time = ioloop_time;
+	process->create_timeval = ioloop_timeval;
+	process->cpu_set_idx = cpu_set_idx;
+	if (cpu_set_idx >= 0)
+		service->cpu_set_process_counts[cpu_set_idx]++;
 	if (process_forked) {
 		process->to_status =
 			timeout_add(SERVICE_FIRST_STATUS_TIMEOUT_SECS * 1000,
@@ -482,6 +539,12 @@ void service_process_destroy(struct service_process *process)
 	}
 	i_assert(service->process_count > 0);
 	service->process_count--;
+	if (process->cpu_set_idx >= 0) {
+		unsigned int *cpu_set_count =
+			&service->cpu_set_process_counts[process->cpu_set_idx];
+		i_assert(*cpu_set_count > 0);
+		(*cpu_set_count)--;
+	}
 	i_assert(service->process_avail <= service->process_count);
 
 	timeout_remove(&process->to_status);
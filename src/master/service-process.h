@@ -21,6 +21,10 @@ struct service_process {
 
 	/* Timestamp when the process was created */
 	time_t create_time;
+	struct timeval create_timeval;
+	/* Index to service->set->parsed_cpu_sets that the process is pinned
+	   to, or -1 if it isn't pinned. */
+	int cpu_set_idx;
 	/* Time when process started idling, or 0 if we're not idling. This is
 	   updated when the process sends a notification via its status pipe
 	   about the number of clients it is processing.
@@ -214,6 +214,11 @@ service_create_real(pool_t pool, struct event *event,
 		set->master_set->default_vsz_limit;
 	service->idle_kill = set->idle_kill != 0 ? set->idle_kill :
 		set->master_set->default_idle_kill;
+	if (array_is_created(&set->parsed_cpu_sets)) {
+		service->cpu_set_process_counts =
+			p_new(pool, unsigned int,
+			      array_count(&set->parsed_cpu_sets));
+	}
 	service->type = service->set->parsed_type;
 
 	if (set->process_limit == 0) {
@@ -223,6 +228,7 @@ service_create_real(pool_t pool, struct event *event,
 	} else {
 		service->process_limit = set->process_limit;
 	}
+	service->process_min_avail = set->process_min_avail;
 
 	/* default gid to user's primary group */
 	if (get_uidgid(set->user, &service->uid, &service->gid, error_r) < 0) {
@@ -79,6 +79,18 @@ struct service {
 	unsigned int process_idling_lowwater_since_kills;
 	/* max number of processes allowed */
 	unsigned int process_limit;
+	/* Number of processes to keep available for new clients. This is
+	   set->process_min_avail, or higher if process_min_avail_auto
+	   predicts more demand. */
+	unsigned int process_min_avail;
+	/* Smoothed rate of new client connections per second. Updated only
+	   with process_min_avail_auto. */
+	double connect_rate;
+	/* Number of new client connections since connect_rate was updated */
+	unsigned int connect_count;
+	/* Smoothed time between fork() and the process's first status
+	   notification */
+	unsigned int process_startup_msecs;
 	/* Total number of processes ever created */
 	uint64_t process_count_total;
 
@@ -88,6 +100,8 @@ struct service {
 	unsigned int idle_kill;
 	/* set->vsz_limit or set->master_set->default_client_limit */
 	uoff_t vsz_limit;
+	/* Number of processes pinned to each of set->parsed_cpu_sets */
+	unsigned int *cpu_set_process_counts;
 
 	/* log process pipe file descriptors. */
 	int log_fd[2];
@@ -125,6 +139,8 @@ struct service {
 	/* prefork processes up to process_min_avail if there's time */
 	struct timeout *to_prefork;
 	unsigned int prefork_counter;
+	/* recalculate process_min_avail with process_min_avail_auto */
+	struct timeout *to_min_avail;
 
 	/* Last time a "dropping client connections" warning was logged */
 	time_t last_drop_warning;
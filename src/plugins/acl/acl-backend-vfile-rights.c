@@ -0,0 +1,324 @@
+/* Copyright (c) 2024 Dovecot authors, see the included COPYING file */
+
+#include "lib.h"
+#include "array.h"
+#include "str.h"
+#include "strescape.h"
+#include "md5.h"
+#include "hex-binary.h"
+#include "safe-mkstemp.h"
+#include "istream.h"
+#include "ostream.h"
+#include "mail-namespace.h"
+#include "mail-user.h"
+#include "acl-cache.h"
+#include "acl-backend-vfile.h"
+
+#include <stdio.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/* The rights index is a persistent copy of the ACL cache: for each object it
+   contains the ACL file stamps and the user's current rights. On the next
+   session the ACL files are only stat()ed and the cached rights are used as
+   long as the stamps still match.
+
+   Anyone who can write the file can grant themselves rights, so it's used
+   only for private namespaces and only when both the file and its directory
+   are owned by us and not writable by anyone else.
+
+   Format:
+   <version> TAB <identity hash>
+   <object name> TAB <global mtime> TAB <global size> TAB <global read time>
+     TAB <local mtime> TAB <local size> TAB <local read time>
+     TAB <space-separated rights>
+*/
+#define ACL_RIGHTS_INDEX_VERSION 1
+
+static bool acl_rights_index_is_private(const struct stat *st)
+{
+	return st->st_uid == geteuid() &&
+		(st->st_mode & (S_IWGRP | S_IWOTH)) == 0;
+}
+
+static bool acl_rights_index_get_path(struct acl_backend_vfile *backend,
+				      const char **path_r)
+{
+	struct mailbox_list *list = backend->backend.list;
+	struct mail_namespace *ns = mailbox_list_get_namespace(list);
+	struct mail_user *user = mailbox_list_get_user(list);
+	struct event *event = backend->backend.event;
+	const char *root_dir;
+	struct stat st;
+
+	if (backend->backend.globals_only)
+		return FALSE;
+	if (ns->type != MAIL_NAMESPACE_TYPE_PRIVATE)
+		return FALSE;
+	/* The rights of mailboxes without their own ACLs come from INBOX's
+	   ACL file, which isn't part of the mailboxes' stamps. */
+	if (mail_user_plugin_getenv_bool(user, "acl_defaults_from_inbox"))
+		return FALSE;
+	if (!mailbox_list_get_root_path(list, MAILBOX_LIST_PATH_TYPE_LIST_INDEX,
+					&root_dir))
+		return FALSE;
+	if (stat(root_dir, &st) < 0) {
+		if (errno != ENOENT && errno != EACCES)
+			e_error(event, "stat(%s) failed: %m", root_dir);
+		return FALSE;
+	}
+	if (!acl_rights_index_is_private(&st)) {
+		e_debug(event, "acl vfile: Rights index not used, "
+			"because %s is writable by other users", root_dir);
+		return FALSE;
+	}
+	*path_r = t_strconcat(root_dir, "/"ACL_RIGHTS_INDEX_FILENAME, NULL);
+	return TRUE;
+}
+
+static const char *
+acl_rights_index_get_identity(struct acl_backend_vfile *backend)
+{
+	struct acl_backend *_backend = &backend->backend;
+	unsigned char digest[MD5_RESULTLEN];
+	string_t *str = t_str_new(128);
+	unsigned int i;
+
+	/* The cached rights are valid only for the same user with the same
+	   groups and ACL configuration. The index may be shared with other
+	   users if the list index isn't private. */
+	str_printfa(str, "%s\t%d\t%s",
+		    _backend->username == NULL ? "" : _backend->username,
+		    _backend->owner ? 1 : 0, backend->rights_index_config);
+	for (i = 0; i < _backend->group_count; i++) {
+		str_append_c(str, '\t');
+		str_append(str, _backend->groups[i]);
+	}
+	md5_get_digest(str_data(str), str_len(str), digest);
+	return binary_to_hex(digest, sizeof(digest));
+}
+
+static bool
+acl_rights_index_parse_validity(const char *const *args,
+				struct acl_vfile_validity *validity_r)
+{
+	long long mtime, read_time;
+	uoff_t size;
+
+	i_zero(validity_r);
+	if (str_to_llong(args[0], &mtime) < 0 ||
+	    str_to_uoff(args[1], &size) < 0 ||
+	    str_to_llong(args[2], &read_time) < 0)
+		return FALSE;
+	/* last_check=0 forces the stamps to be verified on first use */
+	validity_r->last_mtime = mtime;
+	validity_r->last_size = size;
+	validity_r->last_read_time = read_time;
+	return TRUE;
+}
+
+static int
+acl_rights_index_parse_line(struct acl_backend_vfile *backend,
+			    const char *line)
+{
+	struct acl_cache *cache = backend->backend.cache;
+	struct acl_backend_vfile_validity validity;
+	struct acl_rights_update update;
+	const char *const *args = t_strsplit_tabescaped(line);
+
+	if (str_array_length(args) != 8 ||
+	    !acl_rights_index_parse_validity(args + 1,
+					     &validity.global_validity) ||
+	    !acl_rights_index_parse_validity(args + 4,
+					     &validity.local_validity))
+		return -1;
+
+	i_zero(&update);
+	update.modify_mode = ACL_MODIFY_MODE_REPLACE;
+	update.neg_modify_mode = ACL_MODIFY_MODE_REPLACE;
+	update.rights.rights = t_strsplit_spaces(args[7], " ");
+	acl_cache_update(cache, args[0], &update);
+	acl_cache_set_validity(cache, args[0], &validity);
+	return 0;
+}
+
+void acl_backend_vfile_rights_index_read(struct acl_backend_vfile *backend)
+{
+	struct event *event = backend->backend.event;
+	struct istream *input;
+	const char *path, *line, *const *args;
+	unsigned int count = 0;
+	struct stat st;
+	int fd, ret = 0;
+
+	if (!acl_rights_index_get_path(backend, &path))
+		return;
+
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		if (errno != ENOENT && errno != EACCES)
+			e_error(event, "open(%s) failed: %m", path);
+		return;
+	}
+	if (fstat(fd, &st) < 0) {
+		e_error(event, "fstat(%s) failed: %m", path);
+		i_close_fd(&fd);
+		return;
+	}
+	if (!acl_rights_index_is_private(&st)) {
+		e_error(event, "Ignoring ACL rights index %s: "
+			"Not owned by us or writable by other users", path);
+		i_close_fd(&fd);
+		return;
+	}
+
+	input = i_stream_create_fd_autoclose(&fd, SIZE_MAX);
+	if ((line = i_stream_read_next_line(input)) != NULL) {
+		args = t_strsplit_tabescaped(line);
+		if (str_array_length(args) != 2 ||
+		    strcmp(args[0], dec2str(ACL_RIGHTS_INDEX_VERSION)) != 0) {
+			ret = -1;
+		} else if (strcmp(args[1],
+				  acl_rights_index_get_identity(backend)) != 0) {
+			/* written for another user - ignore */
+			line = NULL;
+		}
+	}
+	while (ret == 0 && line != NULL &&
+	       (line = i_stream_read_next_line(input)) != NULL) T_BEGIN {
+		ret = acl_rights_index_parse_line(backend, line);
+		count++;
+	} T_END;
+
+	if (ret < 0) {
+		e_error(event, "Broken ACL rights index file: %s", path);
+		acl_cache_flush_all(backend->backend.cache);
+		i_unlink_if_exists(path);
+	} else if (input->stream_errno != 0) {
+		e_error(event, "read(%s) failed: %s", path,
+			i_stream_get_error(input));
+		acl_cache_flush_all(backend->backend.cache);
+	} else {
+		e_debug(event, "acl vfile: Loaded %u objects from %s",
+			count, path);
+	}
+	i_stream_destroy(&input);
+}
+
+static void
+acl_rights_index_append_validity(string_t *str,
+				 const struct acl_vfile_validity *validity)
+{
+	str_printfa(str, "\t%lld\t%"PRIuUOFF_T"\t%lld",
+		    (long long)validity->last_mtime,
+		    (uoff_t)validity->last_size,
+		    (long long)validity->last_read_time);
+}
+
+static void
+acl_rights_index_append(struct acl_backend_vfile *backend, string_t *str,
+			const char *objname,
+			const struct acl_backend_vfile_validity *validity)
+{
+	struct acl_cache *cache = backend->backend.cache;
+	const struct acl_mask *mask;
+	const char *const *names;
+	unsigned int i, count;
+	bool first = TRUE;
+
+	mask = acl_cache_get_my_rights(cache, objname);
+	if (mask == NULL) {
+		/* negative cache entry */
+		return;
+	}
+
+	str_append_tabescaped(str, objname);
+	acl_rights_index_append_validity(str, &validity->global_validity);
+	acl_rights_index_append_validity(str, &validity->local_validity);
+	str_append_c(str, '\t');
+
+	names = acl_cache_get_names(cache, &count);
+	for (i = 0; i < count; i++) {
+		if (!acl_cache_mask_isset(mask, i))
+			continue;
+		if (!first)
+			str_append_c(str, ' ');
+		str_append_tabescaped(str, names[i]);
+		first = FALSE;
+	}
+	str_append_c(str, '\n');
+}
+
+void acl_backend_vfile_rights_index_write(struct acl_backend_vfile *backend)
+{
+	struct mailbox_list *list = backend->backend.list;
+	struct event *event = backend->backend.event;
+	struct mail_namespace *ns = mailbox_list_get_namespace(list);
+	struct acl_cache_iter *iter;
+	struct ostream *output;
+	const char *path, *objname;
+	const void *validity;
+	string_t *temp_path, *str;
+	int fd;
+
+	if (!backend->rights_index_dirty)
+		return;
+	backend->rights_index_dirty = FALSE;
+
+	if ((ns->flags & NAMESPACE_FLAG_UNUSABLE) != 0 ||
+	    !acl_rights_index_get_path(backend, &path))
+		return;
+
+	temp_path = t_str_new(256);
+	str_append(temp_path, path);
+	str_truncate(temp_path, str_len(temp_path) -
+		     strlen(ACL_RIGHTS_INDEX_FILENAME));
+	str_append(temp_path, mailbox_list_get_temp_prefix(list));
+
+	/* never readable or writable by other users */
+	fd = safe_mkstemp(temp_path, 0600, (uid_t)-1, (gid_t)-1);
+	if (fd == -1) {
+		/* Ignore silently if the list index directory doesn't exist
+		   or we can't write to it. */
+		if (errno != ENOENT && errno != EACCES) {
+			e_error(event, "safe_mkstemp(%s) failed: %m",
+				str_c(temp_path));
+		}
+		return;
+	}
+
+	output = o_stream_create_fd_file(fd, 0, FALSE);
+	o_stream_cork(output);
+
+	str = t_str_new(256);
+	str_printfa(str, "%u\t%s\n", ACL_RIGHTS_INDEX_VERSION,
+		    acl_rights_index_get_identity(backend));
+	iter = acl_cache_iter_init(backend->backend.cache);
+	while (acl_cache_iter_next(iter, &objname, &validity)) {
+		acl_rights_index_append(backend, str, objname, validity);
+		o_stream_nsend(output, str_data(str), str_len(str));
+		str_truncate(str, 0);
+	}
+	acl_cache_iter_deinit(&iter);
+
+	if (o_stream_finish(output) < 0) {
+		e_error(event, "write(%s) failed: %s", str_c(temp_path),
+			o_stream_get_error(output));
+		o_stream_destroy(&output);
+		i_close_fd(&fd);
+		i_unlink(str_c(temp_path));
+		return;
+	}
+	o_stream_destroy(&output);
+	if (close(fd) < 0) {
+		e_error(event, "close(%s) failed: %m", str_c(temp_path));
+		i_unlink(str_c(temp_path));
+		return;
+	}
+	if (rename(str_c(temp_path), path) < 0) {
+		e_error(event, "rename(%s, %s) failed: %m",
+			str_c(temp_path), path);
+		i_unlink_if_exists(str_c(temp_path));
+	}
+}
@@ -52,6 +52,8 @@ acl_backend_vfile_init(struct acl_backend *_backend, const char *data)
 					*tmp + 11);
 				return -1;
 			}
+		} else if (strcmp(*tmp, "rights_index") == 0) {
+			backend->rights_index_config = p_strdup(_backend->pool, data);
 		} else {
 			e_error(event, "acl vfile: Unknown parameter: %s", *tmp);
 			return -1;
@@ -79,6 +81,8 @@ acl_backend_vfile_init(struct acl_backend *_backend, const char *data)
 	_backend->cache =
 		acl_cache_init(_backend,
 			       sizeof(struct acl_backend_vfile_validity));
+	if (backend->rights_index_config != NULL)
+		acl_backend_vfile_rights_index_read(backend);
 	return 0;
 }
 
@@ -87,13 +91,14 @@ static void acl_backend_vfile_deinit(struct acl_backend *_backend)
 	struct acl_backend_vfile *backend =
 		(struct acl_backend_vfile *)_backend;
 
+	if (backend->rights_index_config != NULL)
+		acl_backend_vfile_rights_index_write(backend);
 	if (backend->acllist_pool != NULL) {
 		array_free(&backend->acllist);
 		pool_unref(&backend->acllist_pool);
 	}
 	if (_backend->global_file != NULL)
 		acl_global_file_deinit(&_backend->global_file);
-	pool_unref(&backend->backend.pool);
 }
 
 static const char *
@@ -533,6 +538,7 @@ static int acl_backend_vfile_object_refresh_cache(struct acl_object *_aclobj)
 	acl_object_rebuild_cache(_aclobj);
 	acl_cache_set_validity(_aclobj->backend->cache,
 			       _aclobj->name, &validity);
+	backend->rights_index_dirty = TRUE;
 
 	if (acl_backend_vfile_object_get_mtime(_aclobj, &mtime) == 0)
 		acl_backend_vfile_acllist_verify(backend, _aclobj->name, mtime);
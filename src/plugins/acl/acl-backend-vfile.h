@@ -6,6 +6,7 @@
 
 #define ACL_FILENAME "dovecot-acl"
 #define ACLLIST_FILENAME "dovecot-acl-list"
+#define ACL_RIGHTS_INDEX_FILENAME "dovecot-acl-rights"
 
 #define ACL_VFILE_VALIDITY_MTIME_NOTFOUND 0
 #define ACL_VFILE_VALIDITY_MTIME_NOACCESS -1
@@ -44,8 +45,11 @@ struct acl_backend_vfile {
 	unsigned int acllist_change_counter;
 
 	unsigned int cache_secs;
+	/* Backend configuration string if rights_index is enabled */
+	const char *rights_index_config;
 	bool rebuilding_acllist:1;
 	bool iterating_acllist:1;
+	bool rights_index_dirty:1;
 };
 
 void acl_vfile_write_rights_list(string_t *dest, const char *const *rights);
@@ -57,6 +61,9 @@ int acl_backend_vfile_acllist_rebuild(struct acl_backend_vfile *backend);
 void acl_backend_vfile_acllist_verify(struct acl_backend_vfile *backend,
 				      const char *name, time_t mtime);
 
+void acl_backend_vfile_rights_index_read(struct acl_backend_vfile *backend);
+void acl_backend_vfile_rights_index_write(struct acl_backend_vfile *backend);
+
 struct acl_mailbox_list_context *
 acl_backend_vfile_nonowner_iter_init(struct acl_backend *backend);
 bool acl_backend_vfile_nonowner_iter_next(struct acl_mailbox_list_context *ctx,
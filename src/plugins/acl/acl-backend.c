@@ -103,9 +103,11 @@ void acl_backend_deinit(struct acl_backend **_backend)
 
 	if (backend->default_aclobj != NULL)
 		acl_object_deinit(&backend->default_aclobj);
+	/* backend may still need the cache and event while deiniting */
+	backend->v.deinit(backend);
 	acl_cache_deinit(&backend->cache);
 	event_unref(&backend->event);
-	backend->v.deinit(backend);
+	pool_unref(&backend->pool);
 }
 
 const char *acl_backend_get_acl_username(struct acl_backend *backend)
@@ -34,6 +34,11 @@ struct acl_cache {
 	HASH_TABLE(char *, void *) right_name_idx_map;
 };
 
+struct acl_cache_iter {
+	struct acl_cache *cache;
+	struct hash_iterate_context *iter;
+};
+
 static struct acl_mask negative_cache_entry;
 
 struct acl_cache *acl_cache_init(struct acl_backend *backend,
@@ -332,6 +337,39 @@ void *acl_cache_get_validity(struct acl_cache *cache, const char *objname)
 	return obj_cache == NULL ? NULL : (obj_cache + 1);
 }
 
+struct acl_cache_iter *acl_cache_iter_init(struct acl_cache *cache)
+{
+	struct acl_cache_iter *iter;
+
+	iter = i_new(struct acl_cache_iter, 1);
+	iter->cache = cache;
+	iter->iter = hash_table_iterate_init(cache->objects);
+	return iter;
+}
+
+bool acl_cache_iter_next(struct acl_cache_iter *iter, const char **objname_r,
+			 const void **validity_r)
+{
+	struct acl_object_cache *obj_cache;
+	char *name;
+
+	if (!hash_table_iterate(iter->iter, iter->cache->objects,
+				&name, &obj_cache))
+		return FALSE;
+	*objname_r = name;
+	*validity_r = obj_cache + 1;
+	return TRUE;
+}
+
+void acl_cache_iter_deinit(struct acl_cache_iter **_iter)
+{
+	struct acl_cache_iter *iter = *_iter;
+
+	*_iter = NULL;
+	hash_table_iterate_deinit(&iter->iter);
+	i_free(iter);
+}
+
 const char *const *acl_cache_get_names(struct acl_cache *cache,
 				       unsigned int *count_r)
 {
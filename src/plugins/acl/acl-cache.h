@@ -41,6 +41,12 @@ void *acl_cache_get_validity(struct acl_cache *cache, const char *objname);
 void acl_cache_set_validity(struct acl_cache *cache, const char *objname,
 			    const void *validity);
 
+/* Iterate through all cached objects. */
+struct acl_cache_iter *acl_cache_iter_init(struct acl_cache *cache);
+bool acl_cache_iter_next(struct acl_cache_iter *iter, const char **objname_r,
+			 const void **validity_r);
+void acl_cache_iter_deinit(struct acl_cache_iter **iter);
+
 /* Returns all the right names currently created. The returned pointer may
    change after calling acl_cache_update(). */
 const char *const *acl_cache_get_names(struct acl_cache *cache,
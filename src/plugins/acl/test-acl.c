@@ -2,8 +2,20 @@
 
 #include "lib.h"
 #include "array.h"
+#include "mkdir-parents.h"
+#include "module-dir.h"
+#include "write-full.h"
+#include "master-service.h"
 #include "test-common.h"
+#include "test-mail-storage-common.h"
 #include "acl-api-private.h"
+#include "acl-plugin.h"
+#include "acl-cache.h"
+#include "acl-backend-vfile.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 static void test_acl_rights_sort(void)
 {
@@ -56,11 +68,148 @@ static void test_acl_rights_sort(void)
 	test_end();
 }
 
-int main(void)
+static struct module test_acl_module = {
+	.path = (char *)"lib01_acl_plugin.so",
+	.name = (char *)"acl_plugin",
+};
+static struct test_mail_storage_ctx *test_ctx;
+
+static struct acl_backend *test_acl_backend_init(const char *username)
+{
+	return acl_backend_init("vfile::rights_index",
+				test_ctx->user->namespaces->list,
+				username, NULL, FALSE);
+}
+
+static const char *test_acl_rights_index_path(void)
+{
+	const char *dir;
+
+	test_assert(mailbox_list_get_root_path(test_ctx->user->namespaces->list,
+					       MAILBOX_LIST_PATH_TYPE_LIST_INDEX,
+					       &dir));
+	return t_strconcat(dir, "/"ACL_RIGHTS_INDEX_FILENAME, NULL);
+}
+
+static void test_acl_write_inbox_acl(const char *acl)
+{
+	const char *dir, *path;
+	int fd;
+
+	test_assert(mailbox_list_get_path(test_ctx->user->namespaces->list,
+					  "INBOX", MAILBOX_LIST_PATH_TYPE_DIR,
+					  &dir) > 0);
+	if (mkdir_parents(dir, 0700) < 0 && errno != EEXIST)
+		i_fatal("mkdir_parents(%s) failed: %m", dir);
+	path = t_strconcat(dir, "/"ACL_FILENAME, NULL);
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd == -1)
+		i_fatal("open(%s) failed: %m", path);
+	if (write_full(fd, acl, strlen(acl)) < 0)
+		i_fatal("write(%s) failed: %m", path);
+	i_close_fd(&fd);
+}
+
+static int test_acl_have_right(struct acl_backend *backend, const char *right)
+{
+	struct acl_object *aclobj;
+	int ret;
+
+	aclobj = acl_object_init_from_name(backend, "INBOX");
+	ret = acl_object_have_right(aclobj,
+				    acl_backend_lookup_right(backend, right));
+	acl_object_deinit(&aclobj);
+	return ret;
+}
+
+static bool test_acl_inbox_cached(struct acl_backend *backend)
+{
+	return acl_cache_get_my_rights(backend->cache, "INBOX") != NULL;
+}
+
+static void test_acl_rights_index(void)
+{
+	const char *const extra_input[] = {
+		"mail_plugins=acl",
+		"acl=vfile",
+		NULL
+	};
+	struct test_mail_storage_settings set = {
+		.driver = "maildir",
+		.extra_input = extra_input,
+	};
+	struct acl_backend *backend;
+	struct stat st;
+
+	test_begin("acl rights index");
+	test_ctx = test_mail_storage_init();
+	acl_plugin_init(&test_acl_module);
+	test_mail_storage_init_user(test_ctx, &set);
+	test_acl_write_inbox_acl("user=testuser lr\n");
+
+	/* the first session writes the rights index */
+	backend = test_acl_backend_init("testuser");
+	test_assert(!test_acl_inbox_cached(backend));
+	test_assert(test_acl_have_right(backend, MAIL_ACL_READ) == 1);
+	test_assert(test_acl_have_right(backend, MAIL_ACL_WRITE) == 0);
+	acl_backend_deinit(&backend);
+	test_assert(stat(test_acl_rights_index_path(), &st) == 0 &&
+		    (st.st_mode & 0777) == 0600);
+
+	/* cache hit: the rights are loaded before any lookup */
+	backend = test_acl_backend_init("testuser");
+	test_assert(test_acl_inbox_cached(backend));
+	test_assert(test_acl_have_right(backend, MAIL_ACL_READ) == 1);
+	test_assert(test_acl_have_right(backend, MAIL_ACL_WRITE) == 0);
+	acl_backend_deinit(&backend);
+
+	/* changing the ACL file invalidates the loaded rights */
+	test_acl_write_inbox_acl("user=testuser lrw\n");
+	backend = test_acl_backend_init("testuser");
+	test_assert(test_acl_inbox_cached(backend));
+	test_assert(test_acl_have_right(backend, MAIL_ACL_WRITE) == 1);
+	acl_backend_deinit(&backend);
+
+	/* the index isn't used for another user */
+	backend = test_acl_backend_init("otheruser");
+	test_assert(!test_acl_inbox_cached(backend));
+	test_assert(test_acl_have_right(backend, MAIL_ACL_READ) == 0);
+	acl_backend_deinit(&backend);
+
+	/* the index isn't trusted if other users could have written it */
+	backend = test_acl_backend_init("testuser");
+	test_assert(test_acl_have_right(backend, MAIL_ACL_WRITE) == 1);
+	acl_backend_deinit(&backend);
+	test_assert(chmod(test_acl_rights_index_path(), 0620) == 0);
+	test_expect_error_string("Not owned by us or writable by other users");
+	backend = test_acl_backend_init("testuser");
+	test_expect_no_more_errors();
+	test_assert(!test_acl_inbox_cached(backend));
+	acl_backend_deinit(&backend);
+
+	test_mail_storage_deinit_user(test_ctx);
+	acl_plugin_deinit();
+	test_mail_storage_deinit(&test_ctx);
+	test_end();
+}
+
+int main(int argc, char **argv)
 {
 	static void (*const test_functions[])(void) = {
 		test_acl_rights_sort,
+		test_acl_rights_index,
 		NULL
 	};
-	return test_run(test_functions);
+	int ret;
+
+	master_service = master_service_init("test-acl",
+					     MASTER_SERVICE_FLAG_STANDALONE |
+					     MASTER_SERVICE_FLAG_DONT_SEND_STATS |
+					     MASTER_SERVICE_FLAG_NO_CONFIG_SETTINGS |
+					     MASTER_SERVICE_FLAG_NO_SSL_INIT |
+					     MASTER_SERVICE_FLAG_NO_INIT_DATASTACK_FRAME,
+					     &argc, &argv, "");
+	ret = test_run(test_functions);
+	master_service_deinit(&master_service);
+	return ret;
 }
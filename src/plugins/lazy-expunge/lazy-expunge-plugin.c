@@ -48,6 +48,7 @@ struct lazy_expunge_mail_user {
 	const char *lazy_mailbox_vname;
 	const char *env;
 	bool copy_only_last_instance;
+	bool batch;
 };
 
 struct lazy_expunge_mailbox_list {
@@ -65,12 +66,15 @@ struct lazy_expunge_transaction {
 
 	pool_t pool;
 	HASH_TABLE(const char *, void *) guids;
+	/* UIDs of mails whose moves are delayed until commit */
+	ARRAY_TYPE(seq_range) move_uids;
 
 	char *delayed_errstr;
 	char *delayed_internal_errstr;
 	enum mail_error delayed_error;
 
 	bool copy_only_last_instance;
+	bool batch;
 };
 
 const char *lazy_expunge_plugin_version = DOVECOT_ABI_VERSION;
@@ -388,8 +392,14 @@ static void lazy_expunge_mail_expunge(struct mail *_mail)
 				lazy_expunge_set_error(lt, _mail->box->storage);
 		}
 	}
-	if (ret > 0)
+	if (ret > 0 && lt->batch) {
+		/* move all the mails at once when committing */
+		if (!array_is_created(&lt->move_uids))
+			i_array_init(&lt->move_uids, 64);
+		seq_range_array_add(&lt->move_uids, _mail->uid);
+	} else if (ret > 0) {
 		lazy_expunge_mail_expunge_move(_mail);
+	}
 	event_reason_end(&reason);
 
 	if (ret == 0) {
@@ -426,6 +436,7 @@ lazy_expunge_transaction_begin(struct mailbox *box,
 	t = mbox->super.transaction_begin(box, flags, reason);
 	lt = i_new(struct lazy_expunge_transaction, 1);
 	lt->copy_only_last_instance = luser->copy_only_last_instance;
+	lt->batch = luser->batch;
 
 	MODULE_CONTEXT_SET(t, lazy_expunge_mail_storage_module, lt);
 	return t;
@@ -439,11 +450,42 @@ static void lazy_expunge_transaction_free(struct lazy_expunge_transaction *lt)
 		mailbox_free(&lt->dest_box);
 	hash_table_destroy(&lt->guids);
 	pool_unref(&lt->pool);
+	array_free(&lt->move_uids);
 	i_free(lt->delayed_errstr);
 	i_free(lt->delayed_internal_errstr);
 	i_free(lt);
 }
 
+static void
+lazy_expunge_transaction_move_batch(struct mailbox_transaction_context *ctx,
+				    struct lazy_expunge_transaction *lt)
+{
+	const struct seq_range *range;
+	struct mail *mail;
+	uint32_t uid;
+
+	/* Move the mails in UID order using a single mail. The destination
+	   mailbox is opened only once and all the copies are committed in
+	   the same destination transaction. */
+	struct event_reason *reason =
+		event_reason_begin("lazy_expunge:expunge");
+	mail = mail_alloc(ctx, 0, NULL);
+	array_foreach(&lt->move_uids, range) {
+		for (uid = range->seq1; uid <= range->seq2; uid++) {
+			if (lt->delayed_error != MAIL_ERROR_NONE)
+				break;
+			if (!mail_set_uid(mail, uid)) {
+				/* already expunged */
+				continue;
+			}
+			lazy_expunge_mail_expunge_move(mail);
+		}
+	}
+	mail_free(&mail);
+	event_reason_end(&reason);
+	array_clear(&lt->move_uids);
+}
+
 static int
 lazy_expunge_transaction_commit(struct mailbox_transaction_context *ctx,
 				struct mail_transaction_commit_changes *changes_r)
@@ -452,6 +494,9 @@ lazy_expunge_transaction_commit(struct mailbox_transaction_context *ctx,
 	struct lazy_expunge_transaction *lt = LAZY_EXPUNGE_CONTEXT_REQUIRE(ctx);
 	int ret;
 
+	if (array_is_created(&lt->move_uids) &&
+	    lt->delayed_error == MAIL_ERROR_NONE)
+		lazy_expunge_transaction_move_batch(ctx, lt);
 	if (lt->dest_trans != NULL && lt->delayed_error == MAIL_ERROR_NONE) {
 		if (mailbox_transaction_commit(&lt->dest_trans) < 0) {
 			lazy_expunge_set_error(lt, ctx->box->storage);
@@ -628,6 +673,8 @@ static void lazy_expunge_mail_user_created(struct mail_user *user)
 		luser->env = env;
 		luser->copy_only_last_instance =
 			mail_user_plugin_getenv_bool(user, "lazy_expunge_only_last_instance");
+		luser->batch =
+			mail_user_plugin_getenv_bool(user, "lazy_expunge_batch");
 		luser->excludes = mailbox_match_plugin_init(user, "lazy_expunge_exclude");
 
 		MODULE_CONTEXT_SET(user, lazy_expunge_mail_user_module, luser);
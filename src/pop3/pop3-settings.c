@@ -57,6 +57,7 @@ struct service_settings pop3_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &pop3_unix_listeners_buf,
 			      sizeof(pop3_unix_listeners[0]) } },
@@ -58,6 +58,7 @@ struct service_settings submission_service_settings = {
 	.service_count = 1,
 	.idle_kill = 0,
 	.vsz_limit = UOFF_T_MAX,
+	.cpu_affinity = "",
 
 	.unix_listeners = { { &submission_unix_listeners_buf,
 			      sizeof(submission_unix_listeners[0]) } },